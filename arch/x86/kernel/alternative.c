@@ -743,6 +743,10 @@ void __init alternative_instructions(void)
 	}
 #endif
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+	cna_configure_spin_lock_slowpath();
+#endif
+
 	apply_paravirt(__parainstructions, __parainstructions_end);
 
 	restart_nmi();
@@ -32,6 +32,8 @@
 #include <linux/bit_spinlock.h>
 #include <linux/rculist_bl.h>
 #include <linux/list_lru.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -74,6 +76,15 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Maximum number of unused negative dentries a superblock keeps on its
+ * LRU before they are trimmed proactively. 0 leaves them to the shrinker.
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+
+/* Minimum interval between two trims of the same superblock */
+#define NEGATIVE_DENTRY_TRIM_INTERVAL	HZ
+
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -123,6 +134,8 @@ static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 static DEFINE_PER_CPU(long, nr_dentry_negative);
 
+DEFINE_PER_CPU(struct dcache_stats, dcache_stats);
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -175,6 +188,32 @@ int proc_nr_dentry(struct ctl_table *table, int write, void *buffer,
 }
 #endif
 
+/*
+ * Negative dentries are counted both globally, for dentry-state, and per
+ * superblock, so that a single filesystem full of failed lookups can be
+ * trimmed without waiting for memory pressure.
+ */
+static void d_negative_inc(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&sb->s_nr_dentry_negative);
+
+	if (unlikely(limit) &&
+	    percpu_counter_read(&sb->s_nr_dentry_negative) > (s64)limit &&
+	    time_after_eq(jiffies, READ_ONCE(sb->s_dentry_trim_next)) &&
+	    !work_pending(&sb->s_dentry_trim_work))
+		schedule_work(&sb->s_dentry_trim_work);
+}
+
+static void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 /*
  * Compare 2 name strings, return 0 if they match, otherwise non-zero.
  * The strings are both count bytes long, and count is non-zero.
@@ -330,7 +369,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -385,7 +424,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * The per-cpu "nr_dentry_unused" counters are updated with
  * the DCACHE_LRU_LIST bit.
  *
- * The per-cpu "nr_dentry_negative" counters are only updated
+ * The per-cpu "nr_dentry_negative" counters, and the per-superblock
+ * s_nr_dentry_negative counter, are only updated
  * when deleted from or added to the per-superblock LRU list, not
  * from/to the shrink list. That is to avoid an unneeded dec/inc
  * pair when moving from LRU to shrink list in select_collect().
@@ -400,7 +440,7 @@ static void d_lru_add(struct dentry *dentry)
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -410,7 +450,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -442,7 +482,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -452,7 +492,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -1263,6 +1303,112 @@ void shrink_dcache_sb(struct super_block *sb)
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
+struct dentry_trim_ctl {
+	struct list_head	dispose;
+	long			nr_to_free;
+};
+
+static enum lru_status dentry_lru_isolate_negative(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct dentry_trim_ctl *ctl = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (ctl->nr_to_free <= 0)
+		return LRU_STOP;
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	/*
+	 * Positive dentries are left where they are: rotating them would
+	 * make them look recently used to the regular shrinker.
+	 */
+	if (d_is_positive(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_SKIP;
+	}
+
+	/* Same rules as dentry_lru_isolate() for everything else */
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, &ctl->dispose);
+	spin_unlock(&dentry->d_lock);
+	ctl->nr_to_free--;
+
+	return LRU_REMOVED;
+}
+
+/**
+ * dentry_negative_trim_work - trim the negative dentries of a superblock
+ * @work: the s_dentry_trim_work of the superblock
+ *
+ * Queued once a superblock holds more than sysctl_negative_dentry_limit
+ * unused negative dentries, at most once per NEGATIVE_DENTRY_TRIM_INTERVAL.
+ * Prunes the least recently used of them until the count is back to 7/8 of
+ * the limit, so that the next few failed lookups do not queue it again
+ * right away.
+ *
+ * The LRU is walked in batches, rescheduling in between, for at most one
+ * pass worth of items. Each batch starts over at the head, where skipped
+ * positive dentries stay, so the trim stops early once a batch frees
+ * nothing and leaves the rest to the next run.
+ */
+void dentry_negative_trim_work(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_dentry_trim_work);
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+	struct dentry_trim_ctl ctl;
+	unsigned long nr_to_scan, freed = 0;
+
+	WRITE_ONCE(sb->s_dentry_trim_next,
+		   jiffies + NEGATIVE_DENTRY_TRIM_INTERVAL);
+
+	if (!limit)
+		return;
+
+	/* Same as the shrinker: leave the superblock alone during umount */
+	if (!down_read_trylock(&sb->s_umount))
+		return;
+	if (!sb->s_root || !(sb->s_flags & SB_BORN))
+		goto out;
+
+	INIT_LIST_HEAD(&ctl.dispose);
+	ctl.nr_to_free = percpu_counter_sum_positive(&sb->s_nr_dentry_negative) -
+			 (limit - (limit >> 3));
+	if (ctl.nr_to_free <= 0)
+		goto out;
+
+	nr_to_scan = list_lru_count(&sb->s_dentry_lru);
+	while (nr_to_scan && ctl.nr_to_free > 0) {
+		unsigned long batch = min(nr_to_scan, 1024UL), isolated;
+
+		nr_to_scan -= batch;
+		isolated = list_lru_walk(&sb->s_dentry_lru,
+					 dentry_lru_isolate_negative, &ctl,
+					 batch);
+		shrink_dentry_list(&ctl.dispose);
+		freed += isolated;
+		if (!isolated)
+			break;
+		cond_resched();
+	}
+	count_dcache_stats(DCACHE_NEGATIVE_TRIMMED, freed);
+out:
+	up_read(&sb->s_umount);
+}
+
 /**
  * enum d_walk_ret - action to talke during tree walk
  * @D_WALK_CONTINUE:	contrinue walk
@@ -1942,7 +2088,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 * Decrement negative dentry count if it was in the LRU list.
 	 */
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
@@ -3207,6 +3353,42 @@ static void __init dcache_init(void)
 	d_hash_shift = 32 - d_hash_shift;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static const char * const dcache_stat_names[NR_DCACHE_STAT_ITEMS] = {
+	[DCACHE_LOOKUP_HIT]		= "lookup_hit",
+	[DCACHE_LOOKUP_NEGATIVE]	= "lookup_negative",
+	[DCACHE_LOOKUP_MISS]		= "lookup_miss",
+	[DCACHE_UNLAZY]			= "unlazy",
+	[DCACHE_UNLAZY_FAILED]		= "unlazy_failed",
+	[DCACHE_WALK_RESTART]		= "walk_restart",
+	[DCACHE_NEGATIVE_TRIMMED]	= "negative_trimmed",
+};
+
+static int dcache_stats_show(struct seq_file *m, void *v)
+{
+	int i, cpu;
+
+	for (i = 0; i < NR_DCACHE_STAT_ITEMS; i++) {
+		unsigned long sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += per_cpu(dcache_stats.item[i], cpu);
+		seq_printf(m, "%-20s %lu\n", dcache_stat_names[i], sum);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dcache_stats);
+
+static int __init dcache_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("dcache", NULL);
+
+	debugfs_create_file("stats", 0444, dir, NULL, &dcache_stats_fops);
+	return 0;
+}
+late_initcall(dcache_debugfs_init);
+#endif
+
 /* SLAB cache for __getname() consumers */
 struct kmem_cache *names_cachep __read_mostly;
 EXPORT_SYMBOL(names_cachep);
@@ -37,6 +37,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/capability.h>
 #include <net/busy_poll.h>
 
 /*
@@ -45,18 +46,21 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (rwlock)
+ * 3) ep->lock (spinlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a rwlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
- * user space) we could end up sleeping due a copy_to_user(), so
- * we need a lock that will allow us to sleep. This lock is a
- * mutex (ep->mtx). It is acquired during the event transfer loop,
- * during epoll_ctl(EPOLL_CTL_DEL) and during eventpoll_release_file().
+ * The poll callback, that might be triggered from a wake_up() that
+ * in turn might be called from IRQ context, takes no lock at all: it
+ * chains the item onto ep->rdlpending with cmpxchg() and the chain is
+ * moved to the ready list by the consumers, which hold "ep->mtx".
+ * We need a spinlock (ep->lock) so that a task going to sleep inside
+ * ep_poll() sees a consistent view of the ready list while it is
+ * being stolen by ep_scan_ready_list(). During the event transfer
+ * loop (from kernel to user space) we could end up sleeping due a
+ * copy_to_user(), so we need a lock that will allow us to sleep.
+ * This lock is a mutex (ep->mtx). It is acquired during the event
+ * transfer loop, during epoll_ctl(EPOLL_CTL_DEL) and during
+ * eventpoll_release_file().
  * Then we also need a global mutex to serialize eventpoll_release_file()
  * and ep_free().
  * This mutex is acquired by ep_free() during the epoll file
@@ -100,6 +104,9 @@
 
 #define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
 
+/* Number of epoll_ctl_batch() commands copied in from user space at once */
+#define EP_CTL_BATCH_CHUNK 64
+
 #define EP_UNACTIVE_PTR ((void *) -1L)
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
@@ -146,8 +153,8 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
+	 * Works together "struct eventpoll"->rdlpending in keeping the
+	 * single linked chain of items queued by the poll callback.
 	 */
 	struct epitem *next;
 
@@ -193,21 +200,24 @@ struct eventpoll {
 	/* Wait queue used by file->poll() */
 	wait_queue_head_t poll_wait;
 
-	/* List of ready file descriptors */
+	/* List of ready file descriptors, modified with "mtx" held */
 	struct list_head rdllist;
 
-	/* Lock which protects rdllist and ovflist */
-	rwlock_t lock;
+	/* Lock which serializes waiters against rdllist and txlist_busy */
+	spinlock_t lock;
+
+	/* Set while ep_scan_ready_list() holds the ready items on a txlist */
+	bool txlist_busy;
 
 	/* RB tree root used to store monitored fd structs */
 	struct rb_root_cached rbr;
 
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * This is a single linked LIFO chain of all the "struct epitem" that
+	 * the poll callback found ready. It is pushed without any lock and
+	 * moved onto rdllist by ep_rdlpending_splice().
 	 */
-	struct epitem *ovflist;
+	struct epitem *rdlpending;
 
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
@@ -223,6 +233,11 @@ struct eventpoll {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
+	/* busy poll timeout, 0 means the net.core.busy_poll sysctl is used */
+	u32 busy_poll_usecs;
+	/* busy poll packet budget, 0 means BUSY_POLL_BUDGET */
+	u16 busy_poll_budget;
+	bool prefer_busy_poll;
 #endif
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -375,35 +390,63 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
 static inline int ep_events_available(struct eventpoll *ep)
 {
 	return !list_empty_careful(&ep->rdllist) ||
-		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+		READ_ONCE(ep->rdlpending) != NULL ||
+		READ_ONCE(ep->txlist_busy);
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * Busy polling is on for @ep either because it has been configured with
+ * EPIOCSPARAMS, or because the net.core.busy_poll sysctl is set.
+ */
+static bool ep_busy_loop_on(struct eventpoll *ep)
+{
+	return READ_ONCE(ep->busy_poll_usecs) || net_busy_loop_on();
+}
+
+static bool ep_busy_loop_timeout(struct eventpoll *ep, unsigned long start_time)
+{
+	unsigned long bp_usec = READ_ONCE(ep->busy_poll_usecs);
+
+	if (bp_usec) {
+		unsigned long end_time = start_time + bp_usec;
+		unsigned long now = busy_loop_current_time();
+
+		return time_after(now, end_time);
+	}
+	return busy_loop_timeout(start_time);
+}
+
 static bool ep_busy_loop_end(void *p, unsigned long start_time)
 {
 	struct eventpoll *ep = p;
 
-	return ep_events_available(ep) || busy_loop_timeout(start_time);
+	return ep_events_available(ep) || ep_busy_loop_timeout(ep, start_time);
 }
 
 /*
- * Busy poll if globally on and supporting sockets found && no events,
- * busy loop will return if need_resched or ep_events_available.
+ * Busy poll if on for this instance and supporting sockets found && no
+ * events, busy loop will return if need_resched or ep_events_available.
  *
  * we must do our busy polling with irqs enabled
  */
 static void ep_busy_loop(struct eventpoll *ep, int nonblock)
 {
 	unsigned int napi_id = READ_ONCE(ep->napi_id);
+	u16 budget = READ_ONCE(ep->busy_poll_budget);
+
+	if (!budget)
+		budget = BUSY_POLL_BUDGET;
 
-	if ((napi_id >= MIN_NAPI_ID) && net_busy_loop_on())
-		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep);
+	if ((napi_id >= MIN_NAPI_ID) && ep_busy_loop_on(ep))
+		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep,
+			       READ_ONCE(ep->prefer_busy_poll), budget);
 }
 
 static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
 {
 	if (ep->napi_id)
-		ep->napi_id = 0;
+		WRITE_ONCE(ep->napi_id, 0);
 }
 
 /*
@@ -411,13 +454,13 @@ static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
  */
 static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 {
-	struct eventpoll *ep;
+	struct eventpoll *ep = epi->ep;
 	unsigned int napi_id;
 	struct socket *sock;
 	struct sock *sk;
 	int err;
 
-	if (!net_busy_loop_on())
+	if (!ep_busy_loop_on(ep))
 		return;
 
 	sock = sock_from_file(epi->ffd.file, &err);
@@ -429,17 +472,59 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 		return;
 
 	napi_id = READ_ONCE(sk->sk_napi_id);
-	ep = epi->ep;
 
 	/* Non-NAPI IDs can be rejected
 	 *	or
 	 * Nothing to do if we already have this ID
 	 */
-	if (napi_id < MIN_NAPI_ID || napi_id == ep->napi_id)
+	if (napi_id < MIN_NAPI_ID || napi_id == READ_ONCE(ep->napi_id))
 		return;
 
 	/* record NAPI ID for use in next busy poll */
-	ep->napi_id = napi_id;
+	WRITE_ONCE(ep->napi_id, napi_id);
+}
+
+static long ep_eventpoll_bp_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct eventpoll *ep = file->private_data;
+	void __user *uarg = (void __user *)arg;
+	struct epoll_params epoll_params;
+
+	switch (cmd) {
+	case EPIOCSPARAMS:
+		if (copy_from_user(&epoll_params, uarg, sizeof(epoll_params)))
+			return -EFAULT;
+
+		/* pad byte must be zero */
+		if (epoll_params.__pad)
+			return -EINVAL;
+
+		if (epoll_params.busy_poll_usecs > S32_MAX)
+			return -EINVAL;
+
+		if (epoll_params.prefer_busy_poll > 1)
+			return -EINVAL;
+
+		if (epoll_params.busy_poll_budget > NAPI_POLL_WEIGHT &&
+		    !capable(CAP_NET_ADMIN))
+			return -EPERM;
+
+		WRITE_ONCE(ep->busy_poll_usecs, epoll_params.busy_poll_usecs);
+		WRITE_ONCE(ep->busy_poll_budget, epoll_params.busy_poll_budget);
+		WRITE_ONCE(ep->prefer_busy_poll, epoll_params.prefer_busy_poll);
+		return 0;
+	case EPIOCGPARAMS:
+		memset(&epoll_params, 0, sizeof(epoll_params));
+		epoll_params.busy_poll_usecs = READ_ONCE(ep->busy_poll_usecs);
+		epoll_params.busy_poll_budget = READ_ONCE(ep->busy_poll_budget);
+		epoll_params.prefer_busy_poll = READ_ONCE(ep->prefer_busy_poll);
+		if (copy_to_user(uarg, &epoll_params, sizeof(epoll_params)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
 }
 
 #else
@@ -456,6 +541,12 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 {
 }
 
+static long ep_eventpoll_bp_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	return -EOPNOTSUPP;
+}
+
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 
 /**
@@ -661,6 +752,70 @@ static inline void ep_pm_stay_awake_rcu(struct epitem *epi)
 	rcu_read_unlock();
 }
 
+/*
+ * Moves the items chained on ep->rdlpending by the poll callback to the tail
+ * of the ready list. Must be called with "mtx" held.
+ *
+ * While the chain is detached, its items are neither on ->rdlpending nor on
+ * ->rdllist, so ->txlist_busy is kept set until they are: otherwise a waiter
+ * could find nothing pending and go back to sleep on an event whose wakeup
+ * has already been sent.
+ */
+static void ep_rdlpending_splice(struct eventpoll *ep)
+{
+	struct epitem *epi, *nepi;
+	LIST_HEAD(pending);
+
+	lockdep_assert_held(&ep->mtx);
+
+	if (!READ_ONCE(ep->rdlpending))
+		return;
+
+	spin_lock(&ep->lock);
+	WRITE_ONCE(ep->txlist_busy, true);
+	nepi = xchg(&ep->rdlpending, NULL);
+	spin_unlock(&ep->lock);
+
+	while ((epi = nepi) != NULL) {
+		nepi = epi->next;
+		/*
+		 * Allow the poll callback to chain the item again. It might
+		 * already be linked, since the callback does not look at
+		 * ->rdllink, and ep_send_events_proc() takes care of that.
+		 */
+		smp_store_release(&epi->next, EP_UNACTIVE_PTR);
+		if (!ep_is_linked(epi)) {
+			/*
+			 * ->rdlpending is LIFO, so we have to reverse it in
+			 * order to keep in FIFO.
+			 */
+			list_add(&epi->rdllink, &pending);
+			ep_pm_stay_awake(epi);
+		}
+	}
+
+	spin_lock(&ep->lock);
+	list_splice_tail(&pending, &ep->rdllist);
+	WRITE_ONCE(ep->txlist_busy, false);
+	spin_unlock(&ep->lock);
+}
+
+/*
+ * Removes @epi from the ready list, including the chain the poll callback
+ * might have left it on. Must be called with "mtx" held, after the poll
+ * wait queues of @epi have been unregistered.
+ */
+static void ep_unlink_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	if (READ_ONCE(epi->next) != EP_UNACTIVE_PTR)
+		ep_rdlpending_splice(ep);
+
+	spin_lock(&ep->lock);
+	if (ep_is_linked(epi))
+		list_del_init(&epi->rdllink);
+	spin_unlock(&ep->lock);
+}
+
 /**
  * ep_scan_ready_list - Scans the ready list in a way that makes possible for
  *                      the scan code, to call f_op->poll(). Also allows for
@@ -680,7 +835,6 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 			      void *priv, int depth, bool ep_locked)
 {
 	__poll_t res;
-	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
 	lockdep_assert_irqs_enabled();
@@ -694,59 +848,32 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 		mutex_lock_nested(&ep->mtx, depth);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * Collect whatever the poll callback has chained so far, then steal
+	 * the ready list and re-init the original one to the empty list.
+	 * Events happening while looping w/out locks keep being chained on
+	 * ep->rdlpending and are picked up by the next scan. Waiters see
+	 * ->txlist_busy until the leftovers are back on ep->rdllist.
 	 */
-	write_lock_irq(&ep->lock);
+	ep_rdlpending_splice(ep);
+
+	spin_lock(&ep->lock);
 	list_splice_init(&ep->rdllist, &txlist);
-	WRITE_ONCE(ep->ovflist, NULL);
-	write_unlock_irq(&ep->lock);
+	WRITE_ONCE(ep->txlist_busy, true);
+	spin_unlock(&ep->lock);
 
 	/*
 	 * Now call the callback function.
 	 */
 	res = (*sproc)(ep, &txlist, priv);
 
-	write_lock_irq(&ep->lock);
-	/*
-	 * During the time we spent inside the "sproc" callback, some
-	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
-	 */
-	for (nepi = READ_ONCE(ep->ovflist); (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(epi)) {
-			/*
-			 * ->ovflist is LIFO, so we have to reverse it in order
-			 * to keep in FIFO.
-			 */
-			list_add(&epi->rdllink, &ep->rdllist);
-			ep_pm_stay_awake(epi);
-		}
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	WRITE_ONCE(ep->ovflist, EP_UNACTIVE_PTR);
-
+	spin_lock(&ep->lock);
 	/*
 	 * Quickly re-inject items left on "txlist".
 	 */
 	list_splice(&txlist, &ep->rdllist);
+	WRITE_ONCE(ep->txlist_busy, false);
 	__pm_relax(ep->ws);
-	write_unlock_irq(&ep->lock);
+	spin_unlock(&ep->lock);
 
 	if (!ep_locked)
 		mutex_unlock(&ep->mtx);
@@ -782,10 +909,7 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
-	write_lock_irq(&ep->lock);
-	if (ep_is_linked(epi))
-		list_del_init(&epi->rdllink);
-	write_unlock_irq(&ep->lock);
+	ep_unlink_ready(ep, epi);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 	/*
@@ -835,7 +959,7 @@ static void ep_free(struct eventpoll *ep)
 	 * Walks through the whole tree by freeing each "struct epitem". At this
 	 * point we are sure no poll callbacks will be lingering around, and also by
 	 * holding "epmutex" we can be sure that no file cleanup code will hit
-	 * us during this operation. So we can avoid the lock on "ep->lock".
+	 * us during this operation.
 	 * We do not need to lock ep->mtx, either, we only do it to prevent
 	 * a lockdep warning.
 	 */
@@ -968,6 +1092,8 @@ static const struct file_operations eventpoll_fops = {
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
 	.llseek		= noop_llseek,
+	.unlocked_ioctl	= ep_eventpoll_bp_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 
 /*
@@ -1016,12 +1142,12 @@ static int ep_alloc(struct eventpoll **pep)
 		goto free_uid;
 
 	mutex_init(&ep->mtx);
-	rwlock_init(&ep->lock);
+	spin_lock_init(&ep->lock);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT_CACHED;
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep->rdlpending = NULL;
 	ep->user = user;
 
 	*pep = ep;
@@ -1107,78 +1233,36 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
 #endif /* CONFIG_CHECKPOINT_RESTORE */
 
 /**
- * Adds a new entry to the tail of the list in a lockless way, i.e.
- * multiple CPUs are allowed to call this function concurrently.
+ * Chains a new epi entry to the head of the ep->rdlpending chain in a
+ * lockless way, i.e. multiple CPUs are allowed to call this function
+ * concurrently. The chain is only ever consumed as a whole by
+ * ep_rdlpending_splice(), so there is no ABA problem.
  *
- * Beware: it is necessary to prevent any other modifications of the
- *         existing list until all changes are completed, in other words
- *         concurrent list_add_tail_lockless() calls should be protected
- *         with a read lock, where write lock acts as a barrier which
- *         makes sure all list_add_tail_lockless() calls are fully
- *         completed.
- *
- *        Also an element can be locklessly added to the list only in one
- *        direction i.e. either to the tail either to the head, otherwise
- *        concurrent access will corrupt the list.
- *
- * Returns %false if element has been already added to the list, %true
- * otherwise.
+ * Returns %false if epi element has been already chained and not consumed
+ * yet, %true otherwise.
  */
-static inline bool list_add_tail_lockless(struct list_head *new,
-					  struct list_head *head)
-{
-	struct list_head *prev;
-
-	/*
-	 * This is simple 'new->next = head' operation, but cmpxchg()
-	 * is used in order to detect that same element has been just
-	 * added to the list from another CPU: the winner observes
-	 * new->next == new.
-	 */
-	if (cmpxchg(&new->next, new, head) != new)
-		return false;
-
-	/*
-	 * Initially ->next of a new element must be updated with the head
-	 * (we are inserting to the tail) and only then pointers are atomically
-	 * exchanged.  XCHG guarantees memory ordering, thus ->next should be
-	 * updated before pointers are actually swapped and pointers are
-	 * swapped before prev->next is updated.
-	 */
-
-	prev = xchg(&head->prev, new);
-
-	/*
-	 * It is safe to modify prev->next and new->prev, because a new element
-	 * is added only to the tail and new->next is updated before XCHG.
-	 */
-
-	prev->next = new;
-	new->prev = prev;
-
-	return true;
-}
-
-/**
- * Chains a new epi entry to the tail of the ep->ovflist in a lockless way,
- * i.e. multiple CPUs are allowed to call this function concurrently.
- *
- * Returns %false if epi element has been already chained, %true otherwise.
- */
-static inline bool chain_epi_lockless(struct epitem *epi)
+static inline bool ep_chain_pending(struct epitem *epi)
 {
 	struct eventpoll *ep = epi->ep;
+	struct epitem *first;
 
 	/* Fast preliminary check */
-	if (epi->next != EP_UNACTIVE_PTR)
+	if (READ_ONCE(epi->next) != EP_UNACTIVE_PTR)
 		return false;
 
 	/* Check that the same epi has not been just chained from another CPU */
 	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
 		return false;
 
-	/* Atomically exchange tail */
-	epi->next = xchg(&ep->ovflist, epi);
+	/*
+	 * ->next must point to the old head before the item is published,
+	 * cmpxchg() orders the two and provides the full barrier which pairs
+	 * with set_current_state() in ep_poll().
+	 */
+	do {
+		first = READ_ONCE(ep->rdlpending);
+		WRITE_ONCE(epi->next, first);
+	} while (cmpxchg(&ep->rdlpending, first, epi) != first);
 
 	return true;
 }
@@ -1188,11 +1272,10 @@ static inline bool chain_epi_lockless(struct epitem *epi)
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
  *
- * This callback takes a read lock in order not to content with concurrent
- * events from another file descriptors, thus all modifications to ->rdllist
- * or ->ovflist are lockless.  Read lock is paired with the write lock from
- * ep_scan_ready_list(), which stops all list modifications and guarantees
- * that lists state is seen correctly.
+ * This callback takes no epoll lock: the item is chained on ->rdlpending
+ * with cmpxchg() and moved onto ->rdllist by whoever next scans the ready
+ * list with "mtx" held. Since items are only moved as a whole chain, the
+ * callback does not need to know whether a scan is in progress.
  *
  * Another thing worth to mention is that ep_poll_callback() can be called
  * concurrently for the same @epi from different CPUs if poll table was inited
@@ -1200,6 +1283,10 @@ static inline bool chain_epi_lockless(struct epitem *epi)
  * single wait queue is serialized by wq.lock, but the case when multiple wait
  * queues are used should be detected accordingly.  This is detected using
  * cmpxchg() operation.
+ *
+ * Wakeups are batched per item: if @epi is still chained from a previous
+ * callback, that callback has already woken the waiters up and nobody has
+ * consumed the chain since, so there is nothing new to report.
  */
 static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key)
 {
@@ -1207,11 +1294,9 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 	__poll_t pollflags = key_to_poll(key);
-	unsigned long flags;
+	bool wake = true;
 	int ewake = 0;
 
-	read_lock_irqsave(&ep->lock, flags);
-
 	ep_set_busy_poll_napi_id(epi);
 
 	/*
@@ -1221,7 +1306,7 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		goto out;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -1230,22 +1315,17 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * test for "key" != NULL before the event match test.
 	 */
 	if (pollflags && !(pollflags & epi->event.events))
-		goto out_unlock;
+		goto out;
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Chain the item for the next ready list scan. If it is already
+	 * chained, the wakeup it triggered has not been consumed yet and
+	 * there is nobody new to wake up.
 	 */
-	if (READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR) {
-		if (chain_epi_lockless(epi))
-			ep_pm_stay_awake_rcu(epi);
-	} else if (!ep_is_linked(epi)) {
-		/* In the usual case, add event to ready list. */
-		if (list_add_tail_lockless(&epi->rdllink, &ep->rdllist))
-			ep_pm_stay_awake_rcu(epi);
-	}
+	if (ep_chain_pending(epi))
+		ep_pm_stay_awake_rcu(epi);
+	else if (!(pollflags & POLLFREE))
+		wake = false;
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
@@ -1268,18 +1348,16 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				break;
 			}
 		}
-		wake_up(&ep->wq);
+		if (wake)
+			wake_up(&ep->wq);
 	}
-	if (waitqueue_active(&ep->poll_wait))
+	if (wake && waitqueue_active(&ep->poll_wait))
 		pwake++;
 
-out_unlock:
-	read_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
 	if (pwake)
 		ep_poll_safewake(ep, epi);
 
+out:
 	if (!(epi->event.events & EPOLLEXCLUSIVE))
 		ewake = 1;
 
@@ -1560,7 +1638,7 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 		goto error_unregister;
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	write_lock_irq(&ep->lock);
+	spin_lock(&ep->lock);
 
 	/* record NAPI ID of new item if present */
 	ep_set_busy_poll_napi_id(epi);
@@ -1577,7 +1655,7 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 			pwake++;
 	}
 
-	write_unlock_irq(&ep->lock);
+	spin_unlock(&ep->lock);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
@@ -1598,14 +1676,10 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, and the poll callback could have chained the
+	 * item on ep->rdlpending.
 	 */
-	write_lock_irq(&ep->lock);
-	if (ep_is_linked(epi))
-		list_del_init(&epi->rdllink);
-	write_unlock_irq(&ep->lock);
+	ep_unlink_ready(ep, epi);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 
@@ -1649,9 +1723,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * 1) Flush epi changes above to other CPUs.  This ensures
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
-	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    We need this because ep_poll_callback() reads
+	 *    epi->event.events without taking any lock.
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1670,7 +1743,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * list, push it inside.
 	 */
 	if (ep_item_poll(epi, &pt, 1)) {
-		write_lock_irq(&ep->lock);
+		spin_lock(&ep->lock);
 		if (!ep_is_linked(epi)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 			ep_pm_stay_awake(epi);
@@ -1681,7 +1754,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
-		write_unlock_irq(&ep->lock);
+		spin_unlock(&ep->lock);
 	}
 
 	/* We have to call this outside the lock */
@@ -1765,7 +1838,7 @@ static __poll_t ep_send_events_proc(struct eventpoll *ep, struct list_head *head
 			 * into ep->rdllist besides us. The epoll_ctl()
 			 * callers are locked out by
 			 * ep_scan_ready_list() holding "mtx" and the
-			 * poll callback will queue them in ep->ovflist.
+			 * poll callback will queue them in ep->rdlpending.
 			 */
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 			ep_pm_stay_awake(epi);
@@ -1787,15 +1860,30 @@ static int ep_send_events(struct eventpoll *ep,
 	return esed.res;
 }
 
-static inline struct timespec64 ep_set_mstimeout(long ms)
+/*
+ * Converts the millisecond timeout of epoll_wait() and epoll_pwait() to the
+ * absolute timespec64 used by ep_poll(). A negative timeout means that there
+ * is no timeout, and NULL is returned.
+ */
+static struct timespec64 *ep_timeout_to_timespec(struct timespec64 *to, long ms)
 {
-	struct timespec64 now, ts = {
-		.tv_sec = ms / MSEC_PER_SEC,
-		.tv_nsec = NSEC_PER_MSEC * (ms % MSEC_PER_SEC),
-	};
+	struct timespec64 now;
+
+	if (ms < 0)
+		return NULL;
+
+	if (!ms) {
+		to->tv_sec = 0;
+		to->tv_nsec = 0;
+		return to;
+	}
+
+	to->tv_sec = ms / MSEC_PER_SEC;
+	to->tv_nsec = NSEC_PER_MSEC * (ms % MSEC_PER_SEC);
 
 	ktime_get_ts64(&now);
-	return timespec64_add_safe(now, ts);
+	*to = timespec64_add_safe(now, *to);
+	return to;
 }
 
 /**
@@ -1806,9 +1894,9 @@ static inline struct timespec64 ep_set_mstimeout(long ms)
  * @events: Pointer to the userspace buffer where the ready events should be
  *          stored.
  * @maxevents: Size (in terms of number of events) of the caller event buffer.
- * @timeout: Maximum timeout for the ready events fetch operation, in
- *           milliseconds. If the @timeout is zero, the function will not block,
- *           while if the @timeout is less than zero, the function will block
+ * @timeout: Maximum timeout for the ready events fetch operation, as an
+ *           absolute timespec64. If the @timeout is zero, the function will
+ *           not block, while if the @timeout is NULL, the function will block
  *           until at least one event has been retrieved (or an error
  *           occurred).
  *
@@ -1816,7 +1904,7 @@ static inline struct timespec64 ep_set_mstimeout(long ms)
  *          error code, in case of error.
  */
 static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
-		   int maxevents, long timeout)
+		   int maxevents, struct timespec64 *timeout)
 {
 	int res = 0, eavail, timed_out = 0;
 	u64 slack = 0;
@@ -1825,25 +1913,23 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 
 	lockdep_assert_irqs_enabled();
 
-	if (timeout > 0) {
-		struct timespec64 end_time = ep_set_mstimeout(timeout);
-
-		slack = select_estimate_accuracy(&end_time);
+	if (timeout && (timeout->tv_sec | timeout->tv_nsec)) {
+		slack = select_estimate_accuracy(timeout);
 		to = &expires;
-		*to = timespec64_to_ktime(end_time);
-	} else if (timeout == 0) {
+		*to = timespec64_to_ktime(*timeout);
+	} else if (timeout) {
 		/*
 		 * Avoid the unnecessary trip to the wait queue loop, if the
 		 * caller specified a non blocking operation. We still need
-		 * lock because we could race and not see an epi being added
-		 * to the ready list while in irq callback. Thus incorrectly
-		 * returning 0 back to userspace.
+		 * lock because we could race with ep_scan_ready_list() and
+		 * see both the ready list and ->txlist_busy empty. Thus
+		 * incorrectly returning 0 back to userspace.
 		 */
 		timed_out = 1;
 
-		write_lock_irq(&ep->lock);
+		spin_lock(&ep->lock);
 		eavail = ep_events_available(ep);
-		write_unlock_irq(&ep->lock);
+		spin_unlock(&ep->lock);
 
 		goto send_events;
 	}
@@ -1872,35 +1958,32 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * each new wakeup will hit the next waiter, giving it the
 		 * chance to harvest new event. Otherwise wakeup can be
 		 * lost. This is also good performance-wise, because on
-		 * normal wakeup path no need to call __remove_wait_queue()
-		 * explicitly, thus ep->lock is not taken, which halts the
-		 * event delivery.
+		 * normal wakeup path no need to call remove_wait_queue()
+		 * explicitly, thus ep->wq.lock is not taken again.
 		 */
 		init_wait(&wait);
 
-		write_lock_irq(&ep->lock);
+		spin_lock(&ep->lock);
 		/*
-		 * Barrierless variant, waitqueue_active() is called under
-		 * the same lock on wakeup ep_poll_callback() side, so it
-		 * is safe to avoid an explicit barrier.
+		 * The poll callback does not take ep->lock, so queue ourselves
+		 * before looking at the lists. The full barrier implied by
+		 * set_current_state() pairs with the cmpxchg() in
+		 * ep_chain_pending(), which happens before the callback checks
+		 * waitqueue_active().
 		 */
-		__set_current_state(TASK_INTERRUPTIBLE);
+		add_wait_queue_exclusive(&ep->wq, &wait);
+		set_current_state(TASK_INTERRUPTIBLE);
 
 		/*
 		 * Do the final check under the lock. ep_scan_ready_list()
-		 * plays with two lists (->rdllist and ->ovflist) and there
-		 * is always a race when both lists are empty for short
-		 * period of time although events are pending, so lock is
-		 * important.
+		 * steals ->rdllist while it is running and there is always
+		 * a race when the lists look empty for short period of time
+		 * although events are pending, so lock is important.
 		 */
 		eavail = ep_events_available(ep);
-		if (!eavail) {
-			if (signal_pending(current))
-				res = -EINTR;
-			else
-				__add_wait_queue_exclusive(&ep->wq, &wait);
-		}
-		write_unlock_irq(&ep->lock);
+		if (!eavail && signal_pending(current))
+			res = -EINTR;
+		spin_unlock(&ep->lock);
 
 		if (!eavail && !res)
 			timed_out = !schedule_hrtimeout_range(to, slack,
@@ -1917,7 +2000,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	__set_current_state(TASK_RUNNING);
 
 	if (!list_empty_careful(&wait.entry)) {
-		write_lock_irq(&ep->lock);
+		spin_lock_irq(&ep->wq.lock);
 		/*
 		 * If the thread timed out and is not on the wait queue, it
 		 * means that the thread was woken up after its timeout expired
@@ -1927,7 +2010,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		if (timed_out)
 			eavail = list_empty(&wait.entry);
 		__remove_wait_queue(&ep->wq, &wait);
-		write_unlock_irq(&ep->lock);
+		spin_unlock_irq(&ep->wq.lock);
 	}
 
 send_events:
@@ -2112,30 +2195,16 @@ static inline int epoll_mutex_lock(struct mutex *mutex, int depth,
 	return -EAGAIN;
 }
 
-int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
-		 bool nonblock)
+/*
+ * Checks that @op, with @epds for the operations carrying an event, can be
+ * applied to the target file @tfile inside the epoll file @file.
+ */
+static int ep_ctl_check(int op, struct epoll_event *epds, struct file *file,
+			struct file *tfile)
 {
-	int error;
-	int full_check = 0;
-	struct fd f, tf;
-	struct eventpoll *ep;
-	struct epitem *epi;
-	struct eventpoll *tep = NULL;
-
-	error = -EBADF;
-	f = fdget(epfd);
-	if (!f.file)
-		goto error_return;
-
-	/* Get the "struct file *" for the target file */
-	tf = fdget(fd);
-	if (!tf.file)
-		goto error_fput;
-
 	/* The target file descriptor must support poll */
-	error = -EPERM;
-	if (!file_can_poll(tf.file))
-		goto error_tgt_fput;
+	if (!file_can_poll(tfile))
+		return -EPERM;
 
 	/* Check if EPOLLWAKEUP is allowed */
 	if (ep_op_has_event(op))
@@ -2146,9 +2215,8 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	 * the user passed to us _is_ an eventpoll file. And also we do not permit
 	 * adding an epoll file descriptor inside itself.
 	 */
-	error = -EINVAL;
-	if (f.file == tf.file || !is_file_epoll(f.file))
-		goto error_tgt_fput;
+	if (file == tfile || !is_file_epoll(file))
+		return -EINVAL;
 
 	/*
 	 * epoll adds to the wakeup queue at EPOLL_CTL_ADD time only,
@@ -2157,17 +2225,93 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	 */
 	if (ep_op_has_event(op) && (epds->events & EPOLLEXCLUSIVE)) {
 		if (op == EPOLL_CTL_MOD)
-			goto error_tgt_fput;
-		if (op == EPOLL_CTL_ADD && (is_file_epoll(tf.file) ||
+			return -EINVAL;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tfile) ||
 				(epds->events & ~EPOLLEXCLUSIVE_OK_BITS)))
-			goto error_tgt_fput;
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Tells whether inserting @tfile inside @ep needs the full loop and wakeup
+ * path check, which has to be done with "epmutex" held.
+ */
+static inline bool ep_ctl_needs_full_check(struct eventpoll *ep,
+					   struct file *file,
+					   struct file *tfile)
+{
+	return !list_empty(&file->f_ep_links) || ep->gen == loop_check_gen ||
+	       is_file_epoll(tfile);
+}
+
+/*
+ * Applies @op on the @tfile/@fd pair of @ep. Must be called with "mtx" held,
+ * and with "epmutex" held as well when @full_check is set.
+ */
+static int ep_ctl_apply(struct eventpoll *ep, int op, struct epoll_event *epds,
+			struct file *tfile, int fd, int full_check)
+{
+	struct epitem *epi;
+	int error = -EINVAL;
+
+	/*
+	 * Try to lookup the file inside our RB tree, Since we grabbed "mtx"
+	 * above, we can be sure to be able to use the item looked up by
+	 * ep_find() till we release the mutex.
+	 */
+	epi = ep_find(ep, tfile, fd);
+
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (!epi) {
+			epds->events |= EPOLLERR | EPOLLHUP;
+			error = ep_insert(ep, epds, tfile, fd, full_check);
+		} else
+			error = -EEXIST;
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi)
+			error = ep_remove(ep, epi);
+		else
+			error = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		if (epi) {
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds->events |= EPOLLERR | EPOLLHUP;
+				error = ep_modify(ep, epi, epds);
+			}
+		} else
+			error = -ENOENT;
+		break;
 	}
 
+	return error;
+}
+
+/*
+ * Applies one epoll_ctl() operation of @tfile, open as @fd, to the epoll
+ * file @file. The caller holds references to both files.
+ */
+static int ep_ctl_file(struct file *file, int op, struct file *tfile, int fd,
+		       struct epoll_event *epds, bool nonblock)
+{
+	int error;
+	int full_check = 0;
+	struct eventpoll *ep;
+	struct eventpoll *tep = NULL;
+
+	error = ep_ctl_check(op, epds, file, tfile);
+	if (error)
+		return error;
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
 	 */
-	ep = f.file->private_data;
+	ep = file->private_data;
 
 	/*
 	 * When we insert an epoll file descriptor, inside another epoll file
@@ -2186,83 +2330,72 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	 */
 	error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
 	if (error)
-		goto error_tgt_fput;
+		return error;
 	if (op == EPOLL_CTL_ADD) {
-		if (!list_empty(&f.file->f_ep_links) ||
-				ep->gen == loop_check_gen ||
-						is_file_epoll(tf.file)) {
+		if (ep_ctl_needs_full_check(ep, file, tfile)) {
 			mutex_unlock(&ep->mtx);
 			error = epoll_mutex_lock(&epmutex, 0, nonblock);
 			if (error)
-				goto error_tgt_fput;
+				goto error_full_check;
 			loop_check_gen++;
 			full_check = 1;
-			if (is_file_epoll(tf.file)) {
+			if (is_file_epoll(tfile)) {
 				error = -ELOOP;
-				if (ep_loop_check(ep, tf.file) != 0)
-					goto error_tgt_fput;
+				if (ep_loop_check(ep, tfile) != 0)
+					goto error_full_check;
 			} else {
-				get_file(tf.file);
-				list_add(&tf.file->f_tfile_llink,
+				get_file(tfile);
+				list_add(&tfile->f_tfile_llink,
 							&tfile_check_list);
 			}
 			error = epoll_mutex_lock(&ep->mtx, 0, nonblock);
 			if (error)
-				goto error_tgt_fput;
-			if (is_file_epoll(tf.file)) {
-				tep = tf.file->private_data;
+				goto error_full_check;
+			if (is_file_epoll(tfile)) {
+				tep = tfile->private_data;
 				error = epoll_mutex_lock(&tep->mtx, 1, nonblock);
 				if (error) {
 					mutex_unlock(&ep->mtx);
-					goto error_tgt_fput;
+					goto error_full_check;
 				}
 			}
 		}
 	}
 
-	/*
-	 * Try to lookup the file inside our RB tree, Since we grabbed "mtx"
-	 * above, we can be sure to be able to use the item looked up by
-	 * ep_find() till we release the mutex.
-	 */
-	epi = ep_find(ep, tf.file, fd);
+	error = ep_ctl_apply(ep, op, epds, tfile, fd, full_check);
 
-	error = -EINVAL;
-	switch (op) {
-	case EPOLL_CTL_ADD:
-		if (!epi) {
-			epds->events |= EPOLLERR | EPOLLHUP;
-			error = ep_insert(ep, epds, tf.file, fd, full_check);
-		} else
-			error = -EEXIST;
-		break;
-	case EPOLL_CTL_DEL:
-		if (epi)
-			error = ep_remove(ep, epi);
-		else
-			error = -ENOENT;
-		break;
-	case EPOLL_CTL_MOD:
-		if (epi) {
-			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
-				epds->events |= EPOLLERR | EPOLLHUP;
-				error = ep_modify(ep, epi, epds);
-			}
-		} else
-			error = -ENOENT;
-		break;
-	}
 	if (tep != NULL)
 		mutex_unlock(&tep->mtx);
 	mutex_unlock(&ep->mtx);
 
-error_tgt_fput:
+error_full_check:
 	if (full_check) {
 		clear_tfile_check_list();
 		loop_check_gen++;
 		mutex_unlock(&epmutex);
 	}
 
+	return error;
+}
+
+int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
+		 bool nonblock)
+{
+	int error;
+	struct fd f, tf;
+
+	error = -EBADF;
+	f = fdget(epfd);
+	if (!f.file)
+		goto error_return;
+
+	/* Get the "struct file *" for the target file */
+	tf = fdget(fd);
+	if (!tf.file)
+		goto error_fput;
+
+	error = ep_ctl_file(f.file, op, tf.file, fd, epds, nonblock);
+
 	fdput(tf);
 error_fput:
 	fdput(f);
@@ -2288,12 +2421,127 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	return do_epoll_ctl(epfd, op, fd, &epds, false);
 }
 
+/*
+ * Applies one command of an epoll_ctl_batch() call. Must be called with
+ * "mtx" held, which is dropped around the insertions that need "epmutex".
+ */
+static int ep_ctl_batch_one(struct file *file, struct eventpoll *ep,
+			    const struct epoll_ctl_cmd *cmd)
+{
+	struct epoll_event epds;
+	struct fd tf;
+	int error;
+
+	epds.events = cmd->events;
+	epds.data = cmd->data;
+
+	tf = fdget(cmd->fd);
+	if (!tf.file)
+		return -EBADF;
+
+	error = ep_ctl_check(cmd->op, &epds, file, tf.file);
+	if (error)
+		goto out;
+
+	if (cmd->op == EPOLL_CTL_ADD &&
+	    ep_ctl_needs_full_check(ep, file, tf.file)) {
+		/*
+		 * Loop and path checks need "epmutex", use the regular path.
+		 * Pass @file on: epfd may refer to another file by now.
+		 */
+		mutex_unlock(&ep->mtx);
+		error = ep_ctl_file(file, cmd->op, tf.file, cmd->fd, &epds,
+				    false);
+		mutex_lock(&ep->mtx);
+		goto out;
+	}
+
+	error = ep_ctl_apply(ep, cmd->op, &epds, tf.file, cmd->fd, 0);
+out:
+	fdput(tf);
+	return error;
+}
+
+/*
+ * Applies an array of EPOLL_CTL_ADD/MOD/DEL commands to the interest set of
+ * an eventpoll file, holding "mtx" once for the whole array. Each command
+ * gets its own status in ->result, and the number of commands that
+ * succeeded is returned. Like a partial write(), a fault on a later chunk
+ * returns the count of the commands applied so far, and -EFAULT only if
+ * none was.
+ */
+SYSCALL_DEFINE4(epoll_ctl_batch, int, epfd, int, flags, int, ncmds,
+		struct epoll_ctl_cmd __user *, cmds)
+{
+	struct epoll_ctl_cmd *kcmds;
+	struct eventpoll *ep;
+	int i, n, done = 0;
+	struct fd f;
+	int error;
+
+	if (flags || ncmds < 0)
+		return -EINVAL;
+	if (!ncmds)
+		return 0;
+
+	f = fdget(epfd);
+	if (!f.file)
+		return -EBADF;
+
+	error = -EINVAL;
+	if (!is_file_epoll(f.file))
+		goto error_fput;
+
+	error = -ENOMEM;
+	kcmds = kmalloc_array(min(ncmds, EP_CTL_BATCH_CHUNK), sizeof(*kcmds),
+			      GFP_KERNEL);
+	if (!kcmds)
+		goto error_fput;
+
+	ep = f.file->private_data;
+
+	error = 0;
+	mutex_lock(&ep->mtx);
+	for (i = 0; i < ncmds; i += n) {
+		int j;
+
+		n = min(ncmds - i, EP_CTL_BATCH_CHUNK);
+		if (copy_from_user(kcmds, cmds + i, n * sizeof(*kcmds))) {
+			error = -EFAULT;
+			break;
+		}
+
+		for (j = 0; j < n; j++) {
+			kcmds[j].result = ep_ctl_batch_one(f.file, ep,
+							   &kcmds[j]);
+			if (!kcmds[j].result)
+				done++;
+		}
+
+		if (copy_to_user(cmds + i, kcmds, n * sizeof(*kcmds))) {
+			error = -EFAULT;
+			break;
+		}
+		cond_resched();
+	}
+	mutex_unlock(&ep->mtx);
+
+	kfree(kcmds);
+error_fput:
+	fdput(f);
+
+	/* earlier chunks took effect, report them like a short write */
+	if (error == -EFAULT && done)
+		return done;
+	return error ? error : done;
+}
+
 /*
  * Implement the event wait interface for the eventpoll file. It is the kernel
  * part of the user space epoll_wait(2).
  */
 static int do_epoll_wait(int epfd, struct epoll_event __user *events,
-			 int maxevents, int timeout)
+			 int maxevents, struct timespec64 *to)
 {
 	int error;
 	struct fd f;
@@ -2327,7 +2575,7 @@ static int do_epoll_wait(int epfd, struct epoll_event __user *events,
 	ep = f.file->private_data;
 
 	/* Time to fish for events ... */
-	error = ep_poll(ep, events, maxevents, timeout);
+	error = ep_poll(ep, events, maxevents, to);
 
 error_fput:
 	fdput(f);
@@ -2337,16 +2585,19 @@ static int do_epoll_wait(int epfd, struct epoll_event __user *events,
 SYSCALL_DEFINE4(epoll_wait, int, epfd, struct epoll_event __user *, events,
 		int, maxevents, int, timeout)
 {
-	return do_epoll_wait(epfd, events, maxevents, timeout);
+	struct timespec64 to;
+
+	return do_epoll_wait(epfd, events, maxevents,
+			     ep_timeout_to_timespec(&to, timeout));
 }
 
 /*
  * Implement the event wait interface for the eventpoll file. It is the kernel
  * part of the user space epoll_pwait(2).
  */
-SYSCALL_DEFINE6(epoll_pwait, int, epfd, struct epoll_event __user *, events,
-		int, maxevents, int, timeout, const sigset_t __user *, sigmask,
-		size_t, sigsetsize)
+static int do_epoll_pwait(int epfd, struct epoll_event __user *events,
+			  int maxevents, struct timespec64 *to,
+			  const sigset_t __user *sigmask, size_t sigsetsize)
 {
 	int error;
 
@@ -2358,18 +2609,51 @@ SYSCALL_DEFINE6(epoll_pwait, int, epfd, struct epoll_event __user *, events,
 	if (error)
 		return error;
 
-	error = do_epoll_wait(epfd, events, maxevents, timeout);
+	error = do_epoll_wait(epfd, events, maxevents, to);
+
 	restore_saved_sigmask_unless(error == -EINTR);
 
 	return error;
 }
 
+SYSCALL_DEFINE6(epoll_pwait, int, epfd, struct epoll_event __user *, events,
+		int, maxevents, int, timeout, const sigset_t __user *, sigmask,
+		size_t, sigsetsize)
+{
+	struct timespec64 to;
+
+	return do_epoll_pwait(epfd, events, maxevents,
+			      ep_timeout_to_timespec(&to, timeout),
+			      sigmask, sigsetsize);
+}
+
+/*
+ * Same as epoll_pwait(), but with a nanosecond resolution timeout. A NULL
+ * @timeout blocks indefinitely, a zero one does not block at all.
+ */
+SYSCALL_DEFINE6(epoll_pwait2, int, epfd, struct epoll_event __user *, events,
+		int, maxevents, const struct __kernel_timespec __user *, timeout,
+		const sigset_t __user *, sigmask, size_t, sigsetsize)
+{
+	struct timespec64 ts, *to = NULL;
+
+	if (timeout) {
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+		to = &ts;
+		if (poll_select_set_timeout(to, ts.tv_sec, ts.tv_nsec))
+			return -EINVAL;
+	}
+
+	return do_epoll_pwait(epfd, events, maxevents, to,
+			      sigmask, sigsetsize);
+}
+
 #ifdef CONFIG_COMPAT
-COMPAT_SYSCALL_DEFINE6(epoll_pwait, int, epfd,
-			struct epoll_event __user *, events,
-			int, maxevents, int, timeout,
-			const compat_sigset_t __user *, sigmask,
-			compat_size_t, sigsetsize)
+static int do_compat_epoll_pwait(int epfd, struct epoll_event __user *events,
+				 int maxevents, struct timespec64 *timeout,
+				 const compat_sigset_t __user *sigmask,
+				 compat_size_t sigsetsize)
 {
 	long err;
 
@@ -2382,10 +2666,45 @@ COMPAT_SYSCALL_DEFINE6(epoll_pwait, int, epfd,
 		return err;
 
 	err = do_epoll_wait(epfd, events, maxevents, timeout);
+
 	restore_saved_sigmask_unless(err == -EINTR);
 
 	return err;
 }
+
+COMPAT_SYSCALL_DEFINE6(epoll_pwait, int, epfd,
+			struct epoll_event __user *, events,
+			int, maxevents, int, timeout,
+			const compat_sigset_t __user *, sigmask,
+			compat_size_t, sigsetsize)
+{
+	struct timespec64 to;
+
+	return do_compat_epoll_pwait(epfd, events, maxevents,
+				     ep_timeout_to_timespec(&to, timeout),
+				     sigmask, sigsetsize);
+}
+
+COMPAT_SYSCALL_DEFINE6(epoll_pwait2, int, epfd,
+			struct epoll_event __user *, events,
+			int, maxevents,
+			const struct __kernel_timespec __user *, timeout,
+			const compat_sigset_t __user *, sigmask,
+			compat_size_t, sigsetsize)
+{
+	struct timespec64 ts, *to = NULL;
+
+	if (timeout) {
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+		to = &ts;
+		if (poll_select_set_timeout(to, ts.tv_sec, ts.tv_nsec))
+			return -EINVAL;
+	}
+
+	return do_compat_epoll_pwait(epfd, events, maxevents, to,
+				     sigmask, sigsetsize);
+}
 #endif
 
 static int __init eventpoll_init(void)
@@ -164,6 +164,37 @@ extern struct dentry * d_alloc_pseudo(struct super_block *, const struct qstr *)
 extern char *simple_dname(struct dentry *, char *, int);
 extern void dput_to_list(struct dentry *, struct list_head *);
 extern void shrink_dentry_list(struct list_head *);
+extern void dentry_negative_trim_work(struct work_struct *);
+
+/*
+ * Path walk statistics, summed up in debugfs:dcache/stats.
+ */
+enum dcache_stat_item {
+	DCACHE_LOOKUP_HIT,		/* lookup_fast() found a positive dentry */
+	DCACHE_LOOKUP_NEGATIVE,		/* ... found a negative dentry */
+	DCACHE_LOOKUP_MISS,		/* ... found nothing in the hash */
+	DCACHE_UNLAZY,			/* attempts to leave RCU-walk */
+	DCACHE_UNLAZY_FAILED,		/* ... that failed with -ECHILD */
+	DCACHE_WALK_RESTART,		/* walks redone in ref-walk mode */
+	DCACHE_NEGATIVE_TRIMMED,	/* negative dentries over the limit pruned */
+	NR_DCACHE_STAT_ITEMS
+};
+
+struct dcache_stats {
+	unsigned long item[NR_DCACHE_STAT_ITEMS];
+};
+
+DECLARE_PER_CPU(struct dcache_stats, dcache_stats);
+
+static inline void count_dcache_stat(enum dcache_stat_item item)
+{
+	this_cpu_inc(dcache_stats.item[item]);
+}
+
+static inline void count_dcache_stats(enum dcache_stat_item item, long delta)
+{
+	this_cpu_add(dcache_stats.item[item], delta);
+}
 
 /*
  * read_write.c
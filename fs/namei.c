@@ -685,6 +685,7 @@ static int unlazy_walk(struct nameidata *nd)
 
 	BUG_ON(!(nd->flags & LOOKUP_RCU));
 
+	count_dcache_stat(DCACHE_UNLAZY);
 	nd->flags &= ~LOOKUP_RCU;
 	if (unlikely(!legitimize_links(nd)))
 		goto out1;
@@ -701,6 +702,7 @@ static int unlazy_walk(struct nameidata *nd)
 	nd->path.dentry = NULL;
 out:
 	rcu_read_unlock();
+	count_dcache_stat(DCACHE_UNLAZY_FAILED);
 	return -ECHILD;
 }
 
@@ -721,6 +723,7 @@ static int unlazy_child(struct nameidata *nd, struct dentry *dentry, unsigned se
 {
 	BUG_ON(!(nd->flags & LOOKUP_RCU));
 
+	count_dcache_stat(DCACHE_UNLAZY);
 	nd->flags &= ~LOOKUP_RCU;
 	if (unlikely(!legitimize_links(nd)))
 		goto out2;
@@ -755,10 +758,12 @@ static int unlazy_child(struct nameidata *nd, struct dentry *dentry, unsigned se
 	nd->path.dentry = NULL;
 out:
 	rcu_read_unlock();
+	count_dcache_stat(DCACHE_UNLAZY_FAILED);
 	return -ECHILD;
 out_dput:
 	rcu_read_unlock();
 	dput(dentry);
+	count_dcache_stat(DCACHE_UNLAZY_FAILED);
 	return -ECHILD;
 }
 
@@ -1450,6 +1455,16 @@ static struct dentry *__lookup_hash(const struct qstr *name,
 	return dentry;
 }
 
+static inline void count_dcache_lookup(struct dentry *dentry)
+{
+	if (!dentry)
+		count_dcache_stat(DCACHE_LOOKUP_MISS);
+	else if (d_is_negative(dentry))
+		count_dcache_stat(DCACHE_LOOKUP_NEGATIVE);
+	else
+		count_dcache_stat(DCACHE_LOOKUP_HIT);
+}
+
 static struct dentry *lookup_fast(struct nameidata *nd,
 				  struct inode **inode,
 			          unsigned *seqp)
@@ -1465,6 +1480,7 @@ static struct dentry *lookup_fast(struct nameidata *nd,
 	if (nd->flags & LOOKUP_RCU) {
 		unsigned seq;
 		dentry = __d_lookup_rcu(parent, &nd->last, &seq);
+		count_dcache_lookup(dentry);
 		if (unlikely(!dentry)) {
 			if (unlazy_walk(nd))
 				return ERR_PTR(-ECHILD);
@@ -1500,6 +1516,7 @@ static struct dentry *lookup_fast(struct nameidata *nd,
 			status = d_revalidate(dentry, nd->flags);
 	} else {
 		dentry = __d_lookup(parent, &nd->last);
+		count_dcache_lookup(dentry);
 		if (unlikely(!dentry))
 			return NULL;
 		status = d_revalidate(dentry, nd->flags);
@@ -2365,8 +2382,10 @@ int filename_lookup(int dfd, struct filename *name, unsigned flags,
 	}
 	set_nameidata(&nd, dfd, name);
 	retval = path_lookupat(&nd, flags | LOOKUP_RCU, path);
-	if (unlikely(retval == -ECHILD))
+	if (unlikely(retval == -ECHILD)) {
+		count_dcache_stat(DCACHE_WALK_RESTART);
 		retval = path_lookupat(&nd, flags, path);
+	}
 	if (unlikely(retval == -ESTALE))
 		retval = path_lookupat(&nd, flags | LOOKUP_REVAL, path);
 
@@ -2406,8 +2425,10 @@ static struct filename *filename_parentat(int dfd, struct filename *name,
 		return name;
 	set_nameidata(&nd, dfd, name);
 	retval = path_parentat(&nd, flags | LOOKUP_RCU, parent);
-	if (unlikely(retval == -ECHILD))
+	if (unlikely(retval == -ECHILD)) {
+		count_dcache_stat(DCACHE_WALK_RESTART);
 		retval = path_parentat(&nd, flags, parent);
+	}
 	if (unlikely(retval == -ESTALE))
 		retval = path_parentat(&nd, flags | LOOKUP_REVAL, parent);
 	if (likely(!retval)) {
@@ -3394,8 +3415,10 @@ struct file *do_filp_open(int dfd, struct filename *pathname,
 
 	set_nameidata(&nd, dfd, pathname);
 	filp = path_openat(&nd, op, flags | LOOKUP_RCU);
-	if (unlikely(filp == ERR_PTR(-ECHILD)))
+	if (unlikely(filp == ERR_PTR(-ECHILD))) {
+		count_dcache_stat(DCACHE_WALK_RESTART);
 		filp = path_openat(&nd, op, flags);
+	}
 	if (unlikely(filp == ERR_PTR(-ESTALE)))
 		filp = path_openat(&nd, op, flags | LOOKUP_REVAL);
 	restore_nameidata();
@@ -3422,8 +3445,10 @@ struct file *do_file_open_root(struct dentry *dentry, struct vfsmount *mnt,
 
 	set_nameidata(&nd, -1, filename);
 	file = path_openat(&nd, op, flags | LOOKUP_RCU);
-	if (unlikely(file == ERR_PTR(-ECHILD)))
+	if (unlikely(file == ERR_PTR(-ECHILD))) {
+		count_dcache_stat(DCACHE_WALK_RESTART);
 		file = path_openat(&nd, op, flags);
+	}
 	if (unlikely(file == ERR_PTR(-ESTALE)))
 		file = path_openat(&nd, op, flags | LOOKUP_REVAL);
 	restore_nameidata();
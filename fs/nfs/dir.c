@@ -78,6 +78,7 @@ static struct nfs_open_dir_context *alloc_nfs_open_dir_context(struct inode *dir
 		ctx->attr_gencount = nfsi->attr_gencount;
 		ctx->dir_cookie = 0;
 		ctx->dup_cookie = 0;
+		ctx->page_dir_cookie = 0;
 		ctx->cred = get_cred(cred);
 		spin_lock(&dir->i_lock);
 		if (list_empty(&nfsi->open_files) &&
@@ -556,16 +557,71 @@ void nfs_prime_dcache(struct dentry *parent, struct nfs_entry *entry,
 	dput(dentry);
 }
 
-/* Perform conversion from xdr to cache array */
+/*
+ * Get the page cache page following a full one, so that the rest of a
+ * large READDIR reply is kept instead of being read again later.
+ * Returns a locked page, or NULL if somebody else is already filling it.
+ */
+static
+struct page *nfs_readdir_page_get_next(struct address_space *mapping,
+				       pgoff_t index, u64 last_cookie)
+{
+	struct nfs_cache_array *array;
+	struct page *page;
+
+	page = grab_cache_page_nowait(mapping, index);
+	if (page == NULL)
+		return NULL;
+	if (PageUptodate(page)) {
+		unlock_page(page);
+		put_page(page);
+		return NULL;
+	}
+
+	nfs_readdir_init_array(page);
+	array = kmap_atomic(page);
+	array->last_cookie = last_cookie;
+	kunmap_atomic(array);
+	return page;
+}
+
+static
+void nfs_readdir_page_put_next(struct page *page)
+{
+	SetPageUptodate(page);
+	unlock_page(page);
+	put_page(page);
+}
+
+static
+u64 nfs_readdir_page_last_cookie(struct page *page)
+{
+	struct nfs_cache_array *array;
+	u64 cookie;
+
+	array = kmap_atomic(page);
+	cookie = array->last_cookie;
+	kunmap_atomic(array);
+	return cookie;
+}
+
+/*
+ * Perform conversion from xdr to cache array. Entries that do not fit in
+ * @page go to the page cache pages that follow it, if @page is in the page
+ * cache, and -ENOSPC is returned once @page is full.
+ */
 static
 int nfs_readdir_page_filler(nfs_readdir_descriptor_t *desc, struct nfs_entry *entry,
 				struct page **xdr_pages, struct page *page, unsigned int buflen)
 {
+	struct address_space *mapping = page->mapping;
 	struct xdr_stream stream;
 	struct xdr_buf buf;
 	struct page *scratch;
+	struct page *fill = page;
 	struct nfs_cache_array *array;
 	unsigned int count = 0;
+	bool full = false;
 	int status;
 
 	scratch = alloc_page(GFP_KERNEL);
@@ -595,18 +651,36 @@ int nfs_readdir_page_filler(nfs_readdir_descriptor_t *desc, struct nfs_entry *en
 			nfs_prime_dcache(file_dentry(desc->file), entry,
 					desc->dir_verifier);
 
-		status = nfs_readdir_add_to_array(entry, page);
+		status = nfs_readdir_add_to_array(entry, fill);
+		if (status == -ENOSPC && mapping != NULL) {
+			struct page *next;
+
+			full = true;
+			next = nfs_readdir_page_get_next(mapping,
+					fill->index + 1,
+					nfs_readdir_page_last_cookie(fill));
+			if (next == NULL)
+				break;
+			if (fill != page)
+				nfs_readdir_page_put_next(fill);
+			fill = next;
+			status = nfs_readdir_add_to_array(entry, fill);
+		}
 		if (status != 0)
 			break;
 	} while (!entry->eof);
 
 out_nopages:
 	if (count == 0 || (status == -EBADCOOKIE && entry->eof != 0)) {
-		array = kmap(page);
+		array = kmap(fill);
 		array->eof_index = array->size;
 		status = 0;
-		kunmap(page);
+		kunmap(fill);
 	}
+	if (fill != page)
+		nfs_readdir_page_put_next(fill);
+	if (full && status == 0)
+		status = -ENOSPC;
 
 	put_page(scratch);
 	return status;
@@ -645,12 +719,13 @@ int nfs_readdir_alloc_pages(struct page **pages, unsigned int npages)
 static
 int nfs_readdir_xdr_to_array(nfs_readdir_descriptor_t *desc, struct page *page, struct inode *inode)
 {
-	struct page *pages[NFS_MAX_READDIR_PAGES];
+	struct page **pages;
 	struct nfs_entry entry;
 	struct file	*file = desc->file;
 	struct nfs_cache_array *array;
 	int status = -ENOMEM;
-	unsigned int array_size = ARRAY_SIZE(pages);
+	unsigned int array_size = DIV_ROUND_UP(NFS_SERVER(inode)->dtsize,
+					       PAGE_SIZE);
 
 	nfs_readdir_init_array(page);
 
@@ -671,9 +746,13 @@ int nfs_readdir_xdr_to_array(nfs_readdir_descriptor_t *desc, struct page *page,
 
 	array = kmap(page);
 
+	status = -ENOMEM;
+	pages = kcalloc(array_size, sizeof(*pages), GFP_KERNEL);
+	if (pages == NULL)
+		goto out_release_array;
 	status = nfs_readdir_alloc_pages(pages, array_size);
 	if (status < 0)
-		goto out_release_array;
+		goto out_free_array;
 	do {
 		unsigned int pglen;
 		status = nfs_readdir_xdr_filler(pages, desc, &entry, file, inode);
@@ -690,6 +769,8 @@ int nfs_readdir_xdr_to_array(nfs_readdir_descriptor_t *desc, struct page *page,
 	} while (array->eof_index < 0);
 
 	nfs_readdir_free_pages(pages, array_size);
+out_free_array:
+	kfree(pages);
 out_release_array:
 	kunmap(page);
 	nfs4_label_free(entry.label);
@@ -712,15 +793,19 @@ int nfs_readdir_filler(void *data, struct page* page)
 	struct inode	*inode = file_inode(desc->file);
 	int ret;
 
-	ret = nfs_readdir_xdr_to_array(desc, page, inode);
-	if (ret < 0)
-		goto error;
-	SetPageUptodate(page);
-
+	/*
+	 * Drop the pages that follow before filling this one, as the
+	 * filler may store the rest of the reply in them.
+	 */
 	if (invalidate_inode_pages2_range(inode->i_mapping, page->index + 1, -1) < 0) {
 		/* Should never happen */
 		nfs_zap_mapping(inode, inode->i_mapping);
 	}
+
+	ret = nfs_readdir_xdr_to_array(desc, page, inode);
+	if (ret < 0)
+		goto error;
+	SetPageUptodate(page);
 	unlock_page(page);
 	return 0;
  error:
@@ -915,6 +1000,18 @@ static int nfs_readdir(struct file *file, struct dir_context *ctx)
 	if (res < 0)
 		goto out;
 
+	/*
+	 * Carry on from the page the previous call stopped at, rather than
+	 * searching the page cache from the start of the directory again.
+	 */
+	if (*desc->dir_cookie != 0 &&
+	    *desc->dir_cookie == dir_ctx->page_dir_cookie) {
+		desc->page_index = dir_ctx->page_index;
+		desc->last_cookie = dir_ctx->page_last_cookie;
+		desc->current_index = dir_ctx->page_current_index;
+		desc->prev_index = desc->current_index;
+	}
+
 	do {
 		res = readdir_search_pagecache(desc);
 
@@ -945,6 +1042,11 @@ static int nfs_readdir(struct file *file, struct dir_context *ctx)
 		cache_page_release(desc);
 		if (res < 0)
 			break;
+
+		dir_ctx->page_dir_cookie = *desc->dir_cookie;
+		dir_ctx->page_last_cookie = desc->last_cookie;
+		dir_ctx->page_current_index = desc->current_index;
+		dir_ctx->page_index = desc->page_index;
 	} while (!desc->eof);
 out:
 	if (res > 0)
@@ -57,10 +57,10 @@ static inline bool nfs_lookup_is_soft_revalidate(const struct dentry *dentry)
 #define NFS_UNSPEC_TIMEO	(UINT_MAX)
 
 /*
- * Maximum number of pages that readdir can use for creating
- * a vmapped array of pages.
+ * Maximum number of pages that readdir can use for the reply of
+ * a single READDIR call. dtsize is further limited to rsize.
  */
-#define NFS_MAX_READDIR_PAGES 8
+#define NFS_MAX_READDIR_PAGES (NFS_MAX_FILE_IO_SIZE >> PAGE_SHIFT)
 
 struct nfs_client_initdata {
 	unsigned long init_flags;
@@ -21,6 +21,8 @@
 #include "overlayfs.h"
 
 #define OVL_COPY_UP_CHUNK_SIZE (1 << 20)
+/* Offloaded copies only cost a request each, so use larger chunks */
+#define OVL_COPY_UP_OFFLOAD_CHUNK_SIZE (1 << 26)
 
 static int ovl_ccup_set(const char *buf, const struct kernel_param *param)
 {
@@ -140,6 +142,7 @@ static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
 	loff_t data_pos = -1;
 	loff_t hole_len;
 	bool skip_hole = false;
+	bool offload;
 	int error = 0;
 
 	if (len == 0)
@@ -161,13 +164,23 @@ static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
 		goto out;
 	/* Couldn't clone, so now we try to copy the data */
 
+	/*
+	 * Let the filesystem copy the data itself (e.g. server side copy)
+	 * if both layers are of the same type and it knows how to. As in
+	 * do_copy_file_range(), never hand it a file of another filesystem.
+	 */
+	offload = new_file->f_op->copy_file_range &&
+		  new_file->f_op->copy_file_range ==
+		  old_file->f_op->copy_file_range;
+
 	/* Check if lower fs supports seek operation */
 	if (old_file->f_mode & FMODE_LSEEK &&
 	    old_file->f_op->llseek)
 		skip_hole = true;
 
 	while (len) {
-		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
+		size_t this_len = offload ? OVL_COPY_UP_OFFLOAD_CHUNK_SIZE :
+					    OVL_COPY_UP_CHUNK_SIZE;
 		long bytes;
 
 		if (len < this_len)
@@ -208,6 +221,22 @@ static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
 			}
 		}
 
+		if (offload) {
+			bytes = new_file->f_op->copy_file_range(old_file,
+						old_pos, new_file, new_pos,
+						this_len, 0);
+			if (bytes > 0) {
+				old_pos += bytes;
+				new_pos += bytes;
+				len -= bytes;
+				continue;
+			}
+			/* Fall back to copying through the page cache */
+			offload = false;
+			if (this_len > OVL_COPY_UP_CHUNK_SIZE)
+				this_len = OVL_COPY_UP_CHUNK_SIZE;
+		}
+
 		bytes = do_splice_direct(old_file, &old_pos,
 					 new_file, &new_pos,
 					 this_len, SPLICE_F_MOVE);
@@ -265,7 +265,8 @@ static int ovl_instantiate(struct dentry *dentry, struct inode *inode,
 		.newinode = inode,
 	};
 
-	ovl_dir_modified(dentry->d_parent, false);
+	ovl_dir_entry_modified(dentry->d_parent, &dentry->d_name, newdentry,
+			       false);
 	ovl_dentry_set_upper_alias(dentry);
 	ovl_dentry_update_reval(dentry, newdentry,
 			DCACHE_OP_REVALIDATE | DCACHE_OP_WEAK_REVALIDATE);
@@ -779,7 +780,7 @@ static int ovl_remove_and_whiteout(struct dentry *dentry,
 	if (err)
 		goto out_d_drop;
 
-	ovl_dir_modified(dentry->d_parent, true);
+	ovl_dir_entry_modified(dentry->d_parent, &dentry->d_name, NULL, true);
 out_d_drop:
 	d_drop(dentry);
 out_dput_upper:
@@ -824,7 +825,11 @@ static int ovl_remove_upper(struct dentry *dentry, bool is_dir,
 		err = vfs_rmdir(dir, upper);
 	else
 		err = vfs_unlink(dir, upper, NULL);
-	ovl_dir_modified(dentry->d_parent, ovl_type_origin(dentry));
+	if (!err)
+		ovl_dir_entry_modified(dentry->d_parent, &dentry->d_name, NULL,
+				       ovl_type_origin(dentry));
+	else
+		ovl_dir_modified(dentry->d_parent, ovl_type_origin(dentry));
 
 	/*
 	 * Keeping this dentry hashed would mean having to release
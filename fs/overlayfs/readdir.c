@@ -31,10 +31,17 @@ struct ovl_cache_entry {
 struct ovl_dir_cache {
 	long refcount;
 	u64 version;
+	unsigned int nr_removed;
 	struct list_head entries;
 	struct rb_root root;
 };
 
+/*
+ * Number of entries removed in place by ovl_dir_cache_update(), and only
+ * skipped by ovl_iterate(), before the cache is rebuilt from the layers.
+ */
+#define OVL_DIR_CACHE_MAX_REMOVED	256
+
 struct ovl_readdir_data {
 	struct dir_context ctx;
 	struct dentry *dentry;
@@ -241,10 +248,12 @@ static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
-	if (!cache->refcount) {
-		if (ovl_dir_cache(d_inode(dentry)) == cache)
-			ovl_set_dir_cache(d_inode(dentry), NULL);
-
+	/*
+	 * The current cache of the directory outlives its last user: it is
+	 * kept up to date by ovl_dir_cache_update() and reused by the next
+	 * opendir, until it is invalidated or the inode is evicted.
+	 */
+	if (!cache->refcount && ovl_dir_cache(d_inode(dentry)) != cache) {
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
 	}
@@ -402,6 +411,71 @@ static void ovl_seek_cursor(struct ovl_dir_file *od, loff_t pos)
 	od->cursor = p;
 }
 
+/*
+ * Apply the creation of @name as @upper, or its removal if @upper is NULL,
+ * to the merged dir cache of @dir, so that changes made through the overlay
+ * do not force the whole directory to be read again from all layers.
+ *
+ * Open directories that share the cache keep their cursor: new entries are
+ * appended to the list and removed ones are only marked as whiteouts, which
+ * ovl_iterate() skips.
+ *
+ * Called with @dir locked. Returns false if the cache could not be updated
+ * and needs to be invalidated instead.
+ */
+bool ovl_dir_cache_update(struct dentry *dir, const struct qstr *name,
+			  struct dentry *upper)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache(d_inode(dir));
+	struct rb_node **newp, *parent = NULL;
+	struct ovl_cache_entry *p;
+
+	if (!cache || !OVL_TYPE_MERGE(ovl_path_type(dir)) ||
+	    cache->version != ovl_dentry_version_get(dir))
+		return false;
+
+	newp = &cache->root.rb_node;
+	if (ovl_cache_entry_find_link(name->name, name->len, &newp, &parent))
+		p = ovl_cache_entry_from_node(*newp);
+	else
+		p = NULL;
+
+	if (!upper) {
+		if (!p || p->is_whiteout)
+			return false;
+		p->is_whiteout = true;
+		return ++cache->nr_removed <= OVL_DIR_CACHE_MAX_REMOVED;
+	}
+
+	if (p) {
+		if (!p->is_whiteout)
+			return false;
+	} else {
+		size_t size = offsetof(struct ovl_cache_entry,
+				       name[name->len + 1]);
+
+		p = kmalloc(size, GFP_KERNEL);
+		if (!p)
+			return false;
+
+		memcpy(p->name, name->name, name->len);
+		p->name[name->len] = '\0';
+		p->len = name->len;
+		list_add_tail(&p->l_node, &cache->entries);
+		rb_link_node(&p->node, parent, newp);
+		rb_insert_color(&p->node, &cache->root);
+	}
+
+	p->type = IFTODT(d_inode(upper)->i_mode);
+	p->real_ino = d_inode(upper)->i_ino;
+	/* Defer setting d_ino to ovl_iterate() */
+	p->ino = 0;
+	p->is_upper = true;
+	p->is_whiteout = false;
+
+	return true;
+}
+
 static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
@@ -409,10 +483,12 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 
 	cache = ovl_dir_cache(d_inode(dentry));
 	if (cache && ovl_dentry_version_get(dentry) == cache->version) {
-		WARN_ON(!cache->refcount);
 		cache->refcount++;
 		return cache;
 	}
+	/* A stale cache still in use is freed by its last user */
+	if (cache && !cache->refcount)
+		ovl_dir_cache_free(d_inode(dentry));
 	ovl_set_dir_cache(d_inode(dentry), NULL);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
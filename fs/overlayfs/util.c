@@ -442,6 +442,21 @@ void ovl_dir_modified(struct dentry *dentry, bool impurity)
 	ovl_dentry_version_inc(dentry, impurity);
 }
 
+/*
+ * Like ovl_dir_modified(), for the creation of a single entry @name as
+ * @upper or its removal if @upper is NULL. Merge dir caches are updated in
+ * place rather than invalidated.
+ */
+void ovl_dir_entry_modified(struct dentry *dentry, const struct qstr *name,
+			    struct dentry *upper, bool impurity)
+{
+	/* Copy mtime/ctime */
+	ovl_copyattr(d_inode(ovl_dentry_upper(dentry)), d_inode(dentry));
+
+	if (!ovl_dir_cache_update(dentry, name, upper))
+		ovl_dentry_version_inc(dentry, impurity);
+}
+
 u64 ovl_dentry_version_get(struct dentry *dentry)
 {
 	struct inode *inode = d_inode(dentry);
@@ -106,17 +106,65 @@ void pipe_double_lock(struct pipe_inode_info *pipe1,
 	}
 }
 
+/**
+ * pipe_buf_charge_large - charge a high-order buffer to the ring slots
+ * @pipe:	the pipe that the buffer is added to
+ * @buf:	the buffer holding a compound page
+ *
+ * Description:
+ *	A high-order buffer in the pipe takes the slots of its extra pages
+ *	off ->max_usage, so that the pipe never holds more memory than
+ *	F_SETPIPE_SZ allowed and the user was accounted for. Must be called
+ *	with the pipe locked, and the caller must have checked that the
+ *	ring has room for all the pages.
+ */
+void pipe_buf_charge_large(struct pipe_inode_info *pipe,
+			   struct pipe_buffer *buf)
+{
+	unsigned int extra = compound_nr(buf->page) - 1;
+
+	pipe->max_usage -= extra;
+	pipe->large_slots += extra;
+	buf->flags |= PIPE_BUF_FLAG_LARGE;
+}
+
+/**
+ * pipe_buf_uncharge_large - give the slots of a high-order buffer back
+ * @pipe:	the pipe that the buffer belongs to
+ * @buf:	the buffer leaving the pipe
+ *
+ * Description:
+ *	Must be called, with the pipe locked, for a buffer that leaves
+ *	@pipe without being released through its ->release() hook, such as
+ *	a buffer that is moved to another pipe.
+ */
+void pipe_buf_uncharge_large(struct pipe_inode_info *pipe,
+			     struct pipe_buffer *buf)
+{
+	unsigned int extra;
+
+	if (!(buf->flags & PIPE_BUF_FLAG_LARGE))
+		return;
+
+	extra = compound_nr(buf->page) - 1;
+	pipe->max_usage += extra;
+	pipe->large_slots -= extra;
+	buf->flags &= ~PIPE_BUF_FLAG_LARGE;
+}
+
 static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
 	struct page *page = buf->page;
 
+	pipe_buf_uncharge_large(pipe, buf);
+
 	/*
 	 * If nobody else uses this page, and we don't already have a
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page && !PageCompound(page))
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -127,7 +175,8 @@ static bool anon_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) != 1)
+	/* Only single pages can be moved into a page cache */
+	if (page_count(page) != 1 || PageCompound(page))
 		return false;
 	memcg_kmem_uncharge_page(page, 0);
 	__SetPageLocked(page);
@@ -386,6 +435,34 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+/*
+ * Pipes enlarged to at least PIPE_LARGE_BUF_MIN_SIZE with F_SETPIPE_SZ back
+ * large writes with buffers of order PIPE_LARGE_BUF_ORDER, which cuts down
+ * on the per-page work of both sides and of the splice consumers.
+ */
+#define PIPE_LARGE_BUF_ORDER	4
+#define PIPE_LARGE_BUF_MIN_SIZE	(1024 * 1024)
+
+/*
+ * Returns the page order of the next buffer pipe_write() should allocate
+ * for @count bytes. Called with the pipe locked.
+ */
+static unsigned int pipe_write_order(struct pipe_inode_info *pipe,
+				     struct file *filp, size_t count)
+{
+	unsigned int order = pipe->buf_order;
+
+	if (!order || is_packetized(filp) || count < (PAGE_SIZE << order))
+		return 0;
+
+	/* The buffer must fit with all its pages charged to the ring */
+	if (pipe_occupancy(pipe->head, pipe->tail) + (1U << order) >
+	    pipe->max_usage)
+		return 0;
+
+	return order;
+}
+
 /* Done while waiting without holding the pipe lock - thus the READ_ONCE() */
 static inline bool pipe_writable(const struct pipe_inode_info *pipe)
 {
@@ -478,8 +555,24 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			unsigned int mask = pipe->ring_size - 1;
 			struct pipe_buffer *buf = &pipe->bufs[head & mask];
 			struct page *page = pipe->tmp_page;
+			unsigned int order;
 			int copied;
 
+			order = pipe_write_order(pipe, filp, iov_iter_count(from));
+			if (order) {
+				/*
+				 * No highmem: copy_page_from_iter() maps
+				 * compound pages as a whole.
+				 */
+				page = alloc_pages(GFP_USER | __GFP_ACCOUNT |
+						   __GFP_COMP | __GFP_NOWARN |
+						   __GFP_NORETRY, order);
+				if (!page) {
+					order = 0;
+					page = pipe->tmp_page;
+				}
+			}
+
 			if (!page) {
 				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
 				if (unlikely(!page)) {
@@ -499,6 +592,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			head = pipe->head;
 			if (pipe_full(head, pipe->tail, pipe->max_usage)) {
 				spin_unlock_irq(&pipe->rd_wait.lock);
+				if (order)
+					__free_pages(page, order);
 				continue;
 			}
 
@@ -515,10 +610,15 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			else
 				buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
-			pipe->tmp_page = NULL;
+			if (order)
+				pipe_buf_charge_large(pipe, buf);
+			else
+				pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, PAGE_SIZE << order,
+						     from);
+			if (unlikely(copied < (PAGE_SIZE << order) &&
+				     iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -1243,7 +1343,7 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 	head = pipe->head;
 	tail = pipe->tail;
 	n = pipe_occupancy(pipe->head, pipe->tail);
-	if (nr_slots < n)
+	if (nr_slots < n + pipe->large_slots)
 		return -EBUSY;
 
 	bufs = kcalloc(nr_slots, sizeof(*bufs),
@@ -1277,8 +1377,8 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
 	pipe->ring_size = nr_slots;
-	if (pipe->max_usage > nr_slots)
-		pipe->max_usage = nr_slots;
+	if (pipe->max_usage > nr_slots - pipe->large_slots)
+		pipe->max_usage = nr_slots - pipe->large_slots;
 	pipe->tail = tail;
 	pipe->head = head;
 
@@ -1287,6 +1387,12 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 	return 0;
 }
 
+/* The pipe size as set by F_SETPIPE_SZ, high-order buffers included */
+static inline long pipe_size(struct pipe_inode_info *pipe)
+{
+	return (long)(pipe->max_usage + pipe->large_slots) * PAGE_SIZE;
+}
+
 /*
  * Allocate a new array of pipe buffers and copy the info over. Returns the
  * pipe size if successful, or return -ERROR on error.
@@ -1315,13 +1421,13 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	 * Decreasing the pipe capacity is always permitted, even
 	 * if the user is currently over a limit.
 	 */
-	if (nr_slots > pipe->max_usage &&
+	if (nr_slots > pipe->nr_accounted &&
 			size > pipe_max_size && !capable(CAP_SYS_RESOURCE))
 		return -EPERM;
 
 	user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted, nr_slots);
 
-	if (nr_slots > pipe->max_usage &&
+	if (nr_slots > pipe->nr_accounted &&
 			(too_many_pipe_buffers_hard(user_bufs) ||
 			 too_many_pipe_buffers_soft(user_bufs)) &&
 			pipe_is_unprivileged_user()) {
@@ -1333,9 +1439,11 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	if (ret < 0)
 		goto out_revert_acct;
 
-	pipe->max_usage = nr_slots;
+	pipe->max_usage = nr_slots - pipe->large_slots;
 	pipe->nr_accounted = nr_slots;
-	return pipe->max_usage * PAGE_SIZE;
+	pipe->buf_order = size >= PIPE_LARGE_BUF_MIN_SIZE ?
+			  PIPE_LARGE_BUF_ORDER : 0;
+	return pipe_size(pipe);
 
 out_revert_acct:
 	(void) account_pipe_buffers(pipe->user, nr_slots, pipe->nr_accounted);
@@ -1376,7 +1484,7 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 		ret = pipe_set_size(pipe, arg);
 		break;
 	case F_GETPIPE_SZ:
-		ret = pipe->max_usage * PAGE_SIZE;
+		ret = pipe_size(pipe);
 		break;
 	default:
 		ret = -EINVAL;
@@ -20,6 +20,12 @@
 #include <linux/compat.h>
 #include <linux/mount.h>
 #include <linux/fs.h>
+#include <linux/cred.h>
+#include <linux/kthread.h>
+#include <linux/padata.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/sched/signal.h>
+#include <linux/sizes.h>
 #include "internal.h"
 
 #include <linux/uaccess.h>
@@ -1388,10 +1394,141 @@ ssize_t generic_copy_file_range(struct file *file_in, loff_t pos_in,
 }
 EXPORT_SYMBOL(generic_copy_file_range);
 
+/*
+ * COPY_FILE_PARALLEL copies are only worth the worker setup for large ranges,
+ * and each worker should move enough per call to amortise the internal pipe
+ * and page cache lookups done by do_splice_direct().
+ */
+#define COPY_FILE_PARALLEL_MIN_SIZE	SZ_64M
+#define COPY_FILE_PARALLEL_CHUNK_SIZE	SZ_8M
+#define COPY_FILE_PARALLEL_MAX_THREADS	16
+
+struct copy_file_parallel_job {
+	struct file		*file_in;
+	struct file		*file_out;
+	loff_t			pos_in;
+	loff_t			pos_out;
+	const struct cred	*cred;
+	struct mm_struct	*mm;
+	struct task_struct	*task;
+	spinlock_t		lock;
+	/* Lowest offset into the range at which a chunk came up short. */
+	size_t			short_at;
+	int			error;
+};
+
+static void copy_file_parallel_chunk(unsigned long start, unsigned long end,
+				     void *arg)
+{
+	struct copy_file_parallel_job *job = arg;
+	loff_t pos_in = job->pos_in + start;
+	loff_t pos_out = job->pos_out + start;
+	const struct cred *old_cred;
+	bool use_mm = false;
+	bool own_pipe;
+	long ret = 0;
+
+	/*
+	 * Helpers run from kworkers: borrow the caller's credentials for the
+	 * checks done on write, and its mm so that new page cache is charged
+	 * to the caller's memcg.  The caller waits for all chunks and holds
+	 * freeze protection on file_out meanwhile, so both stay valid.
+	 */
+	old_cred = override_creds(job->cred);
+	if ((current->flags & PF_KTHREAD) && job->mm) {
+		kthread_use_mm(job->mm);
+		use_mm = true;
+	}
+	own_pipe = !current->splice_pipe;
+
+	while (start < end) {
+		/* Nothing past an earlier short chunk can be reported. */
+		if (READ_ONCE(job->short_at) <= start)
+			break;
+		if (fatal_signal_pending(job->task)) {
+			ret = -EINTR;
+			break;
+		}
+		ret = do_splice_direct(job->file_in, &pos_in, job->file_out,
+				       &pos_out, end - start, 0);
+		if (ret <= 0)
+			break;
+		start += ret;
+	}
+
+	/*
+	 * do_splice_direct() caches its internal pipe in the task.  On a
+	 * kworker it would outlive the job, charged to the caller's user.
+	 */
+	if (own_pipe && (current->flags & PF_KTHREAD) && current->splice_pipe) {
+		free_pipe_info(current->splice_pipe);
+		current->splice_pipe = NULL;
+	}
+
+	if (use_mm)
+		kthread_unuse_mm(job->mm);
+	revert_creds(old_cred);
+
+	if (start < end) {
+		spin_lock(&job->lock);
+		if (start < job->short_at) {
+			job->short_at = start;
+			job->error = ret;
+		}
+		spin_unlock(&job->lock);
+	}
+}
+
+/*
+ * Copy @len bytes in chunks spread over padata helpers.  Like any other
+ * copy_file_range() implementation this may return a short count: it is the
+ * length of the leading part of the range that was copied in full, and data
+ * past it may or may not have been written.
+ */
+static ssize_t copy_file_range_parallel(struct file *file_in, loff_t pos_in,
+					struct file *file_out, loff_t pos_out,
+					size_t len)
+{
+	struct copy_file_parallel_job job = {
+		.file_in	= file_in,
+		.file_out	= file_out,
+		.pos_in		= pos_in,
+		.pos_out	= pos_out,
+		.cred		= current_cred(),
+		.mm		= current->mm,
+		.task		= current,
+		.lock		= __SPIN_LOCK_UNLOCKED(job.lock),
+	};
+	struct padata_mt_job mt_job = {
+		.thread_fn	= copy_file_parallel_chunk,
+		.fn_arg		= &job,
+		.start		= 0,
+		.align		= PAGE_SIZE,
+		.min_chunk	= COPY_FILE_PARALLEL_CHUNK_SIZE,
+		.max_threads	= min_t(int, num_online_cpus(),
+					COPY_FILE_PARALLEL_MAX_THREADS),
+	};
+
+	len = min_t(size_t, len, MAX_RW_COUNT);
+	job.short_at = len;
+	mt_job.size = len;
+
+	padata_do_multithreaded(&mt_job);
+
+	if (job.short_at)
+		return job.short_at;
+	return job.error;
+}
+
 static ssize_t do_copy_file_range(struct file *file_in, loff_t pos_in,
 				  struct file *file_out, loff_t pos_out,
 				  size_t len, unsigned int flags)
 {
+	bool parallel = flags & COPY_FILE_PARALLEL;
+
+	/* COPY_FILE_PARALLEL is handled here, pass the other flags on */
+	flags &= ~COPY_FILE_PARALLEL;
+
 	/*
 	 * Although we now allow filesystems to handle cross sb copy, passing
 	 * a file of the wrong filesystem type to filesystem driver can result
@@ -1406,6 +1543,11 @@ static ssize_t do_copy_file_range(struct file *file_in, loff_t pos_in,
 						       file_out, pos_out,
 						       len, flags);
 
+	if (IS_ENABLED(CONFIG_COPY_FILE_PARALLEL) && parallel &&
+	    len >= COPY_FILE_PARALLEL_MIN_SIZE)
+		return copy_file_range_parallel(file_in, pos_in, file_out,
+						pos_out, len);
+
 	return generic_copy_file_range(file_in, pos_in, file_out, pos_out, len,
 				       flags);
 }
@@ -1474,7 +1616,7 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 {
 	ssize_t ret;
 
-	if (flags != 0)
+	if (flags & ~COPY_FILE_VALID_FLAGS)
 		return -EINVAL;
 
 	ret = generic_copy_file_checks(file_in, pos_in, file_out, pos_out, &len,
@@ -32,6 +32,7 @@
 #include <linux/uio.h>
 #include <linux/security.h>
 #include <linux/gfp.h>
+#include <linux/highmem.h>
 #include <linux/socket.h>
 #include <linux/sched/signal.h>
 
@@ -49,6 +50,10 @@ static bool page_cache_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 	struct page *page = buf->page;
 	struct address_space *mapping;
 
+	/* Huge pages cannot be moved out of the page cache one by one */
+	if (PageCompound(page))
+		return false;
+
 	lock_page(page);
 
 	mapping = page_mapping(page);
@@ -1424,6 +1429,48 @@ static int opipe_prep(struct pipe_inode_info *pipe, unsigned int flags)
 	return ret;
 }
 
+/*
+ * Returns true if @opipe, whose next free slot is @o_head, has room to be
+ * charged for the whole high-order page of @ibuf.
+ */
+static bool opipe_fits_large(struct pipe_inode_info *opipe,
+			     unsigned int o_head,
+			     const struct pipe_buffer *ibuf)
+{
+	return pipe_occupancy(o_head, opipe->tail) + compound_nr(ibuf->page) <=
+	       opipe->max_usage;
+}
+
+/*
+ * Copies up to @len bytes from the start of the high-order buffer @ibuf into
+ * a new order-0 page for @obuf, for an output pipe that can't be charged for
+ * the whole page. Returns the number of bytes copied or -ENOMEM.
+ */
+static int splice_copy_large(struct pipe_buffer *ibuf,
+			     struct pipe_buffer *obuf, size_t len)
+{
+	struct page *page;
+	void *dst;
+
+	len = min3(len, (size_t)ibuf->len, (size_t)PAGE_SIZE);
+	page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+	if (!page)
+		return -ENOMEM;
+
+	/* high-order pipe pages are never highmem, see pipe_write() */
+	dst = kmap_atomic(page);
+	memcpy(dst, page_address(ibuf->page) + ibuf->offset, len);
+	kunmap_atomic(dst);
+
+	obuf->page = page;
+	obuf->ops = &default_pipe_buf_ops;
+	obuf->offset = 0;
+	obuf->len = len;
+	obuf->flags = 0;
+	obuf->private = 0;
+	return len;
+}
+
 /*
  * Splice contents of ipipe to opipe.
  */
@@ -1504,11 +1551,36 @@ static int splice_pipe_to_pipe(struct pipe_inode_info *ipipe,
 		ibuf = &ipipe->bufs[i_tail & i_mask];
 		obuf = &opipe->bufs[o_head & o_mask];
 
-		if (len >= ibuf->len) {
+		if ((ibuf->flags & PIPE_BUF_FLAG_LARGE) &&
+		    !opipe_fits_large(opipe, o_head, ibuf)) {
+			int n = splice_copy_large(ibuf, obuf, len);
+
+			if (n < 0) {
+				if (!ret)
+					ret = n;
+				break;
+			}
+			ibuf->offset += n;
+			ibuf->len -= n;
+			if (!ibuf->len) {
+				pipe_buf_release(ipipe, ibuf);
+				i_tail++;
+				ipipe->tail = i_tail;
+				input_wakeup = true;
+			}
+			o_len = n;
+			o_head++;
+			opipe->head = o_head;
+		} else if (len >= ibuf->len) {
 			/*
-			 * Simply move the whole buffer from ipipe to opipe
+			 * Simply move the whole buffer from ipipe to opipe,
+			 * along with the charge of a high-order page.
 			 */
 			*obuf = *ibuf;
+			if (ibuf->flags & PIPE_BUF_FLAG_LARGE) {
+				pipe_buf_uncharge_large(ipipe, ibuf);
+				pipe_buf_charge_large(opipe, obuf);
+			}
 			ibuf->ops = NULL;
 			i_tail++;
 			ipipe->tail = i_tail;
@@ -1535,6 +1607,10 @@ static int splice_pipe_to_pipe(struct pipe_inode_info *ipipe,
 			obuf->flags &= ~PIPE_BUF_FLAG_GIFT;
 			obuf->flags &= ~PIPE_BUF_FLAG_CAN_MERGE;
 
+			/* both pipes hold the high-order page now */
+			if (obuf->flags & PIPE_BUF_FLAG_LARGE)
+				pipe_buf_charge_large(opipe, obuf);
+
 			obuf->len = len;
 			ibuf->offset += len;
 			ibuf->len -= len;
@@ -1608,6 +1684,26 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 		ibuf = &ipipe->bufs[i_tail & i_mask];
 		obuf = &opipe->bufs[o_head & o_mask];
 
+		if ((ibuf->flags & PIPE_BUF_FLAG_LARGE) &&
+		    !opipe_fits_large(opipe, o_head, ibuf)) {
+			int n = splice_copy_large(ibuf, obuf, len);
+
+			if (n < 0) {
+				if (!ret)
+					ret = n;
+				break;
+			}
+			ret += n;
+			len -= n;
+			o_head++;
+			opipe->head = o_head;
+			/* the rest of @ibuf must come before the next one */
+			if (n < ibuf->len)
+				break;
+			i_tail++;
+			continue;
+		}
+
 		/*
 		 * Get a reference to this pipe buffer,
 		 * so we can copy the contents over.
@@ -1627,6 +1723,10 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 		obuf->flags &= ~PIPE_BUF_FLAG_GIFT;
 		obuf->flags &= ~PIPE_BUF_FLAG_CAN_MERGE;
 
+		/* both pipes hold the high-order page now */
+		if (obuf->flags & PIPE_BUF_FLAG_LARGE)
+			pipe_buf_charge_large(opipe, obuf);
+
 		if (obuf->len > len)
 			obuf->len = len;
 		ret += obuf->len;
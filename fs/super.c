@@ -162,6 +162,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	percpu_counter_destroy(&s->s_nr_dentry_negative);
 	kfree(s);
 }
 
@@ -238,6 +239,10 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 			goto fail;
 	}
 	init_waitqueue_head(&s->s_writers.wait_unfrozen);
+	if (percpu_counter_init(&s->s_nr_dentry_negative, 0, GFP_KERNEL))
+		goto fail;
+	INIT_WORK(&s->s_dentry_trim_work, dentry_negative_trim_work);
+	s->s_dentry_trim_next = jiffies;
 	s->s_bdi = &noop_backing_dev_info;
 	s->s_flags = flags;
 	if (s->s_user_ns != &init_user_ns)
@@ -334,6 +339,9 @@ void deactivate_locked_super(struct super_block *s)
 		unregister_shrinker(&s->s_shrink);
 		fs->kill_sb(s);
 
+		/* No dentries are left that could queue the trim again */
+		cancel_work_sync(&s->s_dentry_trim_work);
+
 		/*
 		 * Since list_lru_destroy() may sleep, we cannot call it from
 		 * put_super(), where we hold the sb_lock. Therefore we destroy
@@ -36,6 +36,7 @@ struct seq_operations;
 struct bpf_iter_aux_info;
 struct bpf_local_storage;
 struct bpf_local_storage_map;
+struct bpf_tramp_multi;
 
 extern struct idr btf_idr;
 extern spinlock_t btf_idr_lock;
@@ -83,6 +84,8 @@ struct bpf_map_ops {
 				int fd);
 	void (*map_fd_put_ptr)(void *ptr);
 	int (*map_gen_lookup)(struct bpf_map *map, struct bpf_insn *insn_buf);
+	int (*map_gen_lookup_const)(struct bpf_map *map, u32 key,
+				    struct bpf_insn *insn_buf);
 	u32 (*map_fd_sys_lookup_elem)(void *ptr);
 	void (*map_seq_show_elem)(struct bpf_map *map, void *key,
 				  struct seq_file *m);
@@ -153,6 +156,7 @@ struct bpf_map {
 	u32 max_entries;
 	u32 map_flags;
 	int spin_lock_off; /* >=0 valid offset, <0 error */
+	int timer_off; /* >=0 valid offset, <0 error */
 	u32 id;
 	int numa_node;
 	u32 btf_key_type_id;
@@ -163,7 +167,8 @@ struct bpf_map {
 	u32 btf_vmlinux_value_type_id;
 	bool bypass_spec_v1;
 	bool frozen; /* write-once; write-protected by freeze_mutex */
-	/* 22 bytes hole */
+	u64 map_extra; /* any per-map-type extra fields */
+	/* 6 bytes hole */
 
 	/* The 3rd and 4th cacheline with misc members to avoid false sharing
 	 * particularly with refcounting.
@@ -180,30 +185,53 @@ static inline bool map_value_has_spin_lock(const struct bpf_map *map)
 	return map->spin_lock_off >= 0;
 }
 
-static inline void check_and_init_map_lock(struct bpf_map *map, void *dst)
+static inline bool map_value_has_timer(const struct bpf_map *map)
 {
-	if (likely(!map_value_has_spin_lock(map)))
-		return;
-	*(struct bpf_spin_lock *)(dst + map->spin_lock_off) =
-		(struct bpf_spin_lock){};
+	return map->timer_off >= 0;
 }
 
-/* copy everything but bpf_spin_lock */
+static inline void check_and_init_map_value(struct bpf_map *map, void *dst)
+{
+	if (unlikely(map_value_has_spin_lock(map)))
+		*(struct bpf_spin_lock *)(dst + map->spin_lock_off) =
+			(struct bpf_spin_lock){};
+	if (unlikely(map_value_has_timer(map)))
+		*(struct bpf_timer *)(dst + map->timer_off) =
+			(struct bpf_timer){};
+}
+
+/* copy everything but bpf_spin_lock and bpf_timer */
 static inline void copy_map_value(struct bpf_map *map, void *dst, void *src)
 {
+	u32 s_off = 0, s_sz = 0, t_off = 0, t_sz = 0;
+
 	if (unlikely(map_value_has_spin_lock(map))) {
-		u32 off = map->spin_lock_off;
+		s_off = map->spin_lock_off;
+		s_sz = sizeof(struct bpf_spin_lock);
+	}
+	if (unlikely(map_value_has_timer(map))) {
+		t_off = map->timer_off;
+		t_sz = sizeof(struct bpf_timer);
+	}
 
-		memcpy(dst, src, off);
-		memcpy(dst + off + sizeof(struct bpf_spin_lock),
-		       src + off + sizeof(struct bpf_spin_lock),
-		       map->value_size - off - sizeof(struct bpf_spin_lock));
+	if (unlikely(s_sz || t_sz)) {
+		/* make [t_off, t_off + t_sz) the lower of the two holes */
+		if (s_off < t_off || !s_sz) {
+			swap(s_off, t_off);
+			swap(s_sz, t_sz);
+		}
+		memcpy(dst, src, t_off);
+		memcpy(dst + t_off + t_sz, src + t_off + t_sz,
+		       s_off - t_off - t_sz);
+		memcpy(dst + s_off + s_sz, src + s_off + s_sz,
+		       map->value_size - s_off - s_sz);
 	} else {
 		memcpy(dst, src, map->value_size);
 	}
 }
 void copy_map_value_locked(struct bpf_map *map, void *dst, void *src,
 			   bool lock_src);
+void bpf_timer_cancel_and_free(void *timer);
 int bpf_obj_name_cpy(char *dst, const char *src, unsigned int size);
 
 struct bpf_offload_dev;
@@ -294,6 +322,8 @@ enum bpf_arg_type {
 	ARG_CONST_ALLOC_SIZE_OR_ZERO,	/* number of allocated bytes requested */
 	ARG_PTR_TO_BTF_ID_SOCK_COMMON,	/* pointer to in-kernel sock_common or bpf-mirrored bpf_sock */
 	ARG_PTR_TO_PERCPU_BTF_ID,	/* pointer to in-kernel percpu type */
+	ARG_PTR_TO_FUNC,	/* pointer to a bpf program function */
+	ARG_PTR_TO_TIMER,	/* pointer to bpf_timer */
 	__BPF_ARG_TYPE_MAX,
 };
 
@@ -409,6 +439,8 @@ enum bpf_reg_type {
 	PTR_TO_RDWR_BUF,	 /* reg points to a read/write buffer */
 	PTR_TO_RDWR_BUF_OR_NULL, /* reg points to a read/write buffer or NULL */
 	PTR_TO_PERCPU_BTF_ID,	 /* reg points to a percpu kernel variable */
+	PTR_TO_FUNC,		 /* reg points to a bpf program function */
+	PTR_TO_MAP_KEY,		 /* reg points to a map element key */
 };
 
 /* The information passed from prog-specific *_is_valid_access
@@ -500,12 +532,36 @@ enum bpf_cgroup_storage_type {
  */
 #define MAX_BPF_FUNC_ARGS 12
 
+/* Programs attached to many functions see this many u64 arguments */
+#define MAX_BPF_MULTI_FUNC_ARGS 6
+
+/* Bucket i of the run time histogram counts runs that took [2^(i-1), 2^i)
+ * nanoseconds, bucket 0 counts runs shorter than 1ns and the last bucket
+ * everything longer.
+ */
+#define BPF_PROG_STATS_HIST_BUCKETS	32
+
 struct bpf_prog_stats {
 	u64 cnt;
 	u64 nsecs;
+	/* sampled statistics, see bpf_prog_sample_record() */
+	u64 sampled_cnt;
+	u64 sampled_nsecs;
+	u64 samples;
+	u32 sample_countdown;
+	u32 sample_weight;
+	u32 hist[BPF_PROG_STATS_HIST_BUCKETS];
 	struct u64_stats_sync syncp;
 } __aligned(2 * sizeof(u64));
 
+/* Sampled run time statistics of a program, summed over all CPUs */
+struct bpf_prog_sampled_stats {
+	u64 cnt;	/* runs accounted for by the samples */
+	u64 samples;	/* runs actually timed */
+	u64 nsecs;	/* total run time of the timed runs */
+	u64 hist[BPF_PROG_STATS_HIST_BUCKETS];
+};
+
 struct btf_func_model {
 	u8 ret_size;
 	u8 nr_args;
@@ -525,6 +581,14 @@ struct btf_func_model {
  * programs only. Should not be used with normal calls and indirect calls.
  */
 #define BPF_TRAMP_F_SKIP_FRAME		BIT(2)
+/* Store the address of the traced function at ctx - 8, where
+ * bpf_get_func_ip() reads it from.
+ */
+#define BPF_TRAMP_F_IP_ARG		BIT(3)
+/* The trampoline is shared by many functions: take the function to call
+ * from the return address of the trampoline call instead of orig_call.
+ */
+#define BPF_TRAMP_F_ORIG_STACK		BIT(4)
 
 /* Each call __bpf_prog_enter + call bpf_func + call __bpf_prog_exit is ~50
  * bytes on x86.  Pick a number to fit into BPF_IMAGE_SIZE / 2
@@ -555,6 +619,14 @@ struct bpf_tramp_progs {
  *      orig_call = original callback addr or direct function addr
  *      fentry = a set of program to run before calling original function
  *      fexit = a set of program to run after original function
+ *
+ * 4. replace nops at the entry of many functions with a call to one
+ *    trampoline that runs a single program with MAX_BPF_MULTI_FUNC_ARGS
+ *    u64 arguments
+ *    fentry: flags = BPF_TRAMP_F_IP_ARG | BPF_TRAMP_F_RESTORE_REGS
+ *    fexit: flags = BPF_TRAMP_F_IP_ARG | BPF_TRAMP_F_CALL_ORIG |
+ *                   BPF_TRAMP_F_SKIP_FRAME | BPF_TRAMP_F_ORIG_STACK
+ *    orig_call = NULL
  */
 int arch_prepare_bpf_trampoline(void *image, void *image_end,
 				const struct btf_func_model *m, u32 flags,
@@ -649,6 +721,10 @@ int bpf_trampoline_unlink_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 struct bpf_trampoline *bpf_trampoline_get(u64 key,
 					  struct bpf_attach_target_info *tgt_info);
 void bpf_trampoline_put(struct bpf_trampoline *tr);
+struct bpf_tramp_multi *bpf_trampoline_multi_attach(struct bpf_prog *prog,
+						    unsigned long *ips,
+						    u32 cnt);
+void bpf_trampoline_multi_detach(struct bpf_tramp_multi *mtr);
 #define BPF_DISPATCHER_INIT(_name) {				\
 	.mutex = __MUTEX_INITIALIZER(_name.mutex),		\
 	.func = &_name##_func,					\
@@ -708,6 +784,12 @@ static inline struct bpf_trampoline *bpf_trampoline_get(u64 key,
 	return ERR_PTR(-EOPNOTSUPP);
 }
 static inline void bpf_trampoline_put(struct bpf_trampoline *tr) {}
+static inline struct bpf_tramp_multi *
+bpf_trampoline_multi_attach(struct bpf_prog *prog, unsigned long *ips, u32 cnt)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+static inline void bpf_trampoline_multi_detach(struct bpf_tramp_multi *mtr) {}
 #define DEFINE_BPF_DISPATCHER(name)
 #define DECLARE_BPF_DISPATCHER(name)
 #define BPF_DISPATCHER_FUNC(name) bpf_dispatcher_nop_func
@@ -779,6 +861,7 @@ struct bpf_prog_aux {
 	bool attach_btf_trace; /* true if attaching to BTF-enabled raw tp */
 	bool func_proto_unreliable;
 	bool sleepable;
+	bool multi_func; /* attached to many functions, see BPF_F_MULTI_FUNC */
 	bool tail_call_reachable;
 	enum bpf_tramp_prog_type trampoline_prog_type;
 	struct hlist_node tramp_hlist;
@@ -1236,6 +1319,8 @@ int  generic_map_delete_batch(struct bpf_map *map,
 			      union bpf_attr __user *uattr);
 struct bpf_map *bpf_map_get_curr_or_next(u32 *id);
 struct bpf_prog *bpf_prog_get_curr_or_next(u32 *id);
+void bpf_prog_get_sampled_stats(const struct bpf_prog *prog,
+				struct bpf_prog_sampled_stats *stats);
 
 extern int sysctl_unprivileged_bpf_disabled;
 
@@ -1813,6 +1898,10 @@ extern const struct bpf_func_proto bpf_sk_redirect_hash_proto;
 extern const struct bpf_func_proto bpf_sk_redirect_map_proto;
 extern const struct bpf_func_proto bpf_spin_lock_proto;
 extern const struct bpf_func_proto bpf_spin_unlock_proto;
+extern const struct bpf_func_proto bpf_timer_init_proto;
+extern const struct bpf_func_proto bpf_timer_set_callback_proto;
+extern const struct bpf_func_proto bpf_timer_start_proto;
+extern const struct bpf_func_proto bpf_timer_cancel_proto;
 extern const struct bpf_func_proto bpf_get_local_storage_proto;
 extern const struct bpf_func_proto bpf_strtol_proto;
 extern const struct bpf_func_proto bpf_strtoul_proto;
@@ -1825,6 +1914,7 @@ extern const struct bpf_func_proto bpf_ringbuf_reserve_proto;
 extern const struct bpf_func_proto bpf_ringbuf_submit_proto;
 extern const struct bpf_func_proto bpf_ringbuf_discard_proto;
 extern const struct bpf_func_proto bpf_ringbuf_query_proto;
+extern const struct bpf_func_proto bpf_ringbuf_output_batch_proto;
 extern const struct bpf_func_proto bpf_skc_to_tcp6_sock_proto;
 extern const struct bpf_func_proto bpf_skc_to_tcp_sock_proto;
 extern const struct bpf_func_proto bpf_skc_to_tcp_timewait_sock_proto;
@@ -56,6 +56,8 @@ struct bpf_reg_state {
 
 		u32 mem_size; /* for PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
 
+		u32 subprogno; /* for PTR_TO_FUNC */
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -191,6 +193,12 @@ struct bpf_func_state {
 	 * zero == main subprog
 	 */
 	u32 subprogno;
+	/* number of nested entries into async callbacks on this path,
+	 * used to tell the re-entry of a callback that arms its own timer
+	 * apart from an infinite loop inside the callback
+	 */
+	u32 async_entry_cnt;
+	bool in_async_callback_fn;
 
 	/* The following fields should be last. See copy_func_state() */
 	int acquired_refs;
@@ -298,6 +306,10 @@ struct bpf_verifier_state_list {
 #define BPF_ALU_SANITIZE		(BPF_ALU_SANITIZE_SRC | \
 					 BPF_ALU_SANITIZE_DST)
 
+/* Possible states for rdonly_state member. */
+#define BPF_RDONLY_VAL_SEEN		1U
+#define BPF_RDONLY_VAL_POISON		2U
+
 struct bpf_insn_aux_data {
 	union {
 		enum bpf_reg_type ptr_type;	/* pointer type for load/store insns */
@@ -317,11 +329,13 @@ struct bpf_insn_aux_data {
 		} btf_var;
 	};
 	u64 map_key_state; /* constant (32 bit) key tracking for maps */
+	u64 rdonly_val; /* constant loaded from a frozen read-only map */
 	int ctx_field_size; /* the ctx field size for load insn, maybe 0 */
 	int sanitize_stack_off; /* stack slot to be cleared */
 	u32 seen; /* this insn was processed by the verifier at env->pass_cnt */
 	bool zext_dst; /* this insn zero extends dst reg */
 	u8 alu_state; /* used in combination with alu_limit */
+	u8 rdonly_state; /* used in combination with rdonly_val */
 
 	/* below fields are initialized once */
 	unsigned int orig_idx; /* original instruction index */
@@ -369,6 +383,7 @@ struct bpf_subprog_info {
 	bool has_tail_call;
 	bool tail_call_reachable;
 	bool has_ld_abs;
+	bool is_async_cb; /* called asynchronously, e.g. on timer expiry */
 };
 
 /* single container for all structs
@@ -179,6 +179,28 @@ static inline bool insn_is_zext(const struct bpf_insn *insn)
 	return insn->code == (BPF_ALU | BPF_MOV | BPF_X) && insn->imm == 1;
 }
 
+/* Special form of mov64, used by the verifier to resolve the address of the
+ * current CPU's copy of a per-CPU variable: dst = this_cpu_ptr(src). It is
+ * never accepted from user space and only emitted for JITs which support
+ * it, see bpf_jit_supports_percpu_insn(). The interpreter doesn't handle it,
+ * programs containing it are rejected if the JIT fails.
+ */
+#define BPF_ADDR_PERCPU	(-1)
+
+#define BPF_MOV64_PERCPU_REG(DST, SRC)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_MOV | BPF_X,		\
+		.dst_reg = DST,					\
+		.src_reg = SRC,					\
+		.off   = BPF_ADDR_PERCPU,			\
+		.imm   = 0 })
+
+static inline bool insn_is_mov_percpu_addr(const struct bpf_insn *insn)
+{
+	return insn->code == (BPF_ALU64 | BPF_MOV | BPF_X) &&
+	       insn->off == BPF_ADDR_PERCPU;
+}
+
 /* BPF_LD_IMM64 macro encodes single 'load 64-bit immediate' insn */
 #define BPF_LD_IMM64(DST, IMM)					\
 	BPF_LD_IMM64_RAW(DST, 0, IMM)
@@ -534,7 +556,8 @@ struct bpf_prog {
 				kprobe_override:1, /* Do we override a kprobe? */
 				has_callchain_buf:1, /* callchain buffer allocated? */
 				enforce_expected_attach_type:1, /* Enforce expected_attach_type checking at attach time */
-				call_get_stack:1; /* Do we call bpf_get_stack() or bpf_get_stackid() */
+				call_get_stack:1, /* Do we call bpf_get_stack() or bpf_get_stackid() */
+				call_get_func_ip:1; /* Do we call bpf_get_func_ip() */
 	enum bpf_prog_type	type;		/* Type of BPF program */
 	enum bpf_attach_type	expected_attach_type; /* For some prog types */
 	u32			len;		/* Number of filter blocks */
@@ -556,6 +579,17 @@ struct sk_filter {
 };
 
 DECLARE_STATIC_KEY_FALSE(bpf_stats_enabled_key);
+DECLARE_STATIC_KEY_FALSE(bpf_stats_sampled_key);
+
+extern int sysctl_bpf_stats_sample_period;
+
+void bpf_prog_sample_record(const struct bpf_prog *prog, u64 nsecs);
+
+/* Only time one in sysctl_bpf_stats_sample_period runs on each CPU. The
+ * countdown wraps when a sample is due, bpf_prog_sample_record() resets it.
+ */
+#define bpf_prog_sample_due(prog)					\
+	(this_cpu_ptr((prog)->aux->stats)->sample_countdown-- == 0)
 
 #define __BPF_PROG_RUN(prog, ctx, dfunc)	({			\
 	u32 __ret;							\
@@ -569,6 +603,11 @@ DECLARE_STATIC_KEY_FALSE(bpf_stats_enabled_key);
 		__stats->cnt++;						\
 		__stats->nsecs += sched_clock() - __start;		\
 		u64_stats_update_end(&__stats->syncp);			\
+	} else if (static_branch_unlikely(&bpf_stats_sampled_key) &&	\
+		   bpf_prog_sample_due(prog)) {				\
+		u64 __start = sched_clock();				\
+		__ret = dfunc(ctx, (prog)->insnsi, (prog)->bpf_func);	\
+		bpf_prog_sample_record(prog, sched_clock() - __start);	\
 	} else {							\
 		__ret = dfunc(ctx, (prog)->insnsi, (prog)->bpf_func);	\
 	}								\
@@ -891,6 +930,7 @@ u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
 struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog);
 void bpf_jit_compile(struct bpf_prog *prog);
 bool bpf_jit_needs_zext(void);
+bool bpf_jit_supports_percpu_insn(void);
 bool bpf_helper_changes_pkt_data(void *func);
 
 static inline bool bpf_dump_raw_ok(const struct cred *cred)
@@ -31,6 +31,7 @@
 #include <linux/uidgid.h>
 #include <linux/lockdep.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
 #include <linux/delayed_call.h>
 #include <linux/uuid.h>
@@ -1534,6 +1535,15 @@ struct super_block {
 	struct rcu_head		rcu;
 	struct work_struct	destroy_work;
 
+	/*
+	 * Negative dentries on s_dentry_lru, and the work that trims them
+	 * once there are more than sysctl_negative_dentry_limit. The work
+	 * is not queued again before s_dentry_trim_next (in jiffies).
+	 */
+	struct percpu_counter	s_nr_dentry_negative;
+	struct work_struct	s_dentry_trim_work;
+	unsigned long		s_dentry_trim_next;
+
 	struct mutex		s_sync_lock;	/* sync serialisation lock */
 
 	/*
@@ -24,6 +24,9 @@ struct task_struct;
  *	mapped on a file (reference on the underlying inode)
  *  10 : Shared futex (PTHREAD_PROCESS_SHARED)
  *       (but private mapping on an mm, and reference taken on it)
+ *
+ * node is the hash table node of a FUTEX_NUMA_FLAG futex, FUTEX_NO_NODE
+ * otherwise.  It is derived from the futex and not part of the match.
 */
 
 #define FUT_OFF_INODE    1 /* We set bit 0 if key has a reference on inode */
@@ -34,6 +37,7 @@ union futex_key {
 		u64 i_seq;
 		unsigned long pgoff;
 		unsigned int offset;
+		int node;
 	} shared;
 	struct {
 		union {
@@ -42,15 +46,18 @@ union futex_key {
 		};
 		unsigned long address;
 		unsigned int offset;
+		int node;
 	} private;
 	struct {
 		u64 ptr;
 		unsigned long word;
 		unsigned int offset;
+		int node;
 	} both;
 };
 
-#define FUTEX_KEY_INIT (union futex_key) { .both = { .ptr = 0ULL } }
+#define FUTEX_KEY_INIT (union futex_key) \
+	{ .both = { .ptr = 0ULL, .node = FUTEX_NO_NODE } }
 
 #ifdef CONFIG_FUTEX
 enum {
@@ -75,6 +82,11 @@ void futex_exit_recursive(struct task_struct *tsk);
 void futex_exit_release(struct task_struct *tsk);
 void futex_exec_release(struct task_struct *tsk);
 
+void futex_mm_init(struct mm_struct *mm);
+void futex_hash_free(struct mm_struct *mm);
+void futex_hash_grow(struct mm_struct *mm);
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
+
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	      u32 __user *uaddr2, u32 val2, u32 val3);
 #else
@@ -82,6 +94,13 @@ static inline void futex_init_task(struct task_struct *tsk) { }
 static inline void futex_exit_recursive(struct task_struct *tsk) { }
 static inline void futex_exit_release(struct task_struct *tsk) { }
 static inline void futex_exec_release(struct task_struct *tsk) { }
+static inline void futex_mm_init(struct mm_struct *mm) { }
+static inline void futex_hash_free(struct mm_struct *mm) { }
+static inline void futex_hash_grow(struct mm_struct *mm) { }
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
 static inline long do_futex(u32 __user *uaddr, int op, u32 val,
 			    ktime_t *timeout, u32 __user *uaddr2,
 			    u32 val2, u32 val3)
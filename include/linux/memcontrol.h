@@ -76,8 +76,14 @@ enum mem_cgroup_events_target {
 };
 
 struct memcg_vmstats_percpu {
+	/* Local (CPU and cgroup) page state & events */
 	long stat[MEMCG_NR_STAT];
 	unsigned long events[NR_VM_EVENT_ITEMS];
+
+	/* Values at the last flush, see mem_cgroup_css_rstat_flush() */
+	long stat_prev[MEMCG_NR_STAT];
+	unsigned long events_prev[NR_VM_EVENT_ITEMS];
+
 	unsigned long nr_page_events;
 	unsigned long targets[MEM_CGROUP_NTARGETS];
 };
@@ -107,12 +113,16 @@ struct memcg_shrinker_map {
 struct mem_cgroup_per_node {
 	struct lruvec		lruvec;
 
-	/* Legacy local VM stats */
+	/* Local (CPU and cgroup) VM stats */
 	struct lruvec_stat __percpu *lruvec_stat_local;
 
-	/* Subtree VM stats (batched updates) */
-	struct lruvec_stat __percpu *lruvec_stat_cpu;
+	/* lruvec_stat_local at the last flush */
+	struct lruvec_stat __percpu *lruvec_stat_prev;
+
+	/* Subtree VM stats as of the last flush */
 	atomic_long_t		lruvec_stat[NR_VM_NODE_STAT_ITEMS];
+	/* Flushed changes of the children, not yet in lruvec_stat */
+	long			lruvec_stat_pending[NR_VM_NODE_STAT_ITEMS];
 
 	unsigned long		lru_zone_size[MAX_NR_ZONES][NR_LRU_LISTS];
 
@@ -282,8 +292,12 @@ struct mem_cgroup {
 
 	MEMCG_PADDING(_pad1_);
 
+	/* Subtree VM stats and events as of the last flush */
 	atomic_long_t		vmstats[MEMCG_NR_STAT];
 	atomic_long_t		vmevents[NR_VM_EVENT_ITEMS];
+	/* Flushed changes of the children, not yet in vmstats and vmevents */
+	long			vmstats_pending[MEMCG_NR_STAT];
+	unsigned long		vmevents_pending[NR_VM_EVENT_ITEMS];
 
 	/* memory.events */
 	atomic_long_t		memory_events[MEMCG_NR_MEMORY_EVENTS];
@@ -311,10 +325,7 @@ struct mem_cgroup {
 	atomic_t		moving_account;
 	struct task_struct	*move_lock_task;
 
-	/* Legacy local VM stats and events */
-	struct memcg_vmstats_percpu __percpu *vmstats_local;
-
-	/* Subtree VM stats and events (batched updates) */
+	/* Local VM stats and events, flushed into the subtree ones by rstat */
 	struct memcg_vmstats_percpu __percpu *vmstats_percpu;
 
 #ifdef CONFIG_CGROUP_WRITEBACK
@@ -679,7 +690,7 @@ void unlock_page_memcg(struct page *page);
 
 /*
  * idx can be of type enum memcg_stat_item or node_stat_item.
- * Keep in sync with memcg_exact_page_state().
+ * The subtree counts are updated lazily, see mem_cgroup_flush_stats().
  */
 static inline unsigned long memcg_page_state(struct mem_cgroup *memcg, int idx)
 {
@@ -691,10 +702,7 @@ static inline unsigned long memcg_page_state(struct mem_cgroup *memcg, int idx)
 	return x;
 }
 
-/*
- * idx can be of type enum memcg_stat_item or node_stat_item.
- * Keep in sync with memcg_exact_page_state().
- */
+/* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline unsigned long memcg_page_state_local(struct mem_cgroup *memcg,
 						   int idx)
 {
@@ -702,7 +710,7 @@ static inline unsigned long memcg_page_state_local(struct mem_cgroup *memcg,
 	int cpu;
 
 	for_each_possible_cpu(cpu)
-		x += per_cpu(memcg->vmstats_local->stat[idx], cpu);
+		x += per_cpu(memcg->vmstats_percpu->stat[idx], cpu);
 #ifdef CONFIG_SMP
 	if (x < 0)
 		x = 0;
@@ -792,6 +800,8 @@ static inline unsigned long lruvec_page_state_local(struct lruvec *lruvec,
 	return x;
 }
 
+void mem_cgroup_flush_stats(void);
+
 void __mod_memcg_lruvec_state(struct lruvec *lruvec, enum node_stat_item idx,
 			      int val);
 void __mod_lruvec_state(struct lruvec *lruvec, enum node_stat_item idx,
@@ -1210,6 +1220,10 @@ static inline unsigned long lruvec_page_state_local(struct lruvec *lruvec,
 	return node_page_state(lruvec_pgdat(lruvec), idx);
 }
 
+static inline void mem_cgroup_flush_stats(void)
+{
+}
+
 static inline void __mod_memcg_lruvec_state(struct lruvec *lruvec,
 					    enum node_stat_item idx, int val)
 {
@@ -9,6 +9,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/mutex.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -386,6 +387,7 @@ struct core_state {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct {
 		struct vm_area_struct *mmap;		/* list of VMAs */
@@ -563,6 +565,16 @@ struct mm_struct {
 
 #ifdef CONFIG_IOMMU_SUPPORT
 		u32 pasid;
+#endif
+#ifdef CONFIG_FUTEX
+		/*
+		 * Optional private futex hash, see PR_FUTEX_HASH.  The
+		 * sequence count is odd while a resize is moving waiters.
+		 */
+		struct mutex futex_hash_lock;
+		struct futex_private_hash __rcu *futex_phash;
+		unsigned int futex_hash_seq;
+		bool futex_hash_auto;
 #endif
 	} __randomize_layout;
 
@@ -92,6 +92,11 @@ struct nfs_open_dir_context {
 	unsigned long attr_gencount;
 	__u64 dir_cookie;
 	__u64 dup_cookie;
+	/* Page cache page that dir_cookie was last found on */
+	__u64 page_dir_cookie;
+	__u64 page_last_cookie;
+	loff_t page_current_index;
+	unsigned long page_index;
 	signed char duped;
 };
 
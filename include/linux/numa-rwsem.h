@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_NUMA_RWSEM_H
+#define _LINUX_NUMA_RWSEM_H
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/rcuwait.h>
+#include <linux/topology.h>
+#include <linux/wait.h>
+#include <linux/lockdep.h>
+
+/*
+ * A reader-writer semaphore whose readers only touch a per NUMA node
+ * counter, so read acquisitions from different nodes never share a cache
+ * line. Unlike percpu_rw_semaphore there is no RCU grace period on the
+ * write side: readers pay one barrier instead, and a writer only has to
+ * sum nr_node_ids counters. Meant for hot, read-mostly locks.
+ */
+struct numa_rwsem_node {
+	atomic_long_t		read_count;
+} ____cacheline_aligned_in_smp;
+
+struct numa_rw_semaphore {
+	struct numa_rwsem_node	*nodes;
+	struct rcuwait		writer;
+	wait_queue_head_t	waiters;
+	atomic_t		block;
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+	struct lockdep_map	dep_map;
+#endif
+};
+
+extern bool __numa_down_read(struct numa_rw_semaphore *, bool);
+
+static inline atomic_long_t *
+numa_rwsem_read_count(struct numa_rw_semaphore *sem)
+{
+	/*
+	 * Readers may migrate between lock and unlock; only the sum of the
+	 * counters of all nodes is meaningful.
+	 */
+	return &sem->nodes[numa_node_id()].read_count;
+}
+
+static inline bool __numa_down_read_trylock(struct numa_rw_semaphore *sem)
+{
+	atomic_long_t *read_count = numa_rwsem_read_count(sem);
+
+	atomic_long_inc(read_count);
+
+	/*
+	 * If the reader misses the writer's assignment of sem->block, then
+	 * the writer is guaranteed to see the reader's increment.
+	 */
+	smp_mb__after_atomic(); /* A matches D */
+
+	/*
+	 * If !sem->block the critical section starts here, matched by the
+	 * release in numa_up_write().
+	 */
+	if (likely(!atomic_read_acquire(&sem->block)))
+		return true;
+
+	atomic_long_dec(read_count);
+
+	/* Prod writer to re-evaluate readers_active_check() */
+	rcuwait_wake_up(&sem->writer);
+
+	return false;
+}
+
+static inline void numa_down_read(struct numa_rw_semaphore *sem)
+{
+	might_sleep();
+
+	rwsem_acquire_read(&sem->dep_map, 0, 0, _RET_IP_);
+
+	if (unlikely(!__numa_down_read_trylock(sem)))
+		__numa_down_read(sem, false);
+}
+
+static inline bool numa_down_read_trylock(struct numa_rw_semaphore *sem)
+{
+	bool ret = __numa_down_read_trylock(sem);
+
+	if (ret)
+		rwsem_acquire_read(&sem->dep_map, 0, 1, _RET_IP_);
+
+	return ret;
+}
+
+static inline void numa_up_read(struct numa_rw_semaphore *sem)
+{
+	rwsem_release(&sem->dep_map, _RET_IP_);
+
+	/*
+	 * If the writer sees our decrement (presumably to aggregate zero,
+	 * as that is the only time it matters) it also sees our critical
+	 * section.
+	 */
+	smp_mb__before_atomic(); /* B matches C */
+	atomic_long_dec(numa_rwsem_read_count(sem));
+
+	/*
+	 * Either the writer sees the decrement, or we see its sem->block
+	 * and wake it up to look again.
+	 */
+	smp_mb__after_atomic(); /* E matches D */
+	if (unlikely(atomic_read(&sem->block)))
+		rcuwait_wake_up(&sem->writer);
+}
+
+extern void numa_down_write(struct numa_rw_semaphore *);
+extern void numa_up_write(struct numa_rw_semaphore *);
+
+extern int __numa_init_rwsem(struct numa_rw_semaphore *,
+			     const char *, struct lock_class_key *);
+
+extern void numa_free_rwsem(struct numa_rw_semaphore *);
+
+extern bool numa_rwsem_is_locked(struct numa_rw_semaphore *);
+
+#define numa_init_rwsem(sem)					\
+({								\
+	static struct lock_class_key rwsem_key;			\
+	__numa_init_rwsem(sem, #sem, &rwsem_key);		\
+})
+
+#define numa_rwsem_is_held(sem)		lockdep_is_held(sem)
+#define numa_rwsem_assert_held(sem)	lockdep_assert_held(sem)
+
+#endif
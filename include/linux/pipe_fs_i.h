@@ -13,6 +13,7 @@
 #ifdef CONFIG_WATCH_QUEUE
 #define PIPE_BUF_FLAG_LOSS	0x40	/* Message loss happened after this buffer */
 #endif
+#define PIPE_BUF_FLAG_LARGE	0x80	/* high-order page charged to the ring slots */
 
 /**
  *	struct pipe_buffer - a linux kernel pipe buffer
@@ -42,6 +43,8 @@ struct pipe_buffer {
  *	@max_usage: The maximum number of slots that may be used in the ring
  *	@ring_size: total number of buffers (should be a power of 2)
  *	@nr_accounted: The amount this pipe accounts for in user->pipe_bufs
+ *	@large_slots: Slots taken off @max_usage by high-order buffers in the ring
+ *	@buf_order: Page order of the buffers write() allocates, 0 for single pages
  *	@tmp_page: cached released page
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
@@ -65,6 +68,8 @@ struct pipe_inode_info {
 	bool note_loss;
 #endif
 	unsigned int nr_accounted;
+	unsigned int large_slots;
+	unsigned int buf_order;
 	unsigned int readers;
 	unsigned int writers;
 	unsigned int files;
@@ -251,6 +256,8 @@ void free_pipe_info(struct pipe_inode_info *);
 bool generic_pipe_buf_get(struct pipe_inode_info *, struct pipe_buffer *);
 bool generic_pipe_buf_try_steal(struct pipe_inode_info *, struct pipe_buffer *);
 void generic_pipe_buf_release(struct pipe_inode_info *, struct pipe_buffer *);
+void pipe_buf_charge_large(struct pipe_inode_info *, struct pipe_buffer *);
+void pipe_buf_uncharge_large(struct pipe_inode_info *, struct pipe_buffer *);
 
 extern const struct pipe_buf_operations nosteal_pipe_buf_ops;
 
@@ -47,6 +47,7 @@ extern struct rpc_xprt_switch *xprt_switch_get(struct rpc_xprt_switch *xps);
 extern void xprt_switch_put(struct rpc_xprt_switch *xps);
 
 extern void rpc_xprt_switch_set_roundrobin(struct rpc_xprt_switch *xps);
+extern void rpc_xprt_switch_set_leastqueue(struct rpc_xprt_switch *xps);
 
 extern void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 		struct rpc_xprt *xprt);
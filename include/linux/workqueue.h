@@ -129,6 +129,22 @@ struct rcu_work {
 	struct workqueue_struct *wq;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  An unbound workqueue maps one pwq
+ * to each pod of its scope so that a work item is executed by the workers
+ * of the pod, e.g. the last level cache domain, it was queued from.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per LLC */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -146,13 +162,21 @@ struct workqueue_attrs {
 	cpumask_var_t cpumask;
 
 	/**
-	 * @no_numa: disable NUMA affinity
+	 * @affn_scope: unbound CPU affinity scope
+	 *
+	 * CPU pods are used to improve execution locality of unbound work
+	 * items. There are multiple pod types, one for each wq_affn_scope, and
+	 * every CPU in the system belongs to one pod in every pod type. CPUs
+	 * that belong to the same pod share the worker pool. For example,
+	 * selecting %WQ_AFFN_CACHE makes the workqueue use a separate worker
+	 * pool for each last level cache domain.
 	 *
-	 * Unlike other fields, ``no_numa`` isn't a property of a worker_pool. It
-	 * only modifies how :c:func:`apply_workqueue_attrs` select pools and thus
-	 * doesn't participate in pool hash calculations or equality comparisons.
+	 * Unlike other fields, ``affn_scope`` isn't a property of a
+	 * worker_pool. It only modifies how :c:func:`apply_workqueue_attrs`
+	 * select pools and thus doesn't participate in pool hash calculations
+	 * or equality comparisons.
 	 */
-	bool no_numa;
+	enum wq_affn_scope affn_scope;
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -667,5 +691,6 @@ int workqueue_offline_cpu(unsigned int cpu);
 
 void __init workqueue_init_early(void);
 void __init workqueue_init(void);
+void __init workqueue_init_topology(void);
 
 #endif
@@ -859,9 +859,17 @@ __SYSCALL(__NR_pidfd_getfd, sys_pidfd_getfd)
 __SYSCALL(__NR_faccessat2, sys_faccessat2)
 #define __NR_process_madvise 440
 __SYSCALL(__NR_process_madvise, sys_process_madvise)
+#define __NR_epoll_pwait2 441
+__SC_COMP(__NR_epoll_pwait2, sys_epoll_pwait2, compat_sys_epoll_pwait2)
+#define __NR_epoll_ctl_batch 442
+__SYSCALL(__NR_epoll_ctl_batch, sys_epoll_ctl_batch)
+#define __NR_statx_batch 443
+__SYSCALL(__NR_statx_batch, sys_statx_batch)
+#define __NR_futex_waitv 449
+__SYSCALL(__NR_futex_waitv, sys_futex_waitv)
 
 #undef __NR_syscalls
-#define __NR_syscalls 441
+#define __NR_syscalls 450
 
 /*
  * 32 bit systems traditionally used different
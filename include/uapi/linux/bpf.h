@@ -157,6 +157,16 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_STRUCT_OPS,
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
+	/* Open addressing hash map that grows in the background. Updates
+	 * return -EBUSY when the current table is full before the resize
+	 * has caught up; retrying later succeeds. A value pointer returned
+	 * by a lookup while the resize is moving elements may refer to the
+	 * old table if the lookup couldn't move the element (e.g. from NMI),
+	 * and writes through it may then be lost.
+	 */
+	BPF_MAP_TYPE_OA_HASH,
+	BPF_MAP_TYPE_BLOOM_FILTER,
+	BPF_MAP_TYPE_COUNT_MIN_SKETCH,
 };
 
 /* Note that tracing related programs such as
@@ -253,6 +263,7 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_ITER = 4,
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
+	BPF_LINK_TYPE_TRACING_MULTI = 7,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -355,6 +366,14 @@ enum bpf_link_type {
  */
 #define BPF_F_SLEEPABLE		(1U << 4)
 
+/* If BPF_F_MULTI_FUNC is used in BPF_PROG_LOAD command, the fentry or fexit
+ * program is not bound to one function at load time. It is attached to a set
+ * of functions with BPF_LINK_CREATE and link_create.multi, and sees the first
+ * six arguments of each of them as u64 values (and the return value in the
+ * seventh for fexit).
+ */
+#define BPF_F_MULTI_FUNC	(1U << 5)
+
 /* When BPF ldimm64's insn[0].src_reg != 0 then this can have
  * the following extensions:
  *
@@ -386,6 +405,15 @@ enum bpf_link_type {
  *                   is struct/union.
  */
 #define BPF_PSEUDO_BTF_ID	3
+/* insn[0].src_reg:  BPF_PSEUDO_FUNC
+ * insn[0].imm:      insn offset to the func
+ * insn[1].imm:      0
+ * insn[0].off:      0
+ * insn[1].off:      0
+ * ldimm64 rewrite:  handle of the bpf function, usable only as a callback
+ * verifier type:    PTR_TO_FUNC
+ */
+#define BPF_PSEUDO_FUNC		4
 
 /* when bpf_call->src_reg == BPF_PSEUDO_CALL, bpf_call->imm == pc-relative
  * offset to another bpf function
@@ -438,6 +466,9 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Give each CPU its own ring in a ring buffer map */
+	BPF_F_RINGBUF_PERCPU	= (1U << 13),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -457,6 +488,10 @@ enum {
 enum bpf_stats_type {
 	/* enabled run_time_ns and run_cnt */
 	BPF_STATS_RUN_TIME = 0,
+	/* enabled sampled_run_time_ns and sampled_run_cnt, timing one in
+	 * kernel.bpf_stats_sample_period runs
+	 */
+	BPF_STATS_RUN_TIME_SAMPLED = 1,
 };
 
 enum bpf_stack_build_id_status {
@@ -502,6 +537,13 @@ union bpf_attr {
 						   * struct stored as the
 						   * map value
 						   */
+		__u64	map_extra;	/* any per-map-type extra fields
+					 *
+					 * BPF_MAP_TYPE_BLOOM_FILTER,
+					 * BPF_MAP_TYPE_COUNT_MIN_SKETCH - the
+					 * lowest 4 bits are the number of
+					 * hash functions, or 0 for the default
+					 */
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -669,6 +711,10 @@ union bpf_attr {
 				__aligned_u64	iter_info;	/* extra bpf_iter_link_info */
 				__u32		iter_info_len;	/* iter_info length */
 			};
+			struct {
+				__aligned_u64	btf_ids;	/* btf_ids of targets */
+				__u32		btf_ids_cnt;	/* btf_ids count */
+			} multi;
 		};
 	} link_create;
 
@@ -3316,6 +3362,8 @@ union bpf_attr {
  * void *bpf_ringbuf_reserve(void *ringbuf, u64 size, u64 flags)
  * 	Description
  * 		Reserve *size* bytes of payload in a ring buffer *ringbuf*.
+ * 		For a ring buffer created with **BPF_F_RINGBUF_PERCPU**, the
+ * 		space is reserved in the current CPU's ring.
  * 	Return
  * 		Valid pointer with *size* bytes of memory available; NULL,
  * 		otherwise.
@@ -3350,6 +3398,9 @@ union bpf_attr {
  *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
  *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
  *
+ *		For a ring buffer created with **BPF_F_RINGBUF_PERCPU**, the
+ *		values are those of the current CPU's ring.
+ *
  *		Data returned is just a momentary snapshot of actual values
  *		and could be inaccurate, so this facility should be used to
  *		power heuristics and for reporting, not to make 100% correct
@@ -3742,6 +3793,93 @@ union bpf_attr {
  * 	Return
  * 		The helper returns **TC_ACT_REDIRECT** on success or
  * 		**TC_ACT_SHOT** on error.
+ *
+ * long bpf_timer_init(struct bpf_timer *timer, struct bpf_map *map, u64 flags)
+ *	Description
+ *		Initialize the timer. The timer has to be a member of a map
+ *		value and *map* has to be the map holding it. The lowest four
+ *		bits of *flags* select the clock: **CLOCK_MONOTONIC**,
+ *		**CLOCK_REALTIME** or **CLOCK_BOOTTIME**. Other bits are
+ *		reserved and must be zero.
+ *
+ *		The map has to be held by a file descriptor in user space or
+ *		pinned in bpffs. Once the last such reference is gone, all the
+ *		timers of the map are cancelled and freed.
+ *	Return
+ *		0 on success.
+ *		**-EBUSY** if *timer* is already initialized.
+ *		**-EINVAL** if *flags* are invalid.
+ *		**-EPERM** if *timer* is in a map that is not held by user
+ *		space.
+ *		**-ENOMEM** if the timer could not be allocated.
+ *		**-EOPNOTSUPP** if called from NMI context.
+ *
+ * long bpf_timer_set_callback(struct bpf_timer *timer, void *callback_fn)
+ *	Description
+ *		Set the function to run when *timer* expires. It has to be a
+ *		static function of the same program, with the signature
+ *		**int callback_fn(void \*map, void \*key, void \*value)**,
+ *		which is called with the map, key and value of the element
+ *		holding the timer and must return 0. It runs in softirq
+ *		context on the CPU the timer was started on.
+ *
+ *		The program holds a reference that keeps it loaded until the
+ *		timer is freed, either along with the map element or when the
+ *		map is released by user space.
+ *	Return
+ *		0 on success.
+ *		**-EINVAL** if *timer* was not initialized.
+ *		**-EPERM** if *timer* is in a map that is not held by user
+ *		space.
+ *		**-EOPNOTSUPP** if called from NMI context.
+ *
+ * long bpf_timer_start(struct bpf_timer *timer, u64 nsecs, u64 flags)
+ *	Description
+ *		Arm *timer* to expire *nsecs* nanoseconds from now, relative
+ *		to the clock selected in **bpf_timer_init**\ (). Starting an
+ *		active timer moves its expiry. *flags* are reserved and must
+ *		be zero.
+ *	Return
+ *		0 on success.
+ *		**-EINVAL** if *timer* was not initialized, has no callback
+ *		or *flags* are invalid.
+ *		**-EOPNOTSUPP** if called from NMI context.
+ *
+ * long bpf_timer_cancel(struct bpf_timer *timer)
+ *	Description
+ *		Cancel *timer*. The callback is not waited for: if it is
+ *		running at the time of the call, it runs to completion.
+ *	Return
+ *		0 if the timer was not active.
+ *		1 if the timer was active and got cancelled.
+ *		**-EBUSY** if the callback is running.
+ *		**-EINVAL** if *timer* was not initialized.
+ *		**-EOPNOTSUPP** if called from NMI context.
+ *
+ * long bpf_ringbuf_output_batch(void *ringbuf, void *data, u64 size, u64 rec_size, u64 flags)
+ *	Description
+ *		Copy the *size* bytes at *data* into the ring buffer
+ *		*ringbuf* as a run of records of *rec_size* bytes each.
+ *		*size* must be a multiple of *rec_size*. All the records are
+ *		reserved at once and committed together, with at most one
+ *		notification of new data availability, which makes this
+ *		cheaper than a **bpf_ringbuf_output**\ () call per record.
+ *
+ *		If the ring buffer doesn't have room for all of them, as
+ *		many records as fit are written.
+ *
+ *		*flags* are the same as for **bpf_ringbuf_output**\ ().
+ *	Return
+ *		The number of records written, or a negative error in case
+ *		of failure. **-EAGAIN** if there was no room for any record.
+ *
+ * u64 bpf_get_func_ip(void *ctx)
+ *	Description
+ *		Get the address of the traced function, for fentry and fexit
+ *		programs. This is mostly useful for programs loaded with
+ *		**BPF_F_MULTI_FUNC**, which are attached to many functions.
+ *	Return
+ *		Address of the traced function.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -3900,6 +4038,12 @@ union bpf_attr {
 	FN(per_cpu_ptr),		\
 	FN(this_cpu_ptr),		\
 	FN(redirect_peer),		\
+	FN(timer_init),			\
+	FN(timer_set_callback),		\
+	FN(timer_start),		\
+	FN(timer_cancel),		\
+	FN(ringbuf_output_batch),	\
+	FN(get_func_ip),		\
 	/* */
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -4046,6 +4190,18 @@ enum {
 	BPF_RINGBUF_HDR_SZ		= 8,
 };
 
+/* BPF ring buffer consumer flags, written by user space to the word that
+ * follows the consumer position in the consumer page.
+ */
+enum {
+	/* The consumer polls the producer position itself, producers
+	 * don't send notifications unless BPF_RB_FORCE_WAKEUP is used.
+	 * Clear it, then issue a full memory barrier and check for data
+	 * again before waiting in epoll.
+	 */
+	BPF_RB_CONS_BUSY_POLL		= (1ULL << 0),
+};
+
 /* BPF_FUNC_sk_assign flags in bpf_sk_lookup context. */
 enum {
 	BPF_SK_LOOKUP_F_REPLACE		= (1ULL << 0),
@@ -4395,6 +4551,8 @@ struct bpf_prog_info {
 	__aligned_u64 prog_tags;
 	__u64 run_time_ns;
 	__u64 run_cnt;
+	__u64 sampled_run_time_ns;	/* estimated from the timed runs */
+	__u64 sampled_run_cnt;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -4412,6 +4570,8 @@ struct bpf_map_info {
 	__u32 btf_id;
 	__u32 btf_key_type_id;
 	__u32 btf_value_type_id;
+	__u32 :32;	/* alignment pad */
+	__u64 map_extra;
 } __attribute__((aligned(8)));
 
 struct bpf_btf_info {
@@ -4432,6 +4592,10 @@ struct bpf_link_info {
 		struct {
 			__u32 attach_type;
 		} tracing;
+		struct {
+			__u32 attach_type;
+			__u32 cnt;
+		} tracing_multi;
 		struct {
 			__u64 cgroup_id;
 			__u32 attach_type;
@@ -4979,6 +5143,11 @@ struct bpf_spin_lock {
 	__u32	val;
 };
 
+struct bpf_timer {
+	__u64 :64;
+	__u64 :64;
+} __attribute__((aligned(8)));
+
 struct bpf_sysctl {
 	__u32	write;		/* Sysctl is being read (= 0) or written (= 1).
 				 * Allows 1,2,4-byte read, but no write.
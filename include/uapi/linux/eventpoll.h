@@ -18,6 +18,7 @@
 /* For O_CLOEXEC */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
@@ -79,6 +80,33 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/* One command of an epoll_ctl_batch() call */
+struct epoll_ctl_cmd {
+	/* EPOLL_CTL_ADD, EPOLL_CTL_DEL or EPOLL_CTL_MOD */
+	__u32 op;
+	/* The target file descriptor */
+	__s32 fd;
+	/* The events mask, ignored for EPOLL_CTL_DEL */
+	__u32 events;
+	/* Set by the kernel: 0 on success, or a negative errno */
+	__s32 result;
+	/* The user data returned along with the events */
+	__u64 data;
+};
+
+struct epoll_params {
+	__u32 busy_poll_usecs;
+	__u16 busy_poll_budget;
+	__u8 prefer_busy_poll;
+
+	/* pad the struct to a multiple of 64bits */
+	__u8 __pad;
+};
+
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#define EPIOCGPARAMS _IOR(EPOLL_IOC_TYPE, 0x02, struct epoll_params)
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
@@ -51,6 +51,10 @@
 #define RENAME_EXCHANGE		(1 << 1)	/* Exchange source and dest */
 #define RENAME_WHITEOUT		(1 << 2)	/* Whiteout source */
 
+/* copy_file_range() flags */
+#define COPY_FILE_PARALLEL	(1 << 0)	/* Split large copies across workers */
+#define COPY_FILE_VALID_FLAGS	(COPY_FILE_PARALLEL)
+
 struct file_clone_range {
 	__s64 src_fd;
 	__u64 src_offset;
@@ -24,7 +24,18 @@
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
-#define FUTEX_CMD_MASK		~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)
+#define FUTEX_NUMA_FLAG		512
+#define FUTEX_CMD_MASK		~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME | \
+				  FUTEX_NUMA_FLAG)
+
+/*
+ * A FUTEX_NUMA_FLAG futex is followed by a u32 node word at uaddr + 4, which
+ * selects the NUMA node whose hash table queues its waiters.  Initialize the
+ * word to FUTEX_NO_NODE and the first operation stores the node it runs on.
+ * Every operation on such a futex must pass the flag.  Not valid for PI
+ * operations.
+ */
+#define FUTEX_NO_NODE		(-1)
 
 #define FUTEX_WAIT_PRIVATE	(FUTEX_WAIT | FUTEX_PRIVATE_FLAG)
 #define FUTEX_WAKE_PRIVATE	(FUTEX_WAKE | FUTEX_PRIVATE_FLAG)
@@ -41,6 +52,37 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/*
+ * Flags to specify the bit length of the futex word for futex_waitv().
+ * Currently, only 32 is supported.
+ */
+#define FUTEX_32		2
+
+/*
+ * futex_waitv() flag of a futex followed by a node word, see
+ * FUTEX_NUMA_FLAG.
+ */
+#define FUTEX2_NUMA		4
+
+/*
+ * Max numbers of elements in a futex_waitv array
+ */
+#define FUTEX_WAITV_MAX		128
+
+/**
+ * struct futex_waitv - A waiter for vectorized wait
+ * @val:	Expected value at uaddr
+ * @uaddr:	User address to wait on
+ * @flags:	Flags for this waiter
+ * @__reserved:	Reserved member to preserve data alignment. Should be 0.
+ */
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
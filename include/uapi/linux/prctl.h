@@ -247,4 +247,15 @@ struct prctl_mm_map {
 #define PR_SET_IO_FLUSHER		57
 #define PR_GET_IO_FLUSHER		58
 
+/*
+ * Per-process hash for private futexes.  Like PR_SET_PTRACER, a magic value
+ * keeps it clear of the sequentially allocated upstream options.
+ */
+#define PR_FUTEX_HASH			0x46487368	/* "FHsh" */
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+/* PR_FUTEX_HASH_SET_SLOTS values besides a power of two */
+# define PR_FUTEX_HASH_GLOBAL		0	/* use the global hash */
+# define PR_FUTEX_HASH_AUTO		(-1UL)	/* size by thread count */
+
 #endif /* _LINUX_PRCTL_H */
@@ -130,6 +130,20 @@ struct statx {
 	/* 0x100 */
 };
 
+/*
+ * One entry of the array passed to statx_batch(). @name and @buf hold user
+ * pointers, looked up and filled as by statx(dfd, name, flags, mask, buf).
+ * @result receives 0 or the negative error of that lookup.
+ */
+struct statx_batch_entry {
+	__u64	name;		/* const char * */
+	__u64	buf;		/* struct statx * */
+	__s32	result;
+	__u32	__reserved;	/* Must be zero */
+};
+
+#define STATX_BATCH_MAX	1024	/* Maximum entries per statx_batch() call */
+
 /*
  * Flags to be stx_mask
  *
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * bloom_filter.c: BPF bloom filter map
+ *
+ * Values are added with map_push_elem() and tested with map_peek_elem(),
+ * which returns 0 if the value may be in the set and -ENOENT if it is
+ * definitely not. Elements cannot be removed.
+ */
+#include <linux/bitmap.h>
+#include <linux/bpf.h>
+#include <linux/capability.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+
+#define BLOOM_CREATE_FLAG_MASK \
+	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK)
+
+/* map_extra holds the number of hash functions in its lowest four bits */
+#define BLOOM_NR_HASH_FUNCS_MASK	0xf
+#define BLOOM_DEFAULT_NR_HASH_FUNCS	5
+#define BLOOM_MAX_BITS			(1ULL << 31)
+
+struct bpf_bloom_filter {
+	struct bpf_map map;
+	u32 bitset_mask;
+	u32 hash_seed;
+	u32 nr_hash_funcs;
+	unsigned long bitset[];
+};
+
+static struct bpf_bloom_filter *bpf_bloom_filter(struct bpf_map *map)
+{
+	return container_of(map, struct bpf_bloom_filter, map);
+}
+
+static inline u32 bloom_hash(const struct bpf_bloom_filter *bloom,
+			     const void *value, u32 index)
+{
+	return jhash(value, bloom->map.value_size, bloom->hash_seed + index) &
+	       bloom->bitset_mask;
+}
+
+/* Called from syscall */
+static int bloom_map_alloc_check(union bpf_attr *attr)
+{
+	if (!bpf_capable())
+		return -EPERM;
+
+	if ((attr->map_flags & BPF_F_ZERO_SEED) && !capable(CAP_SYS_ADMIN))
+		/* Guard against local DoS, and discourage production use. */
+		return -EPERM;
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 0 ||
+	    attr->value_size == 0 ||
+	    attr->map_flags & ~BLOOM_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags) ||
+	    attr->map_extra & ~BLOOM_NR_HASH_FUNCS_MASK)
+		return -EINVAL;
+
+	if (attr->value_size > KMALLOC_MAX_SIZE)
+		/* if value_size is bigger, the user space won't be able to
+		 * access the elements.
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
+{
+	int ret, numa_node = bpf_map_attr_numa_node(attr);
+	struct bpf_map_memory mem = {0};
+	struct bpf_bloom_filter *bloom;
+	u32 nr_hash_funcs;
+	u64 nr_bits, cost;
+
+	nr_hash_funcs = attr->map_extra ?: BLOOM_DEFAULT_NR_HASH_FUNCS;
+
+	/* The false positive rate is lowest with n * k / ln(2) bits for n
+	 * elements and k hash functions; 7 / 5 approximates 1 / ln(2).
+	 * Round up to a power of two so that a mask selects the bit.
+	 */
+	nr_bits = div_u64((u64)attr->max_entries * nr_hash_funcs * 7, 5);
+	if (nr_bits > BLOOM_MAX_BITS)
+		return ERR_PTR(-E2BIG);
+	nr_bits = max_t(u64, roundup_pow_of_two(nr_bits), BITS_PER_LONG);
+
+	cost = sizeof(*bloom) + BITS_TO_LONGS(nr_bits) * sizeof(unsigned long);
+
+	ret = bpf_map_charge_init(&mem, cost);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	bloom = bpf_map_area_alloc(cost, numa_node);
+	if (!bloom) {
+		bpf_map_charge_finish(&mem);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	bpf_map_init_from_attr(&bloom->map, attr);
+	bpf_map_charge_move(&bloom->map.memory, &mem);
+
+	bloom->nr_hash_funcs = nr_hash_funcs;
+	bloom->bitset_mask = nr_bits - 1;
+	if (attr->map_flags & BPF_F_ZERO_SEED)
+		bloom->hash_seed = 0;
+	else
+		bloom->hash_seed = get_random_int();
+
+	return &bloom->map;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void bloom_map_free(struct bpf_map *map)
+{
+	bpf_map_area_free(bpf_bloom_filter(map));
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_peek_elem(struct bpf_map *map, void *value)
+{
+	struct bpf_bloom_filter *bloom = bpf_bloom_filter(map);
+	u32 i;
+
+	for (i = 0; i < bloom->nr_hash_funcs; i++)
+		if (!test_bit(bloom_hash(bloom, value, i), bloom->bitset))
+			return -ENOENT;
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_push_elem(struct bpf_map *map, void *value, u64 flags)
+{
+	struct bpf_bloom_filter *bloom = bpf_bloom_filter(map);
+	u32 i;
+
+	if (flags != BPF_ANY)
+		return -EINVAL;
+
+	for (i = 0; i < bloom->nr_hash_funcs; i++)
+		set_bit(bloom_hash(bloom, value, i), bloom->bitset);
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_pop_elem(struct bpf_map *map, void *value)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Called from syscall or from eBPF program */
+static void *bloom_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	/* The eBPF program should use map_peek_elem instead */
+	return ERR_PTR(-EINVAL);
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_update_elem(struct bpf_map *map, void *key,
+				 void *value, u64 flags)
+{
+	/* The eBPF program should use map_push_elem instead */
+	return -EINVAL;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_delete_elem(struct bpf_map *map, void *key)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Called from syscall */
+static int bloom_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	return -EOPNOTSUPP;
+}
+
+static int bloom_filter_map_btf_id;
+const struct bpf_map_ops bloom_filter_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = bloom_map_alloc_check,
+	.map_alloc = bloom_map_alloc,
+	.map_free = bloom_map_free,
+	.map_lookup_elem = bloom_map_lookup_elem,
+	.map_update_elem = bloom_map_update_elem,
+	.map_delete_elem = bloom_map_delete_elem,
+	.map_push_elem = bloom_map_push_elem,
+	.map_pop_elem = bloom_map_pop_elem,
+	.map_peek_elem = bloom_map_peek_elem,
+	.map_get_next_key = bloom_map_get_next_key,
+	.map_btf_name = "bpf_bloom_filter",
+	.map_btf_id = &bloom_filter_map_btf_id,
+};
@@ -2976,11 +2976,10 @@ static void btf_struct_log(struct btf_verifier_env *env,
 	btf_verifier_log(env, "size=%u vlen=%u", t->size, btf_type_vlen(t));
 }
 
-/* find 'struct bpf_spin_lock' in map value.
- * return >= 0 offset if found
- * and < 0 in case of error
- */
-int btf_find_spin_lock(const struct btf *btf, const struct btf_type *t)
+/* find the single member of type 'struct name' in a struct */
+static int btf_find_struct_field(const struct btf *btf,
+				 const struct btf_type *t, const char *name,
+				 int sz, int align)
 {
 	const struct btf_member *member;
 	u32 i, off = -ENOENT;
@@ -2993,26 +2992,48 @@ int btf_find_spin_lock(const struct btf *btf, const struct btf_type *t)
 								    member->type);
 		if (!__btf_type_is_struct(member_type))
 			continue;
-		if (member_type->size != sizeof(struct bpf_spin_lock))
+		if (member_type->size != sz)
 			continue;
 		if (strcmp(__btf_name_by_offset(btf, member_type->name_off),
-			   "bpf_spin_lock"))
+			   name))
 			continue;
 		if (off != -ENOENT)
-			/* only one 'struct bpf_spin_lock' is allowed */
+			/* only one such member is allowed */
 			return -E2BIG;
 		off = btf_member_bit_offset(t, member);
 		if (off % 8)
 			/* valid C code cannot generate such BTF */
 			return -EINVAL;
 		off /= 8;
-		if (off % __alignof__(struct bpf_spin_lock))
-			/* valid struct bpf_spin_lock will be 4 byte aligned */
+		if (off % align)
+			/* valid C code keeps the member aligned */
 			return -EINVAL;
 	}
 	return off;
 }
 
+/* find 'struct bpf_spin_lock' in map value.
+ * return >= 0 offset if found
+ * and < 0 in case of error
+ */
+int btf_find_spin_lock(const struct btf *btf, const struct btf_type *t)
+{
+	return btf_find_struct_field(btf, t, "bpf_spin_lock",
+				     sizeof(struct bpf_spin_lock),
+				     __alignof__(struct bpf_spin_lock));
+}
+
+/* find 'struct bpf_timer' in map value.
+ * return >= 0 offset if found
+ * and < 0 in case of error
+ */
+int btf_find_timer(const struct btf *btf, const struct btf_type *t)
+{
+	return btf_find_struct_field(btf, t, "bpf_timer",
+				     sizeof(struct bpf_timer),
+				     __alignof__(struct bpf_timer));
+}
+
 static void __btf_struct_show(const struct btf *btf, const struct btf_type *t,
 			      u32 type_id, void *data, u8 bits_offset,
 			      struct btf_show *show)
@@ -4445,8 +4466,15 @@ bool btf_ctx_access(int off, int size, enum bpf_access_type type,
 	}
 	arg = off / 8;
 	args = (const struct btf_param *)(t + 1);
-	/* if (t == NULL) Fall back to default BPF prog with 5 u64 arguments */
-	nr_args = t ? btf_type_vlen(t) : 5;
+	/* if (t == NULL) Fall back to default BPF prog with 5 u64 arguments,
+	 * or MAX_BPF_MULTI_FUNC_ARGS for programs attached to many functions
+	 */
+	if (t)
+		nr_args = btf_type_vlen(t);
+	else if (prog->aux->multi_func)
+		nr_args = MAX_BPF_MULTI_FUNC_ARGS;
+	else
+		nr_args = 5;
 	if (prog->aux->attach_btf_trace) {
 		/* skip first 'void *__data' argument in btf_trace_##name typedef */
 		args++;
@@ -392,6 +392,15 @@ static int bpf_adj_branches(struct bpf_prog *prog, u32 pos, s32 end_old,
 			insn = prog->insnsi + end_old;
 		}
 		code = insn->code;
+		/* Adjust the subprog offset of callback references. */
+		if (code == (BPF_LD | BPF_IMM | BPF_DW) &&
+		    insn->src_reg == BPF_PSEUDO_FUNC) {
+			ret = bpf_adj_delta_to_imm(insn, pos, end_old,
+						   end_new, i, probe_pass);
+			if (ret)
+				break;
+			continue;
+		}
 		if ((BPF_CLASS(code) != BPF_JMP &&
 		     BPF_CLASS(code) != BPF_JMP32) ||
 		    BPF_OP(code) == BPF_EXIT)
@@ -1793,6 +1802,19 @@ static void bpf_prog_select_func(struct bpf_prog *fp)
  * Try to JIT eBPF program, if JIT is not available, use interpreter.
  * The BPF program will be executed via BPF_PROG_RUN() macro.
  */
+/* The interpreter doesn't handle BPF_MOV64_PERCPU_REG(), which the verifier
+ * only emits when a JIT was requested.
+ */
+static bool bpf_prog_has_percpu_insn(const struct bpf_prog *fp)
+{
+	u32 i;
+
+	for (i = 0; i < fp->len; i++)
+		if (insn_is_mov_percpu_addr(&fp->insnsi[i]))
+			return true;
+	return false;
+}
+
 struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 {
 	/* In case of BPF to BPF calls, verifier did all the prep
@@ -1820,6 +1842,11 @@ struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 #ifdef CONFIG_BPF_JIT_ALWAYS_ON
 			*err = -ENOTSUPP;
 			return fp;
+#else
+			if (bpf_prog_has_percpu_insn(fp)) {
+				*err = -ENOTSUPP;
+				return fp;
+			}
 #endif
 		} else {
 			bpf_prog_free_unused_jited_linfo(fp);
@@ -2275,6 +2302,14 @@ bool __weak bpf_jit_needs_zext(void)
 	return false;
 }
 
+/* Return TRUE if the JIT backend can translate BPF_MOV64_PERCPU_REG(), which
+ * lets the verifier inline lookups in per-CPU maps.
+ */
+bool __weak bpf_jit_supports_percpu_insn(void)
+{
+	return false;
+}
+
 /* To execute LD_ABS/LD_IND instructions __bpf_prog_run() may call
  * skb_copy_bits(), so provide a weak definition of it for NET-less config.
  */
@@ -2293,6 +2328,32 @@ int __weak bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
 DEFINE_STATIC_KEY_FALSE(bpf_stats_enabled_key);
 EXPORT_SYMBOL(bpf_stats_enabled_key);
 
+DEFINE_STATIC_KEY_FALSE(bpf_stats_sampled_key);
+EXPORT_SYMBOL(bpf_stats_sampled_key);
+
+int sysctl_bpf_stats_sample_period __read_mostly = 1024;
+
+/* Account one timed run of @prog, which stands for all the runs on this CPU
+ * since the previous sample.
+ */
+void bpf_prog_sample_record(const struct bpf_prog *prog, u64 nsecs)
+{
+	struct bpf_prog_stats *stats = this_cpu_ptr(prog->aux->stats);
+	u32 period = max(READ_ONCE(sysctl_bpf_stats_sample_period), 1);
+	u32 bucket = min_t(u32, fls64(nsecs), BPF_PROG_STATS_HIST_BUCKETS - 1);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->sampled_cnt += stats->sample_weight ?: 1;
+	stats->sampled_nsecs += nsecs;
+	stats->samples++;
+	stats->hist[bucket]++;
+	u64_stats_update_end(&stats->syncp);
+
+	stats->sample_weight = period;
+	stats->sample_countdown = period - 1;
+}
+EXPORT_SYMBOL_GPL(bpf_prog_sample_record);
+
 /* All definitions of tracepoints related to BPF. */
 #define CREATE_TRACE_POINTS
 #include <linux/bpf_trace.h>
@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * count_min_sketch.c: BPF count-min sketch map
+ *
+ * The sketch is a matrix of u32 counters with one row per hash function
+ * and max_entries (rounded up to a power of two) counters per row. Updating
+ * a key adds the u32 value to one counter per row; looking it up returns
+ * the smallest of these counters, which never underestimates the real
+ * count. With w counters per row and d rows, the estimate exceeds the real
+ * count by more than e / w times the total of all updates with probability
+ * at most e^-d.
+ *
+ * The pointer returned by lookup refers to the counter holding the
+ * estimate, so the value is the estimate at the time it is read. Writing
+ * through it only skews the counts of the keys sharing that counter.
+ */
+#include <linux/bpf.h>
+#include <linux/capability.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+
+#define CMS_CREATE_FLAG_MASK \
+	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK)
+
+/* map_extra holds the number of rows in its lowest four bits */
+#define CMS_NR_HASH_FUNCS_MASK		0xf
+#define CMS_DEFAULT_NR_HASH_FUNCS	4
+#define CMS_MAX_WIDTH			(1U << 28)
+
+struct bpf_cms {
+	struct bpf_map map;
+	u32 width_shift;
+	u32 width_mask;
+	u32 hash_seed;
+	u32 nr_hash_funcs;
+	atomic_t counters[];
+};
+
+static struct bpf_cms *bpf_cms(struct bpf_map *map)
+{
+	return container_of(map, struct bpf_cms, map);
+}
+
+static inline atomic_t *cms_counter(struct bpf_cms *cms, const void *key,
+				    u32 row)
+{
+	u32 hash = jhash(key, cms->map.key_size, cms->hash_seed + row);
+
+	return &cms->counters[(row << cms->width_shift) +
+			      (hash & cms->width_mask)];
+}
+
+/* Called from syscall */
+static int cms_map_alloc_check(union bpf_attr *attr)
+{
+	if (!bpf_capable())
+		return -EPERM;
+
+	if ((attr->map_flags & BPF_F_ZERO_SEED) && !capable(CAP_SYS_ADMIN))
+		/* Guard against local DoS, and discourage production use. */
+		return -EPERM;
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size != sizeof(u32) ||
+	    attr->map_flags & ~CMS_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags) ||
+	    attr->map_extra & ~CMS_NR_HASH_FUNCS_MASK)
+		return -EINVAL;
+
+	if (attr->key_size > MAX_BPF_STACK)
+		/* eBPF programs initialize keys on stack, so they cannot be
+		 * larger than max stack size
+		 */
+		return -E2BIG;
+
+	if (attr->max_entries > CMS_MAX_WIDTH)
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *cms_map_alloc(union bpf_attr *attr)
+{
+	int ret, numa_node = bpf_map_attr_numa_node(attr);
+	struct bpf_map_memory mem = {0};
+	u32 nr_hash_funcs, width;
+	struct bpf_cms *cms;
+	u64 cost;
+
+	nr_hash_funcs = attr->map_extra ?: CMS_DEFAULT_NR_HASH_FUNCS;
+	width = roundup_pow_of_two(attr->max_entries);
+
+	cost = sizeof(*cms) + (u64)nr_hash_funcs * width * sizeof(atomic_t);
+
+	ret = bpf_map_charge_init(&mem, cost);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	cms = bpf_map_area_alloc(cost, numa_node);
+	if (!cms) {
+		bpf_map_charge_finish(&mem);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	bpf_map_init_from_attr(&cms->map, attr);
+	bpf_map_charge_move(&cms->map.memory, &mem);
+
+	/* max_entries is the number of counters per row */
+	cms->map.max_entries = width;
+	cms->width_shift = ilog2(width);
+	cms->width_mask = width - 1;
+	cms->nr_hash_funcs = nr_hash_funcs;
+	if (attr->map_flags & BPF_F_ZERO_SEED)
+		cms->hash_seed = 0;
+	else
+		cms->hash_seed = get_random_int();
+
+	return &cms->map;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void cms_map_free(struct bpf_map *map)
+{
+	bpf_map_area_free(bpf_cms(map));
+}
+
+/* Called from syscall or from eBPF program */
+static void *cms_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_cms *cms = bpf_cms(map);
+	atomic_t *min = NULL, *c;
+	u32 i;
+
+	for (i = 0; i < cms->nr_hash_funcs; i++) {
+		c = cms_counter(cms, key, i);
+		if (!min || (u32)atomic_read(c) < (u32)atomic_read(min))
+			min = c;
+	}
+
+	return &min->counter;
+}
+
+/* Called from syscall or from eBPF program */
+static int cms_map_update_elem(struct bpf_map *map, void *key, void *value,
+			       u64 flags)
+{
+	struct bpf_cms *cms = bpf_cms(map);
+	u32 i, delta = *(u32 *)value;
+
+	/* counts are added to, the element always exists */
+	if (flags != BPF_ANY)
+		return -EINVAL;
+
+	for (i = 0; i < cms->nr_hash_funcs; i++)
+		atomic_add(delta, cms_counter(cms, key, i));
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int cms_map_delete_elem(struct bpf_map *map, void *key)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Called from syscall */
+static int cms_map_get_next_key(struct bpf_map *map, void *key,
+				void *next_key)
+{
+	return -EOPNOTSUPP;
+}
+
+static int cms_map_btf_id;
+const struct bpf_map_ops count_min_sketch_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = cms_map_alloc_check,
+	.map_alloc = cms_map_alloc,
+	.map_free = cms_map_free,
+	.map_lookup_elem = cms_map_lookup_elem,
+	.map_update_elem = cms_map_update_elem,
+	.map_delete_elem = cms_map_delete_elem,
+	.map_get_next_key = cms_map_get_next_key,
+	.map_btf_name = "bpf_cms",
+	.map_btf_id = &cms_map_btf_id,
+};
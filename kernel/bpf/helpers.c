@@ -327,6 +327,312 @@ void copy_map_value_locked(struct bpf_map *map, void *dst, void *src,
 	preempt_enable();
 }
 
+/* The hrtimer behind a struct bpf_timer. It is allocated by bpf_timer_init(),
+ * so the map value only has to hold a pointer to it and the lock below.
+ */
+struct bpf_hrtimer {
+	struct hrtimer timer;
+	struct bpf_map *map;
+	struct bpf_prog *prog;
+	void __rcu *callback_fn;
+	void *value;
+	struct work_struct free_work;
+};
+
+/* the kernel side of struct bpf_timer */
+struct bpf_timer_kern {
+	struct bpf_hrtimer *timer;
+	/* bpf_spin_lock rather than spinlock_t, so that the struct fits into
+	 * struct bpf_timer whatever the lock debugging options are.
+	 */
+	struct bpf_spin_lock lock;
+} __attribute__((aligned(8)));
+
+static inline void bpf_timer_lock(struct bpf_timer_kern *timer,
+				  unsigned long *flags)
+{
+	local_irq_save(*flags);
+	__bpf_spin_lock(&timer->lock);
+}
+
+static inline void bpf_timer_unlock(struct bpf_timer_kern *timer,
+				    unsigned long *flags)
+{
+	__bpf_spin_unlock(&timer->lock);
+	local_irq_restore(*flags);
+}
+
+static enum hrtimer_restart bpf_timer_cb(struct hrtimer *hrtimer)
+{
+	struct bpf_hrtimer *t;
+	struct bpf_map *map;
+	void *callback_fn;
+	void *key, *value;
+	u32 idx;
+
+	t = container_of(hrtimer, struct bpf_hrtimer, timer);
+	map = t->map;
+	value = t->value;
+
+	/* The program owning callback_fn is freed after a grace period once
+	 * its last reference is dropped, so it stays around until the
+	 * callback returns.
+	 */
+	rcu_read_lock();
+	callback_fn = rcu_dereference(t->callback_fn);
+	if (!callback_fn)
+		goto out;
+
+	if (map->map_type == BPF_MAP_TYPE_ARRAY) {
+		struct bpf_array *array;
+
+		array = container_of(map, struct bpf_array, map);
+		idx = ((char *)value - array->value) / array->elem_size;
+		key = &idx;
+	} else {
+		/* hash and lru_hash keep the value right after the key */
+		key = value - round_up(map->key_size, 8);
+	}
+
+	/* the verifier checked that callback_fn returns a scalar, which
+	 * is ignored
+	 */
+	BPF_CAST_CALL(callback_fn)((u64)(long)map, (u64)(long)key,
+				   (u64)(long)value, 0, 0);
+out:
+	rcu_read_unlock();
+	return HRTIMER_NORESTART;
+}
+
+static void bpf_timer_free_work(struct work_struct *work)
+{
+	struct bpf_hrtimer *t = container_of(work, struct bpf_hrtimer,
+					     free_work);
+
+	/* waits for a callback running on another cpu */
+	hrtimer_cancel(&t->timer);
+	if (t->prog)
+		bpf_prog_put(t->prog);
+	kfree(t);
+}
+
+BPF_CALL_3(bpf_timer_init, struct bpf_timer_kern *, timer,
+	   struct bpf_map *, map, u64, flags)
+{
+	clockid_t clockid = flags & (MAX_CLOCKS - 1);
+	unsigned long irq_flags;
+	struct bpf_hrtimer *t;
+	int ret = 0;
+
+	BUILD_BUG_ON(MAX_CLOCKS != 16);
+	BUILD_BUG_ON(sizeof(struct bpf_timer_kern) > sizeof(struct bpf_timer));
+	BUILD_BUG_ON(__alignof__(struct bpf_timer_kern) !=
+		     __alignof__(struct bpf_timer));
+
+	if (in_nmi())
+		return -EOPNOTSUPP;
+
+	if (flags >= MAX_CLOCKS ||
+	    /* same as timerfd, minus the _ALARM clocks */
+	    (clockid != CLOCK_MONOTONIC &&
+	     clockid != CLOCK_REALTIME &&
+	     clockid != CLOCK_BOOTTIME))
+		return -EINVAL;
+
+	bpf_timer_lock(timer, &irq_flags);
+	if (timer->timer) {
+		ret = -EBUSY;
+		goto out;
+	}
+	t = kmalloc_node(sizeof(*t), GFP_ATOMIC | __GFP_NOWARN,
+			 map->numa_node);
+	if (!t) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	t->value = (void *)timer - map->timer_off;
+	t->map = map;
+	t->prog = NULL;
+	RCU_INIT_POINTER(t->callback_fn, NULL);
+	INIT_WORK(&t->free_work, bpf_timer_free_work);
+	hrtimer_init(&t->timer, clockid, HRTIMER_MODE_REL_SOFT);
+	t->timer.function = bpf_timer_cb;
+	WRITE_ONCE(timer->timer, t);
+	/* Pairs with the barrier implied by atomic64_dec_and_test() on
+	 * usercnt: either map_release_uref() finds the timer and frees it,
+	 * or the zero usercnt is seen here.
+	 */
+	smp_mb();
+	if (!atomic64_read(&map->usercnt)) {
+		/* Maps with timers have to be held by user space or pinned
+		 * in bpffs, since map_release_uref() is what frees them.
+		 */
+		WRITE_ONCE(timer->timer, NULL);
+		kfree(t);
+		ret = -EPERM;
+	}
+out:
+	bpf_timer_unlock(timer, &irq_flags);
+	return ret;
+}
+
+const struct bpf_func_proto bpf_timer_init_proto = {
+	.func		= bpf_timer_init,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_TIMER,
+	.arg2_type	= ARG_CONST_MAP_PTR,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+/* The verifier passes the index of the callback function in the program and
+ * the program's aux as hidden third argument, see fixup_bpf_calls().
+ */
+BPF_CALL_3(bpf_timer_set_callback, struct bpf_timer_kern *, timer, u64, subprog,
+	   struct bpf_prog_aux *, aux)
+{
+	struct bpf_prog *prev = NULL, *prog = aux->prog;
+	unsigned long irq_flags;
+	struct bpf_hrtimer *t;
+	int ret = 0;
+
+	if (in_nmi())
+		return -EOPNOTSUPP;
+
+	if (WARN_ON_ONCE(subprog >= aux->func_cnt))
+		return -EINVAL;
+
+	bpf_timer_lock(timer, &irq_flags);
+	t = timer->timer;
+	if (!t) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (!atomic64_read(&t->map->usercnt)) {
+		/* the timer is about to be freed by map_release_uref() */
+		ret = -EPERM;
+		goto out;
+	}
+	if (t->prog != prog) {
+		/* one reference per timer, whichever function of the
+		 * program the callback is
+		 */
+		prog = bpf_prog_inc_not_zero(prog);
+		if (IS_ERR(prog)) {
+			ret = PTR_ERR(prog);
+			goto out;
+		}
+		prev = t->prog;
+		t->prog = prog;
+	}
+	rcu_assign_pointer(t->callback_fn, aux->func[subprog]->bpf_func);
+out:
+	bpf_timer_unlock(timer, &irq_flags);
+	if (prev)
+		bpf_prog_put(prev);
+	return ret;
+}
+
+const struct bpf_func_proto bpf_timer_set_callback_proto = {
+	.func		= bpf_timer_set_callback,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_TIMER,
+	.arg2_type	= ARG_PTR_TO_FUNC,
+};
+
+BPF_CALL_3(bpf_timer_start, struct bpf_timer_kern *, timer, u64, nsecs,
+	   u64, flags)
+{
+	unsigned long irq_flags;
+	struct bpf_hrtimer *t;
+	int ret = 0;
+
+	if (in_nmi())
+		return -EOPNOTSUPP;
+
+	if (flags)
+		return -EINVAL;
+
+	bpf_timer_lock(timer, &irq_flags);
+	t = timer->timer;
+	if (!t || !t->prog) {
+		ret = -EINVAL;
+		goto out;
+	}
+	hrtimer_start(&t->timer, ns_to_ktime(nsecs), HRTIMER_MODE_REL_SOFT);
+out:
+	bpf_timer_unlock(timer, &irq_flags);
+	return ret;
+}
+
+const struct bpf_func_proto bpf_timer_start_proto = {
+	.func		= bpf_timer_start,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_TIMER,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+BPF_CALL_1(bpf_timer_cancel, struct bpf_timer_kern *, timer)
+{
+	unsigned long irq_flags;
+	struct bpf_hrtimer *t;
+	int ret;
+
+	if (in_nmi())
+		return -EOPNOTSUPP;
+
+	bpf_timer_lock(timer, &irq_flags);
+	t = timer->timer;
+	if (!t) {
+		ret = -EINVAL;
+		goto out;
+	}
+	/* Never wait for the callback: it may be the caller, or it may be
+	 * cancelling the caller's own timer on another cpu.
+	 */
+	ret = hrtimer_try_to_cancel(&t->timer);
+	if (ret < 0)
+		ret = -EBUSY;
+out:
+	bpf_timer_unlock(timer, &irq_flags);
+	return ret;
+}
+
+const struct bpf_func_proto bpf_timer_cancel_proto = {
+	.func		= bpf_timer_cancel,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_TIMER,
+};
+
+/* Called by the map when the element holding the timer is deleted or when
+ * the last user space reference to the map is dropped. May run in atomic
+ * context and from the timer's own callback, so the hrtimer is cancelled
+ * and freed from a workqueue.
+ */
+void bpf_timer_cancel_and_free(void *val)
+{
+	struct bpf_timer_kern *timer = val;
+	unsigned long irq_flags;
+	struct bpf_hrtimer *t;
+
+	bpf_timer_lock(timer, &irq_flags);
+	t = timer->timer;
+	WRITE_ONCE(timer->timer, NULL);
+	bpf_timer_unlock(timer, &irq_flags);
+	if (!t)
+		return;
+
+	/* No bpf_timer_*() call can reach t any more; an expiry racing
+	 * with us finds no callback to run.
+	 */
+	RCU_INIT_POINTER(t->callback_fn, NULL);
+	queue_work(system_unbound_wq, &t->free_work);
+}
+
 BPF_CALL_0(bpf_jiffies64)
 {
 	return get_jiffies_64();
@@ -695,6 +1001,8 @@ bpf_base_func_proto(enum bpf_func_id func_id)
 		return &bpf_ringbuf_discard_proto;
 	case BPF_FUNC_ringbuf_query:
 		return &bpf_ringbuf_query_proto;
+	case BPF_FUNC_ringbuf_output_batch:
+		return &bpf_ringbuf_output_batch_proto;
 	default:
 		break;
 	}
@@ -707,6 +1015,14 @@ bpf_base_func_proto(enum bpf_func_id func_id)
 		return &bpf_spin_lock_proto;
 	case BPF_FUNC_spin_unlock:
 		return &bpf_spin_unlock_proto;
+	case BPF_FUNC_timer_init:
+		return &bpf_timer_init_proto;
+	case BPF_FUNC_timer_set_callback:
+		return &bpf_timer_set_callback_proto;
+	case BPF_FUNC_timer_start:
+		return &bpf_timer_start_proto;
+	case BPF_FUNC_timer_cancel:
+		return &bpf_timer_cancel_proto;
 	case BPF_FUNC_trace_printk:
 		if (!perfmon_capable())
 			return NULL;
@@ -28,7 +28,8 @@ struct bpf_map *bpf_map_meta_alloc(int inner_map_ufd)
 		return ERR_PTR(-ENOTSUPP);
 	}
 
-	if (map_value_has_spin_lock(inner_map)) {
+	if (map_value_has_spin_lock(inner_map) ||
+	    map_value_has_timer(inner_map)) {
 		fdput(f);
 		return ERR_PTR(-ENOTSUPP);
 	}
@@ -136,6 +136,12 @@ static int bpf_iter_attach_map(struct bpf_prog *prog,
 		goto put_map;
 	}
 
+	/* the program must not read or overwrite the bpf_timer internals */
+	if (map_value_has_timer(map) && value_acc_size > map->timer_off) {
+		err = -EACCES;
+		goto put_map;
+	}
+
 	aux->map = map;
 	return 0;
 
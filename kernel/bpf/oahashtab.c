@@ -0,0 +1,751 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Open addressing hash map.
+ *
+ * Keys of up to OA_HTAB_MAX_KEY_SIZE bytes are stored inline, next to a
+ * 32-bit hash tag, in cache line sized buckets. Collisions are resolved by
+ * linear probing over buckets, so a lookup typically touches a single cache
+ * line for the keys plus one for the value. Values live in a separate array
+ * indexed by slot number.
+ *
+ * Lookups are lock-free. A slot only ever moves forward through the states
+ *
+ *   EMPTY -> BUSY -> <hash tag> -> TOMBSTONE
+ *
+ * and the hash tag is published with release semantics after key and value
+ * have been written, so a reader that sees a valid tag also sees the key.
+ * Since an EMPTY slot is never produced again, every key lives before the
+ * first EMPTY slot of its probe sequence and lookups may stop there.
+ *
+ * Updates and deletes are serialized by a striped lock chosen by the hash,
+ * which guarantees that a given key is inserted at most once. Different
+ * writers race for EMPTY slots with cmpxchg(). Updating the value of an
+ * existing key is done in place and is not atomic with respect to
+ * concurrent lookups, like for array maps.
+ *
+ * The map starts small and grows as it fills up. Growing does not stop the
+ * world: a worker allocates a bigger table, publishes it as new_table and
+ * then moves elements one by one under their stripe lock. While new_table
+ * is set, inserts go to the new table and lookups check the old table
+ * first, then the new one. An element is published in the new table before
+ * it is tombstoned in the old one, so it is always visible in one of them.
+ * Tombstones are only reclaimed by the rebuild of the table.
+ *
+ * A value pointer returned by a lookup must not point into the old table
+ * once elements are being moved, or writes through it would be lost when
+ * the element is copied over. A lookup that finds its element in the old
+ * table therefore moves it itself and returns the new slot. This needs the
+ * stripe lock, which is only tried: if it is contended, e.g. for a lookup
+ * from NMI, the old slot is returned and writes to it may be lost.
+ */
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/irq_work.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#define OA_HTAB_CREATE_FLAG_MASK \
+	(BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+
+#define OA_HTAB_BUCKET_SIZE	64
+#define OA_HTAB_MAX_KEY_SIZE	(OA_HTAB_BUCKET_SIZE / 2 - sizeof(u32))
+#define OA_HTAB_MIN_BUCKETS	8
+#define OA_HTAB_MAX_LOCKS	1024
+
+/* Slot tags. A valid hash tag always has OA_SLOT_HASHED set. */
+#define OA_SLOT_EMPTY		0
+#define OA_SLOT_TOMBSTONE	1
+#define OA_SLOT_BUSY		2
+#define OA_SLOT_HASHED		BIT(31)
+
+struct oa_htab_slot {
+	u32 tag;
+	char key[];
+};
+
+struct oa_htab_table {
+	void *buckets;
+	void *values;
+	u32 n_buckets;		/* power of 2 */
+	u32 n_slots;
+	atomic_t used;		/* claimed slots, including tombstones */
+	atomic_t live;		/* elements stored in this table */
+	atomic_t reserve;	/* slots held back for elements being moved in */
+	bool moving;		/* elements are being moved in */
+};
+
+struct bpf_oa_htab {
+	struct bpf_map map;
+	struct oa_htab_table *table;
+	struct oa_htab_table *new_table;	/* non-NULL while resizing */
+	raw_spinlock_t *locks;
+	u32 lock_mask;
+	u32 slot_size;
+	u32 slots_per_bucket;
+	u32 value_elem_size;
+	u32 max_buckets;
+	u32 hashrnd;
+	atomic_t count;		/* number of elements in the map */
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
+};
+
+static inline u32 oa_htab_hash(const struct bpf_oa_htab *oa, const void *key)
+{
+	return jhash(key, oa->map.key_size, oa->hashrnd) | OA_SLOT_HASHED;
+}
+
+static inline raw_spinlock_t *oa_htab_lock(const struct bpf_oa_htab *oa,
+					   u32 hash)
+{
+	return &oa->locks[hash & oa->lock_mask];
+}
+
+static inline struct oa_htab_slot *oa_htab_slot(const struct bpf_oa_htab *oa,
+						const struct oa_htab_table *tbl,
+						u32 bucket, u32 pos)
+{
+	return tbl->buckets + (size_t)bucket * OA_HTAB_BUCKET_SIZE +
+	       pos * oa->slot_size;
+}
+
+static inline void *oa_htab_value(const struct bpf_oa_htab *oa,
+				  const struct oa_htab_table *tbl, u32 idx)
+{
+	return tbl->values + (size_t)idx * oa->value_elem_size;
+}
+
+/* Returns the table inserts should go to in @cur and, while a resize is in
+ * progress, the table elements are being moved out of in @old.
+ */
+static inline void oa_htab_tables(const struct bpf_oa_htab *oa,
+				  struct oa_htab_table **old,
+				  struct oa_htab_table **cur)
+{
+	struct oa_htab_table *new = smp_load_acquire(&oa->new_table);
+	struct oa_htab_table *tbl = smp_load_acquire(&oa->table);
+
+	*cur = new ?: tbl;
+	*old = new && new != tbl ? tbl : NULL;
+}
+
+/* Returns the slot index of @key in @tbl or -ENOENT */
+static long oa_htab_find(const struct bpf_oa_htab *oa,
+			 const struct oa_htab_table *tbl,
+			 const void *key, u32 hash)
+{
+	u32 mask = tbl->n_buckets - 1, bucket = hash & mask;
+	u32 i, pos;
+
+	for (i = 0; i < tbl->n_buckets; i++, bucket = (bucket + 1) & mask) {
+		for (pos = 0; pos < oa->slots_per_bucket; pos++) {
+			struct oa_htab_slot *s = oa_htab_slot(oa, tbl, bucket, pos);
+			u32 tag = smp_load_acquire(&s->tag);
+
+			if (tag == OA_SLOT_EMPTY)
+				return -ENOENT;
+			if (tag == hash && !memcmp(s->key, key, oa->map.key_size))
+				return bucket * oa->slots_per_bucket + pos;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/* Claims the first EMPTY slot of the probe sequence of @hash. The caller
+ * has accounted the slot in tbl->used, so one is guaranteed to exist.
+ */
+static long oa_htab_claim(const struct bpf_oa_htab *oa,
+			  struct oa_htab_table *tbl, u32 hash)
+{
+	u32 mask = tbl->n_buckets - 1, bucket = hash & mask;
+	u32 i, pos;
+
+	for (i = 0; i < tbl->n_buckets; i++, bucket = (bucket + 1) & mask) {
+		for (pos = 0; pos < oa->slots_per_bucket; pos++) {
+			struct oa_htab_slot *s = oa_htab_slot(oa, tbl, bucket, pos);
+
+			if (READ_ONCE(s->tag) == OA_SLOT_EMPTY &&
+			    cmpxchg(&s->tag, OA_SLOT_EMPTY, OA_SLOT_BUSY) ==
+			    OA_SLOT_EMPTY)
+				return bucket * oa->slots_per_bucket + pos;
+		}
+	}
+
+	WARN_ON_ONCE(1);
+	return -EBUSY;
+}
+
+static void oa_htab_publish(const struct bpf_oa_htab *oa,
+			    struct oa_htab_table *tbl, u32 idx,
+			    const void *key, const void *value, u32 hash)
+{
+	struct oa_htab_slot *s;
+
+	s = oa_htab_slot(oa, tbl, idx / oa->slots_per_bucket,
+			 idx % oa->slots_per_bucket);
+	memcpy(s->key, key, oa->map.key_size);
+	memcpy(oa_htab_value(oa, tbl, idx), value, oa->map.value_size);
+	atomic_inc(&tbl->live);
+	/* pairs with smp_load_acquire() in oa_htab_find() */
+	smp_store_release(&s->tag, hash);
+}
+
+static void oa_htab_kill_slot(const struct bpf_oa_htab *oa,
+			      struct oa_htab_table *tbl, u32 idx)
+{
+	struct oa_htab_slot *s;
+
+	s = oa_htab_slot(oa, tbl, idx / oa->slots_per_bucket,
+			 idx % oa->slots_per_bucket);
+	smp_store_release(&s->tag, OA_SLOT_TOMBSTONE);
+	atomic_dec(&tbl->live);
+}
+
+static inline bool oa_htab_over_threshold(const struct oa_htab_table *tbl)
+{
+	return atomic_read(&tbl->used) > tbl->n_slots / 4 * 3;
+}
+
+/* Called from any context, including NMI: defer the resize to a worker */
+static void oa_htab_kick_resize(struct bpf_oa_htab *oa)
+{
+	irq_work_queue(&oa->resize_irq_work);
+}
+
+static void oa_htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_oa_htab *oa = container_of(work, struct bpf_oa_htab,
+					      resize_irq_work);
+
+	queue_work(system_unbound_wq, &oa->resize_work);
+}
+
+/* Called with the stripe lock of @hash held */
+static int oa_htab_insert(struct bpf_oa_htab *oa, struct oa_htab_table *tbl,
+			  const void *key, const void *value, u32 hash)
+{
+	long idx;
+
+	if (atomic_inc_return(&oa->count) > oa->map.max_entries) {
+		atomic_dec(&oa->count);
+		return -E2BIG;
+	}
+
+	if (atomic_inc_return(&tbl->used) + atomic_read(&tbl->reserve) >
+	    tbl->n_slots) {
+		/* table is full and the resize hasn't caught up yet */
+		atomic_dec(&tbl->used);
+		atomic_dec(&oa->count);
+		oa_htab_kick_resize(oa);
+		return -EBUSY;
+	}
+
+	idx = oa_htab_claim(oa, tbl, hash);
+	if (idx < 0) {
+		atomic_dec(&tbl->used);
+		atomic_dec(&oa->count);
+		return idx;
+	}
+
+	oa_htab_publish(oa, tbl, idx, key, value, hash);
+
+	if (oa_htab_over_threshold(tbl))
+		oa_htab_kick_resize(oa);
+	return 0;
+}
+
+/* Called with the stripe lock of @tag held. Moves the element in slot @idx
+ * of @old to @new and returns its slot index there, or -ENOENT if the slot
+ * doesn't hold it anymore.
+ */
+static long oa_htab_move(struct bpf_oa_htab *oa, struct oa_htab_table *old,
+			 struct oa_htab_table *new, u32 idx, u32 tag)
+{
+	struct oa_htab_slot *s;
+	long new_idx;
+
+	s = oa_htab_slot(oa, old, idx / oa->slots_per_bucket,
+			 idx % oa->slots_per_bucket);
+	/* recheck, the element may have been deleted or moved meanwhile */
+	if (READ_ONCE(s->tag) != tag)
+		return -ENOENT;
+
+	atomic_inc(&new->used);
+	new_idx = oa_htab_claim(oa, new, tag);
+	atomic_dec(&new->reserve);
+	if (new_idx >= 0) {
+		oa_htab_publish(oa, new, new_idx, s->key,
+				oa_htab_value(oa, old, idx), tag);
+		oa_htab_kill_slot(oa, old, idx);
+	}
+	return new_idx;
+}
+
+/* Returns the value of the element found in slot @idx of @old, moving it
+ * to @new first if the resize has started moving elements.
+ */
+static void *oa_htab_lookup_move(struct bpf_oa_htab *oa,
+				 struct oa_htab_table *old,
+				 struct oa_htab_table *new,
+				 const void *key, u32 hash, u32 idx)
+{
+	raw_spinlock_t *lock = oa_htab_lock(oa, hash);
+	unsigned long flags;
+	long new_idx;
+
+	/* pairs with smp_store_release() in oa_htab_resize_work() */
+	if (!smp_load_acquire(&new->moving) ||
+	    !raw_spin_trylock_irqsave(lock, flags))
+		return oa_htab_value(oa, old, idx);
+
+	new_idx = oa_htab_move(oa, old, new, idx, hash);
+	if (new_idx == -ENOENT)
+		new_idx = oa_htab_find(oa, new, key, hash);
+	raw_spin_unlock_irqrestore(lock, flags);
+
+	if (new_idx >= 0)
+		return oa_htab_value(oa, new, new_idx);
+	/* deleted meanwhile, or no room to move it: stay in the old table */
+	return new_idx == -ENOENT ? NULL : oa_htab_value(oa, old, idx);
+}
+
+/* Called from syscall or from eBPF program */
+static void *oa_htab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_oa_htab *oa = container_of(map, struct bpf_oa_htab, map);
+	struct oa_htab_table *old, *cur;
+	u32 hash;
+	long idx;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	hash = oa_htab_hash(oa, key);
+	oa_htab_tables(oa, &old, &cur);
+
+	/* Check the old table first: an element being moved is published
+	 * in the new table before it is removed from the old one.
+	 */
+	if (old) {
+		idx = oa_htab_find(oa, old, key, hash);
+		if (idx >= 0)
+			return oa_htab_lookup_move(oa, old, cur, key, hash, idx);
+	}
+
+	idx = oa_htab_find(oa, cur, key, hash);
+	return idx >= 0 ? oa_htab_value(oa, cur, idx) : NULL;
+}
+
+/* Called from syscall or from eBPF program */
+static int oa_htab_map_update_elem(struct bpf_map *map, void *key,
+				   void *value, u64 map_flags)
+{
+	struct bpf_oa_htab *oa = container_of(map, struct bpf_oa_htab, map);
+	struct oa_htab_table *old, *cur, *tbl;
+	raw_spinlock_t *lock;
+	unsigned long flags;
+	u32 hash;
+	long idx;
+	int ret;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	hash = oa_htab_hash(oa, key);
+	lock = oa_htab_lock(oa, hash);
+
+	raw_spin_lock_irqsave(lock, flags);
+	oa_htab_tables(oa, &old, &cur);
+
+	tbl = old;
+	idx = old ? oa_htab_find(oa, old, key, hash) : -ENOENT;
+	if (idx < 0) {
+		tbl = cur;
+		idx = oa_htab_find(oa, cur, key, hash);
+	}
+
+	if (idx >= 0) {
+		ret = -EEXIST;
+		if (map_flags == BPF_NOEXIST)
+			goto unlock;
+		memcpy(oa_htab_value(oa, tbl, idx), value, map->value_size);
+		ret = 0;
+		goto unlock;
+	}
+
+	ret = -ENOENT;
+	if (map_flags == BPF_EXIST)
+		goto unlock;
+
+	ret = oa_htab_insert(oa, cur, key, value, hash);
+unlock:
+	raw_spin_unlock_irqrestore(lock, flags);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int oa_htab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_oa_htab *oa = container_of(map, struct bpf_oa_htab, map);
+	struct oa_htab_table *old, *cur, *tbl;
+	raw_spinlock_t *lock;
+	unsigned long flags;
+	u32 hash;
+	long idx;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	hash = oa_htab_hash(oa, key);
+	lock = oa_htab_lock(oa, hash);
+
+	raw_spin_lock_irqsave(lock, flags);
+	oa_htab_tables(oa, &old, &cur);
+
+	tbl = old;
+	idx = old ? oa_htab_find(oa, old, key, hash) : -ENOENT;
+	if (idx < 0) {
+		tbl = cur;
+		idx = oa_htab_find(oa, cur, key, hash);
+	}
+
+	if (idx >= 0) {
+		oa_htab_kill_slot(oa, tbl, idx);
+		atomic_dec(&oa->count);
+	}
+	raw_spin_unlock_irqrestore(lock, flags);
+
+	return idx >= 0 ? 0 : -ENOENT;
+}
+
+static int oa_htab_next_live(const struct bpf_oa_htab *oa,
+			     const struct oa_htab_table *tbl, u32 idx,
+			     void *next_key)
+{
+	for (; idx < tbl->n_slots; idx++) {
+		struct oa_htab_slot *s;
+
+		s = oa_htab_slot(oa, tbl, idx / oa->slots_per_bucket,
+				 idx % oa->slots_per_bucket);
+		if (smp_load_acquire(&s->tag) & OA_SLOT_HASHED) {
+			memcpy(next_key, s->key, oa->map.key_size);
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/* Called from syscall. Iteration is best effort while a resize is in
+ * progress: elements moved behind the cursor may be returned twice.
+ */
+static int oa_htab_map_get_next_key(struct bpf_map *map, void *key,
+				    void *next_key)
+{
+	struct bpf_oa_htab *oa = container_of(map, struct bpf_oa_htab, map);
+	struct oa_htab_table *old, *cur;
+	u32 hash, idx = 0;
+	long found;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	oa_htab_tables(oa, &old, &cur);
+
+	if (key) {
+		hash = oa_htab_hash(oa, key);
+		if (old) {
+			found = oa_htab_find(oa, old, key, hash);
+			if (found >= 0) {
+				if (!oa_htab_next_live(oa, old, found + 1,
+						       next_key))
+					return 0;
+				return oa_htab_next_live(oa, cur, 0, next_key);
+			}
+		}
+		found = oa_htab_find(oa, cur, key, hash);
+		if (found >= 0)
+			return oa_htab_next_live(oa, cur, found + 1, next_key);
+	}
+
+	/* key was not found or was NULL: start from the beginning */
+	if (old && !oa_htab_next_live(oa, old, idx, next_key))
+		return 0;
+	return oa_htab_next_live(oa, cur, idx, next_key);
+}
+
+static struct oa_htab_table *oa_htab_table_alloc(struct bpf_oa_htab *oa,
+						 u32 n_buckets)
+{
+	u32 n_slots = n_buckets * oa->slots_per_bucket;
+	struct oa_htab_table *tbl;
+
+	tbl = kzalloc_node(sizeof(*tbl), GFP_USER | __GFP_NOWARN,
+			   oa->map.numa_node);
+	if (!tbl)
+		return NULL;
+
+	/* EMPTY is zero, and the bucket area is zeroed */
+	tbl->buckets = bpf_map_area_alloc((u64)n_buckets * OA_HTAB_BUCKET_SIZE,
+					  oa->map.numa_node);
+	if (!tbl->buckets)
+		goto free_tbl;
+
+	tbl->values = bpf_map_area_alloc((u64)n_slots * oa->value_elem_size,
+					 oa->map.numa_node);
+	if (!tbl->values)
+		goto free_buckets;
+
+	tbl->n_buckets = n_buckets;
+	tbl->n_slots = n_slots;
+	return tbl;
+
+free_buckets:
+	bpf_map_area_free(tbl->buckets);
+free_tbl:
+	kfree(tbl);
+	return NULL;
+}
+
+static void oa_htab_table_free(struct oa_htab_table *tbl)
+{
+	bpf_map_area_free(tbl->values);
+	bpf_map_area_free(tbl->buckets);
+	kfree(tbl);
+}
+
+/* Number of buckets the table should be rebuilt with, or 0 if @tbl is fine.
+ * Tables never shrink, which lets the migration reserve room for every
+ * element of the old table in the new one.
+ */
+static u32 oa_htab_resize_target(const struct bpf_oa_htab *oa,
+				 const struct oa_htab_table *tbl)
+{
+	u64 slots = (u64)atomic_read(&oa->count) * 2;
+	u32 n_buckets;
+
+	if (!oa_htab_over_threshold(tbl))
+		return 0;
+
+	n_buckets = roundup_pow_of_two(DIV_ROUND_UP_ULL(slots ?: 1,
+						       oa->slots_per_bucket));
+	n_buckets = clamp(n_buckets, tbl->n_buckets, oa->max_buckets);
+
+	/* same size: only worth it if enough tombstones can be reclaimed */
+	if (n_buckets == tbl->n_buckets &&
+	    atomic_read(&tbl->used) - atomic_read(&tbl->live) <
+	    tbl->n_slots / 4)
+		return 0;
+
+	return n_buckets;
+}
+
+static void oa_htab_migrate_bucket(struct bpf_oa_htab *oa,
+				   struct oa_htab_table *old,
+				   struct oa_htab_table *new, u32 bucket)
+{
+	u32 pos, base = bucket * oa->slots_per_bucket;
+	raw_spinlock_t *lock;
+	unsigned long flags;
+
+	bpf_disable_instrumentation();
+	for (pos = 0; pos < oa->slots_per_bucket; pos++) {
+		struct oa_htab_slot *s = oa_htab_slot(oa, old, bucket, pos);
+		u32 tag = READ_ONCE(s->tag);
+
+		if (!(tag & OA_SLOT_HASHED))
+			continue;
+
+		lock = oa_htab_lock(oa, tag);
+		raw_spin_lock_irqsave(lock, flags);
+		oa_htab_move(oa, old, new, base + pos, tag);
+		raw_spin_unlock_irqrestore(lock, flags);
+	}
+	bpf_enable_instrumentation();
+}
+
+static void oa_htab_resize_work(struct work_struct *work)
+{
+	struct bpf_oa_htab *oa = container_of(work, struct bpf_oa_htab,
+					      resize_work);
+	/* only this work item ever changes oa->table */
+	struct oa_htab_table *old = oa->table, *new;
+	u32 n_buckets, bucket;
+
+	n_buckets = oa_htab_resize_target(oa, old);
+	if (!n_buckets)
+		return;
+
+	/* on failure, the next insert over the threshold retries */
+	new = oa_htab_table_alloc(oa, n_buckets);
+	if (!new)
+		return;
+
+	/* Until every writer has seen new_table, elements may still be
+	 * inserted into the old table: hold back room for all of its slots.
+	 */
+	atomic_set(&new->reserve, old->n_slots);
+	smp_store_release(&oa->new_table, new);
+	synchronize_rcu();
+
+	/* From now on, old->live can only decrease */
+	atomic_set(&new->reserve, atomic_read(&old->live));
+
+	/* Let lookups move the elements they find, and wait for those that
+	 * may still hold a value pointer into the old table.
+	 */
+	smp_store_release(&new->moving, true);
+	synchronize_rcu();
+
+	for (bucket = 0; bucket < old->n_buckets; bucket++) {
+		oa_htab_migrate_bucket(oa, old, new, bucket);
+		cond_resched();
+	}
+
+	/* pairs with smp_load_acquire() in oa_htab_tables() */
+	smp_store_release(&oa->table, new);
+	smp_store_release(&oa->new_table, NULL);
+	synchronize_rcu();
+	oa_htab_table_free(old);
+
+	if (oa_htab_resize_target(oa, new))
+		queue_work(system_unbound_wq, &oa->resize_work);
+}
+
+/* Called from syscall */
+static int oa_htab_map_alloc_check(union bpf_attr *attr)
+{
+	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+
+	if (zero_seed && !capable(CAP_SYS_ADMIN))
+		/* Guard against local DoS, and discourage production use. */
+		return -EPERM;
+
+	if (attr->map_flags & ~OA_HTAB_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags))
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > OA_HTAB_MAX_KEY_SIZE)
+		/* keys are stored inline, at least two per bucket */
+		return -E2BIG;
+
+	if (attr->value_size >= KMALLOC_MAX_SIZE - MAX_BPF_STACK)
+		/* if value_size is bigger, the user space won't be able to
+		 * access the elements via bpf syscall.
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *oa_htab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_oa_htab *oa;
+	u32 n_locks, i;
+	u64 slots, cost;
+	int err;
+
+	oa = kzalloc(sizeof(*oa), GFP_USER);
+	if (!oa)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&oa->map, attr);
+
+	oa->slot_size = round_up(sizeof(struct oa_htab_slot) +
+				 oa->map.key_size, sizeof(u32));
+	oa->slots_per_bucket = OA_HTAB_BUCKET_SIZE / oa->slot_size;
+	oa->value_elem_size = round_up(oa->map.value_size, 8);
+
+	/* the largest table keeps the load under 50% at max_entries */
+	err = -E2BIG;
+	slots = (u64)oa->map.max_entries * 2;
+	if (DIV_ROUND_UP_ULL(slots, oa->slots_per_bucket) > (1U << 31) /
+	    OA_HTAB_BUCKET_SIZE)
+		goto free_oa;
+	oa->max_buckets = roundup_pow_of_two(DIV_ROUND_UP_ULL(slots,
+						oa->slots_per_bucket));
+
+	n_locks = min_t(u32, roundup_pow_of_two(num_possible_cpus() * 4),
+			OA_HTAB_MAX_LOCKS);
+	oa->lock_mask = n_locks - 1;
+
+	/* Charge for the largest table up front, even though it is only
+	 * allocated once the map grows that big.
+	 */
+	cost = sizeof(*oa) + (u64)n_locks * sizeof(raw_spinlock_t) +
+	       (u64)oa->max_buckets * (OA_HTAB_BUCKET_SIZE +
+			oa->slots_per_bucket * oa->value_elem_size);
+
+	/* if map size is larger than memlock limit, reject it */
+	err = bpf_map_charge_init(&oa->map.memory, cost);
+	if (err)
+		goto free_oa;
+
+	err = -ENOMEM;
+	oa->locks = bpf_map_area_alloc((u64)n_locks * sizeof(raw_spinlock_t),
+				       oa->map.numa_node);
+	if (!oa->locks)
+		goto free_charge;
+	for (i = 0; i < n_locks; i++)
+		raw_spin_lock_init(&oa->locks[i]);
+
+	oa->table = oa_htab_table_alloc(oa, min_t(u32, OA_HTAB_MIN_BUCKETS,
+						  oa->max_buckets));
+	if (!oa->table)
+		goto free_locks;
+
+	if (oa->map.map_flags & BPF_F_ZERO_SEED)
+		oa->hashrnd = 0;
+	else
+		oa->hashrnd = get_random_int();
+
+	init_irq_work(&oa->resize_irq_work, oa_htab_resize_irq_work);
+	INIT_WORK(&oa->resize_work, oa_htab_resize_work);
+
+	return &oa->map;
+
+free_locks:
+	bpf_map_area_free(oa->locks);
+free_charge:
+	bpf_map_charge_finish(&oa->map.memory);
+free_oa:
+	kfree(oa);
+	return ERR_PTR(err);
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void oa_htab_map_free(struct bpf_map *map)
+{
+	struct bpf_oa_htab *oa = container_of(map, struct bpf_oa_htab, map);
+
+	/* No program can use the map anymore, but a resize may be pending.
+	 * A running resize always completes, leaving new_table NULL.
+	 */
+	irq_work_sync(&oa->resize_irq_work);
+	cancel_work_sync(&oa->resize_work);
+
+	oa_htab_table_free(oa->table);
+	bpf_map_area_free(oa->locks);
+	kfree(oa);
+}
+
+static int oa_htab_map_btf_id;
+const struct bpf_map_ops oa_htab_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = oa_htab_map_alloc_check,
+	.map_alloc = oa_htab_map_alloc,
+	.map_free = oa_htab_map_free,
+	.map_get_next_key = oa_htab_map_get_next_key,
+	.map_lookup_elem = oa_htab_map_lookup_elem,
+	.map_update_elem = oa_htab_map_update_elem,
+	.map_delete_elem = oa_htab_map_delete_elem,
+	.map_btf_name = "bpf_oa_htab",
+	.map_btf_id = &oa_htab_map_btf_id,
+};
@@ -8,6 +8,7 @@
 
 struct bpf_iter_seq_prog_info {
 	u32 prog_id;
+	struct bpf_prog_sampled_stats stats;
 };
 
 static void *bpf_prog_seq_start(struct seq_file *seq, loff_t *pos)
@@ -37,12 +38,15 @@ static void *bpf_prog_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 struct bpf_iter__bpf_prog {
 	__bpf_md_ptr(struct bpf_iter_meta *, meta);
 	__bpf_md_ptr(struct bpf_prog *, prog);
+	__bpf_md_ptr(struct bpf_prog_sampled_stats *, stats);
 };
 
-DEFINE_BPF_ITER_FUNC(bpf_prog, struct bpf_iter_meta *meta, struct bpf_prog *prog)
+DEFINE_BPF_ITER_FUNC(bpf_prog, struct bpf_iter_meta *meta,
+		     struct bpf_prog *prog, struct bpf_prog_sampled_stats *stats)
 
 static int __bpf_prog_seq_show(struct seq_file *seq, void *v, bool in_stop)
 {
+	struct bpf_iter_seq_prog_info *info = seq->private;
 	struct bpf_iter__bpf_prog ctx;
 	struct bpf_iter_meta meta;
 	struct bpf_prog *prog;
@@ -50,6 +54,12 @@ static int __bpf_prog_seq_show(struct seq_file *seq, void *v, bool in_stop)
 
 	ctx.meta = &meta;
 	ctx.prog = v;
+	ctx.stats = NULL;
+	if (v) {
+		/* summed over CPUs so the program can dump it directly */
+		bpf_prog_get_sampled_stats(v, &info->stats);
+		ctx.stats = &info->stats;
+	}
 	meta.seq = seq;
 	prog = bpf_iter_get_info(&meta, in_stop);
 	if (prog)
@@ -80,6 +90,7 @@ static const struct seq_operations bpf_prog_seq_ops = {
 
 BTF_ID_LIST(btf_bpf_prog_id)
 BTF_ID(struct, bpf_prog)
+BTF_ID(struct, bpf_prog_sampled_stats)
 
 static const struct bpf_iter_seq_info bpf_prog_seq_info = {
 	.seq_ops		= &bpf_prog_seq_ops,
@@ -90,17 +101,20 @@ static const struct bpf_iter_seq_info bpf_prog_seq_info = {
 
 static struct bpf_iter_reg bpf_prog_reg_info = {
 	.target			= "bpf_prog",
-	.ctx_arg_info_size	= 1,
+	.ctx_arg_info_size	= 2,
 	.ctx_arg_info		= {
 		{ offsetof(struct bpf_iter__bpf_prog, prog),
 		  PTR_TO_BTF_ID_OR_NULL },
+		{ offsetof(struct bpf_iter__bpf_prog, stats),
+		  PTR_TO_BTF_ID_OR_NULL },
 	},
 	.seq_info		= &bpf_prog_seq_info,
 };
 
 static int __init bpf_prog_iter_init(void)
 {
-	bpf_prog_reg_info.ctx_arg_info[0].btf_id = *btf_bpf_prog_id;
+	bpf_prog_reg_info.ctx_arg_info[0].btf_id = btf_bpf_prog_id[0];
+	bpf_prog_reg_info.ctx_arg_info[1].btf_id = btf_bpf_prog_id[1];
 	return bpf_iter_reg_target(&bpf_prog_reg_info);
 }
 
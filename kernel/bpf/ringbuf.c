@@ -10,7 +10,7 @@
 #include <linux/poll.h>
 #include <uapi/linux/btf.h>
 
-#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_RINGBUF_PERCPU)
 
 /* non-mmap()'able part of bpf_ringbuf (everything up to consumer page) */
 #define RINGBUF_PGOFF \
@@ -42,6 +42,7 @@ struct bpf_ringbuf {
 	 * application and ruining in-kernel position tracking.
 	 */
 	unsigned long consumer_pos __aligned(PAGE_SIZE);
+	unsigned long consumer_flags; /* BPF_RB_CONS_*, set by user-space */
 	unsigned long producer_pos __aligned(PAGE_SIZE);
 	char data[] __aligned(PAGE_SIZE);
 };
@@ -50,6 +51,13 @@ struct bpf_ringbuf_map {
 	struct bpf_map map;
 	struct bpf_map_memory memory;
 	struct bpf_ringbuf *rb;
+	/* BPF_F_RINGBUF_PERCPU: one ring per possible CPU, indexed by CPU
+	 * id, so that producers on different CPUs don't share a lock.
+	 * User-space maps the ring of the n-th possible CPU at n times the
+	 * size of one ring's mmap()'able area, so that holes in the possible
+	 * mask don't leave holes in the map.
+	 */
+	struct bpf_ringbuf **rbs;
 };
 
 /* 8-byte ring buffer record header structure */
@@ -147,10 +155,39 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	return rb;
 }
 
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb);
+
+static int bpf_ringbuf_alloc_percpu(struct bpf_ringbuf_map *rb_map,
+				    size_t data_sz)
+{
+	struct bpf_ringbuf *rb;
+	int cpu;
+
+	rb_map->rbs = kcalloc(nr_cpu_ids, sizeof(*rb_map->rbs), GFP_USER);
+	if (!rb_map->rbs)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		rb = bpf_ringbuf_alloc(data_sz, cpu_to_node(cpu));
+		if (IS_ERR(rb))
+			goto err_free;
+		rb_map->rbs[cpu] = rb;
+		cond_resched();
+	}
+	return 0;
+
+err_free:
+	for_each_possible_cpu(cpu)
+		if (rb_map->rbs[cpu])
+			bpf_ringbuf_free(rb_map->rbs[cpu]);
+	kfree(rb_map->rbs);
+	return PTR_ERR(rb);
+}
+
 static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 {
 	struct bpf_ringbuf_map *rb_map;
-	u64 cost;
+	u64 cost, nr_rings = 1;
 	int err;
 
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
@@ -173,13 +210,23 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 
 	bpf_map_init_from_attr(&rb_map->map, attr);
 
+	/* in per-CPU mode, max_entries is the size of each CPU's ring */
+	if (attr->map_flags & BPF_F_RINGBUF_PERCPU)
+		nr_rings = num_possible_cpus();
+
 	cost = sizeof(struct bpf_ringbuf_map) +
-	       sizeof(struct bpf_ringbuf) +
-	       attr->max_entries;
+	       nr_rings * (sizeof(struct bpf_ringbuf) + attr->max_entries);
 	err = bpf_map_charge_init(&rb_map->map.memory, cost);
 	if (err)
 		goto err_free_map;
 
+	if (attr->map_flags & BPF_F_RINGBUF_PERCPU) {
+		err = bpf_ringbuf_alloc_percpu(rb_map, attr->max_entries);
+		if (err)
+			goto err_uncharge;
+		return &rb_map->map;
+	}
+
 	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
 	if (IS_ERR(rb_map->rb)) {
 		err = PTR_ERR(rb_map->rb);
@@ -212,12 +259,30 @@ static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
 static void ringbuf_map_free(struct bpf_map *map)
 {
 	struct bpf_ringbuf_map *rb_map;
+	int cpu;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	bpf_ringbuf_free(rb_map->rb);
+	if (rb_map->rbs) {
+		for_each_possible_cpu(cpu)
+			bpf_ringbuf_free(rb_map->rbs[cpu]);
+		kfree(rb_map->rbs);
+	} else {
+		bpf_ringbuf_free(rb_map->rb);
+	}
 	kfree(rb_map);
 }
 
+/* The ring that the current CPU produces into */
+static struct bpf_ringbuf *bpf_ringbuf_this_cpu(struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->rbs)
+		return rb_map->rbs[smp_processor_id()];
+	return rb_map->rb;
+}
+
 static void *ringbuf_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	return ERR_PTR(-ENOTSUPP);
@@ -248,19 +313,48 @@ static size_t bpf_ringbuf_mmap_page_cnt(const struct bpf_ringbuf *rb)
 	return RINGBUF_POS_PAGES + 2 * data_pages;
 }
 
+/* The id of the n-th possible CPU, or nr_cpu_ids if there are fewer */
+static unsigned int ringbuf_nth_possible_cpu(unsigned long n)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		if (!n--)
+			return cpu;
+	return nr_cpu_ids;
+}
+
 static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
 {
 	struct bpf_ringbuf_map *rb_map;
+	unsigned long pgoff = vma->vm_pgoff;
+	struct bpf_ringbuf *rb;
 	size_t mmap_sz;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	mmap_sz = bpf_ringbuf_mmap_page_cnt(rb_map->rb) << PAGE_SHIFT;
+	rb = rb_map->rb;
+
+	if (rb_map->rbs) {
+		/* every ring has the same layout, pick one by the offset */
+		unsigned long idx;
+		unsigned int cpu;
+		size_t page_cnt;
+
+		rb = rb_map->rbs[cpumask_first(cpu_possible_mask)];
+		page_cnt = bpf_ringbuf_mmap_page_cnt(rb);
+		idx = pgoff / page_cnt;
+		cpu = ringbuf_nth_possible_cpu(idx);
+		if (cpu >= nr_cpu_ids)
+			return -EINVAL;
+		rb = rb_map->rbs[cpu];
+		pgoff -= idx * page_cnt;
+	}
+	mmap_sz = bpf_ringbuf_mmap_page_cnt(rb) << PAGE_SHIFT;
 
-	if (vma->vm_pgoff * PAGE_SIZE + (vma->vm_end - vma->vm_start) > mmap_sz)
+	if (pgoff * PAGE_SIZE + (vma->vm_end - vma->vm_start) > mmap_sz)
 		return -EINVAL;
 
-	return remap_vmalloc_range(vma, rb_map->rb,
-				   vma->vm_pgoff + RINGBUF_PGOFF);
+	return remap_vmalloc_range(vma, rb, pgoff + RINGBUF_PGOFF);
 }
 
 static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb)
@@ -276,13 +370,25 @@ static __poll_t ringbuf_map_poll(struct bpf_map *map, struct file *filp,
 				 struct poll_table_struct *pts)
 {
 	struct bpf_ringbuf_map *rb_map;
+	__poll_t mask = 0;
+	int cpu;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	poll_wait(filp, &rb_map->rb->waitq, pts);
+	if (!rb_map->rbs) {
+		poll_wait(filp, &rb_map->rb->waitq, pts);
 
-	if (ringbuf_avail_data_sz(rb_map->rb))
-		return EPOLLIN | EPOLLRDNORM;
-	return 0;
+		if (ringbuf_avail_data_sz(rb_map->rb))
+			return EPOLLIN | EPOLLRDNORM;
+		return 0;
+	}
+
+	/* the map is readable as soon as any of the rings is */
+	for_each_possible_cpu(cpu) {
+		poll_wait(filp, &rb_map->rbs[cpu]->waitq, pts);
+		if (ringbuf_avail_data_sz(rb_map->rbs[cpu]))
+			mask = EPOLLIN | EPOLLRDNORM;
+	}
+	return mask;
 }
 
 static int ringbuf_map_btf_id;
@@ -324,11 +430,18 @@ bpf_ringbuf_restore_from_rec(struct bpf_ringbuf_hdr *hdr)
 	return (void*)((addr & PAGE_MASK) - off);
 }
 
-static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
+/* Reserve up to *nr consecutive records of size bytes each, under a single
+ * acquisition of the producer lock. On success, *nr is updated to the number
+ * of records reserved, and the first one is returned. The following ones
+ * are at round_up(size + BPF_RINGBUF_HDR_SZ, 8) byte strides, see
+ * bpf_ringbuf_next_rec().
+ */
+static void *__bpf_ringbuf_reserve_n(struct bpf_ringbuf *rb, u64 size,
+				     u32 *nr)
 {
 	unsigned long cons_pos, prod_pos, new_prod_pos, flags;
-	u32 len, pg_off;
 	struct bpf_ringbuf_hdr *hdr;
+	u32 len, n, i;
 
 	if (unlikely(size > RINGBUF_MAX_RECORD_SZ))
 		return NULL;
@@ -344,38 +457,57 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	}
 
 	prod_pos = rb->producer_pos;
-	new_prod_pos = prod_pos + len;
 
 	/* check for out of ringbuf space by ensuring producer position
 	 * doesn't advance more than (ringbuf_size - 1) ahead
 	 */
-	if (new_prod_pos - cons_pos > rb->mask) {
+	n = min_t(u64, *nr, (rb->mask - (prod_pos - cons_pos)) / len);
+	if (!n) {
 		spin_unlock_irqrestore(&rb->spinlock, flags);
 		return NULL;
 	}
+	new_prod_pos = prod_pos + (u64)n * len;
 
-	hdr = (void *)rb->data + (prod_pos & rb->mask);
-	pg_off = bpf_ringbuf_rec_pg_off(rb, hdr);
-	hdr->len = size | BPF_RINGBUF_BUSY_BIT;
-	hdr->pg_off = pg_off;
+	for (i = 0; i < n; i++) {
+		hdr = (void *)rb->data + ((prod_pos + (u64)i * len) & rb->mask);
+		hdr->len = size | BPF_RINGBUF_BUSY_BIT;
+		hdr->pg_off = bpf_ringbuf_rec_pg_off(rb, hdr);
+	}
 
 	/* pairs with consumer's smp_load_acquire() */
 	smp_store_release(&rb->producer_pos, new_prod_pos);
 
 	spin_unlock_irqrestore(&rb->spinlock, flags);
 
+	*nr = n;
+	hdr = (void *)rb->data + (prod_pos & rb->mask);
 	return (void *)hdr + BPF_RINGBUF_HDR_SZ;
 }
 
-BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
+static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 {
-	struct bpf_ringbuf_map *rb_map;
+	u32 nr = 1;
+
+	return __bpf_ringbuf_reserve_n(rb, size, &nr);
+}
+
+/* Given a record reserved by __bpf_ringbuf_reserve_n(), return the next */
+static void *bpf_ringbuf_next_rec(struct bpf_ringbuf *rb, void *sample,
+				  u64 size)
+{
+	unsigned long pos = sample - BPF_RINGBUF_HDR_SZ - (void *)rb->data;
+
+	pos += round_up(size + BPF_RINGBUF_HDR_SZ, 8);
+	return (void *)rb->data + (pos & rb->mask) + BPF_RINGBUF_HDR_SZ;
+}
 
+BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
+{
 	if (unlikely(flags))
 		return 0;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
+	return (unsigned long)__bpf_ringbuf_reserve(bpf_ringbuf_this_cpu(map),
+						    size);
 }
 
 const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
@@ -386,9 +518,30 @@ const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
 	.arg3_type	= ARG_ANYTHING,
 };
 
+/* Notify the consumer, if it caught up and is waiting for the record at
+ * rec_pos
+ */
+static void bpf_ringbuf_wakeup(struct bpf_ringbuf *rb, unsigned long rec_pos,
+			       u64 flags)
+{
+	unsigned long cons_pos;
+
+	cons_pos = smp_load_acquire(&rb->consumer_pos) & rb->mask;
+
+	/* The xchg() committing the record orders it before the read of
+	 * consumer_flags. User-space clears BPF_RB_CONS_BUSY_POLL, then
+	 * issues a full barrier and consumes: either it sees the record or
+	 * we see the flag cleared and wake it up.
+	 */
+	if (flags & BPF_RB_FORCE_WAKEUP)
+		irq_work_queue(&rb->work);
+	else if (cons_pos == rec_pos && !(flags & BPF_RB_NO_WAKEUP) &&
+		 !(READ_ONCE(rb->consumer_flags) & BPF_RB_CONS_BUSY_POLL))
+		irq_work_queue(&rb->work);
+}
+
 static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 {
-	unsigned long rec_pos, cons_pos;
 	struct bpf_ringbuf_hdr *hdr;
 	struct bpf_ringbuf *rb;
 	u32 new_len;
@@ -402,16 +555,7 @@ static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 	/* update record header with correct final size prefix */
 	xchg(&hdr->len, new_len);
 
-	/* if consumer caught up and is waiting for our record, notify about
-	 * new data availability
-	 */
-	rec_pos = (void *)hdr - (void *)rb->data;
-	cons_pos = smp_load_acquire(&rb->consumer_pos) & rb->mask;
-
-	if (flags & BPF_RB_FORCE_WAKEUP)
-		irq_work_queue(&rb->work);
-	else if (cons_pos == rec_pos && !(flags & BPF_RB_NO_WAKEUP))
-		irq_work_queue(&rb->work);
+	bpf_ringbuf_wakeup(rb, (void *)hdr - (void *)rb->data, flags);
 }
 
 BPF_CALL_2(bpf_ringbuf_submit, void *, sample, u64, flags)
@@ -443,14 +587,12 @@ const struct bpf_func_proto bpf_ringbuf_discard_proto = {
 BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 	   u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *rec;
 
 	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
 		return -EINVAL;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
+	rec = __bpf_ringbuf_reserve(bpf_ringbuf_this_cpu(map), size);
 	if (!rec)
 		return -EAGAIN;
 
@@ -468,11 +610,57 @@ const struct bpf_func_proto bpf_ringbuf_output_proto = {
 	.arg4_type	= ARG_ANYTHING,
 };
 
+BPF_CALL_5(bpf_ringbuf_output_batch, struct bpf_map *, map, void *, data,
+	   u64, size, u64, rec_size, u64, flags)
+{
+	struct bpf_ringbuf *rb;
+	void *first, *rec;
+	u32 nr, i;
+
+	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
+		return -EINVAL;
+	if (unlikely(!rec_size || size % rec_size))
+		return -EINVAL;
+
+	nr = size / rec_size;
+	if (!nr)
+		return 0;
+
+	rb = bpf_ringbuf_this_cpu(map);
+	first = __bpf_ringbuf_reserve_n(rb, rec_size, &nr);
+	if (!first)
+		return -EAGAIN;
+
+	/* commit in order, and only notify once for the whole run: the
+	 * consumer can only be waiting for the first record
+	 */
+	for (i = 0, rec = first; i < nr; i++) {
+		struct bpf_ringbuf_hdr *hdr = rec - BPF_RINGBUF_HDR_SZ;
+
+		memcpy(rec, data + i * rec_size, rec_size);
+		xchg(&hdr->len, hdr->len ^ BPF_RINGBUF_BUSY_BIT);
+		rec = bpf_ringbuf_next_rec(rb, rec, rec_size);
+	}
+	bpf_ringbuf_wakeup(rb, first - BPF_RINGBUF_HDR_SZ - (void *)rb->data,
+			   flags);
+	return nr;
+}
+
+const struct bpf_func_proto bpf_ringbuf_output_batch_proto = {
+	.func		= bpf_ringbuf_output_batch,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE_OR_ZERO,
+	.arg4_type	= ARG_ANYTHING,
+	.arg5_type	= ARG_ANYTHING,
+};
+
 BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
 	struct bpf_ringbuf *rb;
 
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	rb = bpf_ringbuf_this_cpu(map);
 
 	switch (flags) {
 	case BPF_RB_AVAIL_DATA:
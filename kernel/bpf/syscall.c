@@ -194,7 +194,8 @@ static int bpf_map_update_value(struct bpf_map *map, struct fd f, void *key,
 		err = bpf_fd_reuseport_array_update_elem(map, key, value,
 							 flags);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_push_elem(map, value, flags);
 	} else {
 		rcu_read_lock();
@@ -233,7 +234,8 @@ static int bpf_map_copy_value(struct bpf_map *map, void *key, void *value,
 	} else if (map->map_type == BPF_MAP_TYPE_REUSEPORT_SOCKARRAY) {
 		err = bpf_fd_reuseport_array_lookup_elem(map, key, value);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_peek_elem(map, value);
 	} else if (map->map_type == BPF_MAP_TYPE_STRUCT_OPS) {
 		/* struct_ops map requires directly updating "value" */
@@ -256,7 +258,7 @@ static int bpf_map_copy_value(struct bpf_map *map, void *key, void *value,
 			else
 				copy_map_value(map, value, ptr);
 			/* mask lock, since value wasn't zero inited */
-			check_and_init_map_lock(map, value);
+			check_and_init_map_value(map, value);
 		}
 		rcu_read_unlock();
 	}
@@ -339,6 +341,7 @@ void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr)
 	map->max_entries = attr->max_entries;
 	map->map_flags = bpf_map_flags_retain_permanent(attr->map_flags);
 	map->numa_node = bpf_map_attr_numa_node(attr);
+	map->map_extra = attr->map_extra;
 }
 
 static int bpf_charge_memlock(struct user_struct *user, u32 pages)
@@ -547,7 +550,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "map_flags:\t%#x\n"
 		   "memlock:\t%llu\n"
 		   "map_id:\t%u\n"
-		   "frozen:\t%u\n",
+		   "frozen:\t%u\n"
+		   "map_extra:\t%#llx\n",
 		   map->map_type,
 		   map->key_size,
 		   map->value_size,
@@ -555,7 +559,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		   map->map_flags,
 		   map->memory.pages * 1ULL << PAGE_SHIFT,
 		   map->id,
-		   READ_ONCE(map->frozen));
+		   READ_ONCE(map->frozen),
+		   map->map_extra);
 	if (type) {
 		seq_printf(m, "owner_prog_type:\t%u\n", type);
 		seq_printf(m, "owner_jited:\t%u\n", jited);
@@ -615,7 +620,8 @@ static int bpf_map_mmap(struct file *filp, struct vm_area_struct *vma)
 	struct bpf_map *map = filp->private_data;
 	int err;
 
-	if (!map->ops->map_mmap || map_value_has_spin_lock(map))
+	if (!map->ops->map_mmap || map_value_has_spin_lock(map) ||
+	    map_value_has_timer(map))
 		return -ENOTSUPP;
 
 	if (!(vma->vm_flags & VM_SHARED))
@@ -784,13 +790,23 @@ static int map_check_btf(struct bpf_map *map, const struct btf *btf,
 		}
 	}
 
+	map->timer_off = btf_find_timer(btf, value_type);
+	if (map_value_has_timer(map)) {
+		if (map->map_flags & BPF_F_RDONLY_PROG)
+			return -EACCES;
+		if (map->map_type != BPF_MAP_TYPE_HASH &&
+		    map->map_type != BPF_MAP_TYPE_LRU_HASH &&
+		    map->map_type != BPF_MAP_TYPE_ARRAY)
+			return -ENOTSUPP;
+	}
+
 	if (map->ops->map_check_btf)
 		ret = map->ops->map_check_btf(map, btf, key_type, value_type);
 
 	return ret;
 }
 
-#define BPF_MAP_CREATE_LAST_FIELD btf_vmlinux_value_type_id
+#define BPF_MAP_CREATE_LAST_FIELD map_extra
 /* called via syscall */
 static int map_create(union bpf_attr *attr)
 {
@@ -812,6 +828,11 @@ static int map_create(union bpf_attr *attr)
 		return -EINVAL;
 	}
 
+	if (attr->map_extra &&
+	    attr->map_type != BPF_MAP_TYPE_BLOOM_FILTER &&
+	    attr->map_type != BPF_MAP_TYPE_COUNT_MIN_SKETCH)
+		return -EINVAL;
+
 	f_flags = bpf_get_file_flag(attr->map_flags);
 	if (f_flags < 0)
 		return f_flags;
@@ -836,6 +857,7 @@ static int map_create(union bpf_attr *attr)
 	mutex_init(&map->freeze_mutex);
 
 	map->spin_lock_off = -EINVAL;
+	map->timer_off = -EINVAL;
 	if (attr->btf_key_type_id || attr->btf_value_type_id ||
 	    /* Even the map's value is a kernel's struct,
 	     * the bpf_prog.o must have BTF to begin with
@@ -1044,6 +1066,15 @@ static int map_lookup_elem(union bpf_attr *attr)
 	if (!value)
 		goto free_key;
 
+	if (map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
+		/* the value to test for is passed in */
+		err = -EFAULT;
+		if (copy_from_user(value, uvalue, value_size))
+			goto free_value;
+		err = bpf_map_copy_value(map, key, value, attr->flags);
+		goto free_value;
+	}
+
 	err = bpf_map_copy_value(map, key, value, attr->flags);
 	if (err)
 		goto free_value;
@@ -1792,14 +1823,54 @@ static void bpf_prog_get_stats(const struct bpf_prog *prog,
 	stats->cnt = cnt;
 }
 
+/* Extrapolate the total run time from the timed runs */
+static u64
+bpf_prog_sampled_run_time(const struct bpf_prog_sampled_stats *stats)
+{
+	if (!stats->samples)
+		return 0;
+	return mul_u64_u64_div_u64(stats->nsecs, stats->cnt, stats->samples);
+}
+
+void bpf_prog_get_sampled_stats(const struct bpf_prog *prog,
+				struct bpf_prog_sampled_stats *stats)
+{
+	u32 hist[BPF_PROG_STATS_HIST_BUCKETS];
+	int cpu, i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for_each_possible_cpu(cpu) {
+		const struct bpf_prog_stats *st;
+		u64 tcnt, tsamples, tnsecs;
+		unsigned int start;
+
+		st = per_cpu_ptr(prog->aux->stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_irq(&st->syncp);
+			tcnt = st->sampled_cnt;
+			tsamples = st->samples;
+			tnsecs = st->sampled_nsecs;
+			memcpy(hist, st->hist, sizeof(hist));
+		} while (u64_stats_fetch_retry_irq(&st->syncp, start));
+		stats->cnt += tcnt;
+		stats->samples += tsamples;
+		stats->nsecs += tnsecs;
+		for (i = 0; i < BPF_PROG_STATS_HIST_BUCKETS; i++)
+			stats->hist[i] += hist[i];
+	}
+}
+
 #ifdef CONFIG_PROC_FS
 static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 {
 	const struct bpf_prog *prog = filp->private_data;
 	char prog_tag[sizeof(prog->tag) * 2 + 1] = { };
+	struct bpf_prog_sampled_stats sampled;
 	struct bpf_prog_stats stats;
 
 	bpf_prog_get_stats(prog, &stats);
+	bpf_prog_get_sampled_stats(prog, &sampled);
 	bin2hex(prog_tag, prog->tag, sizeof(prog->tag));
 	seq_printf(m,
 		   "prog_type:\t%u\n"
@@ -1808,14 +1879,20 @@ static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "memlock:\t%llu\n"
 		   "prog_id:\t%u\n"
 		   "run_time_ns:\t%llu\n"
-		   "run_cnt:\t%llu\n",
+		   "run_cnt:\t%llu\n"
+		   "sampled_run_time_ns:\t%llu\n"
+		   "sampled_run_cnt:\t%llu\n"
+		   "run_samples:\t%llu\n",
 		   prog->type,
 		   prog->jited,
 		   prog_tag,
 		   prog->pages * 1ULL << PAGE_SHIFT,
 		   prog->aux->id,
 		   stats.nsecs,
-		   stats.cnt);
+		   stats.cnt,
+		   bpf_prog_sampled_run_time(&sampled),
+		   sampled.cnt,
+		   sampled.samples);
 }
 #endif
 
@@ -2111,6 +2188,7 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 				 BPF_F_ANY_ALIGNMENT |
 				 BPF_F_TEST_STATE_FREQ |
 				 BPF_F_SLEEPABLE |
+				 BPF_F_MULTI_FUNC |
 				 BPF_F_TEST_RND_HI32))
 		return -EINVAL;
 
@@ -2147,6 +2225,16 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 				       attr->attach_prog_fd))
 		return -EINVAL;
 
+	/* Multi function programs are fentry/fexit programs that get their
+	 * targets at BPF_LINK_CREATE time.
+	 */
+	if ((attr->prog_flags & BPF_F_MULTI_FUNC) &&
+	    (type != BPF_PROG_TYPE_TRACING ||
+	     (attr->expected_attach_type != BPF_TRACE_FENTRY &&
+	      attr->expected_attach_type != BPF_TRACE_FEXIT) ||
+	     attr->attach_btf_id || attr->attach_prog_fd))
+		return -EINVAL;
+
 	/* plain bpf_prog allocation */
 	prog = bpf_prog_alloc(bpf_prog_size(attr->insn_cnt), GFP_USER);
 	if (!prog)
@@ -2167,6 +2255,7 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 
 	prog->aux->offload_requested = !!attr->prog_ifindex;
 	prog->aux->sleepable = attr->prog_flags & BPF_F_SLEEPABLE;
+	prog->aux->multi_func = attr->prog_flags & BPF_F_MULTI_FUNC;
 
 	err = security_bpf_prog_alloc(prog->aux);
 	if (err)
@@ -2720,6 +2809,144 @@ static int bpf_tracing_prog_attach(struct bpf_prog *prog,
 	return err;
 }
 
+struct bpf_tracing_multi_link {
+	struct bpf_link link;
+	enum bpf_attach_type attach_type;
+	struct bpf_tramp_multi *mtr;
+	u32 cnt;
+};
+
+static void bpf_tracing_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	bpf_trampoline_multi_detach(tr_link->mtr);
+}
+
+static void bpf_tracing_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	kfree(tr_link);
+}
+
+static void bpf_tracing_multi_link_show_fdinfo(const struct bpf_link *link,
+					       struct seq_file *seq)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	seq_printf(seq,
+		   "attach_type:\t%d\n"
+		   "func_cnt:\t%u\n",
+		   tr_link->attach_type,
+		   tr_link->cnt);
+}
+
+static int bpf_tracing_multi_link_fill_link_info(const struct bpf_link *link,
+						 struct bpf_link_info *info)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	info->tracing_multi.attach_type = tr_link->attach_type;
+	info->tracing_multi.cnt = tr_link->cnt;
+
+	return 0;
+}
+
+static const struct bpf_link_ops bpf_tracing_multi_link_lops = {
+	.release = bpf_tracing_multi_link_release,
+	.dealloc = bpf_tracing_multi_link_dealloc,
+	.show_fdinfo = bpf_tracing_multi_link_show_fdinfo,
+	.fill_link_info = bpf_tracing_multi_link_fill_link_info,
+};
+
+#define BPF_TRACING_MULTI_MAX_CNT	(1U << 20)
+
+static int bpf_tracing_multi_attach(struct bpf_prog *prog,
+				    const union bpf_attr *attr)
+{
+	u32 __user *ubtf_ids = u64_to_user_ptr(attr->link_create.multi.btf_ids);
+	u32 i, btf_id, cnt = attr->link_create.multi.btf_ids_cnt;
+	struct bpf_tracing_multi_link *link;
+	struct bpf_link_primer link_primer;
+	struct bpf_tramp_multi *mtr;
+	unsigned long *ips;
+	int err;
+
+	if (attr->link_create.flags || !cnt || !ubtf_ids)
+		return -EINVAL;
+	/* the trampoline is built for the type the program was verified for */
+	if (attr->link_create.attach_type != prog->expected_attach_type)
+		return -EINVAL;
+	if (cnt > BPF_TRACING_MULTI_MAX_CNT)
+		return -E2BIG;
+
+	ips = kvcalloc(cnt, sizeof(*ips), GFP_USER);
+	if (!ips)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		struct bpf_attach_target_info tgt_info = {};
+
+		if (get_user(btf_id, ubtf_ids + i)) {
+			err = -EFAULT;
+			goto out_free_ips;
+		}
+
+		err = bpf_check_attach_target(NULL, prog, NULL, btf_id,
+					      &tgt_info);
+		if (err)
+			goto out_free_ips;
+
+		/* fexit programs find the return value right after the
+		 * MAX_BPF_MULTI_FUNC_ARGS arguments
+		 */
+		if (prog->expected_attach_type == BPF_TRACE_FEXIT &&
+		    tgt_info.fmodel.nr_args > MAX_BPF_MULTI_FUNC_ARGS) {
+			err = -EINVAL;
+			goto out_free_ips;
+		}
+
+		ips[i] = tgt_info.tgt_addr;
+		cond_resched();
+	}
+
+	link = kzalloc(sizeof(*link), GFP_USER);
+	if (!link) {
+		err = -ENOMEM;
+		goto out_free_ips;
+	}
+	bpf_link_init(&link->link, BPF_LINK_TYPE_TRACING_MULTI,
+		      &bpf_tracing_multi_link_lops, prog);
+	link->attach_type = prog->expected_attach_type;
+	link->cnt = cnt;
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err) {
+		kfree(link);
+		goto out_free_ips;
+	}
+
+	/* on success ips belong to the trampoline */
+	mtr = bpf_trampoline_multi_attach(prog, ips, cnt);
+	if (IS_ERR(mtr)) {
+		bpf_link_cleanup(&link_primer);
+		err = PTR_ERR(mtr);
+		goto out_free_ips;
+	}
+
+	link->mtr = mtr;
+	return bpf_link_settle(&link_primer);
+
+out_free_ips:
+	kvfree(ips);
+	return err;
+}
+
 struct bpf_raw_tp_link {
 	struct bpf_link link;
 	struct bpf_raw_event_map *btp;
@@ -2952,6 +3179,8 @@ attach_type_to_prog_type(enum bpf_attach_type attach_type)
 	case BPF_CGROUP_SETSOCKOPT:
 		return BPF_PROG_TYPE_CGROUP_SOCKOPT;
 	case BPF_TRACE_ITER:
+	case BPF_TRACE_FENTRY:
+	case BPF_TRACE_FEXIT:
 		return BPF_PROG_TYPE_TRACING;
 	case BPF_SK_LOOKUP:
 		return BPF_PROG_TYPE_SK_LOOKUP;
@@ -3395,6 +3624,7 @@ static int bpf_prog_get_info_by_fd(struct file *file,
 	struct bpf_prog_info __user *uinfo = u64_to_user_ptr(attr->info.info);
 	struct bpf_prog_info info;
 	u32 info_len = attr->info.info_len;
+	struct bpf_prog_sampled_stats sampled;
 	struct bpf_prog_stats stats;
 	char __user *uinsns;
 	u32 ulen;
@@ -3444,6 +3674,10 @@ static int bpf_prog_get_info_by_fd(struct file *file,
 	info.run_time_ns = stats.nsecs;
 	info.run_cnt = stats.cnt;
 
+	bpf_prog_get_sampled_stats(prog, &sampled);
+	info.sampled_run_time_ns = bpf_prog_sampled_run_time(&sampled);
+	info.sampled_run_cnt = sampled.cnt;
+
 	if (!bpf_capable()) {
 		info.jited_prog_len = 0;
 		info.xlated_prog_len = 0;
@@ -3690,6 +3924,7 @@ static int bpf_map_get_info_by_fd(struct file *file,
 	info.value_size = map->value_size;
 	info.max_entries = map->max_entries;
 	info.map_flags = map->map_flags;
+	info.map_extra = map->map_extra;
 	memcpy(info.name, map->name, sizeof(map->name));
 
 	if (map->btf) {
@@ -4020,6 +4255,8 @@ static int tracing_bpf_link_attach(const union bpf_attr *attr, struct bpf_prog *
 
 	if (prog->expected_attach_type == BPF_TRACE_ITER)
 		return bpf_iter_link_attach(attr, prog);
+	else if (prog->aux->multi_func)
+		return bpf_tracing_multi_attach(prog, attr);
 	else if (prog->type == BPF_PROG_TYPE_EXT)
 		return bpf_tracing_prog_attach(prog,
 					       attr->link_create.target_fd,
@@ -4221,8 +4458,10 @@ DEFINE_MUTEX(bpf_stats_enabled_mutex);
 
 static int bpf_stats_release(struct inode *inode, struct file *file)
 {
+	struct static_key_false *stats_key = file->private_data;
+
 	mutex_lock(&bpf_stats_enabled_mutex);
-	static_key_slow_dec(&bpf_stats_enabled_key.key);
+	static_key_slow_dec(&stats_key->key);
 	mutex_unlock(&bpf_stats_enabled_mutex);
 	return 0;
 }
@@ -4231,21 +4470,22 @@ static const struct file_operations bpf_stats_fops = {
 	.release = bpf_stats_release,
 };
 
-static int bpf_enable_runtime_stats(void)
+static int bpf_enable_runtime_stats(struct static_key_false *stats_key)
 {
 	int fd;
 
 	mutex_lock(&bpf_stats_enabled_mutex);
 
 	/* Set a very high limit to avoid overflow */
-	if (static_key_count(&bpf_stats_enabled_key.key) > INT_MAX / 2) {
+	if (static_key_count(&stats_key->key) > INT_MAX / 2) {
 		mutex_unlock(&bpf_stats_enabled_mutex);
 		return -EBUSY;
 	}
 
-	fd = anon_inode_getfd("bpf-stats", &bpf_stats_fops, NULL, O_CLOEXEC);
+	fd = anon_inode_getfd("bpf-stats", &bpf_stats_fops, stats_key,
+			      O_CLOEXEC);
 	if (fd >= 0)
-		static_key_slow_inc(&bpf_stats_enabled_key.key);
+		static_key_slow_inc(&stats_key->key);
 
 	mutex_unlock(&bpf_stats_enabled_mutex);
 	return fd;
@@ -4264,7 +4504,9 @@ static int bpf_enable_stats(union bpf_attr *attr)
 
 	switch (attr->enable_stats.type) {
 	case BPF_STATS_RUN_TIME:
-		return bpf_enable_runtime_stats();
+		return bpf_enable_runtime_stats(&bpf_stats_enabled_key);
+	case BPF_STATS_RUN_TIME_SAMPLED:
+		return bpf_enable_runtime_stats(&bpf_stats_sampled_key);
 	default:
 		break;
 	}
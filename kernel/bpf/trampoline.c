@@ -162,7 +162,8 @@ static int register_fentry(struct bpf_trampoline *tr, void *new_addr)
 }
 
 static struct bpf_tramp_progs *
-bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total)
+bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total,
+			 bool *ip_arg)
 {
 	const struct bpf_prog_aux *aux;
 	struct bpf_tramp_progs *tprogs;
@@ -179,8 +180,10 @@ bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total)
 		*total += tr->progs_cnt[kind];
 		progs = tprogs[kind].progs;
 
-		hlist_for_each_entry(aux, &tr->progs_hlist[kind], tramp_hlist)
+		hlist_for_each_entry(aux, &tr->progs_hlist[kind], tramp_hlist) {
+			*ip_arg |= aux->prog->call_get_func_ip;
 			*progs++ = aux->prog;
+		}
 	}
 	return tprogs;
 }
@@ -191,9 +194,10 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 	void *new_image = tr->image + (tr->selector & 1) * PAGE_SIZE/2;
 	struct bpf_tramp_progs *tprogs;
 	u32 flags = BPF_TRAMP_F_RESTORE_REGS;
+	bool ip_arg = false;
 	int err, total;
 
-	tprogs = bpf_trampoline_get_progs(tr, &total);
+	tprogs = bpf_trampoline_get_progs(tr, &total, &ip_arg);
 	if (IS_ERR(tprogs))
 		return PTR_ERR(tprogs);
 
@@ -207,6 +211,9 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 	    tprogs[BPF_TRAMP_MODIFY_RETURN].nr_progs)
 		flags = BPF_TRAMP_F_CALL_ORIG | BPF_TRAMP_F_SKIP_FRAME;
 
+	if (ip_arg)
+		flags |= BPF_TRAMP_F_IP_ARG;
+
 	/* Though the second half of trampoline page is unused a task could be
 	 * preempted in the middle of the first half of trampoline and two
 	 * updates to trampoline would change the code from underneath the
@@ -381,6 +388,117 @@ void bpf_trampoline_put(struct bpf_trampoline *tr)
 	mutex_unlock(&trampoline_mutex);
 }
 
+/* A trampoline shared by all the functions that a BPF_F_MULTI_FUNC program
+ * is attached to with one link. It only runs that program, and it is not in
+ * trampoline_table: it owns the ftrace direct call of each of the functions,
+ * so they cannot have another trampoline attached at the same time.
+ */
+struct bpf_tramp_multi {
+	void *image;
+	unsigned long *ips;
+	u32 cnt;
+	struct bpf_ksym ksym;
+};
+
+/* The program sees the arguments and the return value of every function as
+ * u64, whatever their real types are.
+ */
+static const struct btf_func_model bpf_multi_func_model = {
+	.ret_size = sizeof(u64),
+	.nr_args = MAX_BPF_MULTI_FUNC_ARGS,
+	.arg_size = { [0 ... MAX_BPF_MULTI_FUNC_ARGS - 1] = sizeof(u64) },
+};
+
+/* Attach @prog to the @cnt functions whose entry addresses are in @ips.
+ * All of them are patched to call the same trampoline, with a single update
+ * of the ftrace records. On success @ips is owned by the returned object and
+ * freed with kvfree() by bpf_trampoline_multi_detach().
+ */
+struct bpf_tramp_multi *bpf_trampoline_multi_attach(struct bpf_prog *prog,
+						    unsigned long *ips,
+						    u32 cnt)
+{
+	enum bpf_tramp_prog_type kind = BPF_TRAMP_FENTRY;
+	u32 flags = BPF_TRAMP_F_IP_ARG | BPF_TRAMP_F_RESTORE_REGS;
+	struct bpf_tramp_progs *tprogs;
+	struct bpf_tramp_multi *mtr;
+	int err;
+	u32 i;
+
+	/* The functions can only share a trampoline through ftrace */
+	for (i = 0; i < cnt; i++) {
+		err = is_ftrace_location((void *)ips[i]);
+		if (err <= 0)
+			return ERR_PTR(err ?: -EINVAL);
+	}
+
+	if (prog->expected_attach_type == BPF_TRACE_FEXIT) {
+		kind = BPF_TRAMP_FEXIT;
+		flags = BPF_TRAMP_F_IP_ARG | BPF_TRAMP_F_CALL_ORIG |
+			BPF_TRAMP_F_SKIP_FRAME | BPF_TRAMP_F_ORIG_STACK;
+	}
+
+	err = -ENOMEM;
+	mtr = kzalloc(sizeof(*mtr), GFP_KERNEL);
+	tprogs = kcalloc(BPF_TRAMP_MAX, sizeof(*tprogs), GFP_KERNEL);
+	if (!mtr || !tprogs)
+		goto out_free;
+
+	/* is_root was checked earlier. No need for bpf_jit_charge_modmem() */
+	mtr->image = bpf_jit_alloc_exec_page();
+	if (!mtr->image)
+		goto out_free;
+
+	tprogs[kind].progs[0] = prog;
+	tprogs[kind].nr_progs = 1;
+	err = arch_prepare_bpf_trampoline(mtr->image, mtr->image + PAGE_SIZE,
+					  &bpf_multi_func_model, flags, tprogs,
+					  NULL);
+	if (err < 0)
+		goto out_free_image;
+
+	INIT_LIST_HEAD_RCU(&mtr->ksym.lnode);
+	snprintf(mtr->ksym.name, KSYM_NAME_LEN, "bpf_trampoline_multi_%u",
+		 prog->aux->id);
+	bpf_image_ksym_add(mtr->image, &mtr->ksym);
+
+	err = register_ftrace_direct_ips(ips, cnt, (long)mtr->image);
+	if (err)
+		goto out_ksym_del;
+
+	mtr->ips = ips;
+	mtr->cnt = cnt;
+	kfree(tprogs);
+	return mtr;
+
+out_ksym_del:
+	bpf_image_ksym_del(&mtr->ksym);
+out_free_image:
+	bpf_jit_free_exec(mtr->image);
+out_free:
+	kfree(tprogs);
+	kfree(mtr);
+	return ERR_PTR(err);
+}
+
+void bpf_trampoline_multi_detach(struct bpf_tramp_multi *mtr)
+{
+	/* The functions may still call the image, keep it around */
+	if (WARN_ON_ONCE(unregister_ftrace_direct_ips(mtr->ips, mtr->cnt,
+						      (long)mtr->image)))
+		return;
+
+	bpf_image_ksym_del(&mtr->ksym);
+	/* As in bpf_trampoline_put(), the program itself is freed after the
+	 * needed grace periods, but tasks have to get out of the trampoline
+	 * code before it is freed.
+	 */
+	synchronize_rcu_tasks();
+	bpf_jit_free_exec(mtr->image);
+	kvfree(mtr->ips);
+	kfree(mtr);
+}
+
 /* The logic is similar to BPF_PROG_RUN, but with an explicit
  * rcu_read_lock() and migrate_disable() which are required
  * for the trampoline. The macro is split into
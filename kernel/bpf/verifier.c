@@ -240,6 +240,8 @@ struct bpf_call_arg_meta {
 	int func_id;
 	u32 btf_id;
 	u32 ret_btf_id;
+	int subprogno;
+	s64 const_map_key;
 };
 
 struct btf *btf_vmlinux;
@@ -526,6 +528,8 @@ static const char * const reg_type_str[] = {
 	[PTR_TO_RDONLY_BUF_OR_NULL] = "rdonly_buf_or_null",
 	[PTR_TO_RDWR_BUF]	= "rdwr_buf",
 	[PTR_TO_RDWR_BUF_OR_NULL] = "rdwr_buf_or_null",
+	[PTR_TO_FUNC]		= "func",
+	[PTR_TO_MAP_KEY]	= "map_key",
 };
 
 static char slot_type_char[] = {
@@ -1423,6 +1427,53 @@ static void init_func_state(struct bpf_verifier_env *env,
 	init_reg_state(env, state);
 }
 
+/* Similar to push_stack(), but for async callbacks */
+static struct bpf_verifier_state *push_async_cb(struct bpf_verifier_env *env,
+						int insn_idx, int prev_insn_idx,
+						int subprog)
+{
+	struct bpf_verifier_stack_elem *elem;
+	struct bpf_func_state *frame;
+
+	elem = kzalloc(sizeof(struct bpf_verifier_stack_elem), GFP_KERNEL);
+	if (!elem)
+		goto err;
+
+	elem->insn_idx = insn_idx;
+	elem->prev_insn_idx = prev_insn_idx;
+	elem->next = env->head;
+	elem->log_pos = env->log.len_used;
+	env->head = elem;
+	env->stack_size++;
+	if (env->stack_size > BPF_COMPLEXITY_LIMIT_JMP_SEQ) {
+		verbose(env,
+			"The sequence of %d jumps is too complex for async cb.\n",
+			env->stack_size);
+		goto err;
+	}
+	/* Unlike push_stack() do not copy_verifier_state().
+	 * The caller state doesn't matter: the callback runs later, from
+	 * the timer, on a fresh stack. Initialize it like do_check_common().
+	 */
+	elem->st.branches = 1;
+	elem->st.first_insn_idx = insn_idx;
+	frame = kzalloc(sizeof(*frame), GFP_KERNEL);
+	if (!frame)
+		goto err;
+	init_func_state(env, frame,
+			BPF_MAIN_FUNC /* callsite */,
+			0 /* frameno within this callchain */,
+			subprog /* subprog number within this prog */);
+	elem->st.frame[0] = frame;
+	return &elem->st;
+err:
+	free_verifier_state(env->cur_state, true);
+	env->cur_state = NULL;
+	/* pop all elements and return */
+	while (!pop_stack(env, NULL, NULL, false));
+	return NULL;
+}
+
 enum reg_arg_type {
 	SRC_OP,		/* register is used as source operand */
 	DST_OP,		/* register is used as destination operand */
@@ -1447,6 +1498,12 @@ static int find_subprog(struct bpf_verifier_env *env, int off)
 
 }
 
+static bool bpf_pseudo_func(const struct bpf_insn *insn)
+{
+	return insn->code == (BPF_LD | BPF_IMM | BPF_DW) &&
+	       insn->src_reg == BPF_PSEUDO_FUNC;
+}
+
 static int add_subprog(struct bpf_verifier_env *env, int off)
 {
 	int insn_cnt = env->prog->len;
@@ -1483,6 +1540,17 @@ static int check_subprogs(struct bpf_verifier_env *env)
 
 	/* determine subprog starts. The end is one before the next starts */
 	for (i = 0; i < insn_cnt; i++) {
+		if (bpf_pseudo_func(insn + i)) {
+			if (!env->bpf_capable) {
+				verbose(env,
+					"function pointers to other bpf functions are allowed for CAP_BPF and CAP_SYS_ADMIN\n");
+				return -EPERM;
+			}
+			ret = add_subprog(env, i + insn[i].imm + 1);
+			if (ret < 0)
+				return ret;
+			continue;
+		}
 		if (insn[i].code != (BPF_JMP | BPF_CALL))
 			continue;
 		if (insn[i].src_reg != BPF_PSEUDO_CALL)
@@ -2216,6 +2284,8 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 	case PTR_TO_PERCPU_BTF_ID:
 	case PTR_TO_MEM:
 	case PTR_TO_MEM_OR_NULL:
+	case PTR_TO_FUNC:
+	case PTR_TO_MAP_KEY:
 		return true;
 	default:
 		return false;
@@ -2277,7 +2347,8 @@ static int check_stack_write(struct bpf_verifier_env *env,
 {
 	struct bpf_func_state *cur; /* state of the current function */
 	int i, slot = -off - 1, spi = slot / BPF_REG_SIZE, err;
-	u32 dst_reg = env->prog->insnsi[insn_idx].dst_reg;
+	struct bpf_insn *insn = &env->prog->insnsi[insn_idx];
+	u32 dst_reg = insn->dst_reg;
 	struct bpf_reg_state *reg = NULL;
 
 	err = realloc_func_state(state, round_up(slot + 1, BPF_REG_SIZE),
@@ -2389,6 +2460,12 @@ static int check_stack_write(struct bpf_verifier_env *env,
 			if (err)
 				return err;
 			type = STACK_ZERO;
+		} else if (!reg && BPF_CLASS(insn->code) == BPF_ST &&
+			   insn->imm == 0 && env->bpf_capable) {
+			/* a constant key of zero is the common case for
+			 * lookups in array maps, see get_constant_map_key()
+			 */
+			type = STACK_ZERO;
 		}
 
 		/* Mark slots affected by this stack write. */
@@ -2667,6 +2744,15 @@ static int check_map_access(struct bpf_verifier_env *env, u32 regno,
 			return -EACCES;
 		}
 	}
+	if (map_value_has_timer(map)) {
+		u32 t = map->timer_off;
+
+		if (reg->smin_value + off < t + sizeof(struct bpf_timer) &&
+		     t < reg->umax_value + off + size) {
+			verbose(env, "bpf_timer cannot be accessed directly by load/store\n");
+			return -EACCES;
+		}
+	}
 	return err;
 }
 
@@ -3013,23 +3099,33 @@ static int update_stack_depth(struct bpf_verifier_env *env,
 	return 0;
 }
 
-/* starting from main bpf function walk all instructions of the function
+/* starting from the given bpf function walk all instructions of the function
  * and recursively walk all callees that given function can call.
  * Ignore jump and exit insns.
  * Since recursion is prevented by check_cfg() this algorithm
  * only needs a local stack of MAX_CALL_FRAMES to remember callsites
  */
-static int check_max_stack_depth(struct bpf_verifier_env *env)
+static int check_max_stack_depth_subprog(struct bpf_verifier_env *env, int idx)
 {
-	int depth = 0, frame = 0, idx = 0, i = 0, subprog_end;
 	struct bpf_subprog_info *subprog = env->subprog_info;
 	struct bpf_insn *insn = env->prog->insnsi;
+	int depth = 0, frame = 0, i, subprog_end;
+	bool async = subprog[idx].is_async_cb;
 	bool tail_call_reachable = false;
 	int ret_insn[MAX_CALL_FRAMES];
 	int ret_prog[MAX_CALL_FRAMES];
 	int j;
 
+	i = subprog[idx].start;
 process_func:
+	/* async callbacks are entered directly from the kernel, so there is
+	 * no tail call counter set up by the main program's prologue
+	 */
+	if (async && subprog[idx].has_tail_call) {
+		verbose(env, "tail_calls are not allowed in async callbacks\n");
+		return -EACCES;
+	}
+
 	/* protect against potential stack overflow that might happen when
 	 * bpf2bpf calls get combined with tailcalls. Limit the caller's stack
 	 * depth for such case down to 256 so that the worst case scenario
@@ -3116,6 +3212,22 @@ static int check_max_stack_depth(struct bpf_verifier_env *env)
 	goto continue_func;
 }
 
+/* Async callbacks run on their own stack, check them as separate roots */
+static int check_max_stack_depth(struct bpf_verifier_env *env)
+{
+	struct bpf_subprog_info *si = env->subprog_info;
+	int i, ret;
+
+	for (i = 0; i < env->subprog_cnt; i++) {
+		if (i && !si[i].is_async_cb)
+			continue;
+		ret = check_max_stack_depth_subprog(env, i);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
 #ifndef CONFIG_BPF_JIT_ALWAYS_ON
 static int get_callee_stack_depth(struct bpf_verifier_env *env,
 				  const struct bpf_insn *insn, int idx)
@@ -3288,6 +3400,24 @@ static int bpf_map_direct_read(struct bpf_map *map, int off, int size, u64 *val)
 	return 0;
 }
 
+/* Remember the value loaded by the current insn if it is a constant read
+ * from a frozen read-only map on every path, see opt_fold_rdonly_loads().
+ */
+static void record_rdonly_load(struct bpf_verifier_env *env, bool rdonly_src,
+			       struct bpf_reg_state *dst)
+{
+	struct bpf_insn_aux_data *aux = &env->insn_aux_data[env->insn_idx];
+
+	if (!rdonly_src || !register_is_const(dst)) {
+		aux->rdonly_state |= BPF_RDONLY_VAL_POISON;
+	} else if (!(aux->rdonly_state & BPF_RDONLY_VAL_SEEN)) {
+		aux->rdonly_val = dst->var_off.value;
+		aux->rdonly_state |= BPF_RDONLY_VAL_SEEN;
+	} else if (aux->rdonly_val != dst->var_off.value) {
+		aux->rdonly_state |= BPF_RDONLY_VAL_POISON;
+	}
+}
+
 static int check_ptr_to_btf_access(struct bpf_verifier_env *env,
 				   struct bpf_reg_state *regs,
 				   int regno, int off, int size,
@@ -3421,7 +3551,19 @@ static int check_mem_access(struct bpf_verifier_env *env, int insn_idx, u32 regn
 	/* for access checks, reg->off is just part of off */
 	off += reg->off;
 
-	if (reg->type == PTR_TO_MAP_VALUE) {
+	if (reg->type == PTR_TO_MAP_KEY) {
+		if (t == BPF_WRITE) {
+			verbose(env, "write to change key R%d not allowed\n",
+				regno);
+			return -EACCES;
+		}
+		err = check_mem_region_access(env, regno, off, size,
+					      reg->map_ptr->key_size, false);
+		if (err)
+			return err;
+		if (value_regno >= 0)
+			mark_reg_unknown(env, regs, value_regno);
+	} else if (reg->type == PTR_TO_MAP_VALUE) {
 		if (t == BPF_WRITE && value_regno >= 0 &&
 		    is_pointer_value(env, value_regno)) {
 			verbose(env, "R%d leaks addr into map\n", value_regno);
@@ -3800,6 +3942,13 @@ static int check_helper_mem_access(struct bpf_verifier_env *env, int regno,
 	case PTR_TO_PACKET_META:
 		return check_packet_access(env, regno, reg->off, access_size,
 					   zero_size_allowed);
+	case PTR_TO_MAP_KEY:
+		if (meta && meta->raw_mode)
+			return -EACCES;
+		return check_mem_region_access(env, regno, reg->off,
+					       access_size,
+					       reg->map_ptr->key_size,
+					       zero_size_allowed);
 	case PTR_TO_MAP_VALUE:
 		if (check_map_access_type(env, regno, reg->off, access_size,
 					  meta && meta->raw_mode ? BPF_WRITE :
@@ -3920,6 +4069,53 @@ static int process_spin_lock(struct bpf_verifier_env *env, int regno,
 	return 0;
 }
 
+static int process_timer_func(struct bpf_verifier_env *env, int regno,
+			      struct bpf_call_arg_meta *meta)
+{
+	struct bpf_reg_state *regs = cur_regs(env), *reg = &regs[regno];
+	bool is_const = tnum_is_const(reg->var_off);
+	struct bpf_map *map = reg->map_ptr;
+	u64 val = reg->var_off.value;
+
+	if (!is_const) {
+		verbose(env,
+			"R%d doesn't have constant offset. bpf_timer has to be at the constant offset\n",
+			regno);
+		return -EINVAL;
+	}
+	if (!map->btf) {
+		verbose(env, "map '%s' has to have BTF in order to use bpf_timer\n",
+			map->name);
+		return -EINVAL;
+	}
+	if (!map_value_has_timer(map)) {
+		if (map->timer_off == -E2BIG)
+			verbose(env,
+				"map '%s' has more than one 'struct bpf_timer'\n",
+				map->name);
+		else if (map->timer_off == -ENOENT)
+			verbose(env,
+				"map '%s' doesn't have 'struct bpf_timer'\n",
+				map->name);
+		else
+			verbose(env,
+				"map '%s' is not a struct type or bpf_timer is mangled\n",
+				map->name);
+		return -EINVAL;
+	}
+	if (map->timer_off != val + reg->off) {
+		verbose(env, "off %lld doesn't point to 'struct bpf_timer' that is at %d\n",
+			val + reg->off, map->timer_off);
+		return -EINVAL;
+	}
+	if (meta->map_ptr) {
+		verbose(env, "verifier bug. Two map pointers in a timer helper\n");
+		return -EFAULT;
+	}
+	meta->map_ptr = map;
+	return 0;
+}
+
 static bool arg_type_is_mem_ptr(enum bpf_arg_type type)
 {
 	return type == ARG_PTR_TO_MEM ||
@@ -3974,6 +4170,11 @@ static int resolve_map_arg_type(struct bpf_verifier_env *env,
 			return -EINVAL;
 		}
 		break;
+	case BPF_MAP_TYPE_BLOOM_FILTER:
+		/* peek reads the value to test for instead of filling it */
+		if (meta->func_id == BPF_FUNC_map_peek_elem)
+			*arg_type = ARG_PTR_TO_MAP_VALUE;
+		break;
 
 	default:
 		break;
@@ -3991,6 +4192,7 @@ static const struct bpf_reg_types map_key_value_types = {
 		PTR_TO_STACK,
 		PTR_TO_PACKET,
 		PTR_TO_PACKET_META,
+		PTR_TO_MAP_KEY,
 		PTR_TO_MAP_VALUE,
 	},
 };
@@ -4022,6 +4224,7 @@ static const struct bpf_reg_types mem_types = {
 		PTR_TO_STACK,
 		PTR_TO_PACKET,
 		PTR_TO_PACKET_META,
+		PTR_TO_MAP_KEY,
 		PTR_TO_MAP_VALUE,
 		PTR_TO_MEM,
 		PTR_TO_RDONLY_BUF,
@@ -4046,6 +4249,8 @@ static const struct bpf_reg_types const_map_ptr_types = { .types = { CONST_PTR_T
 static const struct bpf_reg_types btf_ptr_types = { .types = { PTR_TO_BTF_ID } };
 static const struct bpf_reg_types spin_lock_types = { .types = { PTR_TO_MAP_VALUE } };
 static const struct bpf_reg_types percpu_btf_ptr_types = { .types = { PTR_TO_PERCPU_BTF_ID } };
+static const struct bpf_reg_types func_ptr_types = { .types = { PTR_TO_FUNC } };
+static const struct bpf_reg_types timer_types = { .types = { PTR_TO_MAP_VALUE } };
 
 static const struct bpf_reg_types *compatible_reg_types[__BPF_ARG_TYPE_MAX] = {
 	[ARG_PTR_TO_MAP_KEY]		= &map_key_value_types,
@@ -4074,6 +4279,8 @@ static const struct bpf_reg_types *compatible_reg_types[__BPF_ARG_TYPE_MAX] = {
 	[ARG_PTR_TO_INT]		= &int_ptr_types,
 	[ARG_PTR_TO_LONG]		= &int_ptr_types,
 	[ARG_PTR_TO_PERCPU_BTF_ID]	= &percpu_btf_ptr_types,
+	[ARG_PTR_TO_FUNC]		= &func_ptr_types,
+	[ARG_PTR_TO_TIMER]		= &timer_types,
 };
 
 static int check_reg_type(struct bpf_verifier_env *env, u32 regno,
@@ -4203,6 +4410,14 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 arg,
 
 	if (arg_type == ARG_CONST_MAP_PTR) {
 		/* bpf_map_xxx(map_ptr) call: remember that map_ptr */
+		if (meta->map_ptr && meta->map_ptr != reg->map_ptr) {
+			/* bpf_timer_init(timer, map) must be given the map
+			 * that the timer lives in.
+			 */
+			verbose(env, "timer pointer in R1 doesn't match map pointer in R%d\n",
+				regno);
+			return -EINVAL;
+		}
 		meta->map_ptr = reg->map_ptr;
 	} else if (arg_type == ARG_PTR_TO_MAP_KEY) {
 		/* bpf_map_xxx(..., map_ptr, ..., key) call:
@@ -4254,6 +4469,11 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 arg,
 			verbose(env, "verifier internal error\n");
 			return -EFAULT;
 		}
+	} else if (arg_type == ARG_PTR_TO_TIMER) {
+		if (process_timer_func(env, regno, meta))
+			return -EACCES;
+	} else if (arg_type == ARG_PTR_TO_FUNC) {
+		meta->subprogno = reg->subprogno;
 	} else if (arg_type_is_mem_ptr(arg_type)) {
 		/* The access to this pointer is only checked when we hit the
 		 * next is_mem_size argument below.
@@ -4388,7 +4608,8 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		    func_id != BPF_FUNC_ringbuf_reserve &&
 		    func_id != BPF_FUNC_ringbuf_submit &&
 		    func_id != BPF_FUNC_ringbuf_discard &&
-		    func_id != BPF_FUNC_ringbuf_query)
+		    func_id != BPF_FUNC_ringbuf_query &&
+		    func_id != BPF_FUNC_ringbuf_output_batch)
 			goto error;
 		break;
 	case BPF_MAP_TYPE_STACK_TRACE:
@@ -4459,6 +4680,11 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		    func_id != BPF_FUNC_map_push_elem)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_BLOOM_FILTER:
+		if (func_id != BPF_FUNC_map_peek_elem &&
+		    func_id != BPF_FUNC_map_push_elem)
+			goto error;
+		break;
 	case BPF_MAP_TYPE_SK_STORAGE:
 		if (func_id != BPF_FUNC_sk_storage_get &&
 		    func_id != BPF_FUNC_sk_storage_delete)
@@ -4491,6 +4717,13 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		if (map->map_type != BPF_MAP_TYPE_PERF_EVENT_ARRAY)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_reserve:
+	case BPF_FUNC_ringbuf_query:
+	case BPF_FUNC_ringbuf_output_batch:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
 	case BPF_FUNC_get_stackid:
 		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE)
 			goto error;
@@ -4531,8 +4764,13 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 			goto error;
 		break;
 	case BPF_FUNC_map_peek_elem:
-	case BPF_FUNC_map_pop_elem:
 	case BPF_FUNC_map_push_elem:
+		if (map->map_type != BPF_MAP_TYPE_QUEUE &&
+		    map->map_type != BPF_MAP_TYPE_STACK &&
+		    map->map_type != BPF_MAP_TYPE_BLOOM_FILTER)
+			goto error;
+		break;
+	case BPF_FUNC_map_pop_elem:
 		if (map->map_type != BPF_MAP_TYPE_QUEUE &&
 		    map->map_type != BPF_MAP_TYPE_STACK)
 			goto error;
@@ -4945,6 +5183,100 @@ record_func_map(struct bpf_verifier_env *env, struct bpf_call_arg_meta *meta,
 	return 0;
 }
 
+static bool bpf_map_is_used(struct bpf_verifier_env *env,
+			    const struct bpf_map *map)
+{
+	int i;
+
+	for (i = 0; i < env->used_map_cnt; i++)
+		if (env->used_maps[i] == map)
+			return true;
+	return false;
+}
+
+/* Returns the u32 map key @key points to if it is known to be constant, or
+ * -EOPNOTSUPP. Only zero-initialized stack and spilled constant scalars in
+ * the stack of the current function are recognized.
+ */
+static s64 get_constant_map_key(struct bpf_verifier_env *env,
+				struct bpf_reg_state *key)
+{
+	const u32 key_size = sizeof(u32);
+	struct bpf_func_state *state;
+	int i, slot, spi, off, shift, err;
+	struct bpf_reg_state *reg;
+	u8 *stype;
+
+	if (!env->bpf_capable)
+		return -EOPNOTSUPP;
+	if (key->type != PTR_TO_STACK || !tnum_is_const(key->var_off) ||
+	    key->frameno != env->cur_state->curframe)
+		return -EOPNOTSUPP;
+
+	state = func(env, key);
+	slot = -(key->off + (s32)key->var_off.value) - 1;
+	spi = slot / BPF_REG_SIZE;
+	off = slot % BPF_REG_SIZE;
+	/* the key must not cross stack slots */
+	if (off + 1 < key_size)
+		return -EOPNOTSUPP;
+	stype = state->stack[spi].slot_type;
+
+	for (i = 0; i < key_size; i++)
+		if (stype[off - i] != STACK_ZERO)
+			break;
+	if (i == key_size)
+		return 0;
+
+	reg = &state->stack[spi].spilled_ptr;
+	if (stype[0] != STACK_SPILL || !register_is_const(reg))
+		return -EOPNOTSUPP;
+
+	/* states with a different key must not be pruned against this one */
+	err = mark_chain_precision_stack(env, spi);
+	if (err)
+		return err;
+
+	/* the key starts at byte BPF_REG_SIZE - 1 - off of the spilled value */
+	shift = BPF_REG_SIZE - 1 - off;
+	if (IS_ENABLED(CONFIG_CPU_BIG_ENDIAN))
+		shift = BPF_REG_SIZE - shift - key_size;
+	return (u32)(reg->var_off.value >> (shift * BITS_PER_BYTE));
+}
+
+/* Lookups at a constant key in maps which can emit specialized code for it
+ * are recorded, so that fixup_bpf_calls() can replace the helper call.
+ */
+static int record_lookup_key(struct bpf_verifier_env *env,
+			     struct bpf_call_arg_meta *meta, int insn_idx)
+{
+	struct bpf_insn_aux_data *aux = &env->insn_aux_data[insn_idx];
+	struct bpf_map *map = meta->map_ptr;
+	s64 val;
+
+	/* an inner map template doesn't tell where the elements are */
+	if (!map->ops->map_gen_lookup_const || !bpf_map_is_used(env, map)) {
+		bpf_map_key_store(aux, BPF_MAP_KEY_POISON);
+		return 0;
+	}
+
+	val = get_constant_map_key(env, &cur_regs(env)[BPF_REG_2]);
+	if (val < 0 && val != -EOPNOTSUPP)
+		return val;
+	if (val < 0 || val >= map->max_entries) {
+		bpf_map_key_store(aux, BPF_MAP_KEY_POISON);
+		return 0;
+	}
+
+	meta->const_map_key = val;
+	if (bpf_map_key_unseen(aux))
+		bpf_map_key_store(aux, val);
+	else if (!bpf_map_key_poisoned(aux) &&
+		  bpf_map_key_immediate(aux) != val)
+		bpf_map_key_store(aux, BPF_MAP_KEY_POISON);
+	return 0;
+}
+
 static int
 record_func_key(struct bpf_verifier_env *env, struct bpf_call_arg_meta *meta,
 		int func_id, int insn_idx)
@@ -4956,6 +5288,8 @@ record_func_key(struct bpf_verifier_env *env, struct bpf_call_arg_meta *meta,
 	u64 val;
 	int err;
 
+	if (func_id == BPF_FUNC_map_lookup_elem)
+		return record_lookup_key(env, meta, insn_idx);
 	if (func_id != BPF_FUNC_tail_call)
 		return 0;
 	if (!map || map->map_type != BPF_MAP_TYPE_PROG_ARRAY) {
@@ -4996,6 +5330,64 @@ static int check_reference_leak(struct bpf_verifier_env *env)
 	return state->acquired_refs ? -EINVAL : 0;
 }
 
+/* Queue the verification of the callback passed to bpf_timer_set_callback().
+ * It runs asynchronously from the timer as
+ * callback_fn(struct bpf_map *map, void *key, void *value).
+ */
+static int push_timer_callback(struct bpf_verifier_env *env,
+			       struct bpf_call_arg_meta *meta, int insn_idx)
+{
+	struct bpf_verifier_state *cur = env->cur_state;
+	struct bpf_map *map_ptr = meta->map_ptr;
+	struct bpf_verifier_state *async_cb;
+	int subprog = meta->subprogno;
+	struct bpf_func_state *callee;
+
+	env->subprog_info[subprog].is_async_cb = true;
+	async_cb = push_async_cb(env, env->subprog_info[subprog].start,
+				 insn_idx, subprog);
+	if (!async_cb)
+		return -EFAULT;
+	callee = async_cb->frame[0];
+	callee->async_entry_cnt = cur->frame[0]->async_entry_cnt + 1;
+	callee->in_async_callback_fn = true;
+
+	callee->regs[BPF_REG_1].type = CONST_PTR_TO_MAP;
+	__mark_reg_known_zero(&callee->regs[BPF_REG_1]);
+	callee->regs[BPF_REG_1].map_ptr = map_ptr;
+
+	callee->regs[BPF_REG_2].type = PTR_TO_MAP_KEY;
+	__mark_reg_known_zero(&callee->regs[BPF_REG_2]);
+	callee->regs[BPF_REG_2].map_ptr = map_ptr;
+
+	callee->regs[BPF_REG_3].type = PTR_TO_MAP_VALUE;
+	__mark_reg_known_zero(&callee->regs[BPF_REG_3]);
+	callee->regs[BPF_REG_3].map_ptr = map_ptr;
+	/* the value may hold a bpf_spin_lock, see process_spin_lock() */
+	if (map_value_has_spin_lock(map_ptr))
+		callee->regs[BPF_REG_3].id = ++env->id_gen;
+
+	return 0;
+}
+
+static int check_get_func_ip(struct bpf_verifier_env *env)
+{
+	enum bpf_attach_type eatype = env->prog->expected_attach_type;
+	int func_id = BPF_FUNC_get_func_ip;
+
+	/* Only the trampolines of fentry/fexit/fmod_ret programs store
+	 * the address of the traced function, see BPF_TRAMP_F_IP_ARG.
+	 */
+	if (env->prog->type == BPF_PROG_TYPE_TRACING &&
+	    (eatype == BPF_TRACE_FENTRY || eatype == BPF_TRACE_FEXIT ||
+	     eatype == BPF_MODIFY_RETURN))
+		return 0;
+
+	verbose(env, "func %s#%d supported only for fentry/fexit/fmod_ret programs\n",
+		func_id_name(func_id), func_id);
+	return -ENOTSUPP;
+}
+
 static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 {
 	const struct bpf_func_proto *fn = NULL;
@@ -5040,6 +5432,7 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 
 	memset(&meta, 0, sizeof(meta));
 	meta.pkt_access = fn->pkt_access;
+	meta.const_map_key = -1;
 
 	err = check_func_proto(fn, func_id);
 	if (err) {
@@ -5089,6 +5482,12 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 		}
 	}
 
+	if (func_id == BPF_FUNC_timer_set_callback) {
+		err = push_timer_callback(env, &meta, insn_idx);
+		if (err)
+			return err;
+	}
+
 	regs = cur_regs(env);
 
 	/* check that flags argument in get_local_storage(map, flags) is 0,
@@ -5129,7 +5528,11 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 			return -EINVAL;
 		}
 		regs[BPF_REG_0].map_ptr = meta.map_ptr;
-		if (fn->ret_type == RET_PTR_TO_MAP_VALUE) {
+		/* a lookup at a constant key within max_entries of a map
+		 * with map_gen_lookup_const can't fail
+		 */
+		if (fn->ret_type == RET_PTR_TO_MAP_VALUE ||
+		    meta.const_map_key >= 0) {
 			regs[BPF_REG_0].type = PTR_TO_MAP_VALUE;
 			if (map_value_has_spin_lock(meta.map_ptr))
 				regs[BPF_REG_0].id = ++env->id_gen;
@@ -5242,6 +5645,12 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 	if (func_id == BPF_FUNC_get_stackid || func_id == BPF_FUNC_get_stack)
 		env->prog->call_get_stack = true;
 
+	if (func_id == BPF_FUNC_get_func_ip) {
+		if (check_get_func_ip(env))
+			return -ENOTSUPP;
+		env->prog->call_get_func_ip = true;
+	}
+
 	if (changes_data)
 		clear_all_pkt_pointers(env);
 	return 0;
@@ -5353,6 +5762,14 @@ static int retrieve_ptr_limit(const struct bpf_reg_state *ptr_reg,
 			*ptr_limit = ptr_reg->map_ptr->value_size - off;
 		}
 		return 0;
+	case PTR_TO_MAP_KEY:
+		if (mask_to_left) {
+			*ptr_limit = ptr_reg->umax_value + ptr_reg->off;
+		} else {
+			off = ptr_reg->smin_value + ptr_reg->off;
+			*ptr_limit = ptr_reg->map_ptr->key_size - off;
+		}
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -5508,6 +5925,7 @@ static int adjust_ptr_min_max_vals(struct bpf_verifier_env *env,
 	case PTR_TO_TCP_SOCK:
 	case PTR_TO_TCP_SOCK_OR_NULL:
 	case PTR_TO_XDP_SOCK:
+	case PTR_TO_FUNC:
 		verbose(env, "R%d pointer arithmetic on %s prohibited\n",
 			dst, reg_type_str[ptr_reg->type]);
 		return -EACCES;
@@ -7657,6 +8075,29 @@ static int check_ld_imm(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return 0;
 	}
 
+	if (insn->src_reg == BPF_PSEUDO_FUNC) {
+		struct bpf_func_info_aux *func_info_aux;
+		int subprogno;
+
+		subprogno = find_subprog(env, env->insn_idx + insn->imm + 1);
+		if (subprogno <= 0) {
+			verbose(env, "invalid callback target at insn %d\n",
+				env->insn_idx);
+			return -EINVAL;
+		}
+		func_info_aux = env->prog->aux->func_info_aux;
+		if (func_info_aux &&
+		    func_info_aux[subprogno].linkage != BTF_FUNC_STATIC) {
+			verbose(env, "callback function not static\n");
+			return -EINVAL;
+		}
+
+		mark_reg_known_zero(env, regs, insn->dst_reg);
+		dst_reg->type = PTR_TO_FUNC;
+		dst_reg->subprogno = subprogno;
+		return 0;
+	}
+
 	map = env->used_maps[aux->map_index];
 	mark_reg_known_zero(env, regs, insn->dst_reg);
 	dst_reg->map_ptr = map;
@@ -8113,6 +8554,16 @@ static int check_cfg(struct bpf_verifier_env *env)
 			goto peek_stack;
 		else if (ret < 0)
 			goto err_free;
+		if (bpf_pseudo_func(insns + t)) {
+			/* the callback is reachable from its reference */
+			init_explored_state(env, t);
+			ret = push_insn(t, t + insns[t].imm + 1, BRANCH,
+					env, false);
+			if (ret == 1)
+				goto peek_stack;
+			else if (ret < 0)
+				goto err_free;
+		}
 	}
 
 mark_explored:
@@ -9050,8 +9501,18 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 		if (sl->state.insn_idx != insn_idx)
 			goto next;
 		if (sl->state.branches) {
-			if (states_maybe_looping(&sl->state, cur) &&
-			    states_equal(env, &sl->state, cur)) {
+			struct bpf_func_state *frame = sl->state.frame[0];
+			u32 cnt = cur->frame[0]->async_entry_cnt;
+
+			if (frame->in_async_callback_fn &&
+			    frame->async_entry_cnt != cnt) {
+				/* A different async_entry_cnt means this is
+				 * another entry into the async callback, not a
+				 * loop. The old state hasn't reached bpf_exit
+				 * yet, so it cannot be used for pruning either.
+				 */
+			} else if (states_maybe_looping(&sl->state, cur) &&
+				   states_equal(env, &sl->state, cur)) {
 				verbose_linfo(env, insn_idx, "; ");
 				verbose(env, "infinite loop detected at insn %d\n", insn_idx);
 				return -EINVAL;
@@ -9354,6 +9815,7 @@ static int do_check(struct bpf_verifier_env *env)
 
 		} else if (class == BPF_LDX) {
 			enum bpf_reg_type *prev_src_type, src_reg_type;
+			bool rdonly_src;
 
 			/* check for reserved fields is already done */
 
@@ -9367,6 +9829,8 @@ static int do_check(struct bpf_verifier_env *env)
 				return err;
 
 			src_reg_type = regs[insn->src_reg].type;
+			rdonly_src = src_reg_type == PTR_TO_MAP_VALUE &&
+				bpf_map_is_rdonly(regs[insn->src_reg].map_ptr);
 
 			/* check that memory (src_reg + off) is readable,
 			 * the state of dst_reg will be updated by this func
@@ -9377,6 +9841,9 @@ static int do_check(struct bpf_verifier_env *env)
 			if (err)
 				return err;
 
+			record_rdonly_load(env, rdonly_src,
+					   &regs[insn->dst_reg]);
+
 			prev_src_type = &env->insn_aux_data[env->insn_idx].ptr_type;
 
 			if (*prev_src_type == NOT_INIT) {
@@ -9740,6 +10207,21 @@ static int check_map_prog_compatibility(struct bpf_verifier_env *env,
 		return -EINVAL;
 	}
 
+	/* The timer lock could be taken by a tracing prog that interrupted
+	 * the owner of the same lock, and the callback of a sleepable prog
+	 * would run in softirq context.
+	 */
+	if (map_value_has_timer(map)) {
+		if (is_tracing_prog_type(prog_type)) {
+			verbose(env, "tracing progs cannot use bpf_timer yet\n");
+			return -EINVAL;
+		}
+		if (prog->aux->sleepable) {
+			verbose(env, "sleepable progs cannot use bpf_timer yet\n");
+			return -EINVAL;
+		}
+	}
+
 	if ((bpf_prog_is_dev_bound(prog->aux) || bpf_map_is_dev_bound(map)) &&
 	    !bpf_offload_prog_map_match(prog, map)) {
 		verbose(env, "offload device mismatch between prog and map\n");
@@ -9833,6 +10315,18 @@ static int resolve_pseudo_ldimm64(struct bpf_verifier_env *env)
 				goto next_insn;
 			}
 
+			if (insn[0].src_reg == BPF_PSEUDO_FUNC) {
+				if (insn[1].imm != 0) {
+					verbose(env,
+						"unrecognized bpf_ld_imm64 insn\n");
+					return -EINVAL;
+				}
+				/* the subprog offset is kept until
+				 * jit_subprogs() rewrites it
+				 */
+				goto next_insn;
+			}
+
 			/* In final convert_pseudo_ld_imm64() step, this is
 			 * converted into regular 64-bit imm load insn.
 			 */
@@ -9958,9 +10452,13 @@ static void convert_pseudo_ld_imm64(struct bpf_verifier_env *env)
 	int insn_cnt = env->prog->len;
 	int i;
 
-	for (i = 0; i < insn_cnt; i++, insn++)
-		if (insn->code == (BPF_LD | BPF_IMM | BPF_DW))
-			insn->src_reg = 0;
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (insn->code != (BPF_LD | BPF_IMM | BPF_DW))
+			continue;
+		if (insn->src_reg == BPF_PSEUDO_FUNC)
+			continue;
+		insn->src_reg = 0;
+	}
 }
 
 /* single env->prog->insni[off] instruction was replaced with the range
@@ -10304,6 +10802,53 @@ static int opt_remove_nops(struct bpf_verifier_env *env)
 	return 0;
 }
 
+/* Replace loads from frozen read-only maps, whose values the verifier
+ * already tracked as constants, with the constants themselves.
+ */
+static int opt_fold_rdonly_loads(struct bpf_verifier_env *env)
+{
+	struct bpf_insn_aux_data *aux;
+	struct bpf_prog *new_prog;
+	struct bpf_insn *insn;
+	int i, cnt;
+
+	if (bpf_prog_is_dev_bound(env->prog->aux))
+		return 0;
+
+	for (i = 0; i < env->prog->len; i++) {
+		struct bpf_insn insn_buf[2] = {};
+
+		insn = &env->prog->insnsi[i];
+		aux = &env->insn_aux_data[i];
+		if (BPF_CLASS(insn->code) != BPF_LDX ||
+		    BPF_MODE(insn->code) != BPF_MEM ||
+		    aux->rdonly_state != BPF_RDONLY_VAL_SEEN)
+			continue;
+
+		if (aux->rdonly_val <= S32_MAX) {
+			insn_buf[0] = BPF_MOV64_IMM(insn->dst_reg,
+						    aux->rdonly_val);
+			cnt = 1;
+		} else {
+			struct bpf_insn ld_val[2] = {
+				BPF_LD_IMM64(insn->dst_reg, aux->rdonly_val),
+			};
+
+			insn_buf[0] = ld_val[0];
+			insn_buf[1] = ld_val[1];
+			cnt = 2;
+		}
+
+		new_prog = bpf_patch_insn_data(env, i, insn_buf, cnt);
+		if (!new_prog)
+			return -ENOMEM;
+		env->prog = new_prog;
+		i += cnt - 1;
+	}
+
+	return 0;
+}
+
 static int opt_subreg_zext_lo32_rnd_hi32(struct bpf_verifier_env *env,
 					 const union bpf_attr *attr)
 {
@@ -10582,6 +11127,22 @@ static int jit_subprogs(struct bpf_verifier_env *env)
 		return 0;
 
 	for (i = 0, insn = prog->insnsi; i < prog->len; i++, insn++) {
+		if (bpf_pseudo_func(insn)) {
+			subprog = find_subprog(env, i + insn->imm + 1);
+			if (subprog < 0) {
+				WARN_ONCE(1, "verifier bug. No program starts at insn %d\n",
+					  i + insn->imm + 1);
+				return -EFAULT;
+			}
+			/* Load the subprog index rather than its address:
+			 * the address isn't known until the final JIT pass,
+			 * and the image size must not change in that pass.
+			 * The helper looks it up in prog->aux->func[].
+			 */
+			env->insn_aux_data[i].call_imm = insn->imm;
+			insn->imm = subprog;
+			continue;
+		}
 		if (insn->code != (BPF_JMP | BPF_CALL) ||
 		    insn->src_reg != BPF_PSEUDO_CALL)
 			continue;
@@ -10758,6 +11319,10 @@ static int jit_subprogs(struct bpf_verifier_env *env)
 	 * later look the same as if they were interpreted only.
 	 */
 	for (i = 0, insn = prog->insnsi; i < prog->len; i++, insn++) {
+		if (bpf_pseudo_func(insn)) {
+			insn->imm = env->insn_aux_data[i].call_imm;
+			continue;
+		}
 		if (insn->code != (BPF_JMP | BPF_CALL) ||
 		    insn->src_reg != BPF_PSEUDO_CALL)
 			continue;
@@ -10788,6 +11353,10 @@ static int jit_subprogs(struct bpf_verifier_env *env)
 	/* cleanup main prog to be interpreted */
 	prog->jit_requested = 0;
 	for (i = 0, insn = prog->insnsi; i < prog->len; i++, insn++) {
+		if (bpf_pseudo_func(insn)) {
+			insn->imm = env->insn_aux_data[i].call_imm;
+			continue;
+		}
 		if (insn->code != (BPF_JMP | BPF_CALL) ||
 		    insn->src_reg != BPF_PSEUDO_CALL)
 			continue;
@@ -10824,6 +11393,17 @@ static int fixup_call_args(struct bpf_verifier_env *env)
 		return -EINVAL;
 	}
 	for (i = 0; i < prog->len; i++, insn++) {
+		if (bpf_pseudo_func(insn)) {
+			/* The interpreter has no address to give a helper
+			 * for a subprog.
+			 */
+			verbose(env, "callbacks are not allowed in non-JITed programs\n");
+			return -EINVAL;
+		}
+		if (insn_is_mov_percpu_addr(insn)) {
+			verbose(env, "per-CPU lookups are not allowed in non-JITed programs\n");
+			return -EINVAL;
+		}
 		if (insn->code != (BPF_JMP | BPF_CALL) ||
 		    insn->src_reg != BPF_PSEUDO_CALL)
 			continue;
@@ -10837,6 +11417,24 @@ static int fixup_call_args(struct bpf_verifier_env *env)
 	return err;
 }
 
+/* Returns the number of insns inlining the bpf_map_lookup_elem() call, or
+ * -EOPNOTSUPP if the map can't inline it.
+ */
+static int map_gen_lookup(struct bpf_insn_aux_data *aux, struct bpf_map *map,
+			  struct bpf_insn *insn_buf)
+{
+	const struct bpf_map_ops *ops = map->ops;
+	int cnt = -EOPNOTSUPP;
+
+	if (ops->map_gen_lookup_const && !bpf_map_key_poisoned(aux) &&
+	    !bpf_map_key_unseen(aux))
+		cnt = ops->map_gen_lookup_const(map, bpf_map_key_immediate(aux),
+						insn_buf);
+	if (cnt == -EOPNOTSUPP && ops->map_gen_lookup)
+		cnt = ops->map_gen_lookup(map, insn_buf);
+	return cnt;
+}
+
 /* fixup insn->imm field of bpf_call instructions
  * and inline eligible helpers as explicit sequence of BPF instructions
  *
@@ -11071,9 +11669,8 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 
 			map_ptr = BPF_MAP_PTR(aux->map_ptr_state);
 			ops = map_ptr->ops;
-			if (insn->imm == BPF_FUNC_map_lookup_elem &&
-			    ops->map_gen_lookup) {
-				cnt = ops->map_gen_lookup(map_ptr, insn_buf);
+			if (insn->imm == BPF_FUNC_map_lookup_elem) {
+				cnt = map_gen_lookup(aux, map_ptr, insn_buf);
 				if (cnt == -EOPNOTSUPP)
 					goto patch_map_ops_generic;
 				if (cnt <= 0 || cnt >= ARRAY_SIZE(insn_buf)) {
@@ -11137,6 +11734,32 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 			goto patch_call_imm;
 		}
 
+		if (insn->imm == BPF_FUNC_timer_set_callback) {
+			/* Pass prog->aux as a hidden third argument, so
+			 * that the helper can find the JITed callback and
+			 * hold a reference to the program while the timer
+			 * may still fire.
+			 */
+			struct bpf_insn ld_addrs[2] = {
+				BPF_LD_IMM64(BPF_REG_3, (long)prog->aux),
+			};
+
+			insn_buf[0] = ld_addrs[0];
+			insn_buf[1] = ld_addrs[1];
+			insn_buf[2] = *insn;
+			cnt = 3;
+
+			new_prog = bpf_patch_insn_data(env, i + delta, insn_buf,
+						       cnt);
+			if (!new_prog)
+				return -ENOMEM;
+
+			delta    += cnt - 1;
+			env->prog = prog = new_prog;
+			insn      = new_prog->insnsi + i + delta;
+			goto patch_call_imm;
+		}
+
 		if (prog->jit_requested && BITS_PER_LONG == 64 &&
 		    insn->imm == BPF_FUNC_jiffies64) {
 			struct bpf_insn ld_jiffies_addr[2] = {
@@ -11161,6 +11784,23 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 			continue;
 		}
 
+		/* Implement bpf_get_func_ip inline. */
+		if (prog->type == BPF_PROG_TYPE_TRACING &&
+		    insn->imm == BPF_FUNC_get_func_ip) {
+			/* Load IP address from ctx - 8 */
+			insn_buf[0] = BPF_LDX_MEM(BPF_DW, BPF_REG_0,
+						  BPF_REG_1, -8);
+
+			new_prog = bpf_patch_insn_data(env, i + delta, insn_buf,
+						       1);
+			if (!new_prog)
+				return -ENOMEM;
+
+			env->prog = prog = new_prog;
+			insn      = new_prog->insnsi + i + delta;
+			continue;
+		}
+
 patch_call_imm:
 		fn = env->ops->get_func_proto(insn->imm, env->prog);
 		/* all functions that have prototype and verifier allowed
@@ -11757,6 +12397,12 @@ static int check_attach_btf_id(struct bpf_verifier_env *env)
 	    prog->type != BPF_PROG_TYPE_EXT)
 		return 0;
 
+	if (prog->aux->multi_func)
+		/* The functions are only known at BPF_LINK_CREATE time, where
+		 * each of them is checked with bpf_check_attach_target().
+		 */
+		return 0;
+
 	ret = bpf_check_attach_target(&env->log, prog, tgt_prog, btf_id, &tgt_info);
 	if (ret)
 		return ret;
@@ -11943,6 +12589,8 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr,
 			ret = opt_remove_dead_code(env);
 		if (ret == 0)
 			ret = opt_remove_nops(env);
+		if (ret == 0)
+			ret = opt_fold_rdonly_loads(env);
 	} else {
 		if (ret == 0)
 			sanitize_dead_code(env);
@@ -38,8 +38,11 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/memblock.h>
+#include <linux/vmalloc.h>
 #include <linux/fault-inject.h>
 #include <linux/time_namespace.h>
+#include <linux/prctl.h>
+#include <linux/sched/signal.h>
 
 #include <asm/futex.h>
 
@@ -139,10 +142,12 @@
  *
  * Similarly, in order to account for waiters being requeued on another
  * address we always increment the waiters for the destination bucket before
- * acquiring the lock. It then decrements them again  after releasing it -
- * the code that actually moves the futex(es) between hash buckets (requeue_futex)
- * will do the additional required waiter count housekeeping. This is done for
- * double_lock_hb() and double_unlock_hb(), respectively.
+ * acquiring the lock. It then decrements them again right before releasing
+ * it - the code that actually moves the futex(es) between hash buckets
+ * (requeue_futex) will do the additional required waiter count housekeeping.
+ * This is done for double_lock_hb() and double_unlock_hb(), respectively.
+ * The decrement must not come after the unlock, as a private hash bucket may
+ * be freed once its lock is dropped, see struct futex_private_hash.
  */
 
 #ifdef CONFIG_HAVE_FUTEX_CMPXCHG
@@ -166,6 +171,7 @@ static int  __read_mostly futex_cmpxchg_enabled;
 #endif
 #define FLAGS_CLOCKRT		0x02
 #define FLAGS_HAS_TIMEOUT	0x04
+#define FLAGS_NUMA		0x08
 
 /*
  * Priority Inheritance state:
@@ -240,16 +246,19 @@ struct futex_hash_bucket {
 } ____cacheline_aligned_in_smp;
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in hash_futex()), so ensure that they
- * reside in the same cacheline.
+ * The hash is split into one bucket array per possible node, each allocated
+ * on its node.  The arrays and their size are always used together (after
+ * initialization only in hash_futex()), so ensure that they reside in the
+ * same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
-	unsigned long            hashsize;
+	unsigned long            hashmask;
+	unsigned int             hashshift;
+	struct futex_hash_bucket *queues[MAX_NUMNODES];
 } __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+#define futex_queues    (__futex_data.queues)
+#define futex_hashmask  (__futex_data.hashmask)
+#define futex_hashshift (__futex_data.hashshift)
 
 
 /*
@@ -357,14 +366,138 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the global hash.  A FUTEX_NUMA_FLAG futex
+ * carries its node in the key and lives in that node's table.  Other futexes
+ * use the hash bits above the bucket index to pick a table, which only
+ * spreads bucket locks and chains over all nodes instead of homing them on
+ * the boot node.
  */
+static inline u32 futex_key_hash(union futex_key *key)
+{
+	return jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
+		      key->both.offset);
+}
+
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
-	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
-			  key->both.offset);
+	u32 hash = futex_key_hash(key);
+	int node = 0;
+
+#ifdef CONFIG_NUMA
+	node = key->both.node;
+	if (node == FUTEX_NO_NODE) {
+		node = (hash >> futex_hashshift) % nr_node_ids;
+		if (!node_possible(node))
+			node = next_node_in(node, node_possible_map);
+	}
+#endif
+
+	return &futex_queues[node][hash & futex_hashmask];
+}
+
+/*
+ * A process can opt into its own hash for private futexes, see
+ * futex_hash_prctl().  Non-PI operations on private keys then use
+ * futex_hash(), while PI futexes always stay in the global hash.
+ *
+ * Resizing moves all queued waiters of the process into the new table.
+ * Operations sample mm->futex_hash_seq before hashing and recheck it once
+ * the bucket lock is held (or once no waiters were seen); a change means
+ * the table may have been emptied behind their back, and they start over.
+ * The sampled table is only guaranteed to exist inside rcu_read_lock()
+ * until that recheck succeeded, so no bucket of a private table may be
+ * touched after its lock was dropped.
+ */
+struct futex_private_hash {
+	struct rcu_head			rcu;
+	unsigned int			hash_mask;
+	struct futex_hash_bucket	queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_MIN		16
+#define FUTEX_PRIVATE_HASH_MAX		(1U << 16)
+
+static inline bool futex_key_private(union futex_key *key)
+{
+	return !(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED));
+}
+
+static struct futex_hash_bucket *
+futex_private_bucket(struct futex_private_hash *fph, union futex_key *key)
+{
+	return &fph->queues[futex_key_hash(key) & fph->hash_mask];
+}
+
+/**
+ * futex_hash - Return the hash bucket for a non-PI futex operation
+ * @key:	Pointer to the futex key for which the hash is calculated
+ *
+ * Must be called under rcu_read_lock(), after futex_hash_begin().
+ */
+static struct futex_hash_bucket *futex_hash(union futex_key *key)
+{
+	struct futex_private_hash *fph;
+
+	if (futex_key_private(key)) {
+		fph = rcu_dereference(key->private.mm->futex_phash);
+		if (fph)
+			return futex_private_bucket(fph, key);
+	}
+
+	return hash_futex(key);
+}
+
+static void futex_hash_wait(struct mm_struct *mm)
+{
+	long state = current->state;
+
+	/*
+	 * The resize holds the mutex for as long as the count is odd.
+	 * futex_waitv() gets here with some futexes queued and the task
+	 * already TASK_INTERRUPTIBLE; a wakeup consumed while sleeping on
+	 * the mutex is still seen by futex_sleep_multiple() through
+	 * q->lock_ptr.
+	 */
+	__set_current_state(TASK_RUNNING);
+	mutex_lock(&mm->futex_hash_lock);
+	mutex_unlock(&mm->futex_hash_lock);
+	set_current_state(state);
+}
+
+/**
+ * futex_hash_begin - Sample the hash generation for a futex operation
+ * @key:	the futex key about to be hashed with futex_hash()
+ *
+ * Return: the value to pass to futex_hash_changed(), after waiting out any
+ * resize in progress.
+ */
+static unsigned int futex_hash_begin(union futex_key *key)
+{
+	struct mm_struct *mm;
+	unsigned int seq;
+
+	if (!futex_key_private(key))
+		return 0;
+
+	mm = key->private.mm;
+	while ((seq = smp_load_acquire(&mm->futex_hash_seq)) & 1)
+		futex_hash_wait(mm);
+
+	return seq;
+}
+
+/*
+ * Recheck the generation sampled by futex_hash_begin() with the bucket
+ * lock held, or after hb_waiters_pending() found no waiters.
+ */
+static inline bool futex_hash_changed(union futex_key *key, unsigned int seq)
+{
+	if (!futex_key_private(key))
+		return false;
 
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	/* Pairs with the barrier after the resize made the count odd. */
+	smp_rmb();
+	return READ_ONCE(key->private.mm->futex_hash_seq) != seq;
 }
 
 
@@ -460,7 +593,8 @@ static u64 get_inode_sequence_number(struct inode *inode)
 /**
  * get_futex_key() - Get parameters which are the keys for a futex
  * @uaddr:	virtual address of the futex
- * @fshared:	false for a PROCESS_PRIVATE futex, true for PROCESS_SHARED
+ * @flags:	FLAGS_SHARED for a PROCESS_SHARED futex, FLAGS_NUMA to read
+ *		the node word following it
  * @key:	address where result is stored.
  * @rw:		mapping needs to be read/write (values: FUTEX_READ,
  *              FUTEX_WRITE)
@@ -469,13 +603,13 @@ static u64 get_inode_sequence_number(struct inode *inode)
  *
  * The key words are stored in @key on success.
  *
- * For shared mappings (when @fshared), the key is:
+ * For shared mappings (when FLAGS_SHARED), the key is:
  *
  *   ( inode->i_sequence, page->index, offset_within_page )
  *
  * [ also see get_inode_sequence_number() ]
  *
- * For private mappings (or when !@fshared), the key is:
+ * For private mappings (or when !FLAGS_SHARED), the key is:
  *
  *   ( current->mm, address, 0 )
  *
@@ -484,9 +618,12 @@ static u64 get_inode_sequence_number(struct inode *inode)
  *
  * lock_page() might sleep, the caller should not hold a spinlock.
  */
-static int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
-			 enum futex_access rw)
+static int futex_key_node(u32 __user *uaddr, union futex_key *key);
+
+static int get_futex_key(u32 __user *uaddr, unsigned int flags,
+			 union futex_key *key, enum futex_access rw)
 {
+	bool fshared = flags & FLAGS_SHARED;
 	unsigned long address = (unsigned long)uaddr;
 	struct mm_struct *mm = current->mm;
 	struct page *page, *tail;
@@ -504,6 +641,13 @@ static int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
 	if (unlikely(!access_ok(uaddr, sizeof(u32))))
 		return -EFAULT;
 
+	key->both.node = FUTEX_NO_NODE;
+	if (flags & FLAGS_NUMA) {
+		err = futex_key_node(uaddr, key);
+		if (err)
+			return err;
+	}
+
 	if (unlikely(should_fail_futex(fshared)))
 		return -EFAULT;
 
@@ -717,6 +861,44 @@ static int cmpxchg_futex_value_locked(u32 *curval, u32 __user *uaddr,
 	return ret;
 }
 
+/*
+ * Read the node word of a FUTEX_NUMA_FLAG futex.  The first user finds
+ * FUTEX_NO_NODE and claims its own node; cmpxchg makes racing first users
+ * agree on one.
+ */
+static int futex_key_node(u32 __user *uaddr, union futex_key *key)
+{
+	u32 __user *naddr = uaddr + 1;
+	u32 node, curval, self;
+	int ret;
+
+	if (unlikely(!access_ok(naddr, sizeof(u32))))
+		return -EFAULT;
+
+retry:
+	if (get_user(node, naddr))
+		return -EFAULT;
+
+	if (node == (u32)FUTEX_NO_NODE) {
+		self = numa_node_id();
+		ret = cmpxchg_futex_value_locked(&curval, naddr, node, self);
+		if (ret == -EFAULT) {
+			if (fault_in_user_writeable(naddr))
+				return -EFAULT;
+			goto retry;
+		}
+		if (ret)
+			return ret;
+		node = curval == node ? self : curval;
+	}
+
+	if (node >= nr_node_ids || !node_possible(node))
+		return -EINVAL;
+
+	key->both.node = node;
+	return 0;
+}
+
 static int get_futex_value_locked(u32 *dest, u32 __user *from)
 {
 	int ret;
@@ -1593,23 +1775,37 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	struct futex_hash_bucket *hb;
 	struct futex_q *this, *next;
 	union futex_key key = FUTEX_KEY_INIT;
+	unsigned int seq;
 	int ret;
 	DEFINE_WAKE_Q(wake_q);
 
 	if (!bitset)
 		return -EINVAL;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, FUTEX_READ);
+	ret = get_futex_key(uaddr, flags, &key, FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
 
-	hb = hash_futex(&key);
+retry_hash:
+	seq = futex_hash_begin(&key);
+	rcu_read_lock();
+	hb = futex_hash(&key);
 
 	/* Make sure we really have tasks to wakeup */
-	if (!hb_waiters_pending(hb))
+	if (!hb_waiters_pending(hb)) {
+		rcu_read_unlock();
+		if (futex_hash_changed(&key, seq))
+			goto retry_hash;
 		return ret;
+	}
 
 	spin_lock(&hb->lock);
+	if (unlikely(futex_hash_changed(&key, seq))) {
+		spin_unlock(&hb->lock);
+		rcu_read_unlock();
+		goto retry_hash;
+	}
+	rcu_read_unlock();
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (match_futex (&this->key, &key)) {
@@ -1690,22 +1886,32 @@ futex_wake_op(u32 __user *uaddr1, unsigned int flags, u32 __user *uaddr2,
 	union futex_key key1 = FUTEX_KEY_INIT, key2 = FUTEX_KEY_INIT;
 	struct futex_hash_bucket *hb1, *hb2;
 	struct futex_q *this, *next;
+	unsigned int seq;
 	int ret, op_ret;
 	DEFINE_WAKE_Q(wake_q);
 
 retry:
-	ret = get_futex_key(uaddr1, flags & FLAGS_SHARED, &key1, FUTEX_READ);
+	ret = get_futex_key(uaddr1, flags, &key1, FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2, FUTEX_WRITE);
+	ret = get_futex_key(uaddr2, flags, &key2, FUTEX_WRITE);
 	if (unlikely(ret != 0))
 		return ret;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
-
 retry_private:
+	/* Both keys are private or neither is, and they share the mm. */
+	seq = futex_hash_begin(&key1);
+	rcu_read_lock();
+	hb1 = futex_hash(&key1);
+	hb2 = futex_hash(&key2);
 	double_lock_hb(hb1, hb2);
+	if (unlikely(futex_hash_changed(&key1, seq))) {
+		double_unlock_hb(hb1, hb2);
+		rcu_read_unlock();
+		goto retry_private;
+	}
+	rcu_read_unlock();
+
 	op_ret = futex_atomic_op_inuser(op, uaddr2);
 	if (unlikely(op_ret < 0)) {
 		double_unlock_hb(hb1, hb2);
@@ -1927,6 +2133,7 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	struct futex_pi_state *pi_state = NULL;
 	struct futex_hash_bucket *hb1, *hb2;
 	struct futex_q *this, *next;
+	unsigned int seq;
 	DEFINE_WAKE_Q(wake_q);
 
 	if (nr_wake < 0 || nr_requeue < 0)
@@ -1970,10 +2177,10 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	}
 
 retry:
-	ret = get_futex_key(uaddr1, flags & FLAGS_SHARED, &key1, FUTEX_READ);
+	ret = get_futex_key(uaddr1, flags, &key1, FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2,
+	ret = get_futex_key(uaddr2, flags, &key2,
 			    requeue_pi ? FUTEX_WRITE : FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
@@ -1985,12 +2192,21 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	if (requeue_pi && match_futex(&key1, &key2))
 		return -EINVAL;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
-
 retry_private:
+	/* The PI target of requeue_pi lives in the global hash. */
+	seq = futex_hash_begin(&key1);
+	rcu_read_lock();
+	hb1 = futex_hash(&key1);
+	hb2 = requeue_pi ? hash_futex(&key2) : futex_hash(&key2);
 	hb_waiters_inc(hb2);
 	double_lock_hb(hb1, hb2);
+	if (unlikely(futex_hash_changed(&key1, seq))) {
+		hb_waiters_dec(hb2);
+		double_unlock_hb(hb1, hb2);
+		rcu_read_unlock();
+		goto retry_private;
+	}
+	rcu_read_unlock();
 
 	if (likely(cmpval != NULL)) {
 		u32 curval;
@@ -1998,8 +2214,8 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 		ret = get_futex_value_locked(&curval, uaddr1);
 
 		if (unlikely(ret)) {
-			double_unlock_hb(hb1, hb2);
 			hb_waiters_dec(hb2);
+			double_unlock_hb(hb1, hb2);
 
 			ret = get_user(curval, uaddr1);
 			if (ret)
@@ -2064,8 +2280,8 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 
 			/* If the above failed, then pi_state is NULL */
 		case -EFAULT:
-			double_unlock_hb(hb1, hb2);
 			hb_waiters_dec(hb2);
+			double_unlock_hb(hb1, hb2);
 			ret = fault_in_user_writeable(uaddr2);
 			if (!ret)
 				goto retry;
@@ -2078,8 +2294,8 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 			 *   exit to complete.
 			 * - EAGAIN: The user space value changed.
 			 */
-			double_unlock_hb(hb1, hb2);
 			hb_waiters_dec(hb2);
+			double_unlock_hb(hb1, hb2);
 			/*
 			 * Handle the case where the owner is in the middle of
 			 * exiting. Wait for the exit to complete otherwise
@@ -2185,20 +2401,16 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	put_pi_state(pi_state);
 
 out_unlock:
+	hb_waiters_dec(hb2);
 	double_unlock_hb(hb1, hb2);
 	wake_up_q(&wake_q);
-	hb_waiters_dec(hb2);
 	return ret ? ret : task_count;
 }
 
 /* The key must be already stored in q->key. */
-static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
+static inline void __queue_lock(struct futex_q *q, struct futex_hash_bucket *hb)
 	__acquires(&hb->lock)
 {
-	struct futex_hash_bucket *hb;
-
-	hb = hash_futex(&q->key);
-
 	/*
 	 * Increment the counter before taking the lock so that
 	 * a potential waker won't miss a to-be-slept task that is
@@ -2212,15 +2424,67 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	q->lock_ptr = &hb->lock;
 
 	spin_lock(&hb->lock);
-	return hb;
 }
 
 static inline void
 queue_unlock(struct futex_hash_bucket *hb)
 	__releases(&hb->lock)
 {
-	spin_unlock(&hb->lock);
 	hb_waiters_dec(hb);
+	spin_unlock(&hb->lock);
+}
+
+static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
+	__acquires(&hb->lock)
+{
+	struct futex_hash_bucket *hb;
+	unsigned int seq;
+
+retry:
+	seq = futex_hash_begin(&q->key);
+	rcu_read_lock();
+	hb = futex_hash(&q->key);
+	__queue_lock(q, hb);
+	if (unlikely(futex_hash_changed(&q->key, seq))) {
+		queue_unlock(hb);
+		rcu_read_unlock();
+		goto retry;
+	}
+	rcu_read_unlock();
+
+	return hb;
+}
+
+/* Lock the current bucket of @key for a non-PI operation. */
+static struct futex_hash_bucket *futex_hash_lock(union futex_key *key)
+	__acquires(&hb->lock)
+{
+	struct futex_hash_bucket *hb;
+	unsigned int seq;
+
+retry:
+	seq = futex_hash_begin(key);
+	rcu_read_lock();
+	hb = futex_hash(key);
+	spin_lock(&hb->lock);
+	if (unlikely(futex_hash_changed(key, seq))) {
+		spin_unlock(&hb->lock);
+		rcu_read_unlock();
+		goto retry;
+	}
+	rcu_read_unlock();
+
+	return hb;
+}
+
+/* PI futexes always use the global hash. */
+static inline struct futex_hash_bucket *queue_lock_pi(struct futex_q *q)
+	__acquires(&hb->lock)
+{
+	struct futex_hash_bucket *hb = hash_futex(&q->key);
+
+	__queue_lock(q, hb);
+	return hb;
 }
 
 static inline void __queue_me(struct futex_q *q, struct futex_hash_bucket *hb)
@@ -2277,6 +2541,12 @@ static int unqueue_me(struct futex_q *q)
 	spinlock_t *lock_ptr;
 	int ret = 0;
 
+	/*
+	 * A resize of a private hash may move the futex_q and free the old
+	 * table; RCU keeps a stale lock_ptr valid until we notice below.
+	 */
+	rcu_read_lock();
+
 	/* In the common case we don't take the spinlock, which is nice. */
 retry:
 	/*
@@ -2311,6 +2581,7 @@ static int unqueue_me(struct futex_q *q)
 		spin_unlock(lock_ptr);
 		ret = 1;
 	}
+	rcu_read_unlock();
 
 	return ret;
 }
@@ -2652,7 +2923,7 @@ static int futex_wait_setup(u32 __user *uaddr, u32 val, unsigned int flags,
 	 * while the syscall executes.
 	 */
 retry:
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &q->key, FUTEX_READ);
+	ret = get_futex_key(uaddr, flags, &q->key, FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
 
@@ -2763,6 +3034,183 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * struct futex_vector - Kernel side of one futex_waitv() entry
+ * @w:	the userspace futex_waitv entry
+ * @q:	the futex_q queued for this entry
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
+/**
+ * unqueue_multiple() - Remove the futex_qs of a futex_waitv() from their hbs
+ * @v:		the futex vector
+ * @count:	number of leading entries of @v that were queued
+ *
+ * Return:
+ *  - >=0 - index of the last entry that had already been woken
+ *  -  -1 - no entry was woken
+ */
+static int unqueue_multiple(struct futex_vector *v, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&v[i].q))
+			ret = i;
+	}
+
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on and queue several futexes
+ * @vs:		the futex vector
+ * @count:	number of entries in @vs
+ * @woken:	index of the entry found woken while queueing, if any
+ *
+ * All keys are looked up before the task state is set, as get_futex_key()
+ * may sleep.  Each futex_q is then queued as soon as its value matched, so
+ * that no two hash bucket locks are ever held at once.
+ *
+ * Return:
+ *  -  1 - an entry was woken while queueing, see @woken;
+ *  -  0 - all entries are queued and current is TASK_INTERRUPTIBLE;
+ *  - <0 - -EFAULT or -EWOULDBLOCK, nothing is queued
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	unsigned int flags;
+	bool retry = false;
+	int ret, i;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		/* Private keys don't change on retry. */
+		if ((vs[i].w.flags & FUTEX_PRIVATE_FLAG) && retry)
+			continue;
+
+		flags = vs[i].w.flags & FUTEX_PRIVATE_FLAG ? 0 : FLAGS_SHARED;
+		if (vs[i].w.flags & FUTEX2_NUMA)
+			flags |= FLAGS_NUMA;
+
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr), flags,
+				    &vs[i].q.key, FUTEX_READ);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		u32 __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+		u32 val = (u32)vs[i].w.val;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, uaddr);
+
+		if (!ret && uval == val) {
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * A wakeup on one of the entries queued so far wins over
+		 * a fault or a value mismatch on this one.
+		 */
+		*woken = unqueue_multiple(vs, i);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/*
+			 * Fault the page in with nothing locked or queued,
+			 * then start over.
+			 */
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+
+			retry = true;
+			goto retry;
+		}
+
+		if (uval != val)
+			return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/**
+ * futex_sleep_multiple() - Sleep unless woken or timed out already
+ * @vs:		the futex vector, all queued
+ * @count:	number of entries in @vs
+ * @to:		the armed timeout, or NULL
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, unsigned int count,
+				 struct hrtimer_sleeper *to)
+{
+	if (to && !to->task)
+		return;
+
+	for (; count; count--, vs++) {
+		if (!READ_ONCE(vs->q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+/**
+ * futex_wait_multiple() - Wait on several futexes with a single sleep
+ * @vs:		the futex vector
+ * @count:	number of entries in @vs
+ * @to:		the prepared timeout, or NULL
+ *
+ * Return: the index of a woken entry, or -ETIMEDOUT, -ERESTARTSYS,
+ * -EWOULDBLOCK or -EFAULT.
+ */
+static int futex_wait_multiple(struct futex_vector *vs, unsigned int count,
+			       struct hrtimer_sleeper *to)
+{
+	int ret, hint = 0;
+
+	if (to)
+		hrtimer_sleeper_start_expires(to, HRTIMER_MODE_ABS);
+
+	while (1) {
+		ret = futex_wait_multiple_setup(vs, count, &hint);
+		if (ret) {
+			if (ret > 0)
+				ret = hint;
+			return ret;
+		}
+
+		futex_sleep_multiple(vs, count, to);
+
+		__set_current_state(TASK_RUNNING);
+
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (to && !to->task)
+			return -ETIMEDOUT;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		/* Spurious wakeup, go around again. */
+	}
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -2792,12 +3240,12 @@ static int futex_lock_pi(u32 __user *uaddr, unsigned int flags,
 	to = futex_setup_timer(time, &timeout, FLAGS_CLOCKRT, 0);
 
 retry:
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &q.key, FUTEX_WRITE);
+	ret = get_futex_key(uaddr, flags, &q.key, FUTEX_WRITE);
 	if (unlikely(ret != 0))
 		goto out;
 
 retry_private:
-	hb = queue_lock(&q);
+	hb = queue_lock_pi(&q);
 
 	ret = futex_lock_pi_atomic(uaddr, hb, &q.key, &q.pi_state, current,
 				   &exiting, 0);
@@ -2964,7 +3412,7 @@ static int futex_unlock_pi(u32 __user *uaddr, unsigned int flags)
 	if ((uval & FUTEX_TID_MASK) != vpid)
 		return -EPERM;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, FUTEX_WRITE);
+	ret = get_futex_key(uaddr, flags, &key, FUTEX_WRITE);
 	if (ret)
 		return ret;
 
@@ -3175,7 +3623,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	struct hrtimer_sleeper timeout, *to;
 	struct rt_mutex_waiter rt_waiter;
 	struct futex_hash_bucket *hb;
-	union futex_key key2 = FUTEX_KEY_INIT;
+	union futex_key key1, key2 = FUTEX_KEY_INIT;
 	struct futex_q q = futex_q_init;
 	int res, ret;
 
@@ -3197,7 +3645,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	 */
 	rt_mutex_init_waiter(&rt_waiter);
 
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2, FUTEX_WRITE);
+	ret = get_futex_key(uaddr2, flags, &key2, FUTEX_WRITE);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -3224,9 +3672,14 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	}
 
 	/* Queue the futex_q, drop the hb lock, wait for wakeup. */
+	key1 = q.key;
 	futex_wait_queue_me(hb, &q, to);
 
-	spin_lock(&hb->lock);
+	/*
+	 * A private hash resize may have moved us meanwhile, so look up
+	 * the bucket for uaddr again rather than reusing hb.
+	 */
+	hb = futex_hash_lock(&key1);
 	ret = handle_early_requeue_pi_wakeup(hb, &q, &key2, to);
 	spin_unlock(&hb->lock);
 	if (ret)
@@ -3713,6 +4166,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	if (!(op & FUTEX_PRIVATE_FLAG))
 		flags |= FLAGS_SHARED;
 
+	if (op & FUTEX_NUMA_FLAG)
+		flags |= FLAGS_NUMA;
+
 	if (op & FUTEX_CLOCK_REALTIME) {
 		flags |= FLAGS_CLOCKRT;
 		if (cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET && \
@@ -3728,6 +4184,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	case FUTEX_CMP_REQUEUE_PI:
 		if (!futex_cmpxchg_enabled)
 			return -ENOSYS;
+		if (flags & FLAGS_NUMA)
+			return -EINVAL;
 	}
 
 	switch (cmd) {
@@ -3801,6 +4259,104 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+/* Flags accepted in each futex_waitv entry. */
+#define FUTEXV_WAITER_MASK	(FUTEX_32 | FUTEX_PRIVATE_FLAG | FUTEX2_NUMA)
+
+static int futex_parse_waitv(struct futex_vector *futexv,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int nr_futexes)
+{
+	struct futex_waitv aux;
+	unsigned int i;
+
+	for (i = 0; i < nr_futexes; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~FUTEXV_WAITER_MASK) || aux.__reserved)
+			return -EINVAL;
+
+		if (!(aux.flags & FUTEX_32))
+			return -EINVAL;
+
+		futexv[i].w.flags = aux.flags;
+		futexv[i].w.val = aux.val;
+		futexv[i].w.uaddr = aux.uaddr;
+		futexv[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/**
+ * sys_futex_waitv - Wait on a list of futexes
+ * @waiters:    List of futexes to wait on
+ * @nr_futexes: Length of futexv
+ * @flags:      Flag for timeout (monotonic/realtime)
+ * @timeout:	Optional absolute timeout.
+ * @clockid:	Clock to be used for the timeout, realtime or monotonic.
+ *
+ * Given an array of `struct futex_waitv`, wait on each uaddr. The thread wakes
+ * if a futex_wake() is performed at any uaddr. The syscall returns immediately
+ * if any waiter has *uaddr != val.
+ *
+ * Return: the array index of one of the woken futexes, or a negative error.
+ */
+SYSCALL_DEFINE5(futex_waitv, struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes, unsigned int, flags,
+		struct __kernel_timespec __user *, timeout, clockid_t, clockid)
+{
+	struct hrtimer_sleeper to;
+	struct futex_vector *futexv;
+	struct timespec64 ts;
+	ktime_t time;
+	int ret;
+
+	/* This syscall supports no flags for now */
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	if (timeout) {
+		if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+			return -EINVAL;
+
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+		if (!timespec64_valid(&ts))
+			return -EINVAL;
+
+		time = timespec64_to_ktime(ts);
+		if (clockid == CLOCK_MONOTONIC)
+			time = timens_ktime_to_host(CLOCK_MONOTONIC, time);
+
+		futex_setup_timer(&time, &to, clockid == CLOCK_REALTIME ?
+				  FLAGS_CLOCKRT : 0, current->timer_slack_ns);
+	}
+
+	futexv = kcalloc(nr_futexes, sizeof(*futexv), GFP_KERNEL);
+	if (!futexv) {
+		ret = -ENOMEM;
+		goto destroy_timer;
+	}
+
+	ret = futex_parse_waitv(futexv, waiters, nr_futexes);
+	if (!ret)
+		ret = futex_wait_multiple(futexv, nr_futexes,
+					  timeout ? &to : NULL);
+
+	kfree(futexv);
+
+destroy_timer:
+	if (timeout) {
+		hrtimer_cancel(&to.timer);
+		destroy_hrtimer_on_stack(&to.timer);
+	}
+	return ret;
+}
+
 #ifdef CONFIG_COMPAT
 /*
  * Fetch a robust-list pointer. Bit 0 signals PI futexes:
@@ -4012,32 +4568,273 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
-static int __init futex_init(void)
+void futex_mm_init(struct mm_struct *mm)
+{
+	mutex_init(&mm->futex_hash_lock);
+	RCU_INIT_POINTER(mm->futex_phash, NULL);
+	mm->futex_hash_seq = 0;
+	mm->futex_hash_auto = false;
+}
+
+/* Called once the last user of @mm is gone, so no futex_q can be queued. */
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(rcu_dereference_protected(mm->futex_phash, 1));
+	RCU_INIT_POINTER(mm->futex_phash, NULL);
+}
+
+static struct futex_private_hash *futex_private_hash_alloc(unsigned int slots)
+{
+	struct futex_private_hash *fph;
+	unsigned int i;
+
+	fph = kvmalloc(struct_size(fph, queues, slots), GFP_KERNEL_ACCOUNT);
+	if (!fph)
+		return NULL;
+
+	fph->hash_mask = slots - 1;
+	for (i = 0; i < slots; i++) {
+		atomic_set(&fph->queues[i].waiters, 0);
+		plist_head_init(&fph->queues[i].chain);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+
+	return fph;
+}
+
+static unsigned int futex_private_hash_slots(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned int slots = 0;
+
+	rcu_read_lock();
+	fph = rcu_dereference(mm->futex_phash);
+	if (fph)
+		slots = fph->hash_mask + 1;
+	rcu_read_unlock();
+
+	return slots;
+}
+
+/*
+ * Move the waiters on non-PI private futexes of @mm queued on @src into
+ * @fph, or into the global hash if @fph is NULL.
+ */
+static void futex_rehash_bucket(struct mm_struct *mm,
+				struct futex_hash_bucket *src,
+				struct futex_private_hash *fph)
+{
+	struct futex_hash_bucket *dst;
+	struct futex_q *this, *next;
+
+again:
+	spin_lock(&src->lock);
+	plist_for_each_entry_safe(this, next, &src->chain, list) {
+		if (!futex_key_private(&this->key) ||
+		    this->key.private.mm != mm || this->pi_state)
+			continue;
+
+		dst = fph ? futex_private_bucket(fph, &this->key) :
+			    hash_futex(&this->key);
+		/*
+		 * A requeue_pi operation may hold a global bucket and wait
+		 * for @src in double_lock_hb(), so don't block on @dst.
+		 */
+		if (!spin_trylock(&dst->lock)) {
+			spin_unlock(&src->lock);
+			cpu_relax();
+			goto again;
+		}
+
+		plist_del(&this->list, &src->chain);
+		hb_waiters_dec(src);
+		hb_waiters_inc(dst);
+		plist_add(&this->list, &dst->chain);
+		this->lock_ptr = &dst->lock;
+		spin_unlock(&dst->lock);
+	}
+	spin_unlock(&src->lock);
+}
+
+/*
+ * Switch @mm to a private hash of @slots buckets, or back to the global hash
+ * if @slots is 0, moving all queued waiters over.
+ */
+static int futex_hash_resize(struct mm_struct *mm, unsigned int slots)
 {
-	unsigned int futex_shift;
+	struct futex_private_hash *fph = NULL, *old;
 	unsigned long i;
+	int node;
+
+	lockdep_assert_held(&mm->futex_hash_lock);
+
+	if (slots) {
+		fph = futex_private_hash_alloc(slots);
+		if (!fph)
+			return -ENOMEM;
+	}
+
+	old = rcu_dereference_protected(mm->futex_phash,
+					lockdep_is_held(&mm->futex_hash_lock));
+
+	/*
+	 * From here on new operations wait for the mutex, and those that
+	 * raced with us notice the count change once they hold a bucket
+	 * lock we have been through.
+	 */
+	WRITE_ONCE(mm->futex_hash_seq, mm->futex_hash_seq + 1);
+	smp_mb();
+
+	if (old) {
+		for (i = 0; i <= old->hash_mask; i++)
+			futex_rehash_bucket(mm, &old->queues[i], fph);
+	} else {
+		for_each_node(node) {
+			for (i = 0; i <= futex_hashmask; i++) {
+				futex_rehash_bucket(mm, &futex_queues[node][i],
+						    fph);
+				cond_resched();
+			}
+		}
+	}
+
+	rcu_assign_pointer(mm->futex_phash, fph);
+	smp_store_release(&mm->futex_hash_seq, mm->futex_hash_seq + 1);
+
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+/* Four buckets per thread keeps chains short without wasting much memory. */
+static unsigned int futex_hash_auto_slots(void)
+{
+	unsigned long slots = roundup_pow_of_two(4UL * get_nr_threads(current));
+
+	return clamp_t(unsigned long, slots, FUTEX_PRIVATE_HASH_MIN,
+		       FUTEX_PRIVATE_HASH_MAX);
+}
+
+static int futex_hash_set_slots(struct mm_struct *mm, unsigned long slots)
+{
+	bool autosize = slots == PR_FUTEX_HASH_AUTO;
+	int ret = 0;
+
+	if (autosize)
+		slots = futex_hash_auto_slots();
+	else if (slots && (!is_power_of_2(slots) ||
+			   slots < FUTEX_PRIVATE_HASH_MIN ||
+			   slots > FUTEX_PRIVATE_HASH_MAX))
+		return -EINVAL;
+
+	mutex_lock(&mm->futex_hash_lock);
+	if (slots != futex_private_hash_slots(mm))
+		ret = futex_hash_resize(mm, slots);
+	if (!ret)
+		WRITE_ONCE(mm->futex_hash_auto, autosize);
+	mutex_unlock(&mm->futex_hash_lock);
+
+	return ret;
+}
+
+/**
+ * futex_hash_grow - Grow an automatically sized private futex hash
+ * @mm:		the mm a thread was just added to
+ *
+ * Called after a new thread was created.  Allocation failure just leaves
+ * the current table in place.
+ */
+void futex_hash_grow(struct mm_struct *mm)
+{
+	unsigned int slots;
+
+	if (!mm || !READ_ONCE(mm->futex_hash_auto))
+		return;
+
+	slots = futex_hash_auto_slots();
+	if (slots <= futex_private_hash_slots(mm))
+		return;
+
+	mutex_lock(&mm->futex_hash_lock);
+	if (mm->futex_hash_auto && slots > futex_private_hash_slots(mm))
+		futex_hash_resize(mm, slots);
+	mutex_unlock(&mm->futex_hash_lock);
+}
+
+/**
+ * futex_hash_prctl - PR_FUTEX_HASH handler
+ * @arg2:	PR_FUTEX_HASH_SET_SLOTS or PR_FUTEX_HASH_GET_SLOTS
+ * @arg3:	for SET_SLOTS, a power of two bucket count, PR_FUTEX_HASH_AUTO
+ *		to size by thread count and grow with it, or
+ *		PR_FUTEX_HASH_GLOBAL to go back to the global hash
+ *
+ * Return: 0 or the current bucket count (0 for the global hash) on success,
+ * a negative error otherwise.
+ */
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (!mm)
+		return -EINVAL;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		return futex_hash_set_slots(mm, arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		return futex_private_hash_slots(mm);
+	}
+
+	return -EINVAL;
+}
+
+static struct futex_hash_bucket * __init futex_alloc_table(int node,
+							    unsigned long size)
+{
+	if (size > (PAGE_SIZE << (MAX_ORDER - 1)))
+		return vmalloc_node(size, node);
+
+	return alloc_pages_exact_nid(node, size, GFP_KERNEL);
+}
+
+static int __init futex_init(void)
+{
+	unsigned long hashsize, i;
+	int node;
 
 #if CONFIG_BASE_SMALL
-	futex_hashsize = 16;
+	hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	hashsize = 256 * num_possible_cpus() / num_possible_nodes();
+	hashsize = roundup_pow_of_two(max(hashsize, 16UL));
 #endif
-
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0,
-					       futex_hashsize < 256 ? HASH_SMALL : 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
+	futex_hashmask = hashsize - 1;
+	futex_hashshift = ilog2(hashsize);
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+	for_each_node(node) {
+		struct futex_hash_bucket *table;
+
+		table = futex_alloc_table(node, hashsize * sizeof(*table));
+		if (!table)
+			panic("Failed to allocate futex hash table on node %d\n",
+			      node);
+
+		for (i = 0; i < hashsize; i++) {
+			atomic_set(&table[i].waiters, 0);
+			plist_head_init(&table[i].chain);
+			spin_lock_init(&table[i].lock);
+		}
+		futex_queues[node] = table;
 	}
 
+	pr_info("futex hash table entries: %lu per node (%d nodes)\n",
+		hashsize, num_possible_nodes());
+
 	return 0;
 }
 core_initcall(futex_init);
@@ -35,6 +35,15 @@ LOCK_EVENT(pv_wait_head)	/* # of vCPU wait's at the queue head	   */
 LOCK_EVENT(pv_wait_node)	/* # of vCPU wait's at non-head queue node */
 #endif /* CONFIG_PARAVIRT_SPINLOCKS */
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+/*
+ * Locking events for CNA qspinlock.
+ */
+LOCK_EVENT(cna_intra_node)	/* # of lock hand-offs kept on the node	   */
+LOCK_EVENT(cna_splice_tail)	/* # of waiter runs moved to 2nd queue	   */
+LOCK_EVENT(cna_flush_secondary_queue)	/* # of 2nd queue flushes	   */
+#endif /* CONFIG_NUMA_AWARE_SPINLOCKS */
+
 /*
  * Locking events for qspinlock
  *
@@ -45,6 +45,15 @@ do {									\
 	smp_store_release((l), 1)
 #endif
 
+#ifndef arch_mcs_lock_handoff
+/*
+ * Same as arch_mcs_spin_unlock_contended(), but hands over @val rather
+ * than 1; the NUMA-aware qspinlock passes its secondary queue this way.
+ */
+#define arch_mcs_lock_handoff(l, val)					\
+	smp_store_release((l), (val))
+#endif
+
 /*
  * Note: the smp_load_acquire/smp_store_release pair is not
  * sufficient to form a full memory barrier across
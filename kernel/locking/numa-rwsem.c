@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/lockdep.h>
+#include <linux/numa-rwsem.h>
+#include <linux/nodemask.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/errno.h>
+#include <trace/events/lock.h>
+
+int __numa_init_rwsem(struct numa_rw_semaphore *sem,
+		      const char *name, struct lock_class_key *key)
+{
+	sem->nodes = kcalloc(nr_node_ids, sizeof(*sem->nodes), GFP_KERNEL);
+	if (unlikely(!sem->nodes))
+		return -ENOMEM;
+
+	rcuwait_init(&sem->writer);
+	init_waitqueue_head(&sem->waiters);
+	atomic_set(&sem->block, 0);
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+	debug_check_no_locks_freed((void *)sem, sizeof(*sem));
+	lockdep_init_map(&sem->dep_map, name, key, 0);
+#endif
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__numa_init_rwsem);
+
+void numa_free_rwsem(struct numa_rw_semaphore *sem)
+{
+	/* Like percpu_free_rwsem(), safe after a failed init. */
+	if (!sem->nodes)
+		return;
+
+	kfree(sem->nodes);
+	sem->nodes = NULL; /* catch use after free bugs */
+}
+EXPORT_SYMBOL_GPL(numa_free_rwsem);
+
+static inline bool __numa_down_write_trylock(struct numa_rw_semaphore *sem)
+{
+	if (atomic_read(&sem->block))
+		return false;
+
+	return atomic_xchg(&sem->block, 1) == 0;
+}
+
+static bool __numa_rwsem_trylock(struct numa_rw_semaphore *sem, bool reader)
+{
+	if (reader)
+		return __numa_down_read_trylock(sem);
+
+	return __numa_down_write_trylock(sem);
+}
+
+/*
+ * Same wake-up protocol as percpu_rw_semaphore: waiters are queued
+ * EXCLUSIVE in FIFO order, and readers are woken until a single writer
+ * has been woken, or until a trylock fails.
+ */
+static int numa_rwsem_wake_function(struct wait_queue_entry *wq_entry,
+				    unsigned int mode, int wake_flags,
+				    void *key)
+{
+	bool reader = wq_entry->flags & WQ_FLAG_CUSTOM;
+	struct numa_rw_semaphore *sem = key;
+	struct task_struct *p;
+
+	/* concurrent against numa_down_write(), can get stolen */
+	if (!__numa_rwsem_trylock(sem, reader))
+		return 1;
+
+	p = get_task_struct(wq_entry->private);
+	list_del_init(&wq_entry->entry);
+	smp_store_release(&wq_entry->private, NULL);
+
+	wake_up_process(p);
+	put_task_struct(p);
+
+	return !reader; /* wake (readers until) 1 writer */
+}
+
+static void numa_rwsem_wait(struct numa_rw_semaphore *sem, bool reader)
+{
+	DEFINE_WAIT_FUNC(wq_entry, numa_rwsem_wake_function);
+	bool wait;
+
+	spin_lock_irq(&sem->waiters.lock);
+	/*
+	 * Serialize against the wakeup in numa_up_write(), if we fail
+	 * the trylock, the wakeup must see us on the list.
+	 */
+	wait = !__numa_rwsem_trylock(sem, reader);
+	if (wait) {
+		wq_entry.flags |= WQ_FLAG_EXCLUSIVE | reader * WQ_FLAG_CUSTOM;
+		__add_wait_queue_entry_tail(&sem->waiters, &wq_entry);
+	}
+	spin_unlock_irq(&sem->waiters.lock);
+
+	if (!wait)
+		return;
+
+	trace_contention_begin(sem, reader ? LCB_F_READ : LCB_F_WRITE);
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!smp_load_acquire(&wq_entry.private))
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	trace_contention_end(sem, 0);
+}
+
+bool __numa_down_read(struct numa_rw_semaphore *sem, bool try)
+{
+	if (__numa_down_read_trylock(sem))
+		return true;
+
+	if (try)
+		return false;
+
+	numa_rwsem_wait(sem, /* .reader = */ true);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(__numa_down_read);
+
+static long readers_sum(struct numa_rw_semaphore *sem)
+{
+	long sum = 0;
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++)
+		sum += atomic_long_read(&sem->nodes[node].read_count);
+
+	return sum;
+}
+
+/*
+ * Return true if the sum of the per-node reader counts is zero.  If this
+ * sum is zero, then it is stable due to the fact that if any newly arriving
+ * readers increment a given counter, they will immediately decrement that
+ * same counter.
+ *
+ * Assumes sem->block is set.
+ */
+static bool readers_active_check(struct numa_rw_semaphore *sem)
+{
+	if (readers_sum(sem) != 0)
+		return false;
+
+	/*
+	 * If we observed the decrement; ensure we see the entire critical
+	 * section.
+	 */
+
+	smp_mb(); /* C matches B */
+
+	return true;
+}
+
+void numa_down_write(struct numa_rw_semaphore *sem)
+{
+	might_sleep();
+	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
+
+	/*
+	 * Try set sem->block; this provides writer-writer exclusion.
+	 * Having sem->block set makes new readers block.
+	 */
+	if (!__numa_down_write_trylock(sem))
+		numa_rwsem_wait(sem, /* .reader = */ false);
+
+	/* smp_mb() implied by __numa_down_write_trylock() on success -- D matches A and E */
+
+	/*
+	 * If they don't see our store of sem->block, then we are guaranteed to
+	 * see their read_count increment, and therefore will wait for them.
+	 */
+
+	/* Wait for all active readers to complete. */
+	rcuwait_wait_event(&sem->writer, readers_active_check(sem), TASK_UNINTERRUPTIBLE);
+}
+EXPORT_SYMBOL_GPL(numa_down_write);
+
+void numa_up_write(struct numa_rw_semaphore *sem)
+{
+	rwsem_release(&sem->dep_map, _RET_IP_);
+
+	/*
+	 * Readers that see the cleared sem->block through the acquire in
+	 * __numa_down_read_trylock() also see this critical section.
+	 */
+	atomic_set_release(&sem->block, 0);
+
+	/*
+	 * Prod any pending reader/writer to make progress.
+	 */
+	__wake_up(&sem->waiters, TASK_NORMAL, 1, sem);
+}
+EXPORT_SYMBOL_GPL(numa_up_write);
+
+/*
+ * Racy by nature, like rwsem_is_locked(); only meant for assertions and
+ * debugging output.
+ */
+bool numa_rwsem_is_locked(struct numa_rw_semaphore *sem)
+{
+	return atomic_read(&sem->block) || readers_sum(sem) != 0;
+}
+EXPORT_SYMBOL_GPL(numa_rwsem_is_locked);
@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+#include <linux/sched/clock.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * After acquiring the MCS lock and before acquiring the spinlock, the MCS lock
+ * holder checks whether the next waiter in the primary queue (if exists) is
+ * running on the same NUMA node. If it is not, that waiter is detached from
+ * the main queue and moved into the tail of the secondary queue. This way, we
+ * gradually filter the primary queue, leaving only waiters running on the same
+ * preferred NUMA node.
+ *
+ * For fairness, the secondary queue is flushed into the primary queue once
+ * the lock has stayed on one node for longer than numa_spinlock_threshold_ns
+ * while threads of other nodes were waiting for it.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	u16			numa_node;
+	u32			encoded_tail;	/* self */
+	u64			start_time;
+};
+
+/*
+ * Time the lock is kept on one node while the secondary queue is not empty,
+ * 1ms by default. Set with the numa_spinlock_threshold_ns= boot parameter.
+ */
+static ulong numa_spinlock_threshold_ns = NSEC_PER_MSEC;
+
+/* start_time value asking cna_pass_lock() to flush the secondary queue */
+#define CNA_FLUSH_SECONDARY_QUEUE	(~0ULL)
+
+static void __init cna_init_nodes_per_cpu(unsigned int cpu)
+{
+	struct mcs_spinlock *base = per_cpu_ptr(&qnodes[0].mcs, cpu);
+	int numa_node = cpu_to_node(cpu);
+	int i;
+
+	for (i = 0; i < MAX_NODES; i++) {
+		struct cna_node *cn = (struct cna_node *)grab_mcs_node(base, i);
+
+		cn->numa_node = numa_node;
+		cn->encoded_tail = encode_tail(cpu, i);
+		/*
+		 * make sure @encoded_tail is not confused with other valid
+		 * values for @locked (0 or 1)
+		 */
+		WARN_ON(cn->encoded_tail <= 1);
+	}
+}
+
+static void __init cna_init_nodes(void)
+{
+	unsigned int cpu;
+
+	/*
+	 * this will break on 32bit architectures, so we restrict
+	 * the use of CNA to 64bit only (see kernel/Kconfig.locks)
+	 */
+	BUILD_BUG_ON(sizeof(struct cna_node) > sizeof(struct qnode));
+
+	for_each_possible_cpu(cpu)
+		cna_init_nodes_per_cpu(cpu);
+}
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	((struct cna_node *)node)->start_time = 0;
+}
+
+/*
+ * cna_splice_tail -- splice nodes in the primary queue between [first, last]
+ * onto the secondary queue.
+ */
+static void cna_splice_tail(struct mcs_spinlock *node,
+			    struct mcs_spinlock *first,
+			    struct mcs_spinlock *last)
+{
+	/* remove [first,last] */
+	node->next = last->next;
+
+	/* stick [first,last] on the secondary queue tail */
+	if (node->locked <= 1) { /* if secondary queue is empty */
+		/* create secondary queue */
+		last->next = first;
+		/* the lock now stays on this node at the expense of others */
+		((struct cna_node *)node)->start_time = local_clock();
+	} else {
+		/* add to the tail of the secondary queue */
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+		struct mcs_spinlock *head_2nd = tail_2nd->next;
+
+		tail_2nd->next = first;
+		last->next = head_2nd;
+	}
+
+	node->locked = ((struct cna_node *)last)->encoded_tail;
+
+	lockevent_inc(cna_splice_tail);
+}
+
+/*
+ * cna_order_queue - check whether the next waiter in the main queue is on
+ * the same NUMA node as the lock holder; if not, and it has a waiter behind
+ * it in the main queue, move the former onto the secondary queue.
+ *
+ * Returns true once the next waiter is local, false while the main queue
+ * holds no local waiter that could be moved up.
+ */
+static bool cna_order_queue(struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = READ_ONCE(node->next);
+	struct mcs_spinlock *first, *last;
+	int numa_node;
+
+	if (!next)
+		return false;
+
+	numa_node = ((struct cna_node *)node)->numa_node;
+	if (((struct cna_node *)next)->numa_node == numa_node)
+		return true;
+
+	/*
+	 * Look for the first local waiter; the remote ones in front of it
+	 * are moved onto the secondary queue. The last waiter cannot be
+	 * moved as it may be the queue tail, keep spinning and retry.
+	 */
+	first = last = next;
+	for (;;) {
+		next = READ_ONCE(last->next);
+		if (!next)
+			return false;
+		if (((struct cna_node *)next)->numa_node == numa_node)
+			break;
+		last = next;
+	}
+
+	cna_splice_tail(node, first, last);
+	return true;
+}
+
+static __always_inline bool cna_threshold_reached(struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	/* no thread of another node is waiting */
+	if (node->locked <= 1)
+		return false;
+
+	return local_clock() - cn->start_time > numa_spinlock_threshold_ns;
+}
+
+/* Abuse the pv_wait_head_or_lock() hook to get some work done */
+static __always_inline u32 cna_wait_head_or_lock(struct qspinlock *lock,
+						 struct mcs_spinlock *node)
+{
+	if (!cna_threshold_reached(node)) {
+		/*
+		 * Try and put the time otherwise spent spin waiting on
+		 * _Q_LOCKED_PENDING_MASK to use by sorting our lists.
+		 */
+		while ((atomic_read(&lock->val) & _Q_LOCKED_PENDING_MASK) &&
+		       !cna_order_queue(node))
+			cpu_relax();
+	} else {
+		((struct cna_node *)node)->start_time =
+			CNA_FLUSH_SECONDARY_QUEUE;
+	}
+
+	return 0; /* we lied; we didn't wait, go do so now */
+}
+
+static inline bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+				      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *head_2nd, *tail_2nd;
+	u32 new;
+
+	/* If the secondary queue is empty, do what MCS does. */
+	if (node->locked <= 1)
+		return __try_clear_tail(lock, val, node);
+
+	/*
+	 * Try to update the tail value to the last node in the secondary
+	 * queue. If successful, pass the lock to the first thread in the
+	 * secondary queue. Doing those two actions effectively moves all
+	 * nodes from the secondary queue into the main one.
+	 */
+	tail_2nd = decode_tail(node->locked);
+	head_2nd = tail_2nd->next;
+	new = ((struct cna_node *)tail_2nd)->encoded_tail + _Q_LOCKED_VAL;
+
+	if (!atomic_try_cmpxchg_relaxed(&lock->val, &val, new))
+		return false;
+
+	/*
+	 * Try to reset @next in tail_2nd to NULL, but no need to check the
+	 * result - if it failed, a new successor has updated it already.
+	 */
+	cmpxchg_relaxed(&tail_2nd->next, head_2nd, NULL);
+	arch_mcs_lock_handoff(&head_2nd->locked, 1);
+
+	return true;
+}
+
+static inline void cna_pass_lock(struct mcs_spinlock *node,
+				 struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	struct mcs_spinlock *next_holder;
+	u32 val = 1;
+
+	/* cna_order_queue() may have changed the successor */
+	next = READ_ONCE(node->next);
+	next_holder = next;
+
+	if (node->locked > 1) {
+		if (cn->start_time != CNA_FLUSH_SECONDARY_QUEUE &&
+		    ((struct cna_node *)next)->numa_node == cn->numa_node) {
+			/* keep the lock on this node, carry the queue along */
+			val = node->locked;
+			((struct cna_node *)next)->start_time = cn->start_time;
+			lockevent_inc(cna_intra_node);
+		} else {
+			/*
+			 * Either the fairness threshold was reached or there
+			 * is no local waiter: put the secondary queue in front
+			 * of @next, its waiters have been waiting longer.
+			 */
+			struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+
+			next_holder = tail_2nd->next;
+			tail_2nd->next = next;
+			lockevent_inc(cna_flush_secondary_queue);
+		}
+	}
+
+	arch_mcs_lock_handoff(&next_holder->locked, val);
+}
+
+/*
+ * Constant (boot-param configurable) flag selecting the NUMA-aware variant
+ * of spinlock.  Possible values: -1 (off) / 0 (auto, default) / 1 (on).
+ */
+static int numa_spinlock_flag;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto")) {
+		numa_spinlock_flag = 0;
+		return 1;
+	} else if (!strcmp(str, "on")) {
+		numa_spinlock_flag = 1;
+		return 1;
+	} else if (!strcmp(str, "off")) {
+		numa_spinlock_flag = -1;
+		return 1;
+	}
+
+	return 0;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	return !kstrtoul(str, 0, &numa_spinlock_threshold_ns);
+}
+__setup("numa_spinlock_threshold_ns=", numa_spinlock_threshold_setup);
+
+/*
+ * Switch to the NUMA-friendly slow path for spinlocks when we have
+ * multiple NUMA nodes in native environment, unless the user has
+ * overridden this default behavior by setting the numa_spinlock flag.
+ */
+void __init cna_configure_spin_lock_slowpath(void)
+{
+	if (numa_spinlock_flag < 0)
+		return;
+
+	if (numa_spinlock_flag == 0 && (nr_node_ids < 2 ||
+		    pv_ops.lock.queued_spin_lock_slowpath !=
+			native_queued_spin_lock_slowpath))
+		return;
+
+	cna_init_nodes();
+
+	pv_ops.lock.queued_spin_lock_slowpath = __cna_queued_spin_lock_slowpath;
+
+	pr_info("Enabling CNA spinlock\n");
+}
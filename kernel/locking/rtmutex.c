@@ -19,6 +19,7 @@
 #include <linux/sched/wake_q.h>
 #include <linux/sched/debug.h>
 #include <linux/timer.h>
+#include <trace/events/lock.h>
 
 #include "rtmutex_common.h"
 
@@ -1251,6 +1252,8 @@ rt_mutex_slowlock(struct rt_mutex *lock, int state,
 		return 0;
 	}
 
+	trace_contention_begin(lock, LCB_F_RT);
+
 	set_current_state(state);
 
 	/* Setup the timer, when timeout != NULL */
@@ -1275,6 +1278,8 @@ rt_mutex_slowlock(struct rt_mutex *lock, int state,
 	 */
 	fixup_rt_mutex_waiters(lock);
 
+	trace_contention_end(lock, ret);
+
 	raw_spin_unlock_irqrestore(&lock->wait_lock, flags);
 
 	/* Remove pending timer: */
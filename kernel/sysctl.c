@@ -2638,6 +2638,14 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= bpf_stats_handler,
 	},
+	{
+		.procname	= "bpf_stats_sample_period",
+		.data		= &sysctl_bpf_stats_sample_period,
+		.maxlen		= sizeof(sysctl_bpf_stats_sample_period),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ONE,
+	},
 #endif
 #if defined(CONFIG_TREE_RCU)
 	{
@@ -3179,6 +3187,13 @@ static struct ctl_table fs_table[] = {
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "negative-dentry-limit",
+		.data		= &sysctl_negative_dentry_limit,
+		.maxlen		= sizeof(sysctl_negative_dentry_limit),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 	{
 		.procname	= "overflowuid",
 		.data		= &fs_overflowuid,
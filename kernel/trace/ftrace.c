@@ -4930,7 +4930,7 @@ ftrace_notrace_write(struct file *file, const char __user *ubuf,
 }
 
 static int
-ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
+__ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
 {
 	struct ftrace_func_entry *entry;
 
@@ -4948,9 +4948,30 @@ ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
 	return add_hash_entry(hash, ip);
 }
 
+static int
+ftrace_match_addr(struct ftrace_hash *hash, unsigned long *ips,
+		  unsigned int cnt, int remove)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < cnt; i++) {
+		err = __ftrace_match_addr(hash, ips[i], remove);
+		if (err) {
+			/*
+			 * This expects the @hash is a temporary hash and if this
+			 * fails the caller must free the @hash.
+			 */
+			return err;
+		}
+	}
+	return 0;
+}
+
 static int
 ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
-		unsigned long ip, int remove, int reset, int enable)
+		unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
 	struct ftrace_hash **orig_hash;
 	struct ftrace_hash *hash;
@@ -4980,8 +5001,8 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 		ret = -EINVAL;
 		goto out_regex_unlock;
 	}
-	if (ip) {
-		ret = ftrace_match_addr(hash, ip, remove);
+	if (ips) {
+		ret = ftrace_match_addr(hash, ips, cnt, remove);
 		if (ret < 0)
 			goto out_regex_unlock;
 	}
@@ -4998,10 +5019,10 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 }
 
 static int
-ftrace_set_addr(struct ftrace_ops *ops, unsigned long ip, int remove,
-		int reset, int enable)
+ftrace_set_addr(struct ftrace_ops *ops, unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
-	return ftrace_set_hash(ops, NULL, 0, ip, remove, reset, enable);
+	return ftrace_set_hash(ops, NULL, 0, ips, cnt, remove, reset, enable);
 }
 
 #ifdef CONFIG_DYNAMIC_FTRACE_WITH_DIRECT_CALLS
@@ -5239,6 +5260,204 @@ int unregister_ftrace_direct(unsigned long ip, unsigned long addr)
 }
 EXPORT_SYMBOL_GPL(unregister_ftrace_direct);
 
+/**
+ * register_ftrace_direct_ips - Call a custom trampoline from many functions
+ * @ips: The addresses of the nops at the beginning of the functions
+ * @cnt: The number of addresses in @ips
+ * @addr: The address of the trampoline to call at each of @ips
+ *
+ * This is register_ftrace_direct() for a set of functions that share one
+ * trampoline. All of @ips are attached with a single update of the ftrace
+ * records, or none of them are. On success each entry of @ips is updated
+ * to the exact record address, which is what has to be passed to
+ * unregister_ftrace_direct_ips().
+ *
+ * Returns:
+ *  0 on success
+ *  -EBUSY - Another direct function is already attached to one of @ips
+ *  -ENODEV - One of @ips does not point to a ftrace nop location
+ *  -ENOMEM - There was an allocation failure.
+ */
+int register_ftrace_direct_ips(unsigned long *ips, unsigned int cnt,
+			       unsigned long addr)
+{
+	struct ftrace_direct_func *direct;
+	struct ftrace_func_entry *entry;
+	struct ftrace_hash *free_hash = NULL;
+	unsigned int i, added = 0;
+	struct dyn_ftrace *rec;
+	int ret = -ENOMEM;
+
+	if (!cnt)
+		return -EINVAL;
+
+	mutex_lock(&direct_mutex);
+
+	if (ftrace_hash_empty(direct_functions) ||
+	    direct_functions->count + cnt >
+	    2 * (1 << direct_functions->size_bits)) {
+		struct ftrace_hash *new_hash;
+		int size = direct_functions->count + cnt;
+
+		if (size < 32)
+			size = 32;
+
+		new_hash = dup_hash(direct_functions, size);
+		if (!new_hash)
+			goto out_unlock;
+
+		free_hash = direct_functions;
+		direct_functions = new_hash;
+	}
+
+	direct = ftrace_find_direct_func(addr);
+	if (!direct) {
+		direct = kmalloc(sizeof(*direct), GFP_KERNEL);
+		if (!direct)
+			goto out_unlock;
+		direct->addr = addr;
+		direct->count = 0;
+		list_add_rcu(&direct->next, &ftrace_direct_funcs);
+		ftrace_direct_func_count++;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		ret = -EBUSY;
+		if (ftrace_find_rec_direct(ips[i]))
+			goto out_remove;
+
+		ret = -ENODEV;
+		rec = lookup_rec(ips[i], ips[i]);
+		if (!rec || WARN_ON(rec->flags & FTRACE_FL_DIRECT))
+			goto out_remove;
+
+		ret = -EBUSY;
+		if (ips[i] != rec->ip) {
+			ips[i] = rec->ip;
+			if (ftrace_find_rec_direct(ips[i]))
+				goto out_remove;
+		}
+
+		ret = -ENOMEM;
+		entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			goto out_remove;
+
+		entry->ip = ips[i];
+		entry->direct = addr;
+		__add_hash_entry(direct_functions, entry);
+		added++;
+	}
+
+	ret = ftrace_set_filter_ips(&direct_ops, ips, cnt, 0, 0);
+
+	if (!ret && !(direct_ops.flags & FTRACE_OPS_FL_ENABLED)) {
+		ret = register_ftrace_function(&direct_ops);
+		if (ret)
+			ftrace_set_filter_ips(&direct_ops, ips, cnt, 1, 0);
+	}
+
+	if (!ret) {
+		direct->count += cnt;
+		goto out_unlock;
+	}
+
+ out_remove:
+	for (i = 0; i < added; i++) {
+		entry = __ftrace_lookup_ip(direct_functions, ips[i]);
+		remove_hash_entry(direct_functions, entry);
+		kfree(entry);
+	}
+	if (!direct->count) {
+		list_del_rcu(&direct->next);
+		synchronize_rcu_tasks();
+		kfree(direct);
+		if (free_hash)
+			free_ftrace_hash(free_hash);
+		free_hash = NULL;
+		ftrace_direct_func_count--;
+	}
+ out_unlock:
+	mutex_unlock(&direct_mutex);
+
+	if (free_hash) {
+		synchronize_rcu_tasks();
+		free_ftrace_hash(free_hash);
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(register_ftrace_direct_ips);
+
+/**
+ * unregister_ftrace_direct_ips - Remove a trampoline from many functions
+ * @ips: The addresses the trampoline was registered at
+ * @cnt: The number of addresses in @ips
+ * @addr: The address of the trampoline
+ *
+ * Undoes register_ftrace_direct_ips(). The direct calls at all of @ips are
+ * removed with a single update of the ftrace records.
+ *
+ * Returns:
+ *  0 on success
+ *  -ENODEV - @addr is not attached to one of @ips
+ *  -ENOMEM - There was an allocation failure.
+ */
+int unregister_ftrace_direct_ips(unsigned long *ips, unsigned int cnt,
+				 unsigned long addr)
+{
+	struct ftrace_func_entry **entries;
+	struct ftrace_direct_func *direct;
+	unsigned int i;
+	int ret = -ENODEV;
+
+	entries = kvcalloc(cnt, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	mutex_lock(&direct_mutex);
+
+	for (i = 0; i < cnt; i++) {
+		entries[i] = find_direct_entry(&ips[i], NULL);
+		if (!entries[i] || entries[i]->direct != addr)
+			goto out_unlock;
+	}
+
+	direct = ftrace_find_direct_func(addr);
+	if (WARN_ON(!direct || direct->count < cnt))
+		goto out_unlock;
+
+	if (direct_functions->count == cnt)
+		unregister_ftrace_function(&direct_ops);
+
+	ret = ftrace_set_filter_ips(&direct_ops, ips, cnt, 1, 0);
+
+	WARN_ON(ret);
+
+	for (i = 0; i < cnt; i++)
+		remove_hash_entry(direct_functions, entries[i]);
+
+	direct->count -= cnt;
+	if (!direct->count) {
+		list_del_rcu(&direct->next);
+		ftrace_direct_func_count--;
+	}
+
+	/* Lookups of the other direct functions may still walk the entries */
+	synchronize_rcu_tasks();
+
+	for (i = 0; i < cnt; i++)
+		kfree(entries[i]);
+	if (!direct->count)
+		kfree(direct);
+ out_unlock:
+	mutex_unlock(&direct_mutex);
+
+	kvfree(entries);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(unregister_ftrace_direct_ips);
+
 static struct ftrace_ops stub_ops = {
 	.func		= ftrace_stub,
 };
@@ -5379,10 +5598,31 @@ int ftrace_set_filter_ip(struct ftrace_ops *ops, unsigned long ip,
 			 int remove, int reset)
 {
 	ftrace_ops_init(ops);
-	return ftrace_set_addr(ops, ip, remove, reset, 1);
+	return ftrace_set_addr(ops, ip ? &ip : NULL, ip ? 1 : 0,
+			       remove, reset, 1);
 }
 EXPORT_SYMBOL_GPL(ftrace_set_filter_ip);
 
+/**
+ * ftrace_set_filter_ips - set functions to filter on in ftrace by addresses
+ * @ops - the ops to set the filter with
+ * @ips - the array of addresses to add to or remove from the filter.
+ * @cnt - the number of addresses in @ips
+ * @remove - non zero to remove ips from the filter
+ * @reset - non zero to reset all filters before applying this filter.
+ *
+ * Like ftrace_set_filter_ip(), but the whole array is applied with a
+ * single update of the ftrace records. Either all addresses are applied
+ * or, on failure, none of them.
+ */
+int ftrace_set_filter_ips(struct ftrace_ops *ops, unsigned long *ips,
+			  unsigned int cnt, int remove, int reset)
+{
+	ftrace_ops_init(ops);
+	return ftrace_set_addr(ops, ips, cnt, remove, reset, 1);
+}
+EXPORT_SYMBOL_GPL(ftrace_set_filter_ips);
+
 /**
  * ftrace_ops_set_global_filter - setup ops to use global filters
  * @ops - the ops which will use the global filters
@@ -5404,7 +5644,7 @@ static int
 ftrace_set_regex(struct ftrace_ops *ops, unsigned char *buf, int len,
 		 int reset, int enable)
 {
-	return ftrace_set_hash(ops, buf, len, 0, 0, reset, enable);
+	return ftrace_set_hash(ops, buf, len, NULL, 0, 0, reset, enable);
 }
 
 /**
@@ -49,7 +49,10 @@
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 #include <linux/sched/isolation.h>
+#include <linux/sched/topology.h>
 #include <linux/nmi.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_internal.h"
 
@@ -124,6 +127,9 @@ enum {
  *    cpu or grabbing pool->lock is enough for read access.  If
  *    POOL_DISASSOCIATED is set, it's identical to L.
  *
+ * K: Only modified by the worker itself.  Can be safely read by self or
+ *    from IRQ context if %current is the kworker.
+ *
  * A: wq_pool_attach_mutex protected.
  *
  * PL: wq_pool_mutex protected.
@@ -276,14 +282,61 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
-	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
+	struct pool_workqueue __rcu *cpu_pwq_tbl[]; /* PWR: unbound pwqs indexed by CPU */
 };
 
 static struct kmem_cache *pwq_cache;
 
-static cpumask_var_t *wq_numa_possible_cpumask;
-					/* possible CPUs of each node */
+/*
+ * Each pod type describes how CPUs should be grouped for unbound workqueues.
+ * See the comment above workqueue_attrs->affn_scope.
+ */
+struct wq_pod_type {
+	int			nr_pods;	/* number of pods */
+	cpumask_var_t		*pod_cpus;	/* pod -> possible CPUs in the pod */
+	int			*pod_node;	/* pod -> node */
+	int			*cpu_pod;	/* cpu -> pod */
+};
+
+static struct wq_pod_type wq_pod_types[WQ_AFFN_NR_TYPES];
+static enum wq_affn_scope wq_affn_dfl = WQ_AFFN_CACHE;
+
+static const char * const wq_affn_names[WQ_AFFN_NR_TYPES] = {
+	[WQ_AFFN_DFL]			= "default",
+	[WQ_AFFN_CPU]			= "cpu",
+	[WQ_AFFN_SMT]			= "smt",
+	[WQ_AFFN_CACHE]			= "cache",
+	[WQ_AFFN_NUMA]			= "numa",
+	[WQ_AFFN_SYSTEM]		= "system",
+};
 
+static int wq_affn_dfl_set(const char *val, const struct kernel_param *kp)
+{
+	int affn = sysfs_match_string(wq_affn_names, val);
+
+	if (affn < 0)
+		return affn;
+	if (affn == WQ_AFFN_DFL)
+		return -EINVAL;
+
+	wq_affn_dfl = affn;
+	return 0;
+}
+
+static int wq_affn_dfl_get(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s\n", wq_affn_names[wq_affn_dfl]);
+}
+
+static const struct kernel_param_ops wq_affn_dfl_ops = {
+	.set	= wq_affn_dfl_set,
+	.get	= wq_affn_dfl_get,
+};
+
+/* only affects workqueues whose attrs are applied after it is set */
+module_param_cb(default_affinity_scope, &wq_affn_dfl_ops, NULL, 0444);
+
+/* use the system affinity scope by default, see wq_pod_init() */
 static bool wq_disable_numa;
 module_param_named(disable_numa, wq_disable_numa, bool, 0444);
 
@@ -291,12 +344,21 @@ module_param_named(disable_numa, wq_disable_numa, bool, 0444);
 static bool wq_power_efficient = IS_ENABLED(CONFIG_WQ_POWER_EFFICIENT_DEFAULT);
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
+/*
+ * Per-cpu work items which hog the CPU longer than this without sleeping
+ * are automatically marked CPU_INTENSIVE, 0 disables the detection.
+ */
+static unsigned long wq_cpu_intensive_thresh_us = 10 * USEC_PER_MSEC;
+module_param_named(cpu_intensive_thresh_us, wq_cpu_intensive_thresh_us,
+		   ulong, 0644);
+
 static bool wq_online;			/* can kworkers be created yet? */
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+static bool wq_pod_enabled;		/* unbound CPU pods are initialized */
 
-/* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
-static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
+/* buf for wq_update_pod(), protected by CPU hotplug exclusion */
+static struct workqueue_attrs *wq_update_pod_attrs_buf;
 
 static DEFINE_MUTEX(wq_pool_mutex);	/* protects pools and workqueues list */
 static DEFINE_MUTEX(wq_pool_attach_mutex); /* protects worker attach/detach */
@@ -545,32 +607,28 @@ static int worker_pool_assign_id(struct worker_pool *pool)
 }
 
 /**
- * unbound_pwq_by_node - return the unbound pool_workqueue for the given node
+ * unbound_pwq_by_cpu - return the unbound pool_workqueue for the given CPU
  * @wq: the target workqueue
- * @node: the node ID
+ * @cpu: the CPU ID
+ *
+ * All CPUs of a pod of @wq's affinity scope share the same pwq.
  *
  * This must be called with any of wq_pool_mutex, wq->mutex or RCU
  * read locked.
  * If the pwq needs to be used beyond the locking in effect, the caller is
  * responsible for guaranteeing that the pwq stays online.
  *
- * Return: The unbound pool_workqueue for @node.
+ * Return: The unbound pool_workqueue for @cpu.
  */
-static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
-						  int node)
+static struct pool_workqueue *unbound_pwq_by_cpu(struct workqueue_struct *wq,
+						 int cpu)
 {
 	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
 
-	/*
-	 * XXX: @node can be NUMA_NO_NODE if CPU goes offline while a
-	 * delayed item is pending.  The plan is to keep CPU -> NODE
-	 * mapping valid and stable across CPU on/offlines.  Once that
-	 * happens, this workaround can be removed.
-	 */
-	if (unlikely(node == NUMA_NO_NODE))
+	if (unlikely(cpu < 0 || cpu >= nr_cpu_ids))
 		return wq->dfl_pwq;
 
-	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
+	return rcu_dereference_raw(wq->cpu_pwq_tbl[cpu]);
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -851,7 +909,15 @@ void wq_worker_running(struct task_struct *task)
 		return;
 	if (!(worker->flags & WORKER_NOT_RUNNING))
 		atomic_inc(&worker->pool->nr_running);
-	worker->sleeping = 0;
+
+	/*
+	 * CPU hogging is measured from the last time the worker slept.  Reset
+	 * the start before clearing ->sleeping so that wq_worker_tick() never
+	 * sees a running worker with the timestamp of its previous run.
+	 */
+	worker->current_at = task->se.sum_exec_runtime;
+	barrier();
+	WRITE_ONCE(worker->sleeping, 0);
 }
 
 /**
@@ -881,9 +947,19 @@ void wq_worker_sleeping(struct task_struct *task)
 	if (worker->sleeping)
 		return;
 
-	worker->sleeping = 1;
+	WRITE_ONCE(worker->sleeping, 1);
 	raw_spin_lock_irq(&pool->lock);
 
+	/*
+	 * Recheck in case wq_worker_tick() marked us CPU_INTENSIVE or
+	 * unbind_workers() unbound us before ->sleeping was set.  Either
+	 * already took us out of nr_running, don't decrement it twice.
+	 */
+	if (worker->flags & WORKER_NOT_RUNNING) {
+		raw_spin_unlock_irq(&pool->lock);
+		return;
+	}
+
 	/*
 	 * The counterpart of the following dec_and_test, implied mb,
 	 * worklist not empty test sequence is in insert_work().
@@ -989,6 +1065,133 @@ static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
 			atomic_inc(&pool->nr_running);
 }
 
+/*
+ * Work functions which got automatically marked CPU_INTENSIVE, looked up
+ * locklessly by function.  Entries are never freed, so the table only
+ * tracks the first WCI_MAX_ENTS offenders.
+ */
+#define WCI_MAX_ENTS	128
+
+struct wci_ent {
+	work_func_t		func;
+	atomic64_t		cnt;		/* times marked CPU_INTENSIVE */
+	atomic64_t		cpu_time;	/* ns consumed by marked items */
+	struct hlist_node	hash_node;
+};
+
+static struct wci_ent wci_ents[WCI_MAX_ENTS];
+static int wci_nr_ents;
+static DEFINE_RAW_SPINLOCK(wci_lock);
+static DEFINE_HASHTABLE(wci_hash, ilog2(WCI_MAX_ENTS));
+
+static struct wci_ent *wci_find_ent(work_func_t func)
+{
+	struct wci_ent *ent;
+
+	hash_for_each_possible_rcu(wci_hash, ent, hash_node,
+				   (unsigned long)func) {
+		if (ent->func == func)
+			return ent;
+	}
+	return NULL;
+}
+
+/* record that @func got marked CPU_INTENSIVE, called with IRQs disabled */
+static void wq_cpu_intensive_report(work_func_t func)
+{
+	struct wci_ent *ent;
+	u64 cnt;
+
+restart:
+	ent = wci_find_ent(func);
+	if (ent) {
+		/*
+		 * Start reporting from the fourth time and back off
+		 * exponentially, a few hiccups aren't worth the noise.
+		 */
+		cnt = atomic64_inc_return_relaxed(&ent->cnt);
+		if (cnt >= 4 && is_power_of_2(cnt))
+			printk_deferred(KERN_WARNING "workqueue: %ps hogged CPU for >%luus %llu times, consider switching to WQ_UNBOUND\n",
+					ent->func, wq_cpu_intensive_thresh_us,
+					cnt);
+		return;
+	}
+
+	/*
+	 * @func is a new violation.  Allocate a new entry for it.  If
+	 * wci_ents[] is exhausted, something went really wrong and we
+	 * probably made enough noise already.
+	 */
+	if (wci_nr_ents >= WCI_MAX_ENTS)
+		return;
+
+	raw_spin_lock(&wci_lock);
+
+	if (wci_nr_ents >= WCI_MAX_ENTS) {
+		raw_spin_unlock(&wci_lock);
+		return;
+	}
+
+	if (wci_find_ent(func)) {
+		raw_spin_unlock(&wci_lock);
+		goto restart;
+	}
+
+	ent = &wci_ents[wci_nr_ents];
+	ent->func = func;
+	atomic64_set(&ent->cnt, 1);
+	hash_add_rcu(wci_hash, &ent->hash_node, (unsigned long)func);
+
+	/* pairs with the acquire in wq_cpu_intensive_show() */
+	smp_store_release(&wci_nr_ents, wci_nr_ents + 1);
+
+	raw_spin_unlock(&wci_lock);
+}
+
+/**
+ * wq_worker_tick - a scheduler tick occurred while a kworker is running
+ * @task: task currently running
+ *
+ * Called from scheduler_tick().  If a per-cpu work item has been running
+ * longer than wq_cpu_intensive_thresh_us without sleeping, the concurrency
+ * manager never got a chance to start another worker and the rest of the
+ * pool's worklist is stalled behind it.  Take the worker out of concurrency
+ * management by marking it CPU_INTENSIVE, as if its workqueue had been
+ * created with %WQ_CPU_INTENSIVE, and kick off another worker.
+ *
+ * CONTEXT:
+ * hardirq, @task == %current
+ */
+void wq_worker_tick(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+	struct pool_workqueue *pwq = worker->current_pwq;
+	struct worker_pool *pool = worker->pool;
+	unsigned long thresh_ns = READ_ONCE(wq_cpu_intensive_thresh_us) *
+				  NSEC_PER_USEC;
+
+	if (!pwq || !thresh_ns)
+		return;
+
+	/*
+	 * If the current worker is concurrency managed and hogged the CPU
+	 * for longer than the threshold, it's time to kick it out.
+	 */
+	if ((worker->flags & WORKER_NOT_RUNNING) || READ_ONCE(worker->sleeping) ||
+	    task->se.sum_exec_runtime - worker->current_at < thresh_ns)
+		return;
+
+	raw_spin_lock(&pool->lock);
+
+	worker_set_flags(worker, WORKER_CPU_INTENSIVE);
+	wq_cpu_intensive_report(worker->current_func);
+
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+
+	raw_spin_unlock(&pool->lock);
+}
+
 /**
  * find_worker_executing_work - find worker which is executing a work
  * @pool: pool of interest
@@ -1421,7 +1624,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	if (wq->flags & WQ_UNBOUND) {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = wq_select_unbound_cpu(raw_smp_processor_id());
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 	} else {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = raw_smp_processor_id();
@@ -1456,7 +1659,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	 * pwq is determined and locked.  For unbound pools, we could have
 	 * raced with pwq release and it could already be dead.  If its
 	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
-	 * without another pwq replacing it in the numa_pwq_tbl or while
+	 * without another pwq replacing it in the cpu_pwq_tbl or while
 	 * work items are executing on it, so the retrying is guaranteed to
 	 * make forward-progress.
 	 */
@@ -2205,6 +2408,8 @@ __acquires(&pool->lock)
 	worker->current_work = work;
 	worker->current_func = work->func;
 	worker->current_pwq = pwq;
+	worker->current_start = current->se.sum_exec_runtime;
+	worker->current_at = worker->current_start;
 	work_color = get_work_color(work);
 
 	/*
@@ -2299,9 +2504,21 @@ __acquires(&pool->lock)
 
 	raw_spin_lock_irq(&pool->lock);
 
-	/* clear cpu intensive status */
-	if (unlikely(cpu_intensive))
+	/*
+	 * Account the CPU time of items wq_worker_tick() marked CPU
+	 * intensive to their function and clear cpu intensive status.
+	 */
+	if (unlikely(worker->flags & WORKER_CPU_INTENSIVE)) {
+		if (!cpu_intensive) {
+			struct wci_ent *ent = wci_find_ent(worker->current_func);
+
+			if (ent)
+				atomic64_add(current->se.sum_exec_runtime -
+					     worker->current_start,
+					     &ent->cpu_time);
+		}
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
+	}
 
 	/* tag the worker for identification in schedule() */
 	worker->last_func = worker->current_func;
@@ -3378,10 +3595,10 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 	cpumask_copy(to->cpumask, from->cpumask);
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
-	 * ->no_numa as it is used for both pool and wq attrs.  Instead,
-	 * get_unbound_pool() explicitly clears ->no_numa after copying.
+	 * ->affn_scope as it is used for both pool and wq attrs.  Instead,
+	 * get_unbound_pool() explicitly clears ->affn_scope after copying.
 	 */
-	to->no_numa = from->no_numa;
+	to->affn_scope = from->affn_scope;
 }
 
 /* hash value of the content of @attr */
@@ -3598,9 +3815,10 @@ static void put_unbound_pool(struct worker_pool *pool)
  */
 static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 {
+	struct wq_pod_type *pt = &wq_pod_types[WQ_AFFN_NUMA];
 	u32 hash = wqattrs_hash(attrs);
 	struct worker_pool *pool;
-	int node;
+	int pod;
 	int target_node = NUMA_NO_NODE;
 
 	lockdep_assert_held(&wq_pool_mutex);
@@ -3615,10 +3833,9 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 
 	/* if cpumask is contained inside a NUMA node, we belong to that node */
 	if (wq_numa_enabled) {
-		for_each_node(node) {
-			if (cpumask_subset(attrs->cpumask,
-					   wq_numa_possible_cpumask[node])) {
-				target_node = node;
+		for (pod = 0; pod < pt->nr_pods; pod++) {
+			if (cpumask_subset(attrs->cpumask, pt->pod_cpus[pod])) {
+				target_node = pt->pod_node[pod];
 				break;
 			}
 		}
@@ -3634,10 +3851,10 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	pool->node = target_node;
 
 	/*
-	 * no_numa isn't a worker_pool attribute, always clear it.  See
+	 * affn_scope isn't a worker_pool attribute, always clear it.  See
 	 * 'struct workqueue_attrs' comments for detail.
 	 */
-	pool->attrs->no_numa = false;
+	pool->attrs->affn_scope = WQ_AFFN_DFL;
 
 	if (worker_pool_assign_id(pool) < 0)
 		goto fail;
@@ -3815,50 +4032,65 @@ static struct pool_workqueue *alloc_unbound_pwq(struct workqueue_struct *wq,
 	return pwq;
 }
 
+static enum wq_affn_scope
+wqattrs_affn_scope(const struct workqueue_attrs *attrs)
+{
+	enum wq_affn_scope scope = attrs->affn_scope;
+
+	if (scope == WQ_AFFN_DFL)
+		scope = wq_affn_dfl;
+
+	/* SMT and CACHE pods are built by workqueue_init_topology() */
+	if (wq_pod_enabled && !wq_pod_types[scope].nr_pods)
+		scope = WQ_AFFN_NUMA;
+	return scope;
+}
+
 /**
- * wq_calc_node_cpumask - calculate a wq_attrs' cpumask for the specified node
+ * wq_calc_pod_cpumask - calculate a wq_attrs' cpumask for a pod
  * @attrs: the wq_attrs of the default pwq of the target workqueue
- * @node: the target NUMA node
+ * @scope: the affinity scope of the target workqueue
+ * @cpu: the target CPU, its pod is calculated for
  * @cpu_going_down: if >= 0, the CPU to consider as offline
  * @cpumask: outarg, the resulting cpumask
  *
- * Calculate the cpumask a workqueue with @attrs should use on @node.  If
- * @cpu_going_down is >= 0, that cpu is considered offline during
- * calculation.  The result is stored in @cpumask.
+ * Calculate the cpumask a workqueue with @attrs should use on the pod of
+ * @cpu in affinity scope @scope.  If @cpu_going_down is >= 0, that cpu is
+ * considered offline during calculation.  The result is stored in @cpumask.
  *
- * If NUMA affinity is not enabled, @attrs->cpumask is always used.  If
- * enabled and @node has online CPUs requested by @attrs, the returned
- * cpumask is the intersection of the possible CPUs of @node and
- * @attrs->cpumask.
+ * If CPU pods are not initialized yet, @attrs->cpumask is always used.  If
+ * the pod of @cpu has online CPUs requested by @attrs, the returned cpumask
+ * is the intersection of the possible CPUs of the pod and @attrs->cpumask.
  *
- * The caller is responsible for ensuring that the cpumask of @node stays
+ * The caller is responsible for ensuring that the cpumask of the pod stays
  * stable.
  *
  * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
  * %false if equal.
  */
-static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
-				 int cpu_going_down, cpumask_t *cpumask)
+static bool wq_calc_pod_cpumask(const struct workqueue_attrs *attrs,
+				enum wq_affn_scope scope, int cpu,
+				int cpu_going_down, cpumask_t *cpumask)
 {
-	if (!wq_numa_enabled || attrs->no_numa)
+	const struct wq_pod_type *pt = &wq_pod_types[scope];
+	int pod;
+
+	if (!wq_pod_enabled || scope == WQ_AFFN_SYSTEM)
 		goto use_dfl;
 
-	/* does @node have any online CPUs @attrs wants? */
-	cpumask_and(cpumask, cpumask_of_node(node), attrs->cpumask);
+	pod = pt->cpu_pod[cpu];
+
+	/* does the pod have any online CPUs @attrs wants? */
+	cpumask_and(cpumask, pt->pod_cpus[pod], attrs->cpumask);
+	cpumask_and(cpumask, cpumask, cpu_online_mask);
 	if (cpu_going_down >= 0)
 		cpumask_clear_cpu(cpu_going_down, cpumask);
 
 	if (cpumask_empty(cpumask))
 		goto use_dfl;
 
-	/* yeap, return possible CPUs in @node that @attrs wants */
-	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
-
-	if (cpumask_empty(cpumask)) {
-		pr_warn_once("WARNING: workqueue cpumask: online intersect > "
-				"possible intersect\n");
-		return false;
-	}
+	/* yeap, return possible CPUs in the pod that @attrs wants */
+	cpumask_and(cpumask, attrs->cpumask, pt->pod_cpus[pod]);
 
 	return !cpumask_equal(cpumask, attrs->cpumask);
 
@@ -3867,10 +4099,10 @@ static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
 	return false;
 }
 
-/* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
-static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
-						   int node,
-						   struct pool_workqueue *pwq)
+/* install @pwq into @wq's cpu_pwq_tbl[] for @cpu and return the old pwq */
+static struct pool_workqueue *cpu_pwq_tbl_install(struct workqueue_struct *wq,
+						  int cpu,
+						  struct pool_workqueue *pwq)
 {
 	struct pool_workqueue *old_pwq;
 
@@ -3880,8 +4112,8 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 	/* link_pwq() can handle duplicate calls */
 	link_pwq(pwq);
 
-	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-	rcu_assign_pointer(wq->numa_pwq_tbl[node], pwq);
+	old_pwq = rcu_access_pointer(wq->cpu_pwq_tbl[cpu]);
+	rcu_assign_pointer(wq->cpu_pwq_tbl[cpu], pwq);
 	return old_pwq;
 }
 
@@ -3898,10 +4130,10 @@ struct apply_wqattrs_ctx {
 static void apply_wqattrs_cleanup(struct apply_wqattrs_ctx *ctx)
 {
 	if (ctx) {
-		int node;
+		int cpu;
 
-		for_each_node(node)
-			put_pwq_unlocked(ctx->pwq_tbl[node]);
+		for_each_possible_cpu(cpu)
+			put_pwq_unlocked(ctx->pwq_tbl[cpu]);
 		put_pwq_unlocked(ctx->dfl_pwq);
 
 		free_workqueue_attrs(ctx->attrs);
@@ -3917,11 +4149,13 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 {
 	struct apply_wqattrs_ctx *ctx;
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
-	int node;
+	enum wq_affn_scope scope = wqattrs_affn_scope(attrs);
+	struct wq_pod_type *pt = &wq_pod_types[scope];
+	int cpu;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	ctx = kzalloc(struct_size(ctx, pwq_tbl, nr_node_ids), GFP_KERNEL);
+	ctx = kzalloc(struct_size(ctx, pwq_tbl, nr_cpu_ids), GFP_KERNEL);
 
 	new_attrs = alloc_workqueue_attrs();
 	tmp_attrs = alloc_workqueue_attrs();
@@ -3954,15 +4188,31 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (!ctx->dfl_pwq)
 		goto out_free;
 
-	for_each_node(node) {
-		if (wq_calc_node_cpumask(new_attrs, node, -1, tmp_attrs->cpumask)) {
-			ctx->pwq_tbl[node] = alloc_unbound_pwq(wq, tmp_attrs);
-			if (!ctx->pwq_tbl[node])
-				goto out_free;
+	/*
+	 * All CPUs of a pod share one pwq.  Its first CPU is visited first
+	 * and allocates the pwq, the others take a reference.  The pwqs
+	 * aren't linked yet, so there is no need to lock their pools.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct pool_workqueue *pwq;
+
+		if (wq_calc_pod_cpumask(new_attrs, scope, cpu, -1,
+					tmp_attrs->cpumask)) {
+			int first = cpumask_first(pt->pod_cpus[pt->cpu_pod[cpu]]);
+
+			if (first < cpu) {
+				pwq = ctx->pwq_tbl[first];
+				pwq->refcnt++;
+			} else {
+				pwq = alloc_unbound_pwq(wq, tmp_attrs);
+				if (!pwq)
+					goto out_free;
+			}
 		} else {
-			ctx->dfl_pwq->refcnt++;
-			ctx->pwq_tbl[node] = ctx->dfl_pwq;
+			pwq = ctx->dfl_pwq;
+			pwq->refcnt++;
 		}
+		ctx->pwq_tbl[cpu] = pwq;
 	}
 
 	/* save the user configured attrs and sanitize it. */
@@ -3984,7 +4234,7 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 /* set attrs and install prepared pwqs, @ctx points to old pwqs on return */
 static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 {
-	int node;
+	int cpu;
 
 	/* all pwqs have been created successfully, let's install'em */
 	mutex_lock(&ctx->wq->mutex);
@@ -3992,9 +4242,9 @@ static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 	copy_workqueue_attrs(ctx->wq->unbound_attrs, ctx->attrs);
 
 	/* save the previous pwq and install the new one */
-	for_each_node(node)
-		ctx->pwq_tbl[node] = numa_pwq_tbl_install(ctx->wq, node,
-							  ctx->pwq_tbl[node]);
+	for_each_possible_cpu(cpu)
+		ctx->pwq_tbl[cpu] = cpu_pwq_tbl_install(ctx->wq, cpu,
+							ctx->pwq_tbl[cpu]);
 
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(ctx->dfl_pwq);
@@ -4049,12 +4299,12 @@ static int apply_workqueue_attrs_locked(struct workqueue_struct *wq,
  * @wq: the target workqueue
  * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
  *
- * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
- * machines, this function maps a separate pwq to each NUMA node with
- * possibles CPUs in @attrs->cpumask so that work items are affine to the
- * NUMA node it was issued on.  Older pwqs are released as in-flight work
- * items finish.  Note that a work item which repeatedly requeues itself
- * back-to-back will stay on its current pwq.
+ * Apply @attrs to an unbound workqueue @wq.  This function maps a separate
+ * pwq to each CPU pod of @attrs->affn_scope with possible CPUs in
+ * @attrs->cpumask so that work items are affine to the pod, e.g. the last
+ * level cache domain, they were issued on.  Older pwqs are released as
+ * in-flight work items finish.  Note that a work item which repeatedly
+ * requeues itself back-to-back will stay on its current pwq.
  *
  * Performs GFP_KERNEL allocations.
  *
@@ -4077,52 +4327,59 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 }
 
 /**
- * wq_update_unbound_numa - update NUMA affinity of a wq for CPU hot[un]plug
+ * wq_update_pod - update pod affinity of a wq for CPU hot[un]plug
  * @wq: the target workqueue
  * @cpu: the CPU coming up or going down
  * @online: whether @cpu is coming up or going down
  *
  * This function is to be called from %CPU_DOWN_PREPARE, %CPU_ONLINE and
- * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update NUMA affinity of
- * @wq accordingly.
+ * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update the pwq of the
+ * pod of @cpu in @wq's affinity scope accordingly.
  *
- * If NUMA affinity can't be adjusted due to memory allocation failure, it
+ * If pod affinity can't be adjusted due to memory allocation failure, it
  * falls back to @wq->dfl_pwq which may not be optimal but is always
  * correct.
  *
- * Note that when the last allowed CPU of a NUMA node goes offline for a
- * workqueue with a cpumask spanning multiple nodes, the workers which were
- * already executing the work items for the workqueue will lose their CPU
- * affinity and may execute on any CPU.  This is similar to how per-cpu
- * workqueues behave on CPU_DOWN.  If a workqueue user wants strict
- * affinity, it's the user's responsibility to flush the work item from
- * CPU_DOWN_PREPARE.
+ * Note that when the last allowed CPU of a pod goes offline for a workqueue
+ * with a cpumask spanning multiple pods, the workers which were already
+ * executing the work items for the workqueue will lose their CPU affinity
+ * and may execute on any CPU.  This is similar to how per-cpu workqueues
+ * behave on CPU_DOWN.  If a workqueue user wants strict affinity, it's the
+ * user's responsibility to flush the work item from CPU_DOWN_PREPARE.
  */
-static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
-				   bool online)
+static void wq_update_pod(struct workqueue_struct *wq, int cpu, bool online)
 {
-	int node = cpu_to_node(cpu);
 	int cpu_off = online ? -1 : cpu;
-	struct pool_workqueue *old_pwq = NULL, *pwq;
+	struct pool_workqueue *pwq;
 	struct workqueue_attrs *target_attrs;
+	const struct cpumask *pod_cpus;
+	struct wq_pod_type *pt;
+	enum wq_affn_scope scope;
 	cpumask_t *cpumask;
+	int tcpu;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	if (!wq_numa_enabled || !(wq->flags & WQ_UNBOUND) ||
-	    wq->unbound_attrs->no_numa)
+	if (!wq_pod_enabled || !(wq->flags & WQ_UNBOUND))
 		return;
 
+	scope = wqattrs_affn_scope(wq->unbound_attrs);
+	if (scope == WQ_AFFN_SYSTEM)
+		return;
+
+	pt = &wq_pod_types[scope];
+	pod_cpus = pt->pod_cpus[pt->cpu_pod[cpu]];
+
 	/*
 	 * We don't wanna alloc/free wq_attrs for each wq for each CPU.
 	 * Let's use a preallocated one.  The following buf is protected by
 	 * CPU hotplug exclusion.
 	 */
-	target_attrs = wq_update_unbound_numa_attrs_buf;
+	target_attrs = wq_update_pod_attrs_buf;
 	cpumask = target_attrs->cpumask;
 
 	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
-	pwq = unbound_pwq_by_node(wq, node);
+	pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	/*
 	 * Let's determine what needs to be done.  If the target cpumask is
@@ -4130,35 +4387,42 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * and create a new one if they don't match.  If the target cpumask
 	 * equals the default pwq's, the default pwq should be used.
 	 */
-	if (wq_calc_node_cpumask(wq->dfl_pwq->pool->attrs, node, cpu_off, cpumask)) {
+	if (wq_calc_pod_cpumask(wq->dfl_pwq->pool->attrs, scope, cpu, cpu_off,
+				cpumask)) {
 		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
 			return;
 	} else {
+		if (pwq == wq->dfl_pwq)
+			return;
 		goto use_dfl_pwq;
 	}
 
 	/* create a new pwq */
 	pwq = alloc_unbound_pwq(wq, target_attrs);
 	if (!pwq) {
-		pr_warn("workqueue: allocation failed while updating NUMA affinity of \"%s\"\n",
+		pr_warn("workqueue: allocation failed while updating CPU pod affinity of \"%s\"\n",
 			wq->name);
 		goto use_dfl_pwq;
 	}
 
-	/* Install the new pwq. */
+	/* one reference for each CPU of the pod, not linked yet */
+	pwq->refcnt += cpumask_weight(pod_cpus) - 1;
+
 	mutex_lock(&wq->mutex);
-	old_pwq = numa_pwq_tbl_install(wq, node, pwq);
-	goto out_unlock;
+	goto install;
 
 use_dfl_pwq:
+	pwq = wq->dfl_pwq;
 	mutex_lock(&wq->mutex);
-	raw_spin_lock_irq(&wq->dfl_pwq->pool->lock);
-	get_pwq(wq->dfl_pwq);
-	raw_spin_unlock_irq(&wq->dfl_pwq->pool->lock);
-	old_pwq = numa_pwq_tbl_install(wq, node, wq->dfl_pwq);
-out_unlock:
+	raw_spin_lock_irq(&pwq->pool->lock);
+	for_each_cpu(tcpu, pod_cpus)
+		get_pwq(pwq);
+	raw_spin_unlock_irq(&pwq->pool->lock);
+install:
+	/* Install @pwq for the whole pod and put the replaced pwqs. */
+	for_each_cpu(tcpu, pod_cpus)
+		put_pwq_unlocked(cpu_pwq_tbl_install(wq, tcpu, pwq));
 	mutex_unlock(&wq->mutex);
-	put_pwq_unlocked(old_pwq);
 }
 
 static int alloc_and_link_pwqs(struct workqueue_struct *wq)
@@ -4270,7 +4534,7 @@ struct workqueue_struct *alloc_workqueue(const char *fmt,
 
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
-		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
+		tbl_size = nr_cpu_ids * sizeof(wq->cpu_pwq_tbl[0]);
 
 	wq = kzalloc(sizeof(*wq) + tbl_size, GFP_KERNEL);
 	if (!wq)
@@ -4367,7 +4631,7 @@ static bool pwq_busy(struct pool_workqueue *pwq)
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	struct pool_workqueue *pwq;
-	int node;
+	int cpu;
 
 	/*
 	 * Remove it from sysfs first so that sanity check failure doesn't
@@ -4431,12 +4695,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	} else {
 		/*
 		 * We're the sole accessor of @wq at this point.  Directly
-		 * access numa_pwq_tbl[] and dfl_pwq to put the base refs.
+		 * access cpu_pwq_tbl[] and dfl_pwq to put the base refs.
 		 * @wq will be freed when the last pwq is released.
 		 */
-		for_each_node(node) {
-			pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-			RCU_INIT_POINTER(wq->numa_pwq_tbl[node], NULL);
+		for_each_possible_cpu(cpu) {
+			pwq = rcu_access_pointer(wq->cpu_pwq_tbl[cpu]);
+			RCU_INIT_POINTER(wq->cpu_pwq_tbl[cpu], NULL);
 			put_pwq_unlocked(pwq);
 		}
 
@@ -4546,7 +4810,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	ret = !list_empty(&pwq->delayed_works);
 	preempt_enable();
@@ -5071,9 +5335,9 @@ int workqueue_online_cpu(unsigned int cpu)
 		mutex_unlock(&wq_pool_attach_mutex);
 	}
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, true);
+		wq_update_pod(wq, cpu, true);
 
 	mutex_unlock(&wq_pool_mutex);
 	return 0;
@@ -5089,10 +5353,10 @@ int workqueue_offline_cpu(unsigned int cpu)
 
 	unbind_workers(cpu);
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	mutex_lock(&wq_pool_mutex);
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, false);
+		wq_update_pod(wq, cpu, false);
 	mutex_unlock(&wq_pool_mutex);
 
 	return 0;
@@ -5362,10 +5626,12 @@ int workqueue_set_unbound_cpumask(cpumask_var_t cpumask)
  *
  * Unbound workqueues have the following extra attributes.
  *
- *  pool_ids	RO int	: the associated pool IDs for each node
+ *  pool_ids	RO int	: the associated pool IDs for each CPU
  *  nice	RW int	: nice value of the workers
  *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
- *  numa	RW bool	: whether enable NUMA affinity
+ *  affinity_scope RW str : the CPU pods sharing a pool, one of "default",
+ *			  "cpu", "smt", "cache", "numa" and "system"
+ *  numa	RW bool	: whether enable NUMA affinity, kept for compatibility
  */
 struct wq_device {
 	struct workqueue_struct		*wq;
@@ -5423,14 +5689,14 @@ static ssize_t wq_pool_ids_show(struct device *dev,
 {
 	struct workqueue_struct *wq = dev_to_wq(dev);
 	const char *delim = "";
-	int node, written = 0;
+	int cpu, written = 0;
 
 	get_online_cpus();
 	rcu_read_lock();
-	for_each_node(node) {
+	for_each_possible_cpu(cpu) {
 		written += scnprintf(buf + written, PAGE_SIZE - written,
-				     "%s%d:%d", delim, node,
-				     unbound_pwq_by_node(wq, node)->pool->id);
+				     "%s%d:%d", delim, cpu,
+				     unbound_pwq_by_cpu(wq, cpu)->pool->id);
 		delim = " ";
 	}
 	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
@@ -5538,7 +5804,7 @@ static ssize_t wq_numa_show(struct device *dev, struct device_attribute *attr,
 
 	mutex_lock(&wq->mutex);
 	written = scnprintf(buf, PAGE_SIZE, "%d\n",
-			    !wq->unbound_attrs->no_numa);
+			    wqattrs_affn_scope(wq->unbound_attrs) != WQ_AFFN_SYSTEM);
 	mutex_unlock(&wq->mutex);
 
 	return written;
@@ -5559,7 +5825,7 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 
 	ret = -EINVAL;
 	if (sscanf(buf, "%d", &v) == 1) {
-		attrs->no_numa = !v;
+		attrs->affn_scope = v ? WQ_AFFN_NUMA : WQ_AFFN_SYSTEM;
 		ret = apply_workqueue_attrs_locked(wq, attrs);
 	}
 
@@ -5569,10 +5835,55 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 	return ret ?: count;
 }
 
+static ssize_t wq_affn_scope_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	if (wq->unbound_attrs->affn_scope == WQ_AFFN_DFL)
+		written = scnprintf(buf, PAGE_SIZE, "%s (%s)\n",
+				    wq_affn_names[WQ_AFFN_DFL],
+				    wq_affn_names[wq_affn_dfl]);
+	else
+		written = scnprintf(buf, PAGE_SIZE, "%s\n",
+				    wq_affn_names[wq->unbound_attrs->affn_scope]);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_affn_scope_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int affn, ret = -ENOMEM;
+
+	affn = sysfs_match_string(wq_affn_names, buf);
+	if (affn < 0)
+		return affn;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (attrs) {
+		attrs->affn_scope = affn;
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	}
+
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR(affinity_scope, 0644, wq_affn_scope_show, wq_affn_scope_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
 	__ATTR_NULL,
 };
@@ -5723,6 +6034,40 @@ static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
 static void workqueue_sysfs_unregister(struct workqueue_struct *wq)	{ }
 #endif	/* CONFIG_SYSFS */
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * debugfs/workqueue/cpu_intensive lists the work functions which were
+ * automatically marked CPU_INTENSIVE, how many times it happened and the
+ * CPU time in usecs consumed by these work items.
+ */
+static int wq_cpu_intensive_show(struct seq_file *m, void *v)
+{
+	int i, nr_ents = smp_load_acquire(&wci_nr_ents);
+
+	seq_printf(m, "%-48s %12s %16s\n", "function", "count", "cpu_time_us");
+
+	for (i = 0; i < nr_ents; i++) {
+		struct wci_ent *ent = &wci_ents[i];
+
+		seq_printf(m, "%-48ps %12lld %16llu\n", ent->func,
+			   atomic64_read(&ent->cnt),
+			   div_u64(atomic64_read(&ent->cpu_time), NSEC_PER_USEC));
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wq_cpu_intensive);
+
+static int __init wq_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("workqueue", NULL);
+
+	debugfs_create_file("cpu_intensive", 0400, dir, NULL,
+			    &wq_cpu_intensive_fops);
+	return 0;
+}
+fs_initcall(wq_debugfs_init);
+#endif	/* CONFIG_DEBUG_FS */
+
 /*
  * Workqueue watchdog.
  *
@@ -5869,46 +6214,87 @@ static inline void wq_watchdog_init(void) { }
 
 #endif	/* CONFIG_WQ_WATCHDOG */
 
-static void __init wq_numa_init(void)
+static void __init init_pod_type(struct wq_pod_type *pt,
+				 bool (*cpus_share_pod)(int, int))
 {
-	cpumask_var_t *tbl;
-	int node, cpu;
+	int cur, pre, cpu, pod;
 
-	if (num_possible_nodes() <= 1)
-		return;
+	pt->nr_pods = 0;
 
-	if (wq_disable_numa) {
-		pr_info("workqueue: NUMA affinity support disabled\n");
-		return;
-	}
+	/* init @pt->cpu_pod[] according to @cpus_share_pod() */
+	pt->cpu_pod = kcalloc(nr_cpu_ids, sizeof(pt->cpu_pod[0]), GFP_KERNEL);
+	BUG_ON(!pt->cpu_pod);
 
-	wq_update_unbound_numa_attrs_buf = alloc_workqueue_attrs();
-	BUG_ON(!wq_update_unbound_numa_attrs_buf);
+	for_each_possible_cpu(cur) {
+		for_each_possible_cpu(pre) {
+			if (pre >= cur) {
+				pt->cpu_pod[cur] = pt->nr_pods++;
+				break;
+			}
+			if (cpus_share_pod(cur, pre)) {
+				pt->cpu_pod[cur] = pt->cpu_pod[pre];
+				break;
+			}
+		}
+	}
 
-	/*
-	 * We want masks of possible CPUs of each node which isn't readily
-	 * available.  Build one from cpu_to_node() which should have been
-	 * fully initialized by now.
-	 */
-	tbl = kcalloc(nr_node_ids, sizeof(tbl[0]), GFP_KERNEL);
-	BUG_ON(!tbl);
+	/* init the rest to match @pt->cpu_pod[] */
+	pt->pod_cpus = kcalloc(pt->nr_pods, sizeof(pt->pod_cpus[0]), GFP_KERNEL);
+	pt->pod_node = kcalloc(pt->nr_pods, sizeof(pt->pod_node[0]), GFP_KERNEL);
+	BUG_ON(!pt->pod_cpus || !pt->pod_node);
 
-	for_each_node(node)
-		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
-				node_online(node) ? node : NUMA_NO_NODE));
+	for (pod = 0; pod < pt->nr_pods; pod++)
+		BUG_ON(!zalloc_cpumask_var(&pt->pod_cpus[pod], GFP_KERNEL));
 
 	for_each_possible_cpu(cpu) {
-		node = cpu_to_node(cpu);
-		if (WARN_ON(node == NUMA_NO_NODE)) {
-			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n", cpu);
-			/* happens iff arch is bonkers, let's just proceed */
-			return;
-		}
-		cpumask_set_cpu(cpu, tbl[node]);
+		cpumask_set_cpu(cpu, pt->pod_cpus[pt->cpu_pod[cpu]]);
+		pt->pod_node[pt->cpu_pod[cpu]] = cpu_to_node(cpu);
 	}
+}
+
+static bool __init cpus_dont_share(int cpu0, int cpu1)
+{
+	return false;
+}
+
+static bool __init cpus_share_smt(int cpu0, int cpu1)
+{
+	return cpumask_test_cpu(cpu0, topology_sibling_cpumask(cpu1));
+}
 
-	wq_numa_possible_cpumask = tbl;
-	wq_numa_enabled = true;
+static bool __init cpus_share_numa(int cpu0, int cpu1)
+{
+	return cpu_to_node(cpu0) == cpu_to_node(cpu1);
+}
+
+static bool __init cpus_share_system(int cpu0, int cpu1)
+{
+	return true;
+}
+
+/*
+ * Build the CPU pods of the affinity scopes which only need the CPU to node
+ * mapping.  SMT siblings and LLC domains are only known after smp_init()
+ * and sched_init_smp(): until workqueue_init_topology() builds their pods,
+ * the SMT and CACHE scopes fall back to NUMA, see wqattrs_affn_scope().
+ */
+static void __init wq_pod_init(void)
+{
+	wq_update_pod_attrs_buf = alloc_workqueue_attrs();
+	BUG_ON(!wq_update_pod_attrs_buf);
+
+	init_pod_type(&wq_pod_types[WQ_AFFN_CPU], cpus_dont_share);
+	init_pod_type(&wq_pod_types[WQ_AFFN_NUMA], cpus_share_numa);
+	init_pod_type(&wq_pod_types[WQ_AFFN_SYSTEM], cpus_share_system);
+
+	if (wq_disable_numa) {
+		pr_info("workqueue: NUMA affinity support disabled\n");
+		wq_affn_dfl = WQ_AFFN_SYSTEM;
+	} else if (num_possible_nodes() > 1) {
+		wq_numa_enabled = true;
+	}
+
+	wq_pod_enabled = true;
 }
 
 /**
@@ -5964,11 +6350,11 @@ void __init workqueue_init_early(void)
 		/*
 		 * An ordered wq should have only one pwq as ordering is
 		 * guaranteed by max_active which is enforced by pwqs.
-		 * Turn off NUMA so that dfl_pwq is used for all nodes.
+		 * Use the system scope so that dfl_pwq is used for all CPUs.
 		 */
 		BUG_ON(!(attrs = alloc_workqueue_attrs()));
 		attrs->nice = std_nice[i];
-		attrs->no_numa = true;
+		attrs->affn_scope = WQ_AFFN_SYSTEM;
 		ordered_wq_attrs[i] = attrs;
 	}
 
@@ -6006,15 +6392,15 @@ void __init workqueue_init(void)
 	int cpu, bkt;
 
 	/*
-	 * It'd be simpler to initialize NUMA in workqueue_init_early() but
-	 * CPU to node mapping may not be available that early on some
+	 * It'd be simpler to initialize CPU pods in workqueue_init_early()
+	 * but CPU to node mapping may not be available that early on some
 	 * archs such as power and arm64.  As per-cpu pools created
-	 * previously could be missing node hint and unbound pools NUMA
+	 * previously could be missing node hint and unbound pools pod
 	 * affinity, fix them up.
 	 *
 	 * Also, while iterating workqueues, create rescuers if requested.
 	 */
-	wq_numa_init();
+	wq_pod_init();
 
 	mutex_lock(&wq_pool_mutex);
 
@@ -6025,7 +6411,8 @@ void __init workqueue_init(void)
 	}
 
 	list_for_each_entry(wq, &workqueues, list) {
-		wq_update_unbound_numa(wq, smp_processor_id(), true);
+		for_each_online_cpu(cpu)
+			wq_update_pod(wq, cpu, true);
 		WARN(init_rescuer(wq),
 		     "workqueue: failed to create early rescuer for %s",
 		     wq->name);
@@ -6047,3 +6434,31 @@ void __init workqueue_init(void)
 	wq_online = true;
 	wq_watchdog_init();
 }
+
+/**
+ * workqueue_init_topology - build the SMT and CACHE pods
+ *
+ * Called once sched_init_smp() has set up the SMT sibling masks and the LLC
+ * domains.  Build the pods of the affinity scopes depending on them and
+ * re-apply the pods of all existing unbound workqueues, which have been
+ * using NUMA pods in their place so far.
+ */
+void __init workqueue_init_topology(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	init_pod_type(&wq_pod_types[WQ_AFFN_SMT], cpus_share_smt);
+	init_pod_type(&wq_pod_types[WQ_AFFN_CACHE], cpus_share_cache);
+
+	get_online_cpus();
+	mutex_lock(&wq_pool_mutex);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_online_cpu(cpu)
+			wq_update_pod(wq, cpu, true);
+	}
+
+	mutex_unlock(&wq_pool_mutex);
+	put_online_cpus();
+}
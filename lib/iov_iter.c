@@ -391,6 +391,19 @@ static size_t copy_page_to_iter_pipe(struct page *page, size_t offset, size_t by
 	if (!sanity(i))
 		return 0;
 
+	/*
+	 * Refer to the subpages of a compound page through its head, so
+	 * that consecutive ranges of a huge page cache page end up in a
+	 * single pipe buffer and are handed to ->sendpage() in one go.
+	 * Highmem pages can only be mapped one page at a time.
+	 */
+	if (PageCompound(page) && !PageHighMem(page)) {
+		struct page *head = compound_head(page);
+
+		offset += (page_to_pfn(page) - page_to_pfn(head)) << PAGE_SHIFT;
+		page = head;
+	}
+
 	off = i->iov_offset;
 	buf = &pipe->bufs[i_head & p_mask];
 	if (off) {
@@ -247,10 +247,14 @@ __list_lru_walk_one(struct list_lru_node *nlru, int memcg_idx,
 			 */
 			assert_spin_locked(&nlru->lock);
 			goto restart;
+		case LRU_STOP:
+			assert_spin_locked(&nlru->lock);
+			goto out;
 		default:
 			BUG();
 		}
 	}
+out:
 	return isolated;
 }
 
@@ -2672,6 +2672,12 @@ static void shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 
 	target_lruvec = mem_cgroup_lruvec(sc->target_mem_cgroup, pgdat);
 
+	/*
+	 * The reclaim heuristics below read the lruvec counters, make
+	 * sure the cgroup ones are reasonably up to date.
+	 */
+	mem_cgroup_flush_stats();
+
 again:
 	memset(&sc->nr, 0, sizeof(sc->nr));
 
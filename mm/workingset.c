@@ -296,6 +296,9 @@ void workingset_refault(struct page *page, void *shadow)
 
 	unpack_shadow(shadow, &memcgid, &pgdat, &eviction, &workingset);
 
+	/* The workingset size below is read from the lruvec counters */
+	mem_cgroup_flush_stats();
+
 	rcu_read_lock();
 	/*
 	 * Look up the memcg associated with the stored ID. It might
@@ -53,6 +53,14 @@
 
 static DECLARE_WAIT_QUEUE_HEAD(destroy_wait);
 
+/*
+ * Send each new request over the transport with the fewest outstanding
+ * requests, instead of round-robin, when a client has several of them.
+ */
+static bool rpc_xprt_leastqueue;
+module_param_named(xprt_leastqueue, rpc_xprt_leastqueue, bool, 0644);
+MODULE_PARM_DESC(xprt_leastqueue, "Spread requests by transport queue length");
+
 
 static void	call_start(struct rpc_task *task);
 static void	call_reserve(struct rpc_task *task);
@@ -2891,7 +2899,10 @@ int rpc_clnt_add_xprt(struct rpc_clnt *clnt,
 				connect_timeout,
 				reconnect_timeout);
 
-	rpc_xprt_switch_set_roundrobin(xps);
+	if (READ_ONCE(rpc_xprt_leastqueue))
+		rpc_xprt_switch_set_leastqueue(xps);
+	else
+		rpc_xprt_switch_set_roundrobin(xps);
 	if (setup) {
 		ret = setup(clnt, xps, xprt, data);
 		if (ret != 0)
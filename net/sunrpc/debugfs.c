@@ -179,6 +179,10 @@ xprt_info_show(struct seq_file *f, void *v)
 	seq_printf(f, "addr:  %s\n", xprt->address_strings[RPC_DISPLAY_ADDR]);
 	seq_printf(f, "port:  %s\n", xprt->address_strings[RPC_DISPLAY_PORT]);
 	seq_printf(f, "state: 0x%lx\n", xprt->state);
+	seq_printf(f, "cong:  %lu\n", xprt->cong);
+	seq_printf(f, "cwnd:  %lu\n", xprt->cwnd);
+	seq_printf(f, "slots: %u\n", xprt->num_reqs);
+	seq_printf(f, "queue: %ld\n", atomic_long_read(&xprt->queuelen));
 	return 0;
 }
 
@@ -24,6 +24,7 @@ typedef struct rpc_xprt *(*xprt_switch_find_xprt_t)(struct rpc_xprt_switch *xps,
 
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_singular;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin;
+static const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueue;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_listall;
 
 static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
@@ -176,6 +177,19 @@ void rpc_xprt_switch_set_roundrobin(struct rpc_xprt_switch *xps)
 		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_roundrobin);
 }
 
+/**
+ * rpc_xprt_switch_set_leastqueue - Set a least-queued policy on rpc_xprt_switch
+ * @xps: pointer to struct rpc_xprt_switch
+ *
+ * Sets a default policy for iterators acting on xps that picks the
+ * transport with the fewest outstanding requests.
+ */
+void rpc_xprt_switch_set_leastqueue(struct rpc_xprt_switch *xps)
+{
+	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_leastqueue)
+		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_leastqueue);
+}
+
 static
 const struct rpc_xprt_iter_ops *xprt_iter_ops(const struct rpc_xprt_iter *xpi)
 {
@@ -358,6 +372,52 @@ struct rpc_xprt *xprt_iter_next_entry_roundrobin(struct rpc_xprt_iter *xpi)
 			xprt_switch_find_next_entry_roundrobin);
 }
 
+/*
+ * Pick the active transport with the fewest requests queued on it, and of
+ * those one that is not congested. The search starts after @cur so that
+ * transports which are all idle still get used in turn.
+ */
+static
+struct rpc_xprt *xprt_switch_find_next_entry_leastqueue(struct rpc_xprt_switch *xps,
+		const struct rpc_xprt *cur)
+{
+	struct list_head *head = &xps->xps_xprt_list;
+	struct rpc_xprt *start, *pos, *best = NULL;
+	unsigned long best_queuelen = ULONG_MAX;
+	bool best_congested = true;
+	unsigned int nxprts = READ_ONCE(xps->xps_nxprts);
+
+	/*
+	 * @start may go inactive or be removed while we walk the list, in
+	 * which case we never get back to it: visit at most nxprts entries.
+	 */
+	start = __xprt_switch_find_next_entry_roundrobin(head, cur);
+	for (pos = start; pos != NULL && nxprts--;) {
+		unsigned long queuelen = atomic_long_read(&pos->queuelen);
+		bool congested = RPCXPRT_CONGESTED(pos);
+
+		if (queuelen < best_queuelen ||
+		    (queuelen == best_queuelen && best_congested && !congested)) {
+			best = pos;
+			best_queuelen = queuelen;
+			best_congested = congested;
+			if (!queuelen && !congested)
+				break;
+		}
+		pos = __xprt_switch_find_next_entry_roundrobin(head, pos);
+		if (pos == start)
+			break;
+	}
+	return best;
+}
+
+static
+struct rpc_xprt *xprt_iter_next_entry_leastqueue(struct rpc_xprt_iter *xpi)
+{
+	return xprt_iter_next_entry_multiple(xpi,
+			xprt_switch_find_next_entry_leastqueue);
+}
+
 static
 struct rpc_xprt *xprt_switch_find_next_entry_all(struct rpc_xprt_switch *xps,
 		const struct rpc_xprt *cur)
@@ -532,6 +592,14 @@ const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin = {
 	.xpi_next = xprt_iter_next_entry_roundrobin,
 };
 
+/* Policy for picking the least loaded entry in the rpc_xprt_switch */
+static
+const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueue = {
+	.xpi_rewind = xprt_iter_default_rewind,
+	.xpi_xprt = xprt_iter_current_entry,
+	.xpi_next = xprt_iter_next_entry_leastqueue,
+};
+
 /* Policy for once-through iteration of entries in the rpc_xprt_switch */
 static
 const struct rpc_xprt_iter_ops rpc_xprt_iter_listall = {
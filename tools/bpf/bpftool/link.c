@@ -18,6 +18,7 @@ static const char * const link_type_name[] = {
 	[BPF_LINK_TYPE_CGROUP]			= "cgroup",
 	[BPF_LINK_TYPE_ITER]			= "iter",
 	[BPF_LINK_TYPE_NETNS]			= "netns",
+	[BPF_LINK_TYPE_TRACING_MULTI]		= "tracing_multi",
 };
 
 static int link_parse_fd(int *argc, char ***argv)
@@ -139,6 +140,11 @@ static int show_link_close_json(int fd, struct bpf_link_info *info)
 		show_link_attach_type_json(info->tracing.attach_type,
 					   json_wtr);
 		break;
+	case BPF_LINK_TYPE_TRACING_MULTI:
+		show_link_attach_type_json(info->tracing_multi.attach_type,
+					   json_wtr);
+		jsonw_uint_field(json_wtr, "func_cnt", info->tracing_multi.cnt);
+		break;
 	case BPF_LINK_TYPE_CGROUP:
 		jsonw_lluint_field(json_wtr, "cgroup_id",
 				   info->cgroup.cgroup_id);
@@ -229,6 +235,10 @@ static int show_link_close_plain(int fd, struct bpf_link_info *info)
 
 		show_link_attach_type_plain(info->tracing.attach_type);
 		break;
+	case BPF_LINK_TYPE_TRACING_MULTI:
+		show_link_attach_type_plain(info->tracing_multi.attach_type);
+		printf("func_cnt %u  ", info->tracing_multi.cnt);
+		break;
 	case BPF_LINK_TYPE_CGROUP:
 		printf("\n\tcgroup_id %zu  ", (size_t)info->cgroup.cgroup_id);
 		show_link_attach_type_plain(info->cgroup.attach_type);
@@ -586,7 +586,7 @@ int bpf_link_create(int prog_fd, int target_fd,
 		    enum bpf_attach_type attach_type,
 		    const struct bpf_link_create_opts *opts)
 {
-	__u32 target_btf_id, iter_info_len;
+	__u32 target_btf_id, iter_info_len, btf_ids_cnt;
 	union bpf_attr attr;
 
 	if (!OPTS_VALID(opts, bpf_link_create_opts))
@@ -594,8 +594,9 @@ int bpf_link_create(int prog_fd, int target_fd,
 
 	iter_info_len = OPTS_GET(opts, iter_info_len, 0);
 	target_btf_id = OPTS_GET(opts, target_btf_id, 0);
+	btf_ids_cnt = OPTS_GET(opts, btf_ids_cnt, 0);
 
-	if (iter_info_len && target_btf_id)
+	if (!!iter_info_len + !!target_btf_id + !!btf_ids_cnt > 1)
 		return -EINVAL;
 
 	memset(&attr, 0, sizeof(attr));
@@ -610,6 +611,10 @@ int bpf_link_create(int prog_fd, int target_fd,
 		attr.link_create.iter_info_len = iter_info_len;
 	} else if (target_btf_id) {
 		attr.link_create.target_btf_id = target_btf_id;
+	} else if (btf_ids_cnt) {
+		attr.link_create.multi.btf_ids =
+			ptr_to_u64(OPTS_GET(opts, btf_ids, (void *)0));
+		attr.link_create.multi.btf_ids_cnt = btf_ids_cnt;
 	}
 
 	return sys_bpf(BPF_LINK_CREATE, &attr, sizeof(attr));
@@ -226,6 +226,7 @@ bool bpf_probe_map_type(enum bpf_map_type map_type, __u32 ifindex)
 		break;
 	case BPF_MAP_TYPE_QUEUE:
 	case BPF_MAP_TYPE_STACK:
+	case BPF_MAP_TYPE_BLOOM_FILTER:
 		key_size	= 0;
 		break;
 	case BPF_MAP_TYPE_SK_STORAGE:
@@ -264,6 +265,8 @@ bool bpf_probe_map_type(enum bpf_map_type map_type, __u32 ifindex)
 	case BPF_MAP_TYPE_SOCKHASH:
 	case BPF_MAP_TYPE_REUSEPORT_SOCKARRAY:
 	case BPF_MAP_TYPE_STRUCT_OPS:
+	case BPF_MAP_TYPE_OA_HASH:
+	case BPF_MAP_TYPE_COUNT_MIN_SKETCH:
 	default:
 		break;
 	}
@@ -29,6 +29,10 @@ struct ring {
 	unsigned long *producer_pos;
 	unsigned long mask;
 	int map_fd;
+	/* number of rings, starting with this one, that share the epoll
+	 * entry of a BPF_F_RINGBUF_PERCPU map; 0 for the rings after it
+	 */
+	int epoll_ring_cnt;
 };
 
 struct ring_buffer {
@@ -51,6 +55,41 @@ static void ringbuf_unmap_ring(struct ring_buffer *rb, struct ring *r)
 	}
 }
 
+static int ringbuf_map_ring(struct ring_buffer *rb, struct ring *r,
+			    int map_fd, __u32 data_sz, size_t off)
+{
+	void *tmp;
+	int err;
+
+	/* Map writable consumer page */
+	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   map_fd, off);
+	if (tmp == MAP_FAILED) {
+		err = -errno;
+		pr_warn("ringbuf: failed to mmap consumer page for map fd=%d: %d\n",
+			map_fd, err);
+		return err;
+	}
+	r->consumer_pos = tmp;
+
+	/* Map read-only producer page and data pages. We map twice as big
+	 * data size to allow simple reading of samples that wrap around the
+	 * end of a ring buffer. See kernel implementation for details.
+	 * */
+	tmp = mmap(NULL, rb->page_size + 2 * data_sz, PROT_READ,
+		   MAP_SHARED, map_fd, off + rb->page_size);
+	if (tmp == MAP_FAILED) {
+		err = -errno;
+		ringbuf_unmap_ring(rb, r);
+		pr_warn("ringbuf: failed to mmap data pages for map fd=%d: %d\n",
+			map_fd, err);
+		return err;
+	}
+	r->producer_pos = tmp;
+	r->data = tmp + rb->page_size;
+	return 0;
+}
+
 /* Add extra RINGBUF maps to this ring buffer manager */
 int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 		     ring_buffer_sample_fn sample_cb, void *ctx)
@@ -58,9 +97,10 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 	struct bpf_map_info info;
 	__u32 len = sizeof(info);
 	struct epoll_event *e;
+	int i, err, nr = 1;
 	struct ring *r;
+	size_t ring_sz;
 	void *tmp;
-	int err;
 
 	memset(&info, 0, sizeof(info));
 
@@ -78,50 +118,43 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 		return -EINVAL;
 	}
 
-	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + 1, sizeof(*rb->rings));
+	/* A per-CPU map has one ring per possible CPU, each one laid out
+	 * like a regular ring buffer map, one after the other in CPU order
+	 * and without holes for CPUs missing from the possible mask.
+	 */
+	if (info.map_flags & BPF_F_RINGBUF_PERCPU) {
+		nr = libbpf_num_possible_cpus();
+		if (nr < 0)
+			return nr;
+	}
+	ring_sz = 2 * rb->page_size + 2 * (size_t)info.max_entries;
+
+	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + nr, sizeof(*rb->rings));
 	if (!tmp)
 		return -ENOMEM;
 	rb->rings = tmp;
 
-	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + 1, sizeof(*rb->events));
+	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + nr, sizeof(*rb->events));
 	if (!tmp)
 		return -ENOMEM;
 	rb->events = tmp;
 
-	r = &rb->rings[rb->ring_cnt];
-	memset(r, 0, sizeof(*r));
-
-	r->map_fd = map_fd;
-	r->sample_cb = sample_cb;
-	r->ctx = ctx;
-	r->mask = info.max_entries - 1;
+	for (i = 0; i < nr; i++) {
+		r = &rb->rings[rb->ring_cnt + i];
+		memset(r, 0, sizeof(*r));
 
-	/* Map writable consumer page */
-	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		   map_fd, 0);
-	if (tmp == MAP_FAILED) {
-		err = -errno;
-		pr_warn("ringbuf: failed to mmap consumer page for map fd=%d: %d\n",
-			map_fd, err);
-		return err;
-	}
-	r->consumer_pos = tmp;
+		r->map_fd = map_fd;
+		r->sample_cb = sample_cb;
+		r->ctx = ctx;
+		r->mask = info.max_entries - 1;
 
-	/* Map read-only producer page and data pages. We map twice as big
-	 * data size to allow simple reading of samples that wrap around the
-	 * end of a ring buffer. See kernel implementation for details.
-	 * */
-	tmp = mmap(NULL, rb->page_size + 2 * info.max_entries, PROT_READ,
-		   MAP_SHARED, map_fd, rb->page_size);
-	if (tmp == MAP_FAILED) {
-		err = -errno;
-		ringbuf_unmap_ring(rb, r);
-		pr_warn("ringbuf: failed to mmap data pages for map fd=%d: %d\n",
-			map_fd, err);
-		return err;
+		err = ringbuf_map_ring(rb, r, map_fd, info.max_entries,
+				       i * ring_sz);
+		if (err)
+			goto err_unmap;
 	}
-	r->producer_pos = tmp;
-	r->data = tmp + rb->page_size;
+	r = &rb->rings[rb->ring_cnt];
+	r->epoll_ring_cnt = nr;
 
 	e = &rb->events[rb->ring_cnt];
 	memset(e, 0, sizeof(*e));
@@ -130,14 +163,18 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 	e->data.fd = rb->ring_cnt;
 	if (epoll_ctl(rb->epoll_fd, EPOLL_CTL_ADD, map_fd, e) < 0) {
 		err = -errno;
-		ringbuf_unmap_ring(rb, r);
 		pr_warn("ringbuf: failed to epoll add map fd=%d: %d\n",
 			map_fd, err);
-		return err;
+		goto err_unmap;
 	}
 
-	rb->ring_cnt++;
+	rb->ring_cnt += nr;
 	return 0;
+
+err_unmap:
+	while (i--)
+		ringbuf_unmap_ring(rb, &rb->rings[rb->ring_cnt + i]);
+	return err;
 }
 
 void ring_buffer__free(struct ring_buffer *rb)
@@ -273,12 +310,42 @@ int ring_buffer__poll(struct ring_buffer *rb, int timeout_ms)
 	cnt = epoll_wait(rb->epoll_fd, rb->events, rb->ring_cnt, timeout_ms);
 	for (i = 0; i < cnt; i++) {
 		__u32 ring_id = rb->events[i].data.fd;
-		struct ring *ring = &rb->rings[ring_id];
+		int j, ring_cnt = rb->rings[ring_id].epoll_ring_cnt;
 
-		err = ringbuf_process_ring(ring);
-		if (err < 0)
-			return err;
-		res += err;
+		for (j = 0; j < ring_cnt; j++) {
+			err = ringbuf_process_ring(&rb->rings[ring_id + j]);
+			if (err < 0)
+				return err;
+			res += err;
+		}
 	}
 	return cnt < 0 ? -errno : res;
 }
+
+/* Tell producers whether the application busy-polls all registered ring
+ * buffers with ring_buffer__consume(), in which case they stop sending
+ * epoll notifications. Turn it off before going back to ring_buffer__poll().
+ * Records committed while it was on may never be notified, so turning it
+ * off consumes them: returns the number of records consumed, or negative
+ * number if any of the callbacks return error.
+ */
+int ring_buffer__busy_poll(struct ring_buffer *rb, bool enable)
+{
+	int i;
+
+	for (i = 0; i < rb->ring_cnt; i++) {
+		/* consumer flags follow the consumer position */
+		unsigned long *flags = rb->rings[i].consumer_pos + 1;
+
+		smp_store_release(flags, enable ? BPF_RB_CONS_BUSY_POLL : 0);
+	}
+	if (enable)
+		return 0;
+
+	/* A producer reads the flags after committing its record. Order
+	 * clearing them before reading the rings, so that either we see the
+	 * record below or the producer sees the flag cleared and notifies.
+	 */
+	smp_mb();
+	return ring_buffer__consume(rb);
+}
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <test_progs.h>
+
+#ifndef ENOTSUPP
+#define ENOTSUPP 524
+#endif
+
+#define NR_FUNCS 6
+
+static const char * const funcs[NR_FUNCS] = {
+	"bpf_fentry_test1",
+	"bpf_fentry_test2",
+	"bpf_fentry_test3",
+	"bpf_fentry_test4",
+	"bpf_fentry_test5",
+	"bpf_fentry_test6",
+};
+
+/* Count the calls of each traced function in a hash map keyed by
+ * bpf_get_func_ip().
+ */
+static int load_multi_prog(enum bpf_attach_type type, int map_fd)
+{
+	struct bpf_insn insns[] = {
+		BPF_EMIT_CALL(BPF_FUNC_get_func_ip),
+		BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -8),
+		BPF_ST_MEM(BPF_DW, BPF_REG_10, -16, 1),
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -16),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_ANY),
+		BPF_EMIT_CALL(BPF_FUNC_map_update_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_load_program_attr load_attr = {
+		.prog_type = BPF_PROG_TYPE_TRACING,
+		.expected_attach_type = type,
+		.prog_flags = BPF_F_MULTI_FUNC,
+		.insns = insns,
+		.insns_cnt = ARRAY_SIZE(insns),
+		.license = "GPL",
+	};
+
+	return bpf_load_program_xattr(&load_attr, NULL, 0);
+}
+
+static void test_multi_func_ip(enum bpf_attach_type type, const char *name,
+			       __u32 *btf_ids)
+{
+	DECLARE_LIBBPF_OPTS(bpf_link_create_opts, opts,
+		.btf_ids = btf_ids,
+		.btf_ids_cnt = NR_FUNCS,
+	);
+	enum bpf_attach_type other;
+	int map_fd, prog_fd, link_fd, err, i;
+	__u32 duration = 0, retval;
+	__u64 ip, cnt;
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(ip), sizeof(cnt),
+				NR_FUNCS * 2, 0);
+	if (CHECK(map_fd < 0, "create_map", "%s: %s\n", name, strerror(errno)))
+		return;
+
+	prog_fd = load_multi_prog(type, map_fd);
+	if (CHECK(prog_fd < 0, "load_prog", "%s: %s\n", name, strerror(errno)))
+		goto out_map;
+
+	/* the trampoline can only be built for the verified attach type */
+	other = type == BPF_TRACE_FENTRY ? BPF_TRACE_FEXIT : BPF_TRACE_FENTRY;
+	link_fd = bpf_link_create(prog_fd, 0, other, &opts);
+	if (CHECK(link_fd >= 0 || errno != EINVAL, "link_create_mismatch",
+		  "%s: %d errno %d\n", name, link_fd, errno)) {
+		if (link_fd >= 0)
+			close(link_fd);
+		goto out_prog;
+	}
+
+	link_fd = bpf_link_create(prog_fd, 0, type, &opts);
+	if (link_fd < 0 && errno == ENOTSUPP) {
+		printf("%s:SKIP:no multi-function trampoline support\n",
+		       __func__);
+		test__skip();
+		goto out_prog;
+	}
+	if (CHECK(link_fd < 0, "link_create", "%s: %s\n", name,
+		  strerror(errno)))
+		goto out_prog;
+
+	err = bpf_prog_test_run(prog_fd, 1, NULL, 0, NULL, NULL, &retval,
+				&duration);
+	if (CHECK(err || retval, "test_run", "%s: err %d errno %d retval %u\n",
+		  name, err, errno, retval))
+		goto out_link;
+
+	for (i = 0; i < NR_FUNCS; i++) {
+		ip = ksym_get_addr(funcs[i]);
+		cnt = 0;
+		err = bpf_map_lookup_elem(map_fd, &ip, &cnt);
+		CHECK(err || cnt != 1, "func_ip", "%s: %s at %llx: err %d cnt %llu\n",
+		      name, funcs[i], ip, err, cnt);
+	}
+
+	/* nothing was recorded for a function outside of the link */
+	ip = ksym_get_addr("bpf_fentry_test7");
+	err = bpf_map_lookup_elem(map_fd, &ip, &cnt);
+	CHECK(!err, "func_ip_unlinked", "%s: bpf_fentry_test7 recorded\n", name);
+
+out_link:
+	close(link_fd);
+out_prog:
+	close(prog_fd);
+out_map:
+	close(map_fd);
+}
+
+void test_tracing_multi(void)
+{
+	__u32 btf_ids[NR_FUNCS], duration = 0;
+	int i, err;
+
+	err = load_kallsyms();
+	if (CHECK(err, "load_kallsyms", "err %d\n", err))
+		return;
+
+	for (i = 0; i < NR_FUNCS; i++) {
+		err = libbpf_find_vmlinux_btf_id(funcs[i], BPF_TRACE_FENTRY);
+		if (CHECK(err <= 0, "find_btf_id", "%s: %d\n", funcs[i], err))
+			return;
+		btf_ids[i] = err;
+		if (CHECK(!ksym_get_addr(funcs[i]), "ksym_get_addr", "%s\n",
+			  funcs[i]))
+			return;
+	}
+
+	test_multi_func_ip(BPF_TRACE_FENTRY, "fentry", btf_ids);
+	test_multi_func_ip(BPF_TRACE_FEXIT, "fexit", btf_ids);
+}
@@ -15,6 +15,7 @@
 #include <time.h>
 
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <linux/bpf.h>
@@ -342,6 +343,393 @@ static void test_hashmap_zero_seed(void)
 	close(second);
 }
 
+/* An insert into an open addressing hash map may fail with EBUSY while the
+ * table it goes to is full and the resize worker hasn't caught up yet. That
+ * must be transient: retry for up to a second.
+ */
+static int oa_hashmap_update(int fd, long long key, long long value,
+			     int flags, int *busy)
+{
+	int err, i;
+
+	for (i = 0; i < 1000; i++) {
+		err = bpf_map_update_elem(fd, &key, &value, flags);
+		if (!err || errno != EBUSY)
+			return err;
+		(*busy)++;
+		usleep(1000);
+	}
+
+	return err;
+}
+
+static void test_oa_hashmap(unsigned int task, void *data)
+{
+	long long key, next_key, first_key, value;
+	int fd;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_OA_HASH, sizeof(key), sizeof(value),
+			    2, 0);
+	if (fd < 0) {
+		printf("Failed to create oa hashmap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	key = 1;
+	value = 1234;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == 0);
+
+	value = 0;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+	assert(bpf_map_update_elem(fd, &key, &value, -1) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_map_lookup_elem(fd, &key, &value) == 0 && value == 1234);
+
+	key = 2;
+	assert(bpf_map_lookup_elem(fd, &key, &value) == -1 && errno == ENOENT);
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == 0);
+
+	/* The map is full, even though the table has free slots. */
+	key = 0;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == E2BIG);
+	key = 1;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_EXIST) == 0);
+
+	/* Iterate over two elements. */
+	assert(bpf_map_get_next_key(fd, NULL, &first_key) == 0 &&
+	       (first_key == 1 || first_key == 2));
+	assert(bpf_map_get_next_key(fd, &first_key, &next_key) == 0 &&
+	       (next_key == 1 || next_key == 2) &&
+	       (next_key != first_key));
+	assert(bpf_map_get_next_key(fd, &next_key, &next_key) == -1 &&
+	       errno == ENOENT);
+
+	/* A deleted element leaves a tombstone, which must free its entry. */
+	assert(bpf_map_delete_elem(fd, &key) == 0);
+	assert(bpf_map_delete_elem(fd, &key) == -1 && errno == ENOENT);
+	assert(bpf_map_lookup_elem(fd, &key, &value) == -1 && errno == ENOENT);
+	key = 3;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == 0);
+
+	/* Keys are stored inline and can't be larger than a half bucket. */
+	assert(bpf_create_map(BPF_MAP_TYPE_OA_HASH, 64, sizeof(value),
+			      2, 0) == -1 && errno == E2BIG);
+	/* There is no per-element allocation to defer. */
+	assert(bpf_create_map(BPF_MAP_TYPE_OA_HASH, sizeof(key), sizeof(value),
+			      2, BPF_F_NO_PREALLOC) == -1 && errno == EINVAL);
+
+	close(fd);
+}
+
+#define OA_MAP_SIZE	(16 * 1024)
+#define OA_STABLE_KEYS	512
+
+/* Update and look up the stable elements of @fd while it is resized */
+static void test_oa_hashmap_resize_child(int fd)
+{
+	long long key, value;
+	int i, busy = 0;
+
+	for (i = 1; i <= 64; i++) {
+		for (key = 0; key < OA_STABLE_KEYS; key++) {
+			assert(bpf_map_lookup_elem(fd, &key, &value) == 0 &&
+			       value == key * (i - 1));
+			/* BPF_EXIST never needs a free slot */
+			value = key * i;
+			assert(oa_hashmap_update(fd, key, value, BPF_EXIST,
+						 &busy) == 0);
+			assert(busy == 0);
+		}
+	}
+}
+
+static void test_oa_hashmap_resize(void)
+{
+	long long key, value, next_key, expected;
+	int fd, i, status, busy = 0;
+	char *seen;
+	pid_t pid;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_OA_HASH, sizeof(key), sizeof(value),
+			    OA_MAP_SIZE, 0);
+	if (fd < 0) {
+		printf("Failed to create oa hashmap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	for (key = 0; key < OA_STABLE_KEYS; key++) {
+		value = 0;
+		assert(oa_hashmap_update(fd, key, value, BPF_NOEXIST,
+					 &busy) == 0);
+	}
+
+	/* Grow the table from 8 buckets to its full size in another task
+	 * while these elements are updated and looked up: they must always
+	 * be found in either the old or the new table, and updates to them
+	 * must not be lost when they are moved.
+	 */
+	pid = fork();
+	if (pid == 0) {
+		test_oa_hashmap_resize_child(fd);
+		exit(0);
+	}
+	assert(pid != -1);
+
+	for (key = OA_STABLE_KEYS; key < OA_MAP_SIZE; key++) {
+		value = key;
+		assert(oa_hashmap_update(fd, key, value, BPF_NOEXIST,
+					 &busy) == 0);
+	}
+	assert(waitpid(pid, &status, 0) == pid && status == 0);
+	printf("Filled oa hashmap, %d updates got EBUSY during a resize\n",
+	       busy);
+
+	key = OA_MAP_SIZE;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == E2BIG);
+
+	for (key = 0; key < OA_MAP_SIZE; key++)
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0 &&
+		       value == (key < OA_STABLE_KEYS ? key * 64 : key));
+
+	/* Delete every other element, reinsert them and check the others. */
+	for (key = 0; key < OA_MAP_SIZE; key += 2)
+		assert(bpf_map_delete_elem(fd, &key) == 0);
+	for (key = 0; key < OA_MAP_SIZE; key++)
+		assert((bpf_map_lookup_elem(fd, &key, &value) == 0) ==
+		       (key & 1));
+	for (key = 0; key < OA_MAP_SIZE; key += 2) {
+		value = -key;
+		assert(oa_hashmap_update(fd, key, value, BPF_NOEXIST,
+					 &busy) == 0);
+	}
+
+	/* The last resize may still be moving elements, and iteration may
+	 * return moved elements twice meanwhile. Once it is done, every
+	 * element must be returned exactly once.
+	 */
+	seen = malloc(OA_MAP_SIZE);
+	assert(seen);
+	for (i = 0; i < 100; i++) {
+		bool dup = false;
+		int n;
+
+		memset(seen, 0, OA_MAP_SIZE);
+		for (n = 0; bpf_map_get_next_key(fd, !n ? NULL : &key,
+						 &next_key) == 0; n++) {
+			key = next_key;
+			assert(key >= 0 && key < OA_MAP_SIZE);
+			dup |= seen[key];
+			seen[key] = 1;
+		}
+		if (!dup && n == OA_MAP_SIZE)
+			break;
+		usleep(10000);
+	}
+	assert(i < 100);
+	free(seen);
+
+	for (key = 0; key < OA_MAP_SIZE; key++) {
+		if (!(key & 1))
+			expected = -key;
+		else if (key < OA_STABLE_KEYS)
+			expected = key * 64;
+		else
+			expected = key;
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0 &&
+		       value == expected);
+	}
+
+	close(fd);
+}
+
+/* libbpf doesn't know about map_extra yet */
+static int create_map_extra(enum bpf_map_type map_type, __u32 key_size,
+			    __u32 value_size, __u32 max_entries,
+			    __u64 map_extra)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = map_type;
+	attr.key_size = key_size;
+	attr.value_size = value_size;
+	attr.max_entries = max_entries;
+	attr.map_extra = map_extra;
+
+	return syscall(__NR_bpf, BPF_MAP_CREATE, &attr, sizeof(attr));
+}
+
+static __u64 map_extra_of(int fd)
+{
+	struct bpf_map_info info = {};
+	__u32 len = sizeof(info);
+
+	assert(bpf_obj_get_info_by_fd(fd, &info, &len) == 0);
+	return info.map_extra;
+}
+
+#define BLOOM_ENTRIES	1000
+#define BLOOM_TESTS	100000
+
+/* Returns the number of false positives among BLOOM_TESTS values that were
+ * never added to a bloom filter holding BLOOM_ENTRIES values.
+ */
+static int bloom_false_positives(__u64 nr_hash_funcs)
+{
+	int fd, fp = 0;
+	__u32 value;
+
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(value),
+			      BLOOM_ENTRIES, nr_hash_funcs);
+	if (fd < 0) {
+		printf("Failed to create bloom filter '%s'!\n",
+		       strerror(errno));
+		exit(1);
+	}
+	assert(map_extra_of(fd) == nr_hash_funcs);
+
+	for (value = 0; value < BLOOM_ENTRIES; value++)
+		assert(bpf_map_update_elem(fd, NULL, &value, BPF_ANY) == 0);
+
+	/* A bloom filter has no false negatives. */
+	for (value = 0; value < BLOOM_ENTRIES; value++)
+		assert(bpf_map_lookup_elem(fd, NULL, &value) == 0);
+
+	for (value = BLOOM_ENTRIES; value < BLOOM_ENTRIES + BLOOM_TESTS;
+	     value++) {
+		if (!bpf_map_lookup_elem(fd, NULL, &value))
+			fp++;
+		else
+			assert(errno == ENOENT);
+	}
+
+	close(fd);
+	return fp;
+}
+
+static void test_bloom_filter(void)
+{
+	int fd, fp1, fp5;
+	__u32 value = 0;
+
+	/* map_extra holds the number of hash functions in 4 bits */
+	assert(create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(value),
+				BLOOM_ENTRIES, 0x10) == -1 && errno == EINVAL);
+	assert(create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(value),
+				BLOOM_ENTRIES, 1ULL << 32) == -1 &&
+	       errno == EINVAL);
+	/* and is only accepted by the probabilistic maps */
+	assert(create_map_extra(BPF_MAP_TYPE_HASH, sizeof(value),
+				sizeof(value), BLOOM_ENTRIES, 1) == -1 &&
+	       errno == EINVAL);
+	/* bloom filters have values but no keys */
+	assert(create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, sizeof(value),
+				sizeof(value), BLOOM_ENTRIES, 0) == -1 &&
+	       errno == EINVAL);
+	assert(create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, 0,
+				BLOOM_ENTRIES, 0) == -1 && errno == EINVAL);
+	assert(create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(value),
+				0, 0) == -1 && errno == EINVAL);
+
+	/* map_extra 0 selects the default number of hash functions */
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(value),
+			      BLOOM_ENTRIES, 0);
+	assert(fd >= 0 && map_extra_of(fd) == 0);
+	assert(bpf_map_lookup_elem(fd, NULL, &value) == -1 && errno == ENOENT);
+	assert(bpf_map_update_elem(fd, NULL, &value, BPF_EXIST) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_map_update_elem(fd, NULL, &value, BPF_ANY) == 0);
+	assert(bpf_map_lookup_elem(fd, NULL, &value) == 0);
+	assert(bpf_map_delete_elem(fd, NULL) == -1 && errno == EOPNOTSUPP);
+	close(fd);
+
+	/* The bitset is sized for max_entries: with k = 5 the false positive
+	 * rate is about 2%, with k = 1 it is about 39%.
+	 */
+	fp1 = bloom_false_positives(1);
+	fp5 = bloom_false_positives(5);
+	printf("Bloom filter false positives: %d with 1 hash, %d with 5, "
+	       "out of %d\n", fp1, fp5, BLOOM_TESTS);
+	assert(fp5 < BLOOM_TESTS / 20);
+	assert(fp1 > BLOOM_TESTS / 5);
+}
+
+#define CMS_WIDTH	1024
+#define CMS_KEYS	4096
+
+static void test_count_min_sketch(void)
+{
+	struct bpf_map_info info = {};
+	__u32 len = sizeof(info);
+	__u32 key, value, count;
+	int fd, i, over = 0;
+	__u64 total = 0;
+	double bound;
+
+	assert(create_map_extra(BPF_MAP_TYPE_COUNT_MIN_SKETCH, sizeof(key),
+				sizeof(value), CMS_WIDTH, 0x10) == -1 &&
+	       errno == EINVAL);
+	/* counters are u32 */
+	assert(create_map_extra(BPF_MAP_TYPE_COUNT_MIN_SKETCH, sizeof(key),
+				sizeof(__u64), CMS_WIDTH, 0) == -1 &&
+	       errno == EINVAL);
+	assert(create_map_extra(BPF_MAP_TYPE_COUNT_MIN_SKETCH, 0,
+				sizeof(value), CMS_WIDTH, 0) == -1 &&
+	       errno == EINVAL);
+
+	/* max_entries is the row width, rounded up to a power of two */
+	fd = create_map_extra(BPF_MAP_TYPE_COUNT_MIN_SKETCH, sizeof(key),
+			      sizeof(value), CMS_WIDTH - 24, 4);
+	if (fd < 0) {
+		printf("Failed to create count-min sketch '%s'!\n",
+		       strerror(errno));
+		exit(1);
+	}
+	assert(bpf_obj_get_info_by_fd(fd, &info, &len) == 0);
+	assert(info.max_entries == CMS_WIDTH && info.map_extra == 4);
+
+	key = 0;
+	assert(bpf_map_lookup_elem(fd, &key, &value) == 0 && value == 0);
+	value = 1;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_map_delete_elem(fd, &key) == -1 && errno == EOPNOTSUPP);
+
+	/* Key i is counted i % 16 + 1 times, in increments of one. */
+	for (i = 0; i < 16; i++) {
+		value = 1;
+		for (key = 0; key < CMS_KEYS; key++) {
+			if (key % 16 < i)
+				continue;
+			assert(bpf_map_update_elem(fd, &key, &value,
+						   BPF_ANY) == 0);
+			total++;
+		}
+	}
+
+	/* The estimate never undercounts, and exceeds the count by more than
+	 * e / width * total with probability e^-rows, i.e. under 2% here.
+	 */
+	bound = 2.718281828 / CMS_WIDTH * total;
+	for (key = 0; key < CMS_KEYS; key++) {
+		count = key % 16 + 1;
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0);
+		assert(value >= count);
+		if (value - count > bound)
+			over++;
+	}
+	printf("Count-min sketch: %d of %d estimates over the error bound\n",
+	       over, CMS_KEYS);
+	assert(over < CMS_KEYS / 20);
+
+	close(fd);
+}
+
 static void test_arraymap(unsigned int task, void *data)
 {
 	int key, next_key, fd;
@@ -1729,6 +2117,12 @@ static void run_all_tests(void)
 	test_hashmap_walk(0, NULL);
 	test_hashmap_zero_seed();
 
+	test_oa_hashmap(0, NULL);
+	test_oa_hashmap_resize();
+
+	test_bloom_filter();
+	test_count_min_sketch();
+
 	test_arraymap(0, NULL);
 	test_arraymap_percpu(0, NULL);
 
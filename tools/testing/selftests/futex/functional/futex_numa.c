@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * FUTEX_NUMA_FLAG test: the node word following the futex is claimed by the
+ * first user, invalid nodes are refused, wait/wake pair up on the node and
+ * the PI operations reject the flag.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-numa"
+#define WAKE_WAIT_US 10000
+
+#ifndef FUTEX_NUMA_FLAG
+#define FUTEX_NUMA_FLAG 512
+#endif
+
+#ifndef FUTEX_NO_NODE
+#define FUTEX_NO_NODE (-1)
+#endif
+
+#define NUMA_OPFLAGS (FUTEX_PRIVATE_FLAG | FUTEX_NUMA_FLAG)
+
+static struct {
+	futex_t val;
+	futex_t node;
+} __attribute__((aligned(8))) f;
+
+static int waiter_res;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+void *waiterfn(void *arg)
+{
+	struct timespec to = { .tv_sec = 5 };
+
+	waiter_res = futex_wait(&f.val, 0, &to, NUMA_OPFLAGS);
+	if (waiter_res < 0)
+		waiter_res = -errno;
+
+	return NULL;
+}
+
+static int test_claim_node(void)
+{
+	struct timespec to = { .tv_nsec = 1000 };
+	int res;
+
+	f.val = 0;
+	f.node = FUTEX_NO_NODE;
+
+	res = futex_wait(&f.val, 1, &to, NUMA_OPFLAGS);
+	if (res != -1 || errno != EWOULDBLOCK) {
+		fail("futex_wait returned: %d %s, expecting EWOULDBLOCK\n",
+		     res, res < 0 ? strerror(errno) : "");
+		return RET_FAIL;
+	}
+	if ((int)f.node < 0) {
+		fail("node word left at %d\n", (int)f.node);
+		return RET_FAIL;
+	}
+	info("futex claimed node %d\n", (int)f.node);
+
+	return RET_PASS;
+}
+
+static int test_invalid_node(void)
+{
+	int res;
+
+	f.val = 0;
+	f.node = 1 << 20;
+
+	res = futex_wake(&f.val, 1, NUMA_OPFLAGS);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_wake on node %u returned: %d %s, expecting EINVAL\n",
+		     f.node, res, res < 0 ? strerror(errno) : "");
+		return RET_FAIL;
+	}
+
+	return RET_PASS;
+}
+
+static int test_wait_wake(void)
+{
+	pthread_t waiter;
+	int res;
+
+	f.val = 0;
+	f.node = FUTEX_NO_NODE;
+
+	if (pthread_create(&waiter, NULL, waiterfn, NULL)) {
+		error("pthread_create failed\n", errno);
+		return RET_ERROR;
+	}
+
+	usleep(WAKE_WAIT_US);
+
+	res = futex_wake(&f.val, 1, NUMA_OPFLAGS);
+	pthread_join(waiter, NULL);
+
+	if (res != 1) {
+		fail("futex_wake returned: %d %s\n", res,
+		     res < 0 ? strerror(errno) : "");
+		return RET_FAIL;
+	}
+	if (waiter_res) {
+		fail("futex_wait returned: %d\n", waiter_res);
+		return RET_FAIL;
+	}
+
+	return RET_PASS;
+}
+
+static int test_pi(void)
+{
+	int res;
+
+	f.val = 0;
+	f.node = FUTEX_NO_NODE;
+
+	res = futex_lock_pi(&f.val, NULL, 0, NUMA_OPFLAGS);
+	if (res != -1 || (errno != EINVAL && errno != ENOSYS)) {
+		fail("futex_lock_pi returned: %d %s, expecting EINVAL\n",
+		     res, res < 0 ? strerror(errno) : "");
+		return RET_FAIL;
+	}
+
+	return RET_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = RET_PASS;
+	int c;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_set_plan(1);
+	ksft_print_msg("%s: Test FUTEX_NUMA_FLAG\n", basename(argv[0]));
+
+	info("Claiming the node of a new futex\n");
+	ret |= test_claim_node();
+
+	info("Using a futex on an invalid node\n");
+	ret |= test_invalid_node();
+
+	info("Waking a FUTEX_NUMA_FLAG waiter\n");
+	ret |= test_wait_wake();
+
+	info("Taking a FUTEX_NUMA_FLAG PI futex\n");
+	ret |= test_pi();
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
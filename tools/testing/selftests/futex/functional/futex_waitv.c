@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * futex_waitv() test: wait on a vector of private and shared futexes, and
+ * check the error cases and the NUMA node word of FUTEX2_NUMA waiters.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-waitv"
+#define WAKE_WAIT_US 10000
+#define NR_FUTEXES 30
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+
+#ifndef FUTEX2_NUMA
+#define FUTEX2_NUMA 4
+#endif
+
+#ifndef FUTEX_NUMA_FLAG
+#define FUTEX_NUMA_FLAG 512
+#endif
+
+#ifndef FUTEX_NO_NODE
+#define FUTEX_NO_NODE (-1)
+#endif
+
+static struct futex_waitv waitv[NR_FUTEXES];
+static u_int32_t futexes[NR_FUTEXES];
+static int waiter_res;
+
+/* a FUTEX2_NUMA futex is followed by its node word */
+static struct {
+	futex_t val;
+	futex_t node;
+} __attribute__((aligned(8))) numa_futex;
+
+static inline int futex_waitv(struct futex_waitv *waiters,
+			      unsigned long nr_waiters, unsigned long flags,
+			      struct timespec *timo, clockid_t clockid)
+{
+	return syscall(__NR_futex_waitv, waiters, nr_waiters, flags, timo,
+		       clockid);
+}
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void init_waitv(struct futex_waitv *w, void *uaddr, unsigned int flags)
+{
+	w->uaddr = (uintptr_t)uaddr;
+	w->flags = FUTEX_32 | flags;
+	w->val = 0;
+	w->__reserved = 0;
+}
+
+void *waiterfn(void *arg)
+{
+	int nr = (intptr_t)arg;
+	struct timespec to;
+
+	/* the timeout is absolute */
+	clock_gettime(CLOCK_MONOTONIC, &to);
+	to.tv_sec += 5;
+
+	waiter_res = futex_waitv(waitv, nr, 0, &to, CLOCK_MONOTONIC);
+	if (waiter_res < 0)
+		waiter_res = -errno;
+
+	return NULL;
+}
+
+/* Wait on @nr entries of waitv[] in a thread, and wake the last one */
+static int wait_and_wake(int nr, int opflags)
+{
+	pthread_t waiter;
+	int res;
+
+	if (pthread_create(&waiter, NULL, waiterfn, (void *)(intptr_t)nr)) {
+		error("pthread_create failed\n", errno);
+		return RET_ERROR;
+	}
+
+	usleep(WAKE_WAIT_US);
+
+	res = futex_wake((futex_t *)(uintptr_t)waitv[nr - 1].uaddr, 1,
+			 opflags);
+	pthread_join(waiter, NULL);
+
+	if (res != 1) {
+		fail("futex_wake returned: %d %s\n", res,
+		     res < 0 ? strerror(errno) : "");
+		return RET_FAIL;
+	}
+	if (waiter_res != nr - 1) {
+		fail("futex_waitv returned: %d, expecting %d\n",
+		     waiter_res, nr - 1);
+		return RET_FAIL;
+	}
+
+	return RET_PASS;
+}
+
+static int expect_error(const char *what, int res, int err)
+{
+	if (res != -1 || errno != err) {
+		fail("%s: futex_waitv returned: %d %s, expecting %s\n", what,
+		     res, res < 0 ? strerror(errno) : "", strerror(err));
+		return RET_FAIL;
+	}
+
+	return RET_PASS;
+}
+
+static int test_errors(void)
+{
+	struct timespec to;
+	int ret = RET_PASS;
+	int res;
+
+	init_waitv(&waitv[0], &futexes[0], FUTEX_PRIVATE_FLAG);
+
+	waitv[0].flags = FUTEX_PRIVATE_FLAG;
+	res = futex_waitv(waitv, 1, 0, NULL, 0);
+	ret |= expect_error("no FUTEX_32", res, EINVAL);
+
+	init_waitv(&waitv[0], (char *)&futexes[0] + 1, FUTEX_PRIVATE_FLAG);
+	res = futex_waitv(waitv, 1, 0, NULL, 0);
+	ret |= expect_error("unaligned address", res, EINVAL);
+
+	init_waitv(&waitv[0], NULL, FUTEX_PRIVATE_FLAG);
+	res = futex_waitv(waitv, 1, 0, NULL, 0);
+	ret |= expect_error("NULL address", res, EFAULT);
+
+	init_waitv(&waitv[0], &futexes[0], FUTEX_PRIVATE_FLAG);
+	res = futex_waitv(waitv, 0, 0, NULL, 0);
+	ret |= expect_error("no waiters", res, EINVAL);
+
+	res = futex_waitv(waitv, 1, 1, NULL, 0);
+	ret |= expect_error("syscall flags", res, EINVAL);
+
+	waitv[0].__reserved = 1;
+	res = futex_waitv(waitv, 1, 0, NULL, 0);
+	ret |= expect_error("reserved field", res, EINVAL);
+
+	init_waitv(&waitv[0], &futexes[0], FUTEX_PRIVATE_FLAG);
+	waitv[0].val = 1;
+	res = futex_waitv(waitv, 1, 0, NULL, 0);
+	ret |= expect_error("value mismatch", res, EAGAIN);
+
+	init_waitv(&waitv[0], &futexes[0], FUTEX_PRIVATE_FLAG);
+	clock_gettime(CLOCK_MONOTONIC, &to);
+	res = futex_waitv(waitv, 1, 0, &to, CLOCK_MONOTONIC);
+	ret |= expect_error("expired timeout", res, ETIMEDOUT);
+
+	res = futex_waitv(waitv, 1, 0, &to, CLOCK_TAI);
+	ret |= expect_error("bad clockid", res, EINVAL);
+
+	return ret;
+}
+
+static int test_numa(void)
+{
+	int ret;
+
+	numa_futex.val = 0;
+	numa_futex.node = FUTEX_NO_NODE;
+	init_waitv(&waitv[0], &numa_futex.val,
+		   FUTEX_PRIVATE_FLAG | FUTEX2_NUMA);
+
+	ret = wait_and_wake(1, FUTEX_PRIVATE_FLAG | FUTEX_NUMA_FLAG);
+	if (ret)
+		return ret;
+
+	if ((int)numa_futex.node < 0) {
+		fail("FUTEX2_NUMA waiter left node word at %d\n",
+		     (int)numa_futex.node);
+		return RET_FAIL;
+	}
+	info("FUTEX2_NUMA futex is on node %d\n", (int)numa_futex.node);
+
+	return RET_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	u_int32_t *shared;
+	int ret = RET_PASS;
+	int c, i, shm_id;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_set_plan(1);
+	ksft_print_msg("%s: Test FUTEX_WAITV\n", basename(argv[0]));
+
+	info("Waiting on %d private futexes\n", NR_FUTEXES);
+	for (i = 0; i < NR_FUTEXES; i++)
+		init_waitv(&waitv[i], &futexes[i], FUTEX_PRIVATE_FLAG);
+	ret |= wait_and_wake(NR_FUTEXES, FUTEX_PRIVATE_FLAG);
+
+	info("Waiting on %d shared futexes\n", NR_FUTEXES);
+	shm_id = shmget(IPC_PRIVATE, NR_FUTEXES * sizeof(u_int32_t),
+			IPC_CREAT | 0666);
+	if (shm_id < 0) {
+		error("shmget failed\n", errno);
+		ret = RET_ERROR;
+		goto out;
+	}
+	shared = shmat(shm_id, NULL, 0);
+	shmctl(shm_id, IPC_RMID, NULL);
+	if (shared == (void *)-1) {
+		error("shmat failed\n", errno);
+		ret = RET_ERROR;
+		goto out;
+	}
+	for (i = 0; i < NR_FUTEXES; i++) {
+		shared[i] = 0;
+		init_waitv(&waitv[i], &shared[i], 0);
+	}
+	ret |= wait_and_wake(NR_FUTEXES, 0);
+	shmdt(shared);
+
+	info("Checking invalid arguments\n");
+	ret |= test_errors();
+
+	info("Waiting on a FUTEX2_NUMA futex\n");
+	ret |= test_numa();
+
+ out:
+	print_result(TEST_NAME, ret);
+	return ret;
+}